@@ -0,0 +1,217 @@
+/************************************************************
+ * alarm.c - prioritised warnings with tick-driven blinking
+ *
+ * See alarm.h. The table lives in code memory. Only the
+ * active and acknowledged masks and the alarm on row 1 are
+ * kept in IRAM; LED and marker are worked out again from
+ * hal_tick whenever they are needed.
+ ************************************************************/
+
+#include "hal.h"
+#include "cluster.h"
+#include "tune.h"
+#include "alarm.h"
+
+HAL_CODE alarm_t alarm_table[ALARMS] =
+{
+    // input          limit             above hyst prio show                   blink         text
+    { ALARM_IN_FUEL, ALARM_LIM_CUTOFF, 0,    5,   0,   ALARM_LCD,             ALARM_FAST,   "LowFuel" },
+    { ALARM_IN_TEMP, ALARM_LIM_TEMP,   1,    2,   1,   ALARM_LED | ALARM_LCD, ALARM_MEDIUM, "HiTemp " },
+    { ALARM_IN_FUEL, ALARM_LIM_LOW,    0,    5,   2,   ALARM_LCD,             ALARM_SLOW,   "LowFuel" },
+};
+
+unsigned char alarm_active = 0;         // Bit n: alarm n raised
+unsigned char alarm_acked = 0;          // Bit n: alarm n acknowledged
+unsigned char alarm_top = ALARM_NONE;   // Highest-priority active alarm
+unsigned char alarm_lcd = ALARM_NONE;   // Same, among the LCD alarms
+unsigned char alarm_shown = ALARM_NONE; // Alarm whose text is on row 1
+HAL_BIT alarm_mark_on = 0;              // The '!' marker is on row 1
+
+#ifndef __C51__
+/************************************************************
+ * Function: alarm_init
+ * --------------------
+ * Host builds only, as cluster_init().
+ ************************************************************/
+
+void alarm_init()
+{
+    alarm_active = 0;
+    alarm_acked = 0;
+    alarm_top = ALARM_NONE;
+    alarm_lcd = ALARM_NONE;
+    alarm_shown = ALARM_NONE;
+    alarm_mark_on = 0;
+}
+#endif
+
+unsigned char alarm_limit(unsigned char limit)
+{
+    switch (limit)
+    {
+        case ALARM_LIM_TEMP:    return TEMP_ALARM;
+        case ALARM_LIM_CUTOFF:  return FUEL_CUTOFF;
+        default:                return FUEL_LOW + 1;
+    }
+}
+
+/************************************************************
+ * Function: alarm_lit
+ * -------------------
+ * Whether the indication of an active alarm is in its on
+ * phase: always once acknowledged or when it does not blink,
+ * otherwise while its blink bit of hal_tick is clear.
+ ************************************************************/
+
+HAL_BIT alarm_lit(unsigned char id)
+{
+    return (alarm_acked & (1 << id)) || !(hal_tick & alarm_table[id].blink);
+}
+
+/************************************************************
+ * Function: alarm_show
+ * --------------------
+ * Drives the LED and, on the main page, the marker in front
+ * of the alarm text. The LED is a port pin and is simply set
+ * every time; the marker is written only when it changes.
+ ************************************************************/
+
+void alarm_show()
+{
+    unsigned char id;
+    HAL_BIT on = 0;
+
+    for (id = 0; id < ALARMS; id++)
+    {
+        if ((alarm_active & (1 << id)) && (alarm_table[id].show & ALARM_LED) && alarm_lit(id))
+        {
+            on = 1;
+        }
+    }
+    hal_led(on);
+
+    if (page != PAGE_MAIN || alarm_shown == ALARM_NONE)
+    {
+        return;
+    }
+    on = !(alarm_acked & (1 << alarm_shown)) && alarm_lit(alarm_shown);
+    if (on != alarm_mark_on)
+    {
+        hal_lcd_out(1, 9, on ? "!" : " ");
+        alarm_mark_on = on;
+    }
+}
+
+/************************************************************
+ * Function: alarm_update
+ * ----------------------
+ * Raises every alarm whose input is past its limit and clears
+ * those that have come back by the hysteresis, then picks the
+ * top alarm overall and the top one for the LCD.
+ ************************************************************/
+
+void alarm_update()
+{
+    unsigned char id, mask, v, lim, hyst;
+
+    alarm_top = ALARM_NONE;
+    alarm_lcd = ALARM_NONE;
+    for (id = 0, mask = 1; id < ALARMS; id++, mask <<= 1)
+    {
+        v = alarm_table[id].input == ALARM_IN_TEMP ? temp : fuel;
+        lim = alarm_limit(alarm_table[id].limit);
+        hyst = alarm_table[id].hyst;
+
+        if (alarm_table[id].above ? v > lim : v < lim)
+        {
+            alarm_active |= mask;
+        }
+        else if (alarm_table[id].above ? v + hyst <= lim : v >= lim + hyst)
+        {
+            alarm_active &= ~mask;
+            alarm_acked &= ~mask;    // Acknowledge again next time
+        }
+
+        if (!(alarm_active & mask))
+        {
+            continue;
+        }
+        if (alarm_top == ALARM_NONE || alarm_table[id].priority < alarm_table[alarm_top].priority)
+        {
+            alarm_top = id;
+        }
+        if ((alarm_table[id].show & ALARM_LCD) &&
+            (alarm_lcd == ALARM_NONE || alarm_table[id].priority < alarm_table[alarm_lcd].priority))
+        {
+            alarm_lcd = id;
+        }
+    }
+    alarm_show();
+}
+
+/************************************************************
+ * Function: alarm_tick
+ * --------------------
+ * Called every tick from wait_ticks(): follows the blink
+ * phase between cluster passes.
+ ************************************************************/
+
+void alarm_tick()
+{
+    if (alarm_active)
+    {
+        alarm_show();
+    }
+}
+
+/************************************************************
+ * Function: alarm_draw
+ * --------------------
+ * Main page refresh: puts the text of alarm_lcd on row 1 when
+ * it is not there yet, or blanks the text and marker when no
+ * LCD alarm is left.
+ ************************************************************/
+
+void alarm_draw()
+{
+    if (alarm_lcd == alarm_shown)
+    {
+        return;
+    }
+    if (alarm_lcd == ALARM_NONE)
+    {
+        hal_lcd_out(1, 9, "        ");
+        alarm_mark_on = 0;
+    }
+    else
+    {
+        hal_lcd_out(1, 10, alarm_table[alarm_lcd].text);
+    }
+    alarm_shown = alarm_lcd;
+    alarm_show();
+}
+
+void alarm_lcd_cleared()
+{
+    alarm_shown = ALARM_NONE;
+    alarm_mark_on = 0;
+}
+
+/************************************************************
+ * Function: alarm_ack
+ * -------------------
+ * Acknowledges the top alarm if it is not yet: it stops
+ * blinking and the marker goes. Returns 1 when it did, so
+ * the page button press is used up.
+ ************************************************************/
+
+HAL_BIT alarm_ack()
+{
+    if (alarm_top == ALARM_NONE || (alarm_acked & (1 << alarm_top)))
+    {
+        return 0;
+    }
+    alarm_acked |= 1 << alarm_top;
+    alarm_show();
+    return 1;
+}
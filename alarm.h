@@ -0,0 +1,90 @@
+/************************************************************
+ * alarm.h - prioritised warnings with tick-driven blinking
+ *
+ * Every warning is one row of alarm_table (alarm.c): the
+ * input it watches, the limit and the side of it that raises
+ * the alarm, the hysteresis it has to move back past before
+ * it clears, its priority, whether it shows on the LED, the
+ * LCD or both, and how fast it blinks until acknowledged.
+ *
+ * alarm_update() runs once per cluster pass, after the
+ * sensors. On the main page the highest-priority active LCD
+ * alarm owns row 1 columns 10-16, with a '!' at column 9
+ * while it is not acknowledged; when it clears, the next one
+ * takes over or the text is blanked. The LED is on while an
+ * LED alarm is active.
+ *
+ * Blinking runs off hal_tick, not the display refresh: the
+ * rate is a bit of hal_tick, and alarm_tick(), called every
+ * tick from wait_ticks(), switches the LED and writes the
+ * marker only when the phase changes, one character per
+ * change. An acknowledged alarm stays lit without blinking.
+ *
+ * The page button acknowledges the top alarm instead of
+ * turning the page while that alarm is not acknowledged. An
+ * alarm that clears and comes back has to be acknowledged
+ * again.
+ ************************************************************/
+
+#ifndef ALARM_H
+#define ALARM_H
+
+#include "hal.h"
+
+// Alarms, rows of alarm_table
+#define ALARM_CUTOFF     0   // Fuel below FUEL_CUTOFF (LOWFUEL_LIMP)
+#define ALARM_OVERHEAT   1   // Temperature above TEMP_ALARM
+#define ALARM_LOWFUEL    2   // Fuel at or below FUEL_LOW
+#define ALARMS           3
+#define ALARM_NONE       0xFF
+
+// alarm_t.input
+#define ALARM_IN_TEMP    0
+#define ALARM_IN_FUEL    1
+
+// alarm_t.limit
+#define ALARM_LIM_TEMP   0   // TEMP_ALARM
+#define ALARM_LIM_CUTOFF 1   // FUEL_CUTOFF
+#define ALARM_LIM_LOW    2   // FUEL_LOW + 1
+
+// alarm_t.show
+#define ALARM_LED        0x01
+#define ALARM_LCD        0x02
+
+// alarm_t.blink: the bit of hal_tick that gives the phase
+#define ALARM_STEADY     0x00
+#define ALARM_FAST       0x10   // 160 ms on, 160 ms off
+#define ALARM_MEDIUM     0x20   // 320 ms
+#define ALARM_SLOW       0x40   // 640 ms
+
+typedef struct
+{
+    unsigned char input;        // ALARM_IN_*
+    unsigned char limit;        // ALARM_LIM_*
+    unsigned char above;        // Raised above the limit (1) or below it (0)
+    unsigned char hyst;         // Clears this far back inside the limit
+    unsigned char priority;     // 0 is the highest
+    unsigned char show;         // ALARM_LED | ALARM_LCD
+    unsigned char blink;        // ALARM_STEADY/FAST/MEDIUM/SLOW
+    char text[8];               // LCD text, 7 characters
+} alarm_t;
+
+extern HAL_CODE alarm_t alarm_table[ALARMS];
+
+extern unsigned char alarm_active;      // Bit n: alarm n raised
+extern unsigned char alarm_acked;       // Bit n: alarm n acknowledged
+extern unsigned char alarm_top;         // Highest-priority active alarm, or ALARM_NONE
+extern unsigned char alarm_lcd;         // Same, among the LCD alarms
+extern unsigned char alarm_shown;       // Alarm whose text is on row 1, or ALARM_NONE
+extern HAL_BIT alarm_mark_on;           // The '!' marker is on row 1
+
+#ifndef __C51__
+void alarm_init();                  // Power-on values (host builds)
+#endif
+void alarm_update();                // Raise and clear by the table; once per pass
+void alarm_tick();                  // Blink; every tick while the cluster runs
+void alarm_draw();                  // Main page refresh: text of alarm_lcd
+void alarm_lcd_cleared();           // The display has just been cleared
+HAL_BIT alarm_ack();                // Acknowledge the top alarm; 0 if nothing to do
+
+#endif
@@ -0,0 +1,508 @@
+/************************************************************
+ * cluster.c - instrument cluster application logic
+ ************************************************************/
+
+#include "hal.h"
+#include "cluster.h"
+#include "instr.h"
+#include "telem.h"
+#include "tune.h"
+#include "alarm.h"
+
+#define TRIP_UNIT   (100000UL * PULSES_REV)    // 100 m, in mm x pulses per revolution
+
+// Global variables
+HAL_BIT system = 0;          // 1 while the cluster is ON (RUN or LOWFUEL_LIMP)
+HAL_BIT overheat = 0;        // ALARM_OVERHEAT is raised
+HAL_BIT cutoff = 0;          // ALARM_CUTOFF is raised
+HAL_BIT labels_dirty = 0;    // Redraw on the next refresh
+HAL_BIT speed_dirty = 0;
+HAL_BIT fuel_dirty = 0;
+HAL_BIT temp_dirty = 0;
+HAL_BIT count_dirty = 0;
+HAL_BIT sec_dirty = 0;
+HAL_BIT state_dirty = 0;
+HAL_BIT hist_dirty = 0;
+unsigned char adc_val;       // ADC digital value
+unsigned char temp;          // Temperature in deg C
+unsigned char fuel = 100;    // Fuel level percentage
+unsigned int count;          // Pulse count for speed
+unsigned int speed;          // Calculated speed (km/h)
+
+// Dashboard
+unsigned char page = PAGE_MAIN;     // Active PAGE_*
+unsigned int trip_sec;              // Seconds since BOOT
+unsigned int trip_hm;               // Distance since BOOT, 100 m units
+unsigned long trip_part;            // Remainder below 100 m, in TRIP_UNIT units
+unsigned char temp_min = 255;       // Since power-on
+unsigned char temp_max = 0;
+unsigned int speed_max = 0;
+
+// Power state machine
+volatile unsigned char pwr_state = PWR_OFF;  // Current PWR_* state
+unsigned char fuel_mark;                     // Tick of the last fuel step
+HAL_BIT lcd_ready = 0;                       // hal_lcd_init() has run once since reset
+
+#ifndef __C51__
+/************************************************************
+ * Function: cluster_init
+ * ----------------------
+ * Host builds only: restores the power-on values that the
+ * C51 startup code sets from the initialisers above, so a
+ * test can run many independent sessions in one process.
+ ************************************************************/
+
+void cluster_init()
+{
+    system = 0;
+    overheat = 0;
+    cutoff = 0;
+    labels_dirty = 0;
+    speed_dirty = 0;
+    fuel_dirty = 0;
+    temp_dirty = 0;
+    count_dirty = 0;
+    sec_dirty = 0;
+    state_dirty = 0;
+    hist_dirty = 0;
+    adc_val = 0;
+    temp = 0;
+    fuel = 100;
+    count = 0;
+    speed = 0;
+    pwr_state = PWR_OFF;
+    fuel_mark = 0;
+    lcd_ready = 0;
+    page = PAGE_MAIN;
+    trip_sec = 0;
+    trip_hm = 0;
+    trip_part = 0;
+    temp_min = 255;
+    temp_max = 0;
+    speed_max = 0;
+    alarm_init();
+}
+#endif
+
+/************************************************************
+ * Function: redraw_all
+ * --------------------
+ * Marks the page text and every field for the next refresh.
+ ************************************************************/
+
+void redraw_all()
+{
+    labels_dirty = 1;
+    speed_dirty = 1;
+    fuel_dirty = 1;
+    temp_dirty = 1;
+    count_dirty = 1;
+    sec_dirty = 1;
+    state_dirty = 1;
+    hist_dirty = 1;
+}
+
+/************************************************************
+ * Function: power_step
+ * --------------------
+ * Runs one step of the power state machine:
+ *
+ *   OFF --press--> BOOT --> RUN ---> LOWFUEL_LIMP
+ *                            |            |
+ *                          press        press
+ *                            v            v
+ *   OFF <------------------ SHUTDOWN <----+
+ *
+ * RUN drops to LOWFUEL_LIMP once fuel is below FUEL_CUTOFF.
+ * Fuel never rises, so there is no way back; only the press
+ * leaves it.
+ *
+ * hal_lcd_init() only runs on the first BOOT after reset;
+ * later boots just switch the display back on (DDRAM is
+ * retained while the display is off), so resume from OFF is
+ * fast.
+ *
+ * The button is polled between the sensor read and the display
+ * refresh and wait_ticks() returns as soon as a press arrives,
+ * so the display blanks within one cluster_update() pass of
+ * the button edge.
+ ************************************************************/
+
+void power_step()
+{
+    switch (pwr_state)
+    {
+        case PWR_OFF:
+            if (hal_btn_event)
+            {
+                hal_btn_event = 0;
+                pwr_state = PWR_BOOT;
+            }
+            else
+            {
+                hal_idle();     // Idle until the next interrupt
+                telem_poll();
+                tune_poll();
+            }
+            break;
+
+        case PWR_BOOT:
+            if (!lcd_ready)
+            {
+                hal_lcd_init(); // Full power-on init, first boot only
+                lcd_ready = 1;
+            }
+            else
+            {
+                hal_lcd_on(1);  // Display on, cursor off
+            }
+
+            // Initial dummy speed value (calculated based on static pulse count):
+            // PULSE_COUNT pulses over WHEEL_MM / PULSES_REV each, in km/h
+            speed = (unsigned long)(PULSE_COUNT * 36) * WHEEL_MM / (10000UL * PULSES_REV);
+
+            hal_counter_start();    // Restart the speed pulse counter
+            count = 0;
+            fuel_mark = hal_tick;
+            trip_sec = 0;
+            trip_hm = 0;
+            trip_part = 0;
+            hal_page_event = 0;     // Presses while off do not count
+            redraw_all();           // Full redraw on the first pass
+            system = 1;
+            pwr_state = PWR_RUN;
+            break;
+
+        case PWR_RUN:
+        case PWR_LOWFUEL_LIMP:
+            cluster_update();
+            instr_dump();
+            wait_ticks(REFRESH_TICKS);
+            if (hal_btn_event)
+            {
+                hal_btn_event = 0;
+                pwr_state = PWR_SHUTDOWN;
+            }
+            break;
+
+        case PWR_SHUTDOWN:
+        default:
+            hal_lcd_on(0);      // Display off (contents kept for fast resume)
+            hal_led(0);
+            hal_counter_stop(); // Stop pulse counting
+            system = 0;
+            pwr_state = PWR_OFF;
+            break;
+    }
+}
+
+
+/************************************************************
+ * Function: page_layout
+ * ---------------------
+ * Draws the fixed text of the active page on a blank
+ * display:
+ *
+ *   PAGE_MAIN            PAGE_TRIP
+ *   TERMINAL LowFuel     TRIP       02:15
+ *   s:86 F:60% T:45c     0000.5km A:13kmh
+ *
+ *   PAGE_DIAG            PAGE_MINMAX
+ *   DIAG ADC:045 S:2     Tmin:25 Tmax:45c
+ *   P:00483    OVH:1     Smax:86kmh
+ ************************************************************/
+
+void page_layout()
+{
+    switch (page)
+    {
+        case PAGE_MAIN:
+            hal_lcd_out(1, 1, "TERMINAL");
+            hal_lcd_out(2, 1, "s:");     // Speed label
+            hal_lcd_out(2, 6, "F:");     // Fuel label
+            hal_lcd_out(2, 10, "%");
+            hal_lcd_out(2, 12, "T:");    // Temperature label
+            hal_lcd_out(2, 16, "c");
+            break;
+
+        case PAGE_TRIP:
+            hal_lcd_out(1, 1, "TRIP");
+            hal_lcd_out(1, 14, ":");
+            hal_lcd_out(2, 5, ".");
+            hal_lcd_out(2, 7, "km");
+            hal_lcd_out(2, 10, "A:");
+            hal_lcd_out(2, 14, "kmh");
+            break;
+
+        case PAGE_DIAG:
+            hal_lcd_out(1, 1, "DIAG ADC:");
+            hal_lcd_out(1, 14, "S:");
+            hal_lcd_out(2, 1, "P:");
+            hal_lcd_out(2, 12, "OVH:");
+            break;
+
+        default:
+            hal_lcd_out(1, 1, "Tmin:");
+            hal_lcd_out(1, 9, "Tmax:");
+            hal_lcd_out(1, 16, "c");
+            hal_lcd_out(2, 1, "Smax:");
+            hal_lcd_out(2, 8, "kmh");
+            break;
+    }
+}
+
+/************************************************************
+ * Function: page_fields
+ * ---------------------
+ * Redraws the fields of the active page whose values have
+ * changed, working out the average speed only while the
+ * trip page is up. Other pages send nothing.
+ ************************************************************/
+
+void page_fields()
+{
+    switch (page)
+    {
+        case PAGE_MAIN:
+            if (speed_dirty)
+            {
+                hal_lcd_print(2, 3, speed, 2);
+            }
+            if (fuel_dirty)
+            {
+                hal_lcd_print(2, 8, fuel, 2);
+            }
+            if (temp_dirty)
+            {
+                hal_lcd_print(2, 14, temp, 2);
+            }
+            break;
+
+        case PAGE_TRIP:
+            if (sec_dirty)
+            {
+                hal_lcd_print(1, 12, trip_sec / 60, 2);
+                hal_lcd_print(1, 15, trip_sec % 60, 2);
+            }
+            if (count_dirty)
+            {
+                hal_lcd_print(2, 1, trip_hm / 10, 4);   // km with one decimal
+                hal_lcd_print(2, 6, trip_hm % 10, 1);
+            }
+            if (count_dirty || sec_dirty)
+            {
+                hal_lcd_print(2, 12, trip_sec ? (unsigned long)trip_hm * 360 / trip_sec : 0, 2);
+            }
+            break;
+
+        case PAGE_DIAG:
+            if (temp_dirty)
+            {
+                hal_lcd_print(1, 10, adc_val, 3);
+            }
+            if (state_dirty)
+            {
+                hal_lcd_print(1, 16, pwr_state, 1);
+                hal_lcd_print(2, 16, overheat, 1);
+            }
+            if (count_dirty)
+            {
+                hal_lcd_print(2, 3, count, 5);
+            }
+            break;
+
+        default:
+            if (hist_dirty)
+            {
+                hal_lcd_print(1, 6, temp_min, 2);
+                hal_lcd_print(1, 14, temp_max, 2);
+            }
+            if (speed_dirty)
+            {
+                hal_lcd_print(2, 6, speed_max, 2);
+            }
+            break;
+    }
+
+    speed_dirty = 0;
+    fuel_dirty = 0;
+    temp_dirty = 0;
+    count_dirty = 0;
+    sec_dirty = 0;
+    state_dirty = 0;
+    hist_dirty = 0;
+}
+
+/************************************************************
+ * Function: cluster_update
+ * ------------------------
+ * One pass of the cluster: reads temperature and pulse count,
+ * applies due fuel steps, updates warnings and redraws the
+ * display. Enters LOWFUEL_LIMP at fuel cut-off.
+ *
+ * The sensors, alarms and min/max history are kept up to date
+ * whatever page is showing, and each change sets a dirty bit.
+ * A press of the page button clears the display and draws the
+ * next page's fixed text once; after that only the fields
+ * whose dirty bit is set are redrawn, as each character costs
+ * the LCD about 4 ms. DDRAM is kept while the display is off,
+ * and BOOT marks everything dirty anyway.
+ ************************************************************/
+
+void cluster_update()
+{
+    unsigned int c, n;
+    HAL_BIT was;
+
+    INSTR_LOOP_BEGIN();
+
+    INSTR_BEGIN(INSTR_ADC);
+    adc_val = hal_adc_read();   // LM35 through the ADC0804
+    INSTR_END(INSTR_ADC);
+
+    // Read the pulse count from Timer1 (for speed) and add the pulses
+    // since the last pass to the trip. Timer1 wraps after 65536 pulses
+    // (some 6 km), far more than one pass can see, so the 16-bit
+    // difference is exact across the wrap
+    c = hal_pulse_count();
+    if (c != count)
+    {
+        trip_part += (unsigned long)((c - count) & 0xFFFF) * WHEEL_MM;
+        count = c;
+        count_dirty = 1;
+        if (trip_part >= TRIP_UNIT)
+        {
+            n = trip_part / TRIP_UNIT;
+            trip_hm += n;
+            trip_part -= (unsigned long)n * TRIP_UNIT;
+        }
+    }
+
+    if (pwr_state != PWR_LOWFUEL_LIMP && speed <= SPEED_LIMIT - 5)
+    {
+        speed += 5;  // Dummy increment for demonstration (can be replaced with real speed calculation)
+        speed_dirty = 1;
+        if (speed > speed_max)
+        {
+            speed_max = speed;
+        }
+    }
+
+    // One fuel step and one trip second per FUEL_TICKS since boot;
+    // fuel only while it is still above threshold
+    INSTR_BEGIN(INSTR_FUEL);
+    if ((unsigned char)(hal_tick - fuel_mark) >= FUEL_TICKS)
+    {
+        fuel_mark += FUEL_TICKS;
+        trip_sec++;
+        sec_dirty = 1;
+        if (fuel >= 10)
+        {
+            fuel -= 10;   // Decrease fuel level
+            fuel_dirty = 1;
+        }
+    }
+    INSTR_END(INSTR_FUEL);
+
+    // The LM35 gives 10 mV per deg C and the ADC0804 10 mV per
+    // LSB, so the ADC code is the temperature in deg C
+    if (temp != adc_val)
+    {
+        temp = adc_val;
+        temp_dirty = 1;
+    }
+    if (temp < temp_min)
+    {
+        temp_min = temp;
+        hist_dirty = 1;
+    }
+    if (temp > temp_max)
+    {
+        temp_max = temp;
+        hist_dirty = 1;
+    }
+
+    // Overheat above TEMP_ALARM (40 deg C), LowFuel at or below
+    // FUEL_LOW (20%), cut-off below FUEL_CUTOFF (10%); see alarm.c
+    INSTR_BEGIN(INSTR_ALARM);
+    was = overheat;
+    alarm_update();
+    overheat = (alarm_active & (1 << ALARM_OVERHEAT)) != 0;
+    cutoff = (alarm_active & (1 << ALARM_CUTOFF)) != 0;
+    if (overheat != was)
+    {
+        state_dirty = 1;
+    }
+    INSTR_END(INSTR_ALARM);
+
+    if (hal_btn_event)
+    {
+        return;   // Shutdown requested, skip the display refresh
+    }
+
+    INSTR_BEGIN(INSTR_LCD);
+
+    // The page button first acknowledges a new alarm, then turns pages
+    if (hal_page_event)
+    {
+        hal_page_event = 0;
+        if (!alarm_ack())
+        {
+            if (++page == PAGES)
+            {
+                page = PAGE_MAIN;
+            }
+            hal_lcd_clear();
+            alarm_lcd_cleared();
+            redraw_all();
+        }
+    }
+
+    if (cutoff && pwr_state != PWR_LOWFUEL_LIMP)
+    {
+        pwr_state = PWR_LOWFUEL_LIMP;
+        speed = 0;              // Stop the vehicle
+        speed_dirty = 1;
+        state_dirty = 1;
+        hal_counter_stop();     // Stop Timer1 (pulse counter)
+    }
+
+    // Display system status on LCD
+    if (labels_dirty)
+    {
+        page_layout();
+        labels_dirty = 0;
+    }
+    if (page == PAGE_MAIN)
+    {
+        alarm_draw();
+    }
+    page_fields();
+    INSTR_END(INSTR_LCD);
+
+    INSTR_LOOP_END();
+}
+
+
+/************************************************************
+ * Function: wait_ticks
+ * --------------------
+ * Idles the CPU for n system ticks (10 ms each). Returns
+ * early when a debounced press of either button is pending
+ * so the state machine or the page switch reacts at once.
+ * Telemetry frames are queued, tuning commands carried out
+ * and alarms blinked from here, between ticks.
+ ************************************************************/
+
+void wait_ticks(unsigned char n)
+{
+    unsigned char start = hal_tick;
+
+    while ((unsigned char)(hal_tick - start) < n && !hal_btn_event && !hal_page_event)
+    {
+        hal_idle();     // Idle until the next interrupt
+        telem_poll();
+        tune_poll();
+        alarm_tick();
+    }
+}
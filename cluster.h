@@ -0,0 +1,72 @@
+/************************************************************
+ * cluster.h - instrument cluster application logic
+ *
+ * Power state machine, speed, fuel, temperature and alarm
+ * handling. Talks to the board only through hal.h, so it
+ * builds both for the AT89C51 (Keil C51) and on the host.
+ ************************************************************/
+
+#ifndef CLUSTER_H
+#define CLUSTER_H
+
+#include "hal.h"
+
+// Constants used in speed calculation
+#define PULSE_COUNT 50
+#define WHEEL_CIRCUMFERENCE 1.884  // in meters
+#define PULSES_PER_REVOLUTION 20
+#define SPEED_LIMIT 0xFFFF         // Demo speed ramp holds here instead of wrapping
+
+// Power states (see power_step)
+#define PWR_OFF           0   // Display blanked, CPU idles between interrupts
+#define PWR_BOOT          1   // Bring display and counters up
+#define PWR_RUN           2   // Normal cluster operation
+#define PWR_LOWFUEL_LIMP  3   // Fuel cut-off: speed forced to 0, pulse counter stopped
+#define PWR_SHUTDOWN      4   // Blank display and stop counters
+
+// Pacing, in system ticks (TICK_MS each)
+#define FUEL_TICKS       100   // Fuel drops 10% every ~1 s, trip time counts seconds
+#define REFRESH_TICKS    35    // Display refresh period (~350 ms)
+
+// Dashboard pages, stepped through by the page button
+#define PAGE_MAIN     0   // Speed, fuel, temperature, LowFuel
+#define PAGE_TRIP     1   // Trip time, distance, average speed
+#define PAGE_DIAG     2   // ADC code, power state, pulse count, overheat alarm
+#define PAGE_MINMAX   3   // Lowest and highest temperature, top speed
+#define PAGES         4
+
+// State flags. HAL_BIT variables go to the bit-addressable
+// area 0x20-0x2F under Keil, where a test is one JB/JNB and a
+// write one SETB/CLR
+extern HAL_BIT system;                 // 1 while the cluster is ON (RUN or LOWFUEL_LIMP)
+extern HAL_BIT overheat;               // ALARM_OVERHEAT is raised (see alarm.h)
+extern HAL_BIT cutoff;                 // ALARM_CUTOFF is raised
+
+// What changed since the last refresh; the active page redraws the
+// fields that show it. BOOT and a page switch set them all
+extern HAL_BIT labels_dirty;           // Fixed text of the page
+extern HAL_BIT speed_dirty, fuel_dirty, temp_dirty, count_dirty;
+extern HAL_BIT sec_dirty;              // trip_sec
+extern HAL_BIT state_dirty;            // pwr_state or overheat
+extern HAL_BIT hist_dirty;             // temp_min or temp_max
+
+extern unsigned char adc_val;          // ADC digital value
+extern unsigned char temp;             // Temperature in deg C
+extern unsigned char fuel;             // Fuel level percentage
+extern unsigned int count;             // Pulse count for speed
+extern unsigned int speed;             // Calculated speed (km/h), shown modulo 100
+extern volatile unsigned char pwr_state;  // Current PWR_* state
+extern unsigned char page;             // Active PAGE_*
+extern unsigned int trip_sec;          // Seconds since BOOT
+extern unsigned int trip_hm;           // Distance since BOOT, 100 m units
+extern unsigned char temp_min, temp_max;  // Since power-on
+extern unsigned int speed_max;
+
+#ifndef __C51__
+void cluster_init();                // Power-on values (host builds)
+#endif
+void power_step();                  // Run one step of the power state machine
+void cluster_update();              // Sample sensors and refresh the display
+void wait_ticks(unsigned char n);   // Idle for n ticks or until a button press
+
+#endif
@@ -0,0 +1,49 @@
+/************************************************************
+ * hal.h - hardware abstraction for the cluster logic
+ *
+ * cluster.c reaches the hardware only through the names
+ * below. hal_8051.c implements them on the AT89C51 board,
+ * mostly as macros over SFRs and the LCD driver so the split
+ * costs no code or cycles; hal_host.c implements them on
+ * plain variables so the same logic builds with gcc on the
+ * host.
+ *
+ *   hal_init()                    ports, 10 ms tick, button
+ *   hal_idle()                    sleep until the next interrupt
+ *   hal_adc_read()                one ADC0804 conversion (0-255)
+ *   hal_pulse_count()             wheel pulses since counter start
+ *   hal_counter_start/stop()      clear+run / freeze the counter
+ *   hal_led(on)                   overheat LED
+ *   hal_lcd_init/on/out/print()   16x2 display (see lcd.h)
+ *   hal_lcd_clear()               blank the display, cursor home
+ *   hal_uart_init()               UART mode 2; receives only in
+ *                                 TUNE builds, into tune_rx()
+ *   hal_uart_room()               free bytes in the transmit ring
+ *   hal_uart_put(c)               queue a byte (check the room
+ *                                 first); the serial interrupt
+ *                                 sends it
+ *   hal_eeprom_read/write()       parameter EEPROM (TUNE_EEPROM);
+ *                                 nonzero when it does not answer
+ *   hal_tick                      free-running tick counter
+ *   hal_btn_event                 debounced press, cleared by
+ *                                 the logic
+ *   hal_page_event                same for the page button
+ ************************************************************/
+
+#ifndef HAL_H
+#define HAL_H
+
+#define TICK_MS  10     // System tick period
+#define HAL_UART_RING  16   // UART transmit ring, power of two
+
+#ifdef __C51__
+#include "hal_8051.h"
+#else
+#include "hal_host.h"
+#endif
+
+extern volatile unsigned char hal_tick;
+extern volatile HAL_BIT hal_btn_event;
+extern volatile HAL_BIT hal_page_event;
+
+#endif
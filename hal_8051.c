@@ -0,0 +1,440 @@
+/************************************************************
+ * hal_8051.c - AT89C51 board backend of the HAL
+ *
+ * Timer0 runs the 10 ms system tick, Timer1 counts wheel
+ * pulses on T1, and INT0 and INT1 take the ON/OFF and page
+ * buttons with a tick-driven debounce. The LCD calls map
+ * straight onto lcd.c through the macros in hal_8051.h. With
+ * TELEM or TUNE the UART sends from a ring buffer in mode 2,
+ * which is clocked from the oscillator and leaves Timer1 to
+ * the wheel; with TUNE it also receives commands. TUNE_EEPROM
+ * adds a bit-banged I2C bus to a 24C02 for the parameter
+ * table.
+ ************************************************************/
+
+#include "hal.h"
+#include "instr.h"
+#include "telem.h"
+#include "tune.h"
+
+volatile unsigned char hal_tick;     // Free-running 10 ms tick counter
+volatile bit hal_btn_event = 0;      // Debounced button press pending for main loop
+volatile unsigned char debounce;     // Ticks left before INT0 is re-armed
+volatile bit hal_page_event = 0;     // Debounced page button press pending
+volatile unsigned char page_debounce;   // Ticks left before INT1 is re-armed
+
+#if TELEM || TUNE
+unsigned char hal_uart_ring[HAL_UART_RING];  // Bytes waiting for the UART
+volatile unsigned char hal_uart_head;        // Next free slot (main loop)
+volatile unsigned char hal_uart_tail;        // Next byte to send (serial ISR)
+volatile bit uart_busy = 0;                  // A byte is on the line
+#endif
+
+void conv();            // Start ADC conversion
+unsigned char read();   // Read ADC result
+void timer();           // Start Timer0 as the 10 ms system tick
+
+/************************************************************
+ * Function: hal_init
+ * ------------------
+ * Puts the pins in their idle state, configures both timers
+ * and enables the button interrupts.
+ ************************************************************/
+
+void hal_init()
+{
+    led = 0;
+    intr = 1;
+
+    TMOD = 0x51;  // Timer1 = Mode 1 counter (C/T1 = 1), Timer0 = Mode 1 timer
+    timer();      // Start the 10 ms system tick
+
+    // Enable External Interrupt 0 (for system ON/OFF toggle)
+    IT0 = 1;     // INT0 triggered on falling edge
+    EX0 = 1;     // Enable INT0
+
+    // and External Interrupt 1 (dashboard page button)
+    IT1 = 1;
+    EX1 = 1;
+    EA = 1;      // Enable global interrupt
+}
+
+/************************************************************
+ * Function: hal_adc_read
+ * ----------------------
+ * Runs one ADC0804 conversion and returns the result.
+ ************************************************************/
+
+unsigned char hal_adc_read()
+{
+    conv();         // Trigger ADC conversion (LM35)
+    return read();  // Read ADC value
+}
+
+/************************************************************
+ * Function: hal_counter_start
+ * ---------------------------
+ * Clears and starts Timer1, configured in hal_init() as a
+ * 16-bit external counter (TMOD = 0x51, C/T1 = 1) on T1 pin
+ * (P3.5). Used to measure speed pulses for speed calculation.
+ ************************************************************/
+
+void hal_counter_start()
+{
+    TH1 = 0;          // Restart pulse count
+    TL1 = 0;
+    TR1 = 1;          // Start Timer1 (pulse counter)
+}
+
+/************************************************************
+ * Function: ISR_ex0
+ * -----------------
+ * External Interrupt 0 Service Routine (INT0 - P3.2)
+ * Accepts a button press on the first falling edge, then
+ * masks INT0 so contact bounce cannot toggle again. The
+ * Timer0 tick re-arms INT0 once the button has read released
+ * for DEBOUNCE_TICKS.
+ *
+ * Triggered on falling edge (IT0 = 1)
+ ************************************************************/
+
+void ISR_ex0(void) interrupt 0
+{
+    EX0 = 0;                    // Ignore bounce until released
+    debounce = DEBOUNCE_TICKS;
+    hal_btn_event = 1;
+}
+
+/************************************************************
+ * Function: ISR_ex1
+ * -----------------
+ * External Interrupt 1 Service Routine (INT1 - P3.3)
+ * The page button, debounced the same way as INT0.
+ ************************************************************/
+
+void ISR_ex1(void) interrupt 2
+{
+    EX1 = 0;
+    page_debounce = DEBOUNCE_TICKS;
+    hal_page_event = 1;
+}
+
+/************************************************************
+ * Function: ISR_t0
+ * ----------------
+ * Timer0 Service Routine - 10 ms system tick.
+ * Advances the tick counter and runs the INT0 and INT1
+ * debounce.
+ ************************************************************/
+
+void ISR_t0(void) interrupt 1
+{
+    TR0 = 0;
+    TH0 = TICK_RELOAD >> 8;     // Reload for the next 10 ms
+    TL0 = TICK_RELOAD & 0xFF;
+    TR0 = 1;
+
+    hal_tick++;
+    INSTR_TICK();
+
+    if (debounce)
+    {
+        if (btn == 0)
+        {
+            debounce = DEBOUNCE_TICKS;  // Still pressed or bouncing
+        }
+        else if (--debounce == 0)
+        {
+            IE0 = 0;            // Drop edges latched during bounce
+            EX0 = 1;            // Re-arm INT0
+        }
+    }
+    if (page_debounce)
+    {
+        if (page_btn == 0)
+        {
+            page_debounce = DEBOUNCE_TICKS;
+        }
+        else if (--page_debounce == 0)
+        {
+            IE1 = 0;
+            EX1 = 1;
+        }
+    }
+}
+
+/************************************************************
+ * Function: conv
+ * --------------
+ * Starts the ADC conversion by toggling the WR pin of ADC0804.
+ * Waits until the INTR pin goes low, indicating conversion complete.
+ ************************************************************/
+
+void conv()
+{
+    wr = 0;
+    wr = 1;
+    while (intr == 1);  // Wait for conversion to complete (INTR goes low)
+}
+
+/************************************************************
+ * Function: read
+ * --------------
+ * Reads the digital value from ADC0804 via port P1.
+ * Reads on RD low and returns the value.
+ * Loop pacing is handled by wait_ticks(), so no recovery
+ * delay is spent here.
+ ************************************************************/
+
+unsigned char read()
+{
+    unsigned char value;
+
+    rd = 1;
+    rd = 0;
+    value = adc_port;       // Read digital value from ADC0804
+    rd = 1;
+    return value;
+}
+
+/************************************************************
+ * Function: timer
+ * ---------------
+ * Starts Timer0 in Mode 1 (16-bit timer mode) with its
+ * interrupt enabled. ISR_t0 reloads it every 10 ms and uses
+ * the tick for debounce; the cluster logic paces fuel and
+ * display refresh from hal_tick.
+ * TMOD is set once in hal_init() so Timer1 stays a counter.
+ ************************************************************/
+
+void timer()
+{
+    TH0 = TICK_RELOAD >> 8;     // Load high byte (10 ms at 12 MHz)
+    TL0 = TICK_RELOAD & 0xFF;   // Load low byte
+    ET0 = 1;                    // Enable Timer0 interrupt
+    TR0 = 1;                    // Start Timer0
+}
+
+#if TELEM || TUNE
+/************************************************************
+ * Function: hal_uart_init
+ * -----------------------
+ * UART in mode 2: 11-bit frames at fosc/64 (187.5 kbaud at
+ * 12 MHz) with TB8 = 1 as a second stop bit. Mode 2 needs no
+ * baud rate timer, so Timer1 keeps counting wheel pulses.
+ * Receive is on for TUNE. telem_init() and tune_init() both
+ * call it before anything is queued.
+ ************************************************************/
+
+void hal_uart_init()
+{
+#if TUNE
+    SCON = 0x98;            // Mode 2, TB8 = 1, receive on
+#else
+    SCON = 0x88;            // Mode 2, TB8 = 1, no receive
+#endif
+    hal_uart_head = 0;
+    hal_uart_tail = 0;
+    uart_busy = 0;
+    ES = 1;                 // Enable the serial interrupt
+}
+
+/************************************************************
+ * Function: hal_uart_put
+ * ----------------------
+ * Queues one byte; the caller checks hal_uart_room() first.
+ * When the line is idle, setting TI raises the serial
+ * interrupt, which sends the byte. The head moves only after
+ * the byte is stored, so the ISR never sends a stale slot.
+ ************************************************************/
+
+void hal_uart_put(unsigned char c)
+{
+    hal_uart_ring[hal_uart_head & (HAL_UART_RING - 1)] = c;
+    hal_uart_head++;
+    if (!uart_busy)
+    {
+        uart_busy = 1;
+        TI = 1;
+    }
+}
+
+/************************************************************
+ * Function: ISR_serial
+ * --------------------
+ * Serial Port Service Routine - sends the next byte of the
+ * ring each time the previous one has gone out, and marks
+ * the line idle when the ring is empty. With TUNE each
+ * received byte goes to the command parser.
+ ************************************************************/
+
+void ISR_serial(void) interrupt 4
+{
+    if (RI)
+    {
+        RI = 0;
+#if TUNE
+        tune_rx(SBUF);
+#endif
+    }
+    if (TI)
+    {
+        TI = 0;
+        if (hal_uart_tail != hal_uart_head)
+        {
+            SBUF = hal_uart_ring[hal_uart_tail & (HAL_UART_RING - 1)];
+            hal_uart_tail++;
+        }
+        else
+        {
+            uart_busy = 0;
+        }
+    }
+}
+#endif
+
+#if TUNE_EEPROM
+/************************************************************
+ * 24C02 on a bit-banged I2C bus
+ * -----------------------------
+ * SCL on P0.0 and SDA on P0.1. P0 pins are open drain, so
+ * writing 1 releases the line to its pull-up and the slave
+ * can drive SDA low. ee_delay() is an empty call, 4 us with
+ * LCALL and RET, which keeps the clock under 100 kHz.
+ ************************************************************/
+
+sbit ee_scl = P0^0;
+sbit ee_sda = P0^1;
+
+#define EE_DEVICE  0xA0     // 24C02 with A0-A2 tied low
+
+void ee_delay()
+{
+}
+
+void ee_start()
+{
+    ee_sda = 1;
+    ee_scl = 1;
+    ee_delay();
+    ee_sda = 0;
+    ee_delay();
+    ee_scl = 0;
+}
+
+void ee_stop()
+{
+    ee_sda = 0;
+    ee_scl = 1;
+    ee_delay();
+    ee_sda = 1;
+    ee_delay();
+}
+
+// Sends one byte MSB first; returns 1 when the slave does not acknowledge
+bit ee_send(unsigned char b)
+{
+    unsigned char i;
+    bit nack;
+
+    for (i = 0; i < 8; i++)
+    {
+        ee_sda = (b & 0x80) ? 1 : 0;
+        b <<= 1;
+        ee_delay();
+        ee_scl = 1;
+        ee_delay();
+        ee_scl = 0;
+    }
+    ee_sda = 1;
+    ee_delay();
+    ee_scl = 1;
+    ee_delay();
+    nack = ee_sda;
+    ee_scl = 0;
+    return nack;
+}
+
+// Reads one byte; the master acknowledges all but the last
+unsigned char ee_recv(bit last)
+{
+    unsigned char i, b = 0;
+
+    ee_sda = 1;
+    for (i = 0; i < 8; i++)
+    {
+        ee_delay();
+        ee_scl = 1;
+        ee_delay();
+        b = (b << 1) | ee_sda;
+        ee_scl = 0;
+    }
+    ee_sda = last;
+    ee_delay();
+    ee_scl = 1;
+    ee_delay();
+    ee_scl = 0;
+    ee_sda = 1;
+    return b;
+}
+
+/************************************************************
+ * Function: hal_eeprom_read
+ * -------------------------
+ * Reads n bytes from addr: a dummy write sets the address,
+ * then a repeated start reads. Returns 1 when the EEPROM
+ * does not answer.
+ ************************************************************/
+
+bit hal_eeprom_read(unsigned char addr, unsigned char *p, unsigned char n)
+{
+    ee_start();
+    if (ee_send(EE_DEVICE) || ee_send(addr))
+    {
+        ee_stop();
+        return 1;
+    }
+    ee_start();
+    if (ee_send(EE_DEVICE | 1))
+    {
+        ee_stop();
+        return 1;
+    }
+    while (n--)
+    {
+        *p++ = ee_recv(n == 0);
+    }
+    ee_stop();
+    return 0;
+}
+
+/************************************************************
+ * Function: hal_eeprom_write
+ * --------------------------
+ * Writes n bytes from addr as one page write (at most 8
+ * bytes, not crossing a multiple of 8). Does not wait for
+ * the 5 ms write cycle: the EEPROM does not acknowledge
+ * during it, so a write or read that comes too soon returns
+ * 1 instead of blocking the main loop.
+ ************************************************************/
+
+bit hal_eeprom_write(unsigned char addr, unsigned char *p, unsigned char n)
+{
+    ee_start();
+    if (ee_send(EE_DEVICE) || ee_send(addr))
+    {
+        ee_stop();
+        return 1;
+    }
+    while (n--)
+    {
+        if (ee_send(*p++))
+        {
+            ee_stop();
+            return 1;
+        }
+    }
+    ee_stop();
+    return 0;
+}
+#endif
@@ -0,0 +1,71 @@
+/************************************************************
+ * hal_8051.h - AT89C51 board backend of the HAL
+ *
+ * Pin map (Proteus schematic):
+ *   P1        ADC0804 data          P3.0  LED
+ *   P2.1      ADC RD                P3.2  ON/OFF button (INT0)
+ *                                   P3.3  PAGE button (INT1)
+ *   P2.2-2.7  LCD RS, EN, D4-D7     P3.5  wheel pulses (T1)
+ *   P3.6      ADC WR                P3.7  ADC INTR
+ *   P0.0      24C02 SCL             P0.1  24C02 SDA
+ *             (TUNE_EEPROM only, 4.7k pull-ups: P0 is open drain)
+ *   P2.0      LED in TUNE builds, where P3.0 is RXD
+ ************************************************************/
+
+#ifndef HAL_8051_H
+#define HAL_8051_H
+
+#include <reg51.h>
+#include "lcd.h"
+
+#define HAL_BIT   bit
+#define HAL_CODE  code
+
+// Timer0 system tick (12 MHz crystal -> 1 us machine cycle)
+#define TICK_RELOAD      (65536 - 10000)  // 10 ms per tick
+#define DEBOUNCE_TICKS   3     // Button must read released for 30 ms before INT0 re-arms
+
+// LED connected to P3.0 to indicate high temperature
+// (P2.0 with TUNE: P3.0 doubles as RXD and the UART listens on it)
+#if TUNE
+sbit led = P2^0;
+#else
+sbit led = P3^0;
+#endif
+
+// ON/OFF push button on INT0 (P3.2), active low
+sbit btn = P3^2;
+
+// Dashboard page button on INT1 (P3.3), active low
+sbit page_btn = P3^3;
+
+// ADC data port (ADC0804 output connected to P1)
+#define adc_port P1
+
+// ADC control signals
+sbit rd = P2^1;    // Read pin of ADC
+sbit wr = P3^6;    // Write pin of ADC
+sbit intr = P3^7;  // Interrupt pin from ADC (goes LOW when conversion is done)
+
+#define hal_idle()          (PCON |= 0x01)      // Idle until the next interrupt
+#define hal_led(on)         (led = (on))
+#define hal_pulse_count()   (((unsigned int)TH1 << 8) | TL1)
+#define hal_counter_stop()  (TR1 = 0)
+#define hal_lcd_init()      lcd_init()
+#define hal_lcd_on(on)      lcd_cmd((on) ? 0x0C : 0x08)
+#define hal_lcd_clear()     lcd_cmd(0x01)
+#define hal_lcd_out         lcd_out
+#define hal_lcd_print       lcd_print
+#define hal_uart_room()     (HAL_UART_RING - (unsigned char)(hal_uart_head - hal_uart_tail))
+
+extern volatile unsigned char hal_uart_head, hal_uart_tail;
+
+void hal_init();
+unsigned char hal_adc_read();
+void hal_counter_start();
+void hal_uart_init();
+void hal_uart_put(unsigned char c);
+bit hal_eeprom_read(unsigned char addr, unsigned char *p, unsigned char n);
+bit hal_eeprom_write(unsigned char addr, unsigned char *p, unsigned char n);
+
+#endif
@@ -0,0 +1,217 @@
+/************************************************************
+ * hal_host.c - host (gcc) backend of the HAL
+ *
+ * Mirrors what the board does at the level the cluster logic
+ * can observe: lcd_out/lcd_print produce the same DDRAM
+ * contents as lcd.c, the pulse counter is 16 bits and stops
+ * with hal_counter_stop(), and the buttons arrive already
+ * debounced as on the 8051 backend. UART bytes go straight
+ * to on_uart: the line is never busy, since the real one
+ * moves some 170 bytes per tick. The EEPROM is a plain array
+ * that always answers unless eeprom_absent is set.
+ ************************************************************/
+
+#include <string.h>
+
+#include "hal.h"
+#include "tune.h"
+
+hal_host_t hal_host;
+volatile unsigned char hal_tick;
+volatile HAL_BIT hal_btn_event;
+volatile HAL_BIT hal_page_event;
+
+void hal_host_reset(void)
+{
+    memset(&hal_host, 0, sizeof(hal_host));
+    memset(hal_host.ddram, ' ', sizeof(hal_host.ddram));
+    memset(hal_host.eeprom, 0xFF, sizeof(hal_host.eeprom));
+    hal_tick = 0;
+    hal_btn_event = 0;
+    hal_page_event = 0;
+}
+
+void hal_host_press(void)
+{
+    hal_btn_event = 1;
+}
+
+void hal_host_page(void)
+{
+    hal_page_event = 1;
+}
+
+void hal_host_uart_rx(unsigned char c)
+{
+#if TUNE
+    tune_rx(c);
+#else
+    (void)c;
+#endif
+}
+
+void hal_host_row(int row, char *buf)
+{
+    int base = row == 2 ? 0x40 : 0x00;
+    int i;
+
+    for (i = 0; i < HAL_LCD_COLS; i++)
+        buf[i] = hal_host.display_on ? (char)hal_host.ddram[base + i] : ' ';
+    buf[HAL_LCD_COLS] = '\0';
+}
+
+void hal_init(void)
+{
+    hal_host.led = 0;
+}
+
+void hal_idle(void)
+{
+    hal_tick++;
+    hal_host.ticks++;
+    if (hal_host.counting)
+        hal_host.pulses = (hal_host.pulses + hal_host.pulses_per_tick) & 0xFFFF;
+    if (hal_host.on_tick)
+        hal_host.on_tick();
+}
+
+unsigned char hal_adc_read(void)
+{
+    hal_host.adc_reads++;
+    return hal_host.adc;
+}
+
+unsigned int hal_pulse_count(void)
+{
+    return hal_host.pulses;
+}
+
+void hal_counter_start(void)
+{
+    hal_host.pulses = 0;
+    hal_host.counting = 1;
+}
+
+void hal_counter_stop(void)
+{
+    hal_host.counting = 0;
+}
+
+void hal_led(HAL_BIT on)
+{
+    hal_host.led = on != 0;
+}
+
+void hal_lcd_init(void)
+{
+    memset(hal_host.ddram, ' ', sizeof(hal_host.ddram));
+    hal_host.ac = 0;
+    hal_host.display_on = 1;
+    hal_host.lcd_inits++;
+}
+
+void hal_lcd_on(HAL_BIT on)
+{
+    hal_host.display_on = on != 0;
+}
+
+void hal_lcd_clear(void)
+{
+    memset(hal_host.ddram, ' ', sizeof(hal_host.ddram));
+    hal_host.ac = 0;
+    hal_host.lcd_writes++;
+}
+
+static void lcd_cursor(char row, char column)
+{
+    if (row == 1)
+        hal_host.ac = (unsigned char)(0x00 + column - 1);
+    else if (row == 2)
+        hal_host.ac = (unsigned char)(0x40 + column - 1);
+}
+
+static void lcd_data(unsigned char c)
+{
+    hal_host.ddram[hal_host.ac & 0x7F] = c;
+    hal_host.ac = (unsigned char)((hal_host.ac + 1) & 0x7F);
+    hal_host.lcd_writes++;
+}
+
+void hal_lcd_out(char row, char column, HAL_CODE char *str)
+{
+    lcd_cursor(row, column);
+    while (*str)
+        lcd_data((unsigned char)*str++);
+}
+
+// Same digit selection as lcd.c lcd_print(), including 'E' for digits > 5
+void hal_lcd_print(char row, char column, unsigned int value, int digits)
+{
+    int flag = 0;
+
+    value &= 0xFFFF;    // unsigned int is 16 bits on the 8051
+
+    if (row == 0 || column == 0)
+        hal_host.ac = 0;
+    else
+        lcd_cursor(row, column);
+
+    if (digits == 5 || flag)
+    {
+        lcd_data((unsigned char)(value / 10000 + '0'));
+        flag = 1;
+    }
+    if (digits == 4 || flag)
+    {
+        lcd_data((unsigned char)(value / 1000 % 10 + '0'));
+        flag = 1;
+    }
+    if (digits == 3 || flag)
+    {
+        lcd_data((unsigned char)(value / 100 % 10 + '0'));
+        flag = 1;
+    }
+    if (digits == 2 || flag)
+    {
+        lcd_data((unsigned char)(value / 10 % 10 + '0'));
+        flag = 1;
+    }
+    if (digits == 1 || flag)
+        lcd_data((unsigned char)(value % 10 + '0'));
+    if (digits > 5)
+        lcd_data('E');
+}
+
+void hal_uart_init(void)
+{
+}
+
+unsigned char hal_uart_room(void)
+{
+    return HAL_UART_RING;
+}
+
+void hal_uart_put(unsigned char c)
+{
+    hal_host.uart_bytes++;
+    if (hal_host.on_uart)
+        hal_host.on_uart(c);
+}
+
+HAL_BIT hal_eeprom_read(unsigned char addr, unsigned char *p, unsigned char n)
+{
+    if (hal_host.eeprom_absent)
+        return 1;
+    while (n--)
+        *p++ = hal_host.eeprom[addr++];
+    return 0;
+}
+
+HAL_BIT hal_eeprom_write(unsigned char addr, unsigned char *p, unsigned char n)
+{
+    if (hal_host.eeprom_absent)
+        return 1;
+    while (n--)
+        hal_host.eeprom[addr++] = *p++;
+    return 0;
+}
@@ -0,0 +1,68 @@
+/************************************************************
+ * hal_host.h - host (gcc) backend of the HAL
+ *
+ * The board is a set of plain variables in hal_host: tests
+ * and drivers set the ADC reading and the pulse rate, press
+ * the buttons and read back the LED and the display. Every
+ * hal_idle() call stands for one 10 ms tick.
+ ************************************************************/
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#define HAL_BIT   unsigned char
+#define HAL_CODE  const
+
+#define HAL_LCD_COLS  16
+
+typedef struct
+{
+    // Inputs
+    unsigned char adc;              // Returned by hal_adc_read()
+    unsigned int pulses_per_tick;   // Wheel pulses counted per tick while running
+
+    // Outputs
+    unsigned char led;
+    unsigned int pulses;            // Timer1 count, wraps at 16 bits as TH1:TL1
+    unsigned char counting;
+    unsigned char ddram[128];       // Rows at 0x00 and 0x40
+    unsigned char ac;               // DDRAM address counter
+    unsigned char display_on;
+    unsigned char eeprom[256];      // 24C02 contents, erased (0xFF) after reset
+    unsigned char eeprom_absent;    // Input: EEPROM does not answer
+
+    // Statistics
+    unsigned long ticks, adc_reads, lcd_inits, lcd_writes, uart_bytes;
+
+    void (*on_tick)(void);          // Called after every simulated tick
+    void (*on_uart)(unsigned char c);   // Called for every byte sent on the UART
+} hal_host_t;
+
+extern hal_host_t hal_host;
+
+void hal_init(void);
+void hal_idle(void);
+unsigned char hal_adc_read(void);
+unsigned int hal_pulse_count(void);
+void hal_counter_start(void);
+void hal_counter_stop(void);
+void hal_led(HAL_BIT on);
+void hal_lcd_init(void);
+void hal_lcd_on(HAL_BIT on);
+void hal_lcd_clear(void);
+void hal_lcd_out(char row, char column, HAL_CODE char *str);
+void hal_lcd_print(char row, char column, unsigned int value, int digits);
+void hal_uart_init(void);
+unsigned char hal_uart_room(void);
+void hal_uart_put(unsigned char c);
+HAL_BIT hal_eeprom_read(unsigned char addr, unsigned char *p, unsigned char n);
+HAL_BIT hal_eeprom_write(unsigned char addr, unsigned char *p, unsigned char n);
+
+// Host-only controls
+void hal_host_reset(void);                  // Power-on state of the board
+void hal_host_press(void);                  // One debounced button press
+void hal_host_page(void);                   // One debounced page button press
+void hal_host_row(int row, char *buf);      // Visible text of row 1/2, HAL_LCD_COLS + NUL
+void hal_host_uart_rx(unsigned char c);     // One byte received, as the serial interrupt
+
+#endif
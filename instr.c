@@ -0,0 +1,128 @@
+/************************************************************
+ * instr.c - main-loop latency and jitter instrumentation
+ *
+ * See instr.h for the clock, the statistics and the dump
+ * format.
+ ************************************************************/
+
+#include "hal.h"
+#include "instr.h"
+
+#if INSTR
+
+instr_stat_t instr_stat[INSTR_SECTIONS];
+volatile unsigned int instr_base;   // Advanced by INSTR_TICK_UNITS every tick
+unsigned int instr_t_loop;          // Start of the running INSTR_LOOP sample
+unsigned int instr_t_inner;         // Start of the running inner section
+unsigned char instr_passes;         // Loop passes since the last dump
+
+// Histogram bin 0 upper edge per section, as a power of two (16 us units)
+code unsigned char instr_hist_base[INSTR_SECTIONS] =
+{
+    10,     // LOOP : <16 ms ... >=1 s
+    2,      // ADC  : <64 us ... >=4 ms
+    9,      // LCD  : <8 ms  ... >=512 ms
+    0,      // FUEL : <16 us ... >=1 ms
+    0       // ALARM: <16 us ... >=1 ms
+};
+
+/************************************************************
+ * Function: instr_now
+ * -------------------
+ * Returns the free-running clock in 16 us units. The tick
+ * base and Timer0 are re-read until consistent; a pending,
+ * not yet serviced overflow is absorbed by the 16-bit
+ * subtraction from TICK_RELOAD.
+ ************************************************************/
+
+unsigned int instr_now()
+{
+    unsigned int base;
+    unsigned char h, l;
+
+    do
+    {
+        base = instr_base;
+        h = TH0;
+        l = TL0;
+    } while (h != TH0 || base != instr_base);
+
+    return base + ((((unsigned int)h << 8 | l) - TICK_RELOAD) >> INSTR_UNIT_SHIFT);
+}
+
+/************************************************************
+ * Function: instr_record
+ * ----------------------
+ * Folds one sample into a section's min/max/average and
+ * histogram.
+ ************************************************************/
+
+void instr_record(unsigned char s, unsigned int d)
+{
+    instr_stat_t *st = &instr_stat[s];
+    unsigned char bin = 0;
+    unsigned int v = d >> instr_hist_base[s];
+    unsigned char i, n;
+
+    if (d < st->min || st->max == 0) st->min = d;
+    if (d > st->max) st->max = d;
+    st->avg += ((int)(d - st->avg)) >> 3;
+
+    while (v && bin < 7)
+    {
+        v >>= 1;
+        bin++;
+    }
+
+    n = st->hist[bin >> 1];
+    if (((bin & 1) ? (n >> 4) : (n & 0x0F)) == 0x0F)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            st->hist[i] = (st->hist[i] >> 1) & 0x77;   // Halve every bin
+        }
+        n = st->hist[bin >> 1];
+    }
+    st->hist[bin >> 1] = n + ((bin & 1) ? 0x10 : 0x01);
+}
+
+/************************************************************
+ * Function: instr_dump
+ * --------------------
+ * Every INSTR_DUMP_PASSES calls, sends the stats block over
+ * the UART (mode 2, polled). Called outside any measured
+ * section so the dump does not skew the loop figures.
+ ************************************************************/
+
+void instr_putc(unsigned char c)
+{
+    TI = 0;
+    SBUF = c;
+    while (!TI);
+}
+
+void instr_dump()
+{
+    unsigned char *p;
+    unsigned char s, i;
+
+    if (++instr_passes < INSTR_DUMP_PASSES)
+    {
+        return;
+    }
+    instr_passes = 0;
+
+    SCON = 0x88;            // Mode 2, TB8 = 1 (acts as stop bit), no receive
+    instr_putc(0xA5);
+    instr_putc(INSTR_SECTIONS);
+    for (s = 0; s < INSTR_SECTIONS; s++)
+    {
+        p = (unsigned char *)&instr_stat[s];
+        for (i = 0; i < sizeof(instr_stat_t); i++)
+        {
+            instr_putc(p[i]);   // Keil stores ints big-endian
+        }
+    }
+}
+
+#endif
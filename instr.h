@@ -0,0 +1,86 @@
+/************************************************************
+ * instr.h - main-loop latency and jitter instrumentation
+ *
+ * Timestamps come from the Timer0 system tick: instr_base
+ * advances by one tick (10 ms) in ISR_t0 and the running
+ * Timer0 count supplies the fraction, giving a free-running
+ * 16-bit clock in units of 16 us (wraps after ~1.05 s).
+ *
+ * For every section the stats keep min, max, an exponential
+ * average (alpha = 1/8) and an 8-bin log2 histogram. Bins
+ * are 4-bit counters packed two per byte; when one saturates
+ * all bins are halved, so the histogram keeps its shape.
+ * Bin 0 holds samples below 2^base units, bin n holds
+ * [2^(base+n-1), 2^(base+n)) and bin 7 is open-ended; the
+ * per-section base lives in code memory.
+ *
+ * The stats block is a fixed-layout array in IRAM so the
+ * host simulator can read it through the map file symbol
+ * instr_stat. instr_dump() also sends it over the on-chip
+ * UART in mode 2 (fosc/64, no timer needed) as the debug
+ * channel:  0xA5, INSTR_SECTIONS, then each section as
+ * min, max, avg (big-endian) followed by the 4 hist bytes.
+ *
+ * Disabled by default; build with INSTR defined to 1 for the
+ * whole target (C51 Define) so cluster.c, hal_8051.c and
+ * instr.c agree. The stats need INSTR_SECTIONS * 10 + 6 bytes
+ * of IRAM.
+ ************************************************************/
+
+#ifndef INSTR_H
+#define INSTR_H
+
+#ifndef INSTR
+#define INSTR 0
+#endif
+
+// Instrumented sections
+#define INSTR_LOOP      0   // One full cluster_update() pass
+#define INSTR_ADC       1   // conv() + read()
+#define INSTR_LCD       2   // Display refresh
+#define INSTR_FUEL      3   // Fuel step
+#define INSTR_ALARM     4   // Temperature / low-fuel checks
+#define INSTR_SECTIONS  5
+
+#define INSTR_UNIT_SHIFT  4                     // 1 unit = 16 us
+#define INSTR_TICK_UNITS  (10000 >> INSTR_UNIT_SHIFT)
+#define INSTR_DUMP_PASSES 16                    // Loop passes between debug dumps
+
+#if INSTR
+
+typedef struct
+{
+    unsigned int min;           // Shortest sample (16 us units)
+    unsigned int max;           // Longest sample
+    unsigned int avg;           // Exponential average, alpha = 1/8
+    unsigned char hist[4];      // 8 x 4-bit log2 bins, low nibble = even bin
+} instr_stat_t;
+
+extern instr_stat_t instr_stat[INSTR_SECTIONS];
+extern volatile unsigned int instr_base;
+extern unsigned int instr_t_loop;
+extern unsigned int instr_t_inner;
+
+unsigned int instr_now();
+void instr_record(unsigned char s, unsigned int d);
+void instr_dump();
+
+// Section timing helpers; LOOP may enclose exactly one inner section at a time
+#define INSTR_TICK()         instr_base += INSTR_TICK_UNITS
+#define INSTR_LOOP_BEGIN()   instr_t_loop = instr_now()
+#define INSTR_LOOP_END()     instr_record(INSTR_LOOP, instr_now() - instr_t_loop)
+#define INSTR_BEGIN(s)       instr_t_inner = instr_now()
+#define INSTR_END(s)         instr_record(s, instr_now() - instr_t_inner)
+
+#else
+
+#define INSTR_TICK()
+#define INSTR_LOOP_BEGIN()
+#define INSTR_LOOP_END()
+#define INSTR_BEGIN(s)
+#define INSTR_END(s)
+#define instr_dump()
+
+#endif
+
+#endif
@@ -1,3 +1,4 @@
+#ifdef __C51__
 #include<reg51.h>
 //#include"lcd.c"
 sbit LCD_RS = P2^2;
@@ -6,22 +7,21 @@ sbit LCD_D4 = P2^4;
 sbit LCD_D5 = P2^5;
 sbit LCD_D6 = P2^6;
 sbit LCD_D7 = P2^7;
-
-void delay_ms(unsigned int count);
-void lcd_init();
-void lcd_set_4bit();
-void lcd_busy();
-void lcd_cmd(unsigned char);
-void lcd_data(char);
-void lcd_out(char row, char column, char*);
-void lcd_cursor (char row, char column);
-void lcd_print(char row, char coloumn, unsigned int value, int digits);
-
-
-
-
-
-
+#else
+// Host builds (sim/fuzz_lcd.c): each pin write goes through lcd_pin() to
+// the HD44780 model, and the model's clock supplies delay_ms()
+unsigned char *lcd_pin(unsigned char bit);
+#define LCD_RS  (*lcd_pin(2))
+#define LCD_EN  (*lcd_pin(3))
+#define LCD_D4  (*lcd_pin(4))
+#define LCD_D5  (*lcd_pin(5))
+#define LCD_D6  (*lcd_pin(6))
+#define LCD_D7  (*lcd_pin(7))
+#endif
+
+#include "lcd.h"
+
+#ifdef __C51__
 void delay_ms(unsigned int count)
 {
         unsigned int i;
@@ -33,6 +33,7 @@ void delay_ms(unsigned int count)
                 count--;
         }
 }
+#endif
 
 void lcd_init()
 {
@@ -143,13 +144,14 @@ void lcd_data(unsigned char letter)
                 LCD_EN = 0;        
 }
 
-void lcd_out(char row, char column, char *str)
+void lcd_out(char row, char column, char LCD_CODE *str)
 {
+                char c;
+
                 lcd_cursor(row, column);
-          while(*str != '\0')
+                while((c = *str++) != '\0')   // One MOVC per character
                 {
-                                lcd_data(*str);
-                                str++;
+                                lcd_data(c);
                 }
 }
 
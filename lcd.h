@@ -0,0 +1,33 @@
+/************************************************************
+ * lcd.h - HD44780 16x2 LCD driver, 4-bit bus
+ *
+ * RS = P2.2, EN = P2.3, D4-D7 = P2.4-P2.7, R/W tied low.
+ * Rows and columns are 1-based.
+ *
+ * lcd_out() takes its text from code memory. A generic char *
+ * costs a 3-byte pointer and a ?C?CLDPTR library call per
+ * character; a code pointer is 2 bytes and reads inline with
+ * MOVC A,@A+DPTR. Keil already keeps string literals in code
+ * memory, so the labels pass straight through.
+ ************************************************************/
+
+#ifndef LCD_H
+#define LCD_H
+
+#ifdef __C51__
+#define LCD_CODE  code
+#else
+#define LCD_CODE  const     // Host builds (sim/fuzz_lcd.c)
+#endif
+
+void delay_ms(unsigned int count);
+void lcd_init();
+void lcd_set_4bit();
+void lcd_busy();
+void lcd_cmd(unsigned char);
+void lcd_data(unsigned char);
+void lcd_out(char row, char column, char LCD_CODE *str);
+void lcd_cursor (char row, char column);
+void lcd_print(char row, char coloumn, unsigned int value, int digits);
+
+#endif
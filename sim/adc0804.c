@@ -0,0 +1,124 @@
+/************************************************************
+ * adc0804.c - ADC0804 + LM35 peripheral model
+ ************************************************************/
+
+#include <ctype.h>
+#include <string.h>
+
+#include "adc0804.h"
+
+#define P1_ALL    0xFF
+#define P2_RD     0x02
+#define P3_WR     0x40
+#define P3_INTR   0x80
+
+// Case-insensitive search in the CSV column header
+static int header_has(const char *header, const char *word)
+{
+    char low[64];
+    int i;
+
+    for (i = 0; header[i] && i < (int)sizeof(low) - 1; i++)
+        low[i] = (char)tolower((unsigned char)header[i]);
+    low[i] = 0;
+    return strstr(low, word) != NULL;
+}
+
+static uint8_t quantise(const adc0804_t *adc, double v)
+{
+    double code = v / adc->vref * 256.0 + 0.5;
+
+    if (code < 0)
+        return 0;
+    if (code > 255)
+        return 255;
+    return (uint8_t)code;
+}
+
+static void adc_pins(sim_dev_t *dev, mcs51_t *cpu, int port, uint8_t old, uint8_t now)
+{
+    adc0804_t *adc = dev->ctx;
+
+    if (port == 3 && ((old ^ now) & P3_WR))
+    {
+        if (!(now & P3_WR))
+        {
+            // WR low: reset SAR, INTR high
+            adc->converting = 0;
+            mcs51_schedule(cpu, dev, MCS51_NEVER);
+            mcs51_drive(cpu, 3, P3_INTR, P3_INTR);
+        }
+        else
+        {
+            // WR high: start conversion, 66-73 clock periods
+            uint64_t periods;
+
+            adc->seed = adc->seed * 1103515245u + 12345u;
+            periods = 66 + ((adc->seed >> 16) & 7);
+            adc->converting = 1;
+            mcs51_schedule(cpu, dev,
+                           cpu->cycles + mcs51_cycles(cpu, (double)periods / adc->fclk));
+        }
+    }
+    else if (port == 2 && ((old ^ now) & P2_RD))
+    {
+        if (!(now & P2_RD))
+        {
+            if (adc->converting)
+                adc->early_reads++;
+            adc->reading = 1;
+            mcs51_drive(cpu, 3, P3_INTR, P3_INTR);
+            mcs51_drive(cpu, 1, P1_ALL, adc->result);
+        }
+        else if (adc->reading)
+        {
+            adc->reading = 0;
+            mcs51_drive(cpu, 1, P1_ALL, P1_ALL);
+        }
+    }
+}
+
+static void adc_event(sim_dev_t *dev, mcs51_t *cpu)
+{
+    adc0804_t *adc = dev->ctx;
+    double v = wave_at(adc->input, mcs51_seconds(cpu, cpu->cycles));
+
+    if (!adc->converting)
+        return;
+    adc->vin = adc->lm35 ? v * 0.010 : v;
+    if (adc->on_sample)
+        adc->vin = adc->on_sample(adc->on_sample_ctx, cpu, adc->vin);
+    adc->result = quantise(adc, adc->vin);
+    adc->converting = 0;
+    adc->conversions++;
+    if (adc->reading)
+        mcs51_drive(cpu, 1, P1_ALL, adc->result);
+    mcs51_drive(cpu, 3, P3_INTR, 0);
+    if (adc->on_convert)
+        adc->on_convert(adc->on_convert_ctx, cpu, adc->vin, adc->result);
+}
+
+void adc0804_input(adc0804_t *adc, wave_t *input)
+{
+    adc->input = input;
+    adc->lm35 = header_has(input->header, "celsius") || header_has(input->header, "degc");
+}
+
+void adc0804_init(adc0804_t *adc, mcs51_t *cpu, wave_t *input)
+{
+    memset(adc, 0, sizeof(*adc));
+    adc->vref = 2.56;
+    adc->fclk = 640000.0;
+    adc->seed = 1;
+    adc0804_input(adc, input);
+
+    adc->dev.name = "adc0804";
+    adc->dev.ctx = adc;
+    adc->dev.pins = adc_pins;
+    adc->dev.event = adc_event;
+    adc->dev.next = MCS51_NEVER;
+    mcs51_attach(cpu, &adc->dev);
+
+    // INTR idles high (released)
+    mcs51_drive(cpu, 3, P3_INTR, P3_INTR);
+}
@@ -0,0 +1,60 @@
+/************************************************************
+ * adc0804.h - ADC0804 + LM35 peripheral model
+ *
+ * Wiring as in the Proteus design: DB0-DB7 on P1, WR on
+ * P3.6, RD on P2.1, INTR on P3.7, CS tied low.
+ *
+ *  - WR low resets the converter and releases INTR (high);
+ *    the conversion starts on the WR rising edge and takes
+ *    66-73 ADC clock periods (seeded jitter), then the
+ *    result is latched and INTR is pulled low.
+ *  - RD low drives the latched result onto P1 and releases
+ *    INTR; RD high floats P1 again.
+ *
+ * The analog input is sampled at the end of the conversion
+ * from a wave_t time series. With lm35 set the series is in
+ * degrees Celsius and converted at 10 mV/degC. Codes are
+ * round(vin / vref * 256), clamped to 0..255; the default
+ * vref of 2.56 V (Vref/2 = 1.28 V) gives the 10 mV/LSB the
+ * firmware's temp = adc_val assumes.
+ ************************************************************/
+
+#ifndef ADC0804_H
+#define ADC0804_H
+
+#include <stdint.h>
+
+#include "mcs51.h"
+#include "wave.h"
+
+typedef struct
+{
+    sim_dev_t dev;
+    wave_t *input;
+
+    double vref;            // Full-scale voltage (2 x Vref/2)
+    double fclk;            // ADC clock (Hz), 640 kHz with the datasheet R/C
+    int lm35;               // Input series is degC
+    uint32_t seed;          // Conversion-time jitter state
+
+    uint8_t result;         // Output latch
+    uint8_t converting;
+    uint8_t reading;        // RD low, P1 driven
+    double vin;             // Last sampled input (V)
+
+    uint64_t conversions;
+    uint64_t early_reads;   // RD while a conversion was still running
+    void (*on_convert)(void *ctx, mcs51_t *cpu, double vin, uint8_t code);
+    void *on_convert_ctx;
+
+    // Optional input hook: gets the sampled voltage, returns the one to convert
+    double (*on_sample)(void *ctx, mcs51_t *cpu, double vin);
+    void *on_sample_ctx;
+} adc0804_t;
+
+void adc0804_init(adc0804_t *adc, mcs51_t *cpu, wave_t *input);
+
+// Switches to another input series (LM35 scaling follows its header)
+void adc0804_input(adc0804_t *adc, wave_t *input);
+
+#endif
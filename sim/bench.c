@@ -0,0 +1,475 @@
+/************************************************************
+ * bench.c - firmware cycle benchmarks
+ *
+ * Boots Main.hex on the simulated board and measures the
+ * machine cycles of the LCD driver, the ADC read and one
+ * cluster pass by watching calls into the functions named in
+ * the linker map. Cycles spent in interrupt handlers are not
+ * charged to the function they interrupted, so the numbers
+ * are stable from run to run.
+ *
+ *   bench --map Listings/Main.m51 [options] [Main.hex]
+ *     -t SEC          simulated time (default 4)
+ *     -o FILE         write the results as JSON
+ *     -b FILE         compare against a stored baseline
+ *     --threshold P   allowed regression in percent (default 2)
+ *
+ * Metrics (cycles are averages per call):
+ *   cycles.lcd_init             one full LCD initialisation
+ *   cycles.lcd_cmd              one instruction byte
+ *   cycles.lcd_data             one character byte
+ *   cycles.lcd_out_per_char     lcd_out() divided by characters sent
+ *   cycles.lcd_print_wN         lcd_print() writing N digits
+ *   cycles.conv_read            conv() + read()
+ *   cycles.loop                 one cluster_update() pass
+ *   bytes.FUNC                  code size of every function
+ *   bytes.total                 sum of the above
+ *
+ * With -b the run fails (exit 1) when any metric in the
+ * baseline grew by more than the threshold, or disappeared.
+ * A missing or empty baseline is an error (exit 2) found
+ * before the run, so the gate cannot pass by default. The
+ * baseline lives in sim/bench_baseline.json and is written
+ * with -o from the same Keil build as the committed Main.hex.
+ ************************************************************/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "symmap.h"
+
+#define MAX_DEPTH       16
+#define MAX_METRICS     128
+#define PRINT_WIDTHS    5
+
+// Tracked functions
+#define F_LCD_INIT      0
+#define F_LCD_CMD       1
+#define F_LCD_DATA      2
+#define F_LCD_OUT       3
+#define F_LCD_PRINT     4
+#define F_CONV          5
+#define F_READ          6
+#define F_LOOP          7
+#define F_COUNT         8
+
+static const char *func_names[F_COUNT] =
+{
+    "lcd_init", "lcd_cmd", "lcd_data", "lcd_out", "lcd_print", "conv", "read", "cluster_update"
+};
+
+typedef struct
+{
+    uint64_t calls, total, min, max;
+} stat_t;
+
+typedef struct
+{
+    int func;
+    uint16_t ret;           // Return address pushed by the call
+    uint8_t sp;             // SP after the return
+    uint64_t start;         // Cycle at entry
+    uint64_t isr_start;     // ISR cycles at entry
+    uint64_t data_start;    // lcd_data calls at entry
+} frame_t;
+
+typedef struct
+{
+    int addr[F_COUNT];      // Entry point, -1 when not in the map
+    frame_t stack[MAX_DEPTH];
+    int depth;
+
+    uint64_t last_cycles;
+    int last_in_isr;
+    uint64_t isr_cycles;    // Cycles spent in interrupt handlers so far
+    uint64_t data_calls;
+
+    stat_t fn[F_COUNT];
+    stat_t print_width[PRINT_WIDTHS + 1];
+    uint64_t out_chars;
+} bench_t;
+
+typedef struct
+{
+    char name[SYM_NAME_MAX + 8];
+    double value;
+} metric_t;
+
+typedef struct
+{
+    metric_t m[MAX_METRICS];
+    int n;
+} metrics_t;
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: bench --map FILE [options] [image.hex]\n"
+        "  --map FILE      Keil .m51 or SDCC .map of the image (required)\n"
+        "  -t SEC          simulated time (default 4)\n"
+        "  -o FILE         write the results as JSON\n"
+        "  -b FILE         compare against a stored baseline\n"
+        "  --threshold P   allowed regression in percent (default 2)\n");
+    exit(2);
+}
+
+/************************************************************
+ * Call tracking
+ ************************************************************/
+
+static void stat_add(stat_t *s, uint64_t v)
+{
+    if (s->calls == 0 || v < s->min)
+        s->min = v;
+    if (v > s->max)
+        s->max = v;
+    s->calls++;
+    s->total += v;
+}
+
+static void leave(bench_t *b, const frame_t *f, uint64_t now)
+{
+    uint64_t cycles = now - f->start - (b->isr_cycles - f->isr_start);
+    uint64_t chars = b->data_calls - f->data_start;
+
+    stat_add(&b->fn[f->func], cycles);
+    if (f->func == F_LCD_OUT)
+        b->out_chars += chars;
+    else if (f->func == F_LCD_PRINT && chars >= 1 && chars <= PRINT_WIDTHS)
+        stat_add(&b->print_width[chars], cycles);
+}
+
+static void bench_insn(mcs51_t *cpu, uint16_t pc, void *ctx)
+{
+    bench_t *b = ctx;
+    uint8_t sp = cpu->sfr[SFR_SP - 0x80];
+    int i;
+
+    // Charge the previous instruction to the ISR or the main flow
+    if (b->last_in_isr)
+        b->isr_cycles += cpu->cycles - b->last_cycles;
+    b->last_cycles = cpu->cycles;
+    b->last_in_isr = cpu->isr_active != 0;
+    if (cpu->isr_active)
+        return;
+
+    // Returns (several frames at once after a tail jump)
+    while (b->depth && b->stack[b->depth - 1].ret == pc && b->stack[b->depth - 1].sp == sp)
+        leave(b, &b->stack[--b->depth], cpu->cycles);
+
+    for (i = 0; i < F_COUNT; i++)
+    {
+        frame_t *f;
+        uint16_t ret;
+
+        if (b->addr[i] != pc)
+            continue;
+        ret = (uint16_t)(cpu->iram[sp] << 8 | cpu->iram[(uint8_t)(sp - 1)]);
+
+        // A jump back to the entry of the running function is not a call
+        if (b->depth && b->stack[b->depth - 1].func == i && b->stack[b->depth - 1].ret == ret &&
+            b->stack[b->depth - 1].sp == (uint8_t)(sp - 2))
+            break;
+        if (i == F_LCD_DATA)
+            b->data_calls++;
+        if (b->depth == MAX_DEPTH)
+            break;
+        f = &b->stack[b->depth++];
+        f->func = i;
+        f->ret = ret;
+        f->sp = (uint8_t)(sp - 2);
+        f->start = cpu->cycles;
+        f->isr_start = b->isr_cycles;
+        f->data_start = b->data_calls;
+        break;
+    }
+}
+
+/************************************************************
+ * Metrics
+ ************************************************************/
+
+static void put(metrics_t *m, const char *name, double value)
+{
+    if (m->n == MAX_METRICS)
+        return;
+    snprintf(m->m[m->n].name, sizeof(m->m[0].name), "%s", name);
+    m->m[m->n++].value = value;
+}
+
+static double avg(const stat_t *s)
+{
+    return s->calls ? (double)s->total / s->calls : 0.0;
+}
+
+static void collect(const bench_t *b, const symmap_t *map, metrics_t *m)
+{
+    char name[SYM_NAME_MAX + 8];
+    int i, total = 0;
+
+    if (b->fn[F_LCD_INIT].calls)
+        put(m, "cycles.lcd_init", avg(&b->fn[F_LCD_INIT]));
+    if (b->fn[F_LCD_CMD].calls)
+        put(m, "cycles.lcd_cmd", avg(&b->fn[F_LCD_CMD]));
+    if (b->fn[F_LCD_DATA].calls)
+        put(m, "cycles.lcd_data", avg(&b->fn[F_LCD_DATA]));
+    if (b->out_chars)
+        put(m, "cycles.lcd_out_per_char", (double)b->fn[F_LCD_OUT].total / b->out_chars);
+    for (i = 1; i <= PRINT_WIDTHS; i++)
+    {
+        if (!b->print_width[i].calls)
+            continue;
+        snprintf(name, sizeof(name), "cycles.lcd_print_w%d", i);
+        put(m, name, avg(&b->print_width[i]));
+    }
+    if (b->fn[F_CONV].calls && b->fn[F_READ].calls)
+        put(m, "cycles.conv_read", avg(&b->fn[F_CONV]) + avg(&b->fn[F_READ]));
+    if (b->fn[F_LOOP].calls)
+        put(m, "cycles.loop", avg(&b->fn[F_LOOP]));
+
+    // Code bytes: Keil function segments, or every global code symbol
+    if (map->big_endian && map->nseg)
+    {
+        for (i = 0; i < map->nseg; i++)
+        {
+            const char *g = map->seg[i].name;
+            char *c;
+
+            if (map->seg[i].kind != SEG_FUNC)
+                continue;
+
+            // Keil upper-cases segment names; report C spelling
+            snprintf(name, sizeof(name), "bytes.%s", g[0] == '_' ? g + 1 : g);
+            for (c = name; *c; c++)
+                *c = (char)tolower((unsigned char)*c);
+            put(m, name, map->seg[i].length);
+            total += map->seg[i].length;
+        }
+    }
+    else
+    {
+        for (i = 0; i < map->n; i++)
+        {
+            const sym_t *s = &map->sym[i];
+            int size;
+
+            if (s->space != SYM_CODE || !s->global || (size = symmap_code_size(map, s->name)) < 0)
+                continue;
+            snprintf(name, sizeof(name), "bytes.%s", s->name);
+            put(m, name, size);
+            total += size;
+        }
+    }
+    put(m, "bytes.total", total);
+}
+
+static void print_details(const bench_t *b, FILE *out)
+{
+    int i;
+
+    fprintf(out, "%-16s %8s %10s %10s %10s\n", "function", "calls", "min", "avg", "max");
+    for (i = 0; i < F_COUNT; i++)
+    {
+        const stat_t *s = &b->fn[i];
+
+        if (b->addr[i] < 0)
+            fprintf(out, "%-16s %8s\n", func_names[i], "not in map");
+        else
+            fprintf(out, "%-16s %8llu %10llu %10.1f %10llu\n", func_names[i],
+                    (unsigned long long)s->calls, (unsigned long long)s->min, avg(s),
+                    (unsigned long long)s->max);
+    }
+}
+
+static int write_json(const char *path, const char *image, const bench_t *b, const metrics_t *m)
+{
+    FILE *f = fopen(path, "w");
+    int i;
+
+    if (!f)
+        return -1;
+    fprintf(f, "{\n  \"image\": \"");
+    for (; *image; image++)
+        fprintf(f, *image == '"' || *image == '\\' ? "\\%c" : "%c", *image);
+    fprintf(f, "\",\n  \"metrics\": {\n");
+    for (i = 0; i < m->n; i++)
+        fprintf(f, "    \"%s\": %.1f%s\n", m->m[i].name, m->m[i].value, i + 1 < m->n ? "," : "");
+    fprintf(f, "  },\n  \"calls\": {\n");
+    for (i = 0; i < F_COUNT; i++)
+    {
+        const stat_t *s = &b->fn[i];
+
+        fprintf(f, "    \"%s\": { \"calls\": %llu, \"min\": %llu, \"max\": %llu }%s\n", func_names[i],
+                (unsigned long long)s->calls, (unsigned long long)s->min,
+                (unsigned long long)s->max, i + 1 < F_COUNT ? "," : "");
+    }
+    fprintf(f, "  }\n}\n");
+    return fclose(f);
+}
+
+// Reads the "metrics" object of a file written by write_json
+static int read_baseline(const char *path, metrics_t *m)
+{
+    FILE *f = fopen(path, "r");
+    char line[256];
+    int in_metrics = 0;
+
+    m->n = 0;
+    if (!f)
+        return -1;
+    while (fgets(line, sizeof(line), f))
+    {
+        char name[SYM_NAME_MAX + 8];
+        double v;
+
+        if (strstr(line, "\"metrics\""))
+            in_metrics = 1;
+        else if (in_metrics && strchr(line, '}'))
+            break;
+        else if (in_metrics && sscanf(line, " \"%47[^\"]\": %lf", name, &v) == 2)
+            put(m, name, v);
+    }
+    fclose(f);
+    return 0;
+}
+
+static const metric_t *find(const metrics_t *m, const char *name)
+{
+    int i;
+
+    for (i = 0; i < m->n; i++)
+        if (!strcmp(m->m[i].name, name))
+            return &m->m[i];
+    return NULL;
+}
+
+// Prints baseline vs current; returns the number of regressions
+static int compare(const metrics_t *base, const metrics_t *now, double threshold)
+{
+    int i, bad = 0;
+
+    printf("%-28s %12s %12s %8s\n", "metric", "baseline", "now", "change");
+    for (i = 0; i < base->n; i++)
+    {
+        const metric_t *b = &base->m[i];
+        const metric_t *n = find(now, b->name);
+        double pct;
+
+        if (!n)
+        {
+            printf("%-28s %12.1f %12s %8s  MISSING\n", b->name, b->value, "-", "-");
+            bad++;
+            continue;
+        }
+        pct = b->value ? (n->value - b->value) * 100.0 / b->value : (n->value ? 100.0 : 0.0);
+        printf("%-28s %12.1f %12.1f %+7.2f%%%s\n", b->name, b->value, n->value, pct,
+               pct > threshold ? "  REGRESSION" : pct < 0 ? "  better" : "");
+        if (pct > threshold)
+            bad++;
+    }
+    for (i = 0; i < now->n; i++)
+        if (!find(base, now->m[i].name))
+            printf("%-28s %12s %12.1f %8s  new\n", now->m[i].name, "-", now->m[i].value, "-");
+    return bad;
+}
+
+int main(int argc, char **argv)
+{
+    static board_t board;
+    static bench_t bench;
+    static metrics_t metrics, baseline;
+    symmap_t map;
+    const char *image = "Main.hex", *map_path = NULL, *out = NULL, *base = NULL;
+    double seconds = 4.0, threshold = 2.0;
+    char err[256];
+    int i, found = 0;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--map") && i + 1 < argc)
+            map_path = argv[++i];
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            out = argv[++i];
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc)
+            base = argv[++i];
+        else if (!strcmp(argv[i], "--threshold") && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (argv[i][0] == '-')
+            usage();
+        else
+            image = argv[i];
+    }
+    if (!map_path || seconds <= 0)
+        usage();
+    if (symmap_load(&map, map_path, err, sizeof(err)))
+    {
+        fprintf(stderr, "bench: %s\n", err);
+        return 2;
+    }
+    for (i = 0; i < F_COUNT; i++)
+    {
+        const sym_t *s = symmap_func(&map, func_names[i]);
+
+        bench.addr[i] = s ? s->addr : -1;
+        found += s != NULL;
+    }
+    if (!found)
+    {
+        fprintf(stderr, "bench: none of the benchmarked functions are in %s\n", map_path);
+        return 2;
+    }
+    if (base && (read_baseline(base, &baseline) || baseline.n == 0))
+    {
+        fprintf(stderr, "bench: no baseline in %s; record one with -o from the Keil build "
+                "of this tree\n", base);
+        return 2;
+    }
+
+    // Boot the cluster with a short press and let it run a few passes
+    board_init(&board, 12000000);
+    if (board_load(&board, image, err, sizeof(err)) ||
+        board_wheel(&board, "36", 0, 1, err, sizeof(err)))
+    {
+        fprintf(stderr, "bench: %s\n", err);
+        return 2;
+    }
+    board.cpu.on_insn = bench_insn;
+    board.cpu.on_insn_ctx = &bench;
+    mcs51_run(&board.cpu, mcs51_cycles(&board.cpu, 0.10));
+    mcs51_drive(&board.cpu, 3, 0x04, 0x00);
+    mcs51_run(&board.cpu, mcs51_cycles(&board.cpu, 0.15));
+    mcs51_drive(&board.cpu, 3, 0x04, 0x04);
+    mcs51_run(&board.cpu, mcs51_cycles(&board.cpu, seconds));
+
+    collect(&bench, &map, &metrics);
+    print_details(&bench, stdout);
+    if (out && write_json(out, image, &bench, &metrics))
+    {
+        fprintf(stderr, "bench: cannot write %s\n", out);
+        return 2;
+    }
+    board_close(&board);
+    symmap_free(&map);
+
+    if (base)
+    {
+        int bad = compare(&baseline, &metrics, threshold);
+
+        if (bad)
+        {
+            printf("%d metric%s regressed by more than %.1f%%\n", bad, bad == 1 ? "" : "s", threshold);
+            return 1;
+        }
+    }
+    else
+    {
+        for (i = 0; i < metrics.n; i++)
+            printf("%-28s %12.1f\n", metrics.m[i].name, metrics.m[i].value);
+    }
+    return 0;
+}
@@ -0,0 +1,391 @@
+/************************************************************
+ * board.c - the cluster board as seen by the firmware
+ ************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+
+void board_init(board_t *b, uint32_t fosc)
+{
+    memset(b, 0, sizeof(*b));
+    mcs51_init(&b->cpu, fosc);
+    hd44780_init(&b->lcd, &b->cpu);
+    wave_const(&b->adc_wave, 0.25);
+    adc0804_init(&b->adc, &b->cpu, &b->adc_wave);
+}
+
+int board_load(board_t *b, const char *path, char *err, int errlen)
+{
+    if (ihex_load(path, b->cpu.code, sizeof(b->cpu.code), NULL, &b->image, err, errlen))
+        return -1;
+    mcs51_invalidate(&b->cpu, 0, sizeof(b->cpu.code));
+    return 0;
+}
+
+void board_adc_volts(board_t *b, double volts)
+{
+    wave_close(&b->adc_wave);
+    wave_const(&b->adc_wave, volts);
+    adc0804_input(&b->adc, &b->adc_wave);
+}
+
+int board_adc_file(board_t *b, const char *path, double speed, char *err, int errlen)
+{
+    wave_t w;
+
+    if (wave_open(&w, path, speed, err, errlen))
+        return -1;
+    wave_close(&b->adc_wave);
+    b->adc_wave = w;
+    adc0804_input(&b->adc, &b->adc_wave);
+    return 0;
+}
+
+int board_wheel(board_t *b, const char *profile, int loop, uint64_t seed, char *err, int errlen)
+{
+    int n;
+    const double (*pts)[2] = wheel_profile(profile, &n);
+    char *end;
+    double kmh = strtod(profile, &end);
+
+    if (b->has_wheel)
+    {
+        snprintf(err, errlen, "wheel already attached");
+        return -1;
+    }
+    if (pts)
+        wave_table(&b->wheel_wave, pts, n, 1.0);
+    else if (end != profile && *end == '\0')
+        wave_const(&b->wheel_wave, kmh);
+    else if (wave_open(&b->wheel_wave, profile, 1.0, err, errlen))
+        return -1;
+    b->wheel_wave.loop = loop;
+    wheel_init(&b->wheel, &b->cpu, &b->wheel_wave, seed);
+    b->has_wheel = 1;
+    return 0;
+}
+
+int board_led(const board_t *b)
+{
+    return mcs51_pins(&b->cpu, 3) & 0x01;
+}
+
+/************************************************************
+ * State save/restore
+ *
+ * Layout: a header with the struct sizes (a state only loads
+ * into the same build), the mcs51_t fields after the program
+ * memory, the used part of XRAM, then the LCD and ADC models.
+ ************************************************************/
+
+#define STATE_MAGIC     0x53354254u     // "TB5S"
+#define CPU_STATE       offsetof(mcs51_t, iram)
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t cpu, lcd, adc;     // sizeof of each part
+    uint32_t xram;              // XRAM bytes stored (highest non-zero + 1)
+} state_hdr_t;
+
+// Zeroes one mcs51_t field inside a saved CPU state
+#define CLEAR_CPU(out, field) \
+    memset((out) + offsetof(mcs51_t, field) - CPU_STATE, 0, sizeof(((mcs51_t *)0)->field))
+
+static void clear_dev(sim_dev_t *d)
+{
+    uint64_t next = d->next;
+
+    memset(d, 0, sizeof(*d));
+    d->next = next;
+}
+
+// Keeps the live wiring of a device, takes the saved schedule
+static void keep_dev(sim_dev_t *saved, const sim_dev_t *live)
+{
+    uint64_t next = saved->next;
+
+    *saved = *live;
+    saved->next = next;
+}
+
+size_t board_save(const board_t *b, uint8_t *buf, size_t cap)
+{
+    hd44780_t lcd = b->lcd;
+    adc0804_t adc = b->adc;
+    state_hdr_t h;
+    size_t n, at = 0;
+
+    h.magic = STATE_MAGIC;
+    h.cpu = sizeof(mcs51_t);
+    h.lcd = sizeof(hd44780_t);
+    h.adc = sizeof(adc0804_t);
+    for (h.xram = sizeof(b->cpu.xram); h.xram && !b->cpu.xram[h.xram - 1]; h.xram--)
+        ;
+    n = sizeof(h) + (sizeof(mcs51_t) - CPU_STATE) + h.xram + sizeof(lcd) + sizeof(adc);
+    if (n > cap)
+        return n;
+
+    memcpy(buf + at, &h, sizeof(h));
+    at += sizeof(h);
+    memcpy(buf + at, (const uint8_t *)&b->cpu + CPU_STATE, sizeof(mcs51_t) - CPU_STATE);
+    CLEAR_CPU(buf + at, devs);
+    CLEAR_CPU(buf + at, next_event);
+    CLEAR_CPU(buf + at, on_insn);
+    CLEAR_CPU(buf + at, on_insn_ctx);
+    CLEAR_CPU(buf + at, on_drive);
+    CLEAR_CPU(buf + at, on_drive_ctx);
+    CLEAR_CPU(buf + at, translate);
+    CLEAR_CPU(buf + at, xlat);
+    CLEAR_CPU(buf + at, xlat_blocks);
+    CLEAR_CPU(buf + at, xlat_insns);
+    CLEAR_CPU(buf + at, ff_insns);
+    at += sizeof(mcs51_t) - CPU_STATE;
+    memcpy(buf + at, b->cpu.xram, h.xram);
+    at += h.xram;
+
+    clear_dev(&lcd.dev);
+    clear_dev(&adc.dev);
+    adc.input = NULL;
+    adc.on_convert = NULL;
+    adc.on_convert_ctx = NULL;
+    adc.on_sample = NULL;
+    adc.on_sample_ctx = NULL;
+    memcpy(buf + at, &lcd, sizeof(lcd));
+    at += sizeof(lcd);
+    memcpy(buf + at, &adc, sizeof(adc));
+    return n;
+}
+
+int board_restore(board_t *b, const uint8_t *buf, size_t len, char *err, int errlen)
+{
+    mcs51_t *c = &b->cpu;
+    uint8_t keep[sizeof(mcs51_t) - CPU_STATE];
+    hd44780_t lcd;
+    adc0804_t adc;
+    state_hdr_t h;
+    size_t at = sizeof(h);
+    sim_dev_t *d;
+
+    if (len >= sizeof(h))
+        memcpy(&h, buf, sizeof(h));
+    if (len < sizeof(h) || h.magic != STATE_MAGIC || h.cpu != sizeof(mcs51_t) ||
+        h.lcd != sizeof(hd44780_t) || h.adc != sizeof(adc0804_t) || h.xram > sizeof(c->xram) ||
+        len != sizeof(h) + (sizeof(mcs51_t) - CPU_STATE) + h.xram + sizeof(lcd) + sizeof(adc))
+    {
+        snprintf(err, errlen, "machine state is damaged or from another simulator build");
+        return -1;
+    }
+
+    // Host-side fields of the live CPU survive the copy
+    memcpy(keep, (uint8_t *)c + CPU_STATE, sizeof(keep));
+    memcpy((uint8_t *)c + CPU_STATE, buf + at, sizeof(keep));
+    at += sizeof(keep);
+#define KEEP_CPU(field) \
+    memcpy(&c->field, keep + offsetof(mcs51_t, field) - CPU_STATE, sizeof(c->field))
+    KEEP_CPU(devs);
+    KEEP_CPU(on_insn);
+    KEEP_CPU(on_insn_ctx);
+    KEEP_CPU(on_drive);
+    KEEP_CPU(on_drive_ctx);
+    KEEP_CPU(translate);
+    KEEP_CPU(xlat);
+    KEEP_CPU(xlat_blocks);
+    KEEP_CPU(xlat_insns);
+    KEEP_CPU(ff_insns);
+#undef KEEP_CPU
+    memset(c->xram, 0, sizeof(c->xram));
+    memcpy(c->xram, buf + at, h.xram);
+    at += h.xram;
+
+    // Device models: state from the buffer, wiring and hooks from the live ones
+    memcpy(&lcd, buf + at, sizeof(lcd));
+    at += sizeof(lcd);
+    memcpy(&adc, buf + at, sizeof(adc));
+    keep_dev(&lcd.dev, &b->lcd.dev);
+    keep_dev(&adc.dev, &b->adc.dev);
+    adc.input = b->adc.input;
+    adc.on_convert = b->adc.on_convert;
+    adc.on_convert_ctx = b->adc.on_convert_ctx;
+    adc.on_sample = b->adc.on_sample;
+    adc.on_sample_ctx = b->adc.on_sample_ctx;
+    b->lcd = lcd;
+    b->adc = adc;
+
+    c->next_event = MCS51_NEVER;
+    for (d = c->devs; d; d = d->link)
+    {
+        if (d->next < c->next_event)
+            c->next_event = d->next;
+    }
+    return 0;
+}
+
+uint64_t board_hash(const uint8_t *p, size_t n)
+{
+    uint64_t h = 0xCBF29CE484222325ull;
+
+    while (n--)
+    {
+        h ^= *p++;
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+/************************************************************
+ * Snapshot files
+ *
+ * "S51S", u32 fosc, u64 hash of the program memory, u32
+ * length + board_save() state, u32 length + wheel model (0
+ * when the wheel was not attached). Sizes tie a snapshot to
+ * the simulator build, like board_save().
+ ************************************************************/
+
+#define SNAP_MAGIC      "S51S"
+
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+int board_snapshot_save(const board_t *b, const char *path, char *err, int errlen)
+{
+    uint8_t head[16], len[4];
+    uint64_t hash = board_hash(b->cpu.code, sizeof(b->cpu.code));
+    size_t n = board_save(b, NULL, 0);
+    uint8_t *state = malloc(n);
+    wheel_t w = b->wheel;
+    FILE *f;
+    int i, rc;
+
+    if (!state)
+    {
+        snprintf(err, errlen, "out of memory");
+        return -1;
+    }
+    board_save(b, state, n);
+    f = fopen(path, "wb");
+    if (!f)
+    {
+        free(state);
+        snprintf(err, errlen, "cannot create %s", path);
+        return -1;
+    }
+
+    // Only the generator state; profile and wiring belong to the run that loads it
+    w.profile = NULL;
+    clear_dev(&w.dev);
+
+    memcpy(head, SNAP_MAGIC, 4);
+    put_u32(head + 4, b->cpu.fosc);
+    for (i = 0; i < 8; i++)
+        head[8 + i] = (uint8_t)(hash >> (8 * i));
+    fwrite(head, 1, sizeof(head), f);
+    put_u32(len, (uint32_t)n);
+    fwrite(len, 1, 4, f);
+    fwrite(state, 1, n, f);
+    put_u32(len, b->has_wheel ? (uint32_t)sizeof(w) : 0);
+    fwrite(len, 1, 4, f);
+    if (b->has_wheel)
+        fwrite(&w, 1, sizeof(w), f);
+    free(state);
+
+    rc = ferror(f) ? -1 : 0;
+    if (fclose(f))
+        rc = -1;
+    if (rc)
+        snprintf(err, errlen, "error writing %s", path);
+    return rc;
+}
+
+int board_snapshot_load(board_t *b, const char *path, char *err, int errlen)
+{
+    mcs51_t *c = &b->cpu;
+    FILE *f = fopen(path, "rb");
+    uint8_t head[16], len[4], *state = NULL;
+    uint64_t hash = 0;
+    uint32_t n;
+    wheel_t w;
+    int i, has_wheel;
+
+    if (!f)
+    {
+        snprintf(err, errlen, "cannot open snapshot %s", path);
+        return -1;
+    }
+    if (fread(head, 1, sizeof(head), f) != sizeof(head) || memcmp(head, SNAP_MAGIC, 4) ||
+        fread(len, 1, 4, f) != 4 || !(state = malloc((n = get_u32(len)) ? n : 1)) ||
+        fread(state, 1, n, f) != n || fread(len, 1, 4, f) != 4 ||
+        (get_u32(len) != 0 && get_u32(len) != sizeof(w)) ||
+        ((has_wheel = get_u32(len) != 0) && fread(&w, 1, sizeof(w), f) != sizeof(w)))
+    {
+        snprintf(err, errlen, "%s is not a snapshot of this simulator build", path);
+        goto fail;
+    }
+    for (i = 0; i < 8; i++)
+        hash |= (uint64_t)head[8 + i] << (8 * i);
+    if (get_u32(head + 4) != c->fosc)
+    {
+        snprintf(err, errlen, "%s was taken at %u Hz", path, get_u32(head + 4));
+        goto fail;
+    }
+    if (hash != board_hash(c->code, sizeof(c->code)))
+    {
+        snprintf(err, errlen, "%s was taken with another image", path);
+        goto fail;
+    }
+    if (board_restore(b, state, n, err, errlen))
+        goto fail;
+    fclose(f);
+    free(state);
+
+    if (b->has_wheel && has_wheel)
+    {
+        // Generator state from the snapshot, profile and sensor settings from this run
+        w.profile = b->wheel.profile;
+        w.circumference = b->wheel.circumference;
+        w.pulses_per_rev = b->wheel.pulses_per_rev;
+        w.jitter = b->wheel.jitter;
+        w.dropout = b->wheel.dropout;
+        keep_dev(&w.dev, &b->wheel.dev);
+        b->wheel = w;
+        mcs51_schedule(c, &b->wheel.dev, b->wheel.dev.next);
+    }
+    else if (b->has_wheel)
+    {
+        // New wheel: starts moving from here
+        b->wheel.last_t = mcs51_seconds(c, c->cycles);
+        mcs51_schedule(c, &b->wheel.dev, c->cycles);
+    }
+    else if (has_wheel && w.low)
+    {
+        // Wheel left out: end the pulse it was sending
+        mcs51_drive(c, 3, 0x20, 0x20);
+    }
+    return 0;
+
+fail:
+    fclose(f);
+    free(state);
+    return -1;
+}
+
+void board_close(board_t *b)
+{
+    mcs51_free(&b->cpu);
+    wave_close(&b->adc_wave);
+    if (b->has_wheel)
+        wave_close(&b->wheel_wave);
+}
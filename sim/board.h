@@ -0,0 +1,73 @@
+/************************************************************
+ * board.h - the cluster board as seen by the firmware
+ *
+ * One AT89C51 with the devices wired as in the Proteus
+ * schematic: HD44780 on P2, ADC0804 on P1/P2.1/P3.6/P3.7
+ * fed from a waveform, and optionally the wheel sensor on
+ * T1 (P3.5). Used by sim8051 and the scenario runner so the
+ * wiring lives in one place.
+ ************************************************************/
+
+#ifndef BOARD_H
+#define BOARD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mcs51.h"
+#include "ihex.h"
+#include "hd44780.h"
+#include "adc0804.h"
+#include "wheel.h"
+
+typedef struct
+{
+    mcs51_t cpu;
+    hd44780_t lcd;
+    adc0804_t adc;
+    wave_t adc_wave;
+    wheel_t wheel;
+    wave_t wheel_wave;
+    int has_wheel;
+    ihex_info_t image;
+} board_t;
+
+// Resets the CPU and attaches the LCD and the ADC (0.25 V input)
+void board_init(board_t *b, uint32_t fosc);
+
+// Loads an Intel HEX image into program memory
+int board_load(board_t *b, const char *path, char *err, int errlen);
+
+// ADC input: constant voltage, or a CSV series replayed 'speed' times faster
+void board_adc_volts(board_t *b, double volts);
+int board_adc_file(board_t *b, const char *path, double speed, char *err, int errlen);
+
+// Wheel pulses from a built-in drive cycle, a seconds,kmh CSV or a
+// constant speed given as a number (km/h)
+int board_wheel(board_t *b, const char *profile, int loop, uint64_t seed, char *err, int errlen);
+
+// LED on P3.0 (1 = lit)
+int board_led(const board_t *b);
+
+// Machine state: CPU (without the program image), LCD and ADC models.
+// Host-side pointers, hooks and statistics are left out, so equal states
+// give equal bytes. Returns the size; the state is written only if it fits.
+size_t board_save(const board_t *b, uint8_t *buf, size_t cap);
+
+// Restores a state saved by the same build; hooks and devices stay attached.
+// Returns 0 or -1 with a message in err.
+int board_restore(board_t *b, const uint8_t *buf, size_t len, char *err, int errlen);
+
+// FNV-1a of a buffer (program memory, saved states)
+uint64_t board_hash(const uint8_t *p, size_t n);
+
+// Snapshot file: the machine state plus the wheel generator, for runs
+// that continue from it with the same or other inputs. Load after
+// board_load() and the input setup; the image must be the same and the
+// wheel keeps this run's profile and sensor settings. Return 0 or -1.
+int board_snapshot_save(const board_t *b, const char *path, char *err, int errlen);
+int board_snapshot_load(board_t *b, const char *path, char *err, int errlen);
+
+void board_close(board_t *b);
+
+#endif
@@ -0,0 +1,197 @@
+/************************************************************
+ * cluster_host.c - cluster logic on the host HAL backend
+ *
+ * Builds cluster.c natively with hal_host.c and drives it at
+ * full host speed: one button press, a constant temperature
+ * and wheel speed, optionally repeated for many independent
+ * sessions. Handy as a perf/gprof target and as a smoke test
+ * that the logic still builds outside Keil.
+ *
+ *   cluster_host [options]
+ *     -t SEC      simulated time per session (default 20)
+ *     -n N        number of sessions (default 1)
+ *     --adc CODE  ADC reading, 10 mV per LSB (default 25)
+ *     --kmh K     wheel speed (default 36)
+ *     --telemetry FILE
+ *                 save the UART telemetry stream (needs a
+ *                 build with -DTELEM=1)
+ *     --cmd LINE  send a tuning command, repeatable; one goes
+ *                 out every 100 ms from 0.5 s and the replies
+ *                 are printed (needs -DTUNE=1)
+ *     --page N    press the page button N times, every 100 ms
+ *                 from 0.3 s, so the display ends on page N
+ *                 (mod 4); a press that acknowledges a warning
+ *                 does not turn the page
+ *
+ * The EEPROM keeps its contents from one session to the
+ * next, as it would across power cycles.
+ *
+ * stdlib.h stays out: it declares system(), which clashes
+ * with the firmware's power flag of the same name.
+ ************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "cluster.h"
+#include "telem.h"
+#include "tune.h"
+
+#define PRESS_TICK  10
+#define PAGE_TICK   30      // First --page press
+#define PAGE_GAP    10
+#define CMD_TICK    50      // First --cmd line
+#define CMD_GAP     10      // Ticks between --cmd lines
+#define MAX_CMDS    32
+
+static double pulses_per_tick, pulse_frac;
+static unsigned long passes;
+static FILE *telemetry;
+static const char *cmds[MAX_CMDS];
+static int ncmds;
+static unsigned long page_presses;
+static char reply[64];
+static int reply_len;
+
+static double now_wall(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void on_tick(void)
+{
+    if (hal_host.ticks == PRESS_TICK)
+        hal_host_press();
+    if (hal_host.ticks >= PAGE_TICK && (hal_host.ticks - PAGE_TICK) % PAGE_GAP == 0 &&
+        (hal_host.ticks - PAGE_TICK) / PAGE_GAP < page_presses)
+        hal_host_page();
+    if (hal_host.ticks >= CMD_TICK && (hal_host.ticks - CMD_TICK) % CMD_GAP == 0 &&
+        (hal_host.ticks - CMD_TICK) / CMD_GAP < (unsigned long)ncmds)
+    {
+        const char *p = cmds[(hal_host.ticks - CMD_TICK) / CMD_GAP];
+
+        printf("< %s\n", p);
+        while (*p)
+            hal_host_uart_rx((unsigned char)*p++);
+        hal_host_uart_rx('\r');
+    }
+    if (hal_host.counting)
+    {
+        pulse_frac += pulses_per_tick;
+        hal_host.pulses = (hal_host.pulses + (unsigned int)pulse_frac) & 0xFFFF;
+        pulse_frac -= (unsigned int)pulse_frac;
+    }
+}
+
+static void on_uart(unsigned char c)
+{
+    if (telemetry)
+        fputc(c, telemetry);
+    else if (c == '\n')
+    {
+        printf("> %.*s\n", reply_len, reply);
+        reply_len = 0;
+    }
+    else if (c != '\r' && reply_len < (int)sizeof(reply))
+        reply[reply_len++] = (char)c;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 20.0, kmh = 36.0, t0, wall;
+    unsigned long runs = 1, r, ticks;
+    const char *telemetry_path = NULL;
+    unsigned char eeprom[sizeof(hal_host.eeprom)];
+    int adc = 25, i;
+    char row1[HAL_LCD_COLS + 1], row2[HAL_LCD_COLS + 1];
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            sscanf(argv[++i], "%lf", &seconds);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            sscanf(argv[++i], "%lu", &runs);
+        else if (!strcmp(argv[i], "--adc") && i + 1 < argc)
+            sscanf(argv[++i], "%d", &adc);
+        else if (!strcmp(argv[i], "--kmh") && i + 1 < argc)
+            sscanf(argv[++i], "%lf", &kmh);
+        else if (!strcmp(argv[i], "--telemetry") && i + 1 < argc)
+            telemetry_path = argv[++i];
+        else if (!strcmp(argv[i], "--cmd") && i + 1 < argc && ncmds < MAX_CMDS)
+            cmds[ncmds++] = argv[++i];
+        else if (!strcmp(argv[i], "--page") && i + 1 < argc)
+            sscanf(argv[++i], "%lu", &page_presses);
+        else
+        {
+            fprintf(stderr, "usage: cluster_host [-t SEC] [-n N] [--adc CODE] [--kmh K] "
+                            "[--telemetry FILE] [--cmd LINE]... [--page N]\n");
+            return 2;
+        }
+    }
+    if (ncmds && !TUNE)
+    {
+        fprintf(stderr, "cluster_host: built without TUNE, rebuild with -DTUNE=1\n");
+        return 2;
+    }
+    if (telemetry_path)
+    {
+        if (!TELEM)
+        {
+            fprintf(stderr, "cluster_host: built without TELEM, rebuild with -DTELEM=1\n");
+            return 2;
+        }
+        telemetry = fopen(telemetry_path, "wb");
+        if (!telemetry)
+        {
+            fprintf(stderr, "cluster_host: cannot create %s\n", telemetry_path);
+            return 2;
+        }
+    }
+    ticks = (unsigned long)(seconds * 1000 / TICK_MS);
+    pulses_per_tick = kmh / 3.6 / WHEEL_CIRCUMFERENCE * PULSES_PER_REVOLUTION * TICK_MS / 1000;
+
+    hal_host_reset();
+    memcpy(eeprom, hal_host.eeprom, sizeof(eeprom));
+    t0 = now_wall();
+    for (r = 0; r < runs; r++)
+    {
+        hal_host_reset();
+        memcpy(hal_host.eeprom, eeprom, sizeof(eeprom));
+        cluster_init();
+        hal_host.adc = (unsigned char)adc;
+        hal_host.on_tick = on_tick;
+        hal_host.on_uart = telemetry || ncmds ? on_uart : NULL;
+        pulse_frac = 0;
+        hal_init();
+        telem_init();
+        tune_init();
+        while (hal_host.ticks < ticks)
+            power_step();
+        passes += hal_host.adc_reads;
+        memcpy(eeprom, hal_host.eeprom, sizeof(eeprom));
+    }
+    wall = now_wall() - t0;
+
+    hal_host_row(1, row1);
+    hal_host_row(2, row2);
+    printf("+----------------+\n|%s|\n|%s|\n+----------------+\n", row1, row2);
+    printf("state %u  fuel %u  temp %u  count %u  led %u\n", pwr_state, fuel, temp, count,
+           hal_host.led);
+    printf("%lu sessions, %lu cluster passes, %.3f s wall (%.0f passes/s, %.0fx real time)\n",
+           runs, passes, wall, wall > 0 ? passes / wall : 0.0,
+           wall > 0 ? runs * seconds / wall : 0.0);
+    if (telemetry)
+    {
+        printf("telemetry %ld bytes to %s\n", ftell(telemetry), telemetry_path);
+        if (fclose(telemetry))
+        {
+            fprintf(stderr, "cluster_host: cannot write %s\n", telemetry_path);
+            return 1;
+        }
+    }
+    return 0;
+}
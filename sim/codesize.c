@@ -0,0 +1,313 @@
+/************************************************************
+ * codesize.c - code size report and IROM budget check
+ *
+ * Reads the Intel HEX image together with the Keil BL51 or
+ * SDCC map of the same build and attributes every code byte
+ * to a function, a module's constants (strings), a run-time
+ * library routine (float, division, multiplication helpers),
+ * startup code or the interrupt vectors. Prints the items
+ * sorted by size and the totals per category.
+ *
+ *   codesize [options] [Main.hex]
+ *     --map FILE   Keil .m51 or SDCC .map of the image
+ *     --irom N     on-chip code size (default 4096, IROM(0-0xFFF))
+ *     --budget P   fail above P percent of IROM (default 100)
+ *     -n N         list only the N largest items
+ *
+ * Exit status is 1 when the image uses more than the budget
+ * or has code at or above the IROM size, so it can run as a
+ * post-build step. Without --map only the totals are checked.
+ ************************************************************/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ihex.h"
+#include "symmap.h"
+
+#define MAX_ITEMS   512
+#define ITEM_NAME   (2 * SYM_NAME_MAX + 4)     // "function (module)"
+
+// Categories, in report order
+#define CAT_FUNC        0
+#define CAT_CONST       1
+#define CAT_LIB_FLOAT   2
+#define CAT_LIB_DIV     3
+#define CAT_LIB_MUL     4
+#define CAT_LIB         5
+#define CAT_START       6
+#define CAT_VECTORS     7
+#define CAT_OTHER       8
+#define CAT_UNKNOWN     9
+#define CAT_COUNT       10
+
+static const char *cat_names[CAT_COUNT] =
+{
+    "function", "constants", "lib float", "lib divide", "lib multiply", "lib other",
+    "startup", "vectors", "other", "unattributed"
+};
+
+typedef struct
+{
+    char name[ITEM_NAME];
+    int cat;
+    unsigned base, size;
+} item_t;
+
+typedef struct
+{
+    item_t item[MAX_ITEMS];
+    int n;
+} report_t;
+
+static uint8_t code[65536], used[65536];
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: codesize [options] [image.hex]\n"
+        "  --map FILE   Keil .m51 or SDCC .map of the image\n"
+        "  --irom N     on-chip code size (default 4096)\n"
+        "  --budget P   fail above P percent of IROM (default 100)\n"
+        "  -n N         list only the N largest items\n");
+    exit(2);
+}
+
+// Counts image bytes in [base, base + size)
+static unsigned used_in(unsigned base, unsigned size)
+{
+    unsigned a, n = 0;
+
+    for (a = base; a < base + size && a < sizeof(used); a++)
+        n += used[a];
+    return n;
+}
+
+static void add_item(report_t *r, const char *name, int cat, unsigned base, unsigned size)
+{
+    item_t *it;
+
+    if (!size || r->n == MAX_ITEMS)
+        return;
+    it = &r->item[r->n++];
+    snprintf(it->name, sizeof(it->name), "%s", name);
+    it->cat = cat;
+    it->base = base;
+    it->size = size;
+}
+
+// Library routine category from its name (Keil ?C?FPADD, SDCC __fsadd / _divuint)
+static int lib_cat(const char *name)
+{
+    char u[SYM_NAME_MAX];
+    const char *p = name;
+    int i;
+
+    if (!strncmp(p, "?C?", 3))
+        p += 3;
+    while (*p == '_')
+        p++;
+    for (i = 0; p[i] && i < (int)sizeof(u) - 1; i++)
+        u[i] = (char)toupper((unsigned char)p[i]);
+    u[i] = '\0';
+
+    if (!strncmp(u, "FP", 2) || !strncmp(u, "FC", 2) || !strncmp(u, "FS", 2) ||
+        strstr(u, "CASTF") || strstr(u, "2FS") || strstr(u, "FS2"))
+        return CAT_LIB_FLOAT;
+    if (strstr(u, "DIV") || strstr(u, "MOD"))
+        return CAT_LIB_DIV;
+    if (strstr(u, "MUL"))
+        return CAT_LIB_MUL;
+    return CAT_LIB;
+}
+
+static int cmp_addr(const void *a, const void *b)
+{
+    const sym_t *x = *(const sym_t * const *)a, *y = *(const sym_t * const *)b;
+
+    return (int)x->addr - (int)y->addr;
+}
+
+// Splits a segment into pieces at the code symbols inside it
+static void split_segment(report_t *r, const symmap_t *m, const symseg_t *g, int lib)
+{
+    const sym_t *in[MAX_ITEMS];
+    unsigned end = (unsigned)g->base + g->length, start = g->base;
+    int n = 0, i;
+
+    for (i = 0; i < m->n && n < MAX_ITEMS; i++)
+    {
+        const sym_t *s = &m->sym[i];
+
+        if (s->space == SYM_CODE && s->global && s->addr >= g->base && s->addr < end)
+            in[n++] = s;
+    }
+    qsort(in, n, sizeof(in[0]), cmp_addr);
+    if (n && in[0]->addr > start)
+        add_item(r, lib ? "(library)" : g->name, lib ? CAT_LIB : CAT_OTHER, start,
+                 used_in(start, in[0]->addr - start));
+    for (i = 0; i < n; i++)
+    {
+        unsigned next = i + 1 < n ? in[i + 1]->addr : end;
+        const char *name = in[i]->name;
+        int cat = CAT_FUNC;
+
+        if (i + 1 < n && in[i + 1]->addr == in[i]->addr)
+            continue;   // Alias at the same address: the last one takes the bytes
+
+        // SDCC: user functions were _name, library helpers __name
+        if (lib || name[0] == '_')
+            cat = lib_cat(name);
+        add_item(r, name, cat, in[i]->addr, used_in(in[i]->addr, next - in[i]->addr));
+    }
+    if (!n)
+        add_item(r, g->name, lib ? CAT_LIB : CAT_OTHER, start, used_in(start, g->length));
+}
+
+static void attribute(report_t *r, const symmap_t *m)
+{
+    char name[ITEM_NAME], *c;
+    int i;
+
+    for (i = 0; i < m->nseg; i++)
+    {
+        const symseg_t *g = &m->seg[i];
+        unsigned size = used_in(g->base, g->length);
+
+        if (g->space != SYM_CODE)
+            continue;
+        switch (g->kind)
+        {
+            case SEG_FUNC:
+                // Keil upper-cases names; report the C spelling and module
+                snprintf(name, sizeof(name), "%s (%s)", g->name[0] == '_' ? g->name + 1 : g->name,
+                         g->module);
+                for (c = name; *c; c++)
+                    *c = (char)tolower((unsigned char)*c);
+                add_item(r, name, CAT_FUNC, g->base, size);
+                break;
+            case SEG_CONST:
+                snprintf(name, sizeof(name), "%s", g->module[0] ? g->module : g->name);
+                for (c = name; *c; c++)
+                    *c = (char)tolower((unsigned char)*c);
+                add_item(r, name, CAT_CONST, g->base, size);
+                break;
+            case SEG_LIB:
+                split_segment(r, m, g, 1);
+                break;
+            case SEG_AREA:
+                split_segment(r, m, g, 0);
+                break;
+            case SEG_START:
+                add_item(r, g->name, CAT_START, g->base, size);
+                break;
+            case SEG_ABS:
+                add_item(r, g->name, CAT_VECTORS, g->base, size);
+                break;
+            default:
+                add_item(r, g->name, CAT_OTHER, g->base, size);
+                break;
+        }
+    }
+}
+
+static int cmp_size(const void *a, const void *b)
+{
+    const item_t *x = a, *y = b;
+
+    if (x->size != y->size)
+        return x->size < y->size ? 1 : -1;
+    return strcmp(x->name, y->name);
+}
+
+int main(int argc, char **argv)
+{
+    static report_t rep;
+    symmap_t map;
+    ihex_info_t info;
+    const char *image = "Main.hex", *map_path = NULL;
+    unsigned irom = 4096, total = 0, above = 0, limit, attributed = 0, a;
+    unsigned cat_total[CAT_COUNT] = { 0 };
+    double budget = 100.0;
+    char err[256];
+    int i, top = -1, over;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--map") && i + 1 < argc)
+            map_path = argv[++i];
+        else if (!strcmp(argv[i], "--irom") && i + 1 < argc)
+            irom = (unsigned)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--budget") && i + 1 < argc)
+            budget = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            top = atoi(argv[++i]);
+        else if (argv[i][0] == '-')
+            usage();
+        else
+            image = argv[i];
+    }
+    if (irom == 0 || irom > sizeof(code) || budget <= 0)
+        usage();
+
+    if (ihex_load(image, code, sizeof(code), used, &info, err, sizeof(err)))
+    {
+        fprintf(stderr, "codesize: %s\n", err);
+        return 2;
+    }
+    for (a = 0; a < sizeof(used); a++)
+    {
+        total += used[a];
+        if (used[a] && a >= irom)
+            above++;
+    }
+
+    if (map_path)
+    {
+        if (symmap_load(&map, map_path, err, sizeof(err)))
+        {
+            fprintf(stderr, "codesize: %s\n", err);
+            return 2;
+        }
+        attribute(&rep, &map);
+        symmap_free(&map);
+
+        for (i = 0; i < rep.n; i++)
+            attributed += rep.item[i].size;
+        if (attributed < total)
+            add_item(&rep, "(not in the map)", CAT_UNKNOWN, 0, total - attributed);
+        qsort(rep.item, rep.n, sizeof(rep.item[0]), cmp_size);
+
+        printf("%6s %7s  %-12s %-6s %s\n", "bytes", "%irom", "category", "addr", "name");
+        for (i = 0; i < rep.n && (top < 0 || i < top); i++)
+        {
+            const item_t *it = &rep.item[i];
+
+            printf("%6u %6.1f%%  %-12s ", it->size, 100.0 * it->size / irom, cat_names[it->cat]);
+            if (it->cat == CAT_UNKNOWN)
+                printf("%-6s %s\n", "-", it->name);
+            else
+                printf("%04XH  %s\n", it->base, it->name);
+        }
+        for (i = 0; i < rep.n; i++)
+            cat_total[rep.item[i].cat] += rep.item[i].size;
+        printf("\n");
+        for (i = 0; i < CAT_COUNT; i++)
+        {
+            if (cat_total[i])
+                printf("%6u %6.1f%%  %s\n", cat_total[i], 100.0 * cat_total[i] / irom, cat_names[i]);
+        }
+        printf("\n");
+    }
+
+    limit = (unsigned)(irom * budget / 100.0);
+    over = total > limit || above;
+    printf("%s: %u bytes of code in 0x%04X-0x%04X, %.1f%% of %u bytes IROM, budget %.0f%% (%u bytes): %s\n",
+           image, total, info.lo, info.hi ? info.hi - 1 : 0, 100.0 * total / irom, irom, budget, limit,
+           over ? "OVER" : "ok");
+    if (above)
+        printf("%u bytes at or above IROM end 0x%04X\n", above, irom);
+    return over ? 1 : 0;
+}
@@ -0,0 +1,672 @@
+/************************************************************
+ * collect.c - telemetry collector and store queries
+ *
+ * Ingest: reads the telemetry streams of any number of
+ * clusters, each from a file (cluster_host --telemetry,
+ * sim8051 --uart), a pipe, or a serial port, and appends
+ * each vehicle's rows to DIR/NAME.tsc (see tstore.h).
+ * Sources are read without blocking from one loop, so one
+ * slow port does not hold up the others.
+ *
+ *   collect [options] [NAME=]SOURCE...
+ *     -d DIR        directory of the stores, created if missing
+ *                   (default .)
+ *     --period MS   time between frames (default TELEM_TICKS ticks)
+ *     --start SEC   time of the first frame of a file (default 0)
+ *     --follow      keep reading files past their end
+ *     --baud N      serial speed (default 187500)
+ *     --span SEC    longest time one block covers (default 3600)
+ *     --flush SEC   write partial blocks of live sources this often
+ *                   (default 60)
+ *
+ * NAME defaults to the file name without its extension; "-"
+ * is standard input. Frames carry no time, so a row's time
+ * is the start of its source plus the frame index times the
+ * period: files start at --start, live sources (serial ports,
+ * pipes, --follow) at the wall clock when opened. Lost
+ * frames advance the index, so gaps stay gaps in time.
+ * SIGINT or SIGTERM write what is buffered and stop.
+ *
+ * Query: answers per-bucket questions from a store, reading
+ * only block headers for blocks inside one bucket.
+ *
+ *   collect -q FILE [options]
+ *     -f FIELDS     comma-separated fields (default temp,fuel)
+ *     --bucket SEC  bucket length (default 3600)
+ *     --from SEC    first time to include
+ *     --to SEC      end of the range (exclusive)
+ *
+ * Prints min, max, mean and the least squares slope per hour
+ * of each field for each bucket.
+ ************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+#endif
+
+#include "hal.h"
+#include "tframe.h"
+#include "tstore.h"
+
+#define MAX_SOURCES     256
+#define NAME_MAX_LEN    64
+#define PATH_MAX_LEN    4096
+#define READ_CHUNK      65536
+#define IDLE_MS         100
+
+typedef struct
+{
+    char name[NAME_MAX_LEN];
+    const char *path;
+    int fd;
+    int live;                   // Waits for more data instead of ending
+    int regular;                // Regular file: poll() cannot wait on it
+    int done;
+    int64_t start, period;      // ms
+    uint64_t lost;              // d.lost already passed to the store
+    tframe_t d;
+    tstore_t s;
+} source_t;
+
+static volatile sig_atomic_t stop;
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: collect [options] [NAME=]SOURCE...\n"
+        "       collect -q FILE [query options]\n"
+        "  -d DIR        directory of the stores (default .)\n"
+        "  --period MS   time between frames (default %d)\n"
+        "  --start SEC   time of the first frame of a file (default 0)\n"
+        "  --follow      keep reading files past their end\n"
+        "  --baud N      serial speed (default 187500)\n"
+        "  --span SEC    longest time one block covers (default 3600)\n"
+        "  --flush SEC   write partial blocks of live sources this often (default 60)\n"
+        "query options:\n"
+        "  -f FIELDS     comma-separated fields (default temp,fuel)\n"
+        "  --bucket SEC  bucket length (default 3600)\n"
+        "  --from SEC    first time to include\n"
+        "  --to SEC      end of the range (exclusive)\n",
+        TELEM_TICKS * TICK_MS);
+    exit(2);
+}
+
+static double now_wall(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Creates DIR and any missing parents, as mkdir -p
+static int make_dir(const char *dir)
+{
+    char path[PATH_MAX_LEN], *p;
+    struct stat st;
+
+    if (strlen(dir) >= sizeof(path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(path, dir);
+    for (p = path + 1; *p; p++)
+    {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(path, 0777) && errno != EEXIST)
+            return -1;
+        *p = '/';
+    }
+    if (mkdir(path, 0777) && errno != EEXIST)
+        return -1;
+    if (stat(path, &st))
+        return -1;
+    if (!S_ISDIR(st.st_mode))
+    {
+        errno = ENOTDIR;
+        return -1;
+    }
+    return 0;
+}
+
+static void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+/************************************************************
+ * Sources
+ ************************************************************/
+
+// Raw 8N1 at any rate; telem.h's 187500 baud is not a B* constant
+static int serial_setup(int fd, int baud)
+{
+#ifdef __linux__
+    struct termios2 t;
+
+    if (ioctl(fd, TCGETS2, &t))
+        return -1;
+    t.c_iflag = 0;
+    t.c_oflag = 0;
+    t.c_lflag = 0;
+    t.c_cflag = BOTHER | CS8 | CREAD | CLOCAL;
+    t.c_ispeed = t.c_ospeed = baud;
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 0;
+    return ioctl(fd, TCSETS2, &t);
+#else
+    (void)fd;
+    (void)baud;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+static void on_row(void *ctx, uint64_t index, const int32_t *val)
+{
+    source_t *src = ctx;
+    tstore_row_t r;
+
+    if (src->d.lost != src->lost)
+    {
+        tstore_lost(&src->s, (uint32_t)(src->d.lost - src->lost));
+        src->lost = src->d.lost;
+    }
+    r.t = src->start + (int64_t)index * src->period;
+    memcpy(r.v, val, sizeof(r.v));
+    if (tstore_add(&src->s, &r))
+    {
+        fprintf(stderr, "collect: %s: cannot write the store\n", src->name);
+        stop = 1;
+    }
+}
+
+static int open_source(source_t *src, const char *arg, const char *dir, int follow, int baud,
+                       int64_t start, int64_t period, int64_t span)
+{
+    const char *eq = strchr(arg, '='), *base, *dot;
+    char path[PATH_MAX_LEN], err[256];
+    struct stat st;
+    size_t n;
+
+    memset(src, 0, sizeof(*src));
+    if (eq)
+    {
+        n = (size_t)(eq - arg);
+        src->path = eq + 1;
+        base = arg;
+    }
+    else
+    {
+        src->path = arg;
+        base = strrchr(arg, '/') ? strrchr(arg, '/') + 1 : arg;
+        dot = strrchr(base, '.');
+        n = dot && dot != base ? (size_t)(dot - base) : strlen(base);
+        if (!strcmp(arg, "-"))
+        {
+            base = "stdin";
+            n = 5;
+        }
+    }
+    if (n == 0 || n >= NAME_MAX_LEN || memchr(base, '/', n))
+    {
+        fprintf(stderr, "collect: bad vehicle name in %s\n", arg);
+        return -1;
+    }
+    memcpy(src->name, base, n);
+
+    src->fd = strcmp(src->path, "-") ? open(src->path, O_RDONLY | O_NOCTTY | O_NONBLOCK) : 0;
+    if (src->fd < 0 || fstat(src->fd, &st))
+    {
+        fprintf(stderr, "collect: cannot open %s: %s\n", src->path, strerror(errno));
+        return -1;
+    }
+    src->regular = S_ISREG(st.st_mode);
+    if (isatty(src->fd))
+    {
+        if (serial_setup(src->fd, baud))
+        {
+            fprintf(stderr, "collect: cannot set %s to %d baud: %s\n", src->path, baud,
+                    strerror(errno));
+            return -1;
+        }
+        src->live = 1;
+    }
+    else if (!src->regular)
+    {
+        fcntl(src->fd, F_SETFL, fcntl(src->fd, F_GETFL) | O_NONBLOCK);
+        src->live = 1;
+    }
+    else
+        src->live = follow;
+    src->start = src->live ? now_ms() : start;
+    src->period = period;
+
+    snprintf(path, sizeof(path), "%s/%s.tsc", dir, src->name);
+    if (tstore_open(&src->s, path, span, err, sizeof(err)))
+    {
+        fprintf(stderr, "collect: %s\n", err);
+        return -1;
+    }
+    tframe_init(&src->d, on_row, src);
+    return 0;
+}
+
+// Reads what a source has; returns 1 when bytes came in
+static int read_source(source_t *src, uint8_t *buf)
+{
+    ssize_t n = read(src->fd, buf, READ_CHUNK);
+
+    if (n > 0)
+    {
+        tframe_feed(&src->d, buf, (size_t)n);
+        return 1;
+    }
+    if (n < 0 && (errno == EAGAIN || errno == EINTR))
+        return 0;
+    if (n < 0)
+        fprintf(stderr, "collect: %s: %s\n", src->path, strerror(errno));
+    // A serial port with no data reads 0 bytes; a file may grow
+    if (n < 0 || !(src->live && (src->regular || isatty(src->fd))))
+        src->done = 1;
+    return 0;
+}
+
+static int ingest(source_t *src, int n, double flush_s)
+{
+    static uint8_t buf[READ_CHUNK];
+    struct pollfd pfd[MAX_SOURCES];
+    double wall = now_wall(), last_flush = wall;
+    uint64_t frames = 0, rows = 0, bytes = 0;
+    int i, active = n, failed = 0;
+
+    while (!stop && active > 0)
+    {
+        int got = 0, np = 0;
+
+        for (i = 0; i < n && !stop; i++)
+            if (!src[i].done)
+            {
+                got |= read_source(&src[i], buf);
+                if (src[i].done)
+                    active--;
+            }
+        if (now_wall() - last_flush >= flush_s)
+        {
+            for (i = 0; i < n; i++)
+                if (src[i].live && tstore_flush(&src[i].s))
+                    stop = failed = 1;
+            last_flush = now_wall();
+        }
+        if (got || stop || active == 0)
+            continue;
+
+        // Nothing came in: wait for the ports and pipes, or a while for files
+        for (i = 0; i < n; i++)
+            if (!src[i].done && !src[i].regular)
+            {
+                pfd[np].fd = src[i].fd;
+                pfd[np].events = POLLIN;
+                np++;
+            }
+        poll(pfd, np, IDLE_MS);
+    }
+    wall = now_wall() - wall;
+
+    printf("%-16s %10s %8s %8s %6s %6s %8s %5s %5s %7s %10s\n", "vehicle", "bytes", "frames",
+           "rows", "bad", "lost", "unsynced", "dups", "boots", "blocks", "stored");
+    for (i = 0; i < n; i++)
+    {
+        source_t *s = &src[i];
+
+        if (tstore_close(&s->s))
+        {
+            fprintf(stderr, "collect: %s: cannot write the store\n", s->name);
+            failed = 1;
+        }
+        if (s->fd > 0)
+            close(s->fd);
+        printf("%-16s %10llu %8llu %8llu %6llu %6llu %8llu %5llu %5llu %7llu %10llu\n", s->name,
+               (unsigned long long)s->d.bytes, (unsigned long long)s->d.frames,
+               (unsigned long long)s->d.rows, (unsigned long long)s->d.bad,
+               (unsigned long long)s->d.lost, (unsigned long long)s->d.unsynced,
+               (unsigned long long)s->d.dups, (unsigned long long)s->d.restarts,
+               (unsigned long long)s->s.blocks, (unsigned long long)s->s.bytes);
+        frames += s->d.frames;
+        rows += s->d.rows;
+        bytes += s->s.bytes;
+    }
+    printf("%llu frames, %llu rows in %.2f s: %.0f frames/s; %.2f bytes per row stored\n",
+           (unsigned long long)frames, (unsigned long long)rows, wall,
+           wall > 0 ? frames / wall : 0.0, rows ? (double)bytes / rows : 0.0);
+    return failed;
+}
+
+/************************************************************
+ * Queries
+ ************************************************************/
+
+typedef struct
+{
+    int32_t min, max;
+    double sv, stv;
+} acc_field_t;
+
+// Sums are taken with t in seconds from the bucket start
+typedef struct
+{
+    uint64_t n;
+    double st, stt;
+    acc_field_t f[TSTORE_FIELDS];
+} bucket_t;
+
+static void acc_block(bucket_t *k, const tstore_block_t *b, double dt0, const int *fields, int nf)
+{
+    int i;
+
+    for (i = 0; i < nf; i++)
+    {
+        const tstore_col_t *c = &b->col[fields[i]];
+        acc_field_t *a = &k->f[fields[i]];
+
+        if (k->n == 0 || c->min < a->min)
+            a->min = c->min;
+        if (k->n == 0 || c->max > a->max)
+            a->max = c->max;
+        a->sv += (double)c->sum;
+        a->stv += c->sum_tv + dt0 * (double)c->sum;
+    }
+    k->stt += b->sum_tt + 2 * dt0 * b->sum_t + b->rows * dt0 * dt0;
+    k->st += b->sum_t + b->rows * dt0;
+    k->n += b->rows;
+}
+
+static void acc_row(bucket_t *k, double t, const int64_t *const *col, int row, const int *fields,
+                    int nf)
+{
+    int i;
+
+    for (i = 0; i < nf; i++)
+    {
+        int32_t v = (int32_t)col[i][row];
+        acc_field_t *a = &k->f[fields[i]];
+
+        if (k->n == 0 || v < a->min)
+            a->min = v;
+        if (k->n == 0 || v > a->max)
+            a->max = v;
+        a->sv += v;
+        a->stv += t * v;
+    }
+    k->st += t;
+    k->stt += t * t;
+    k->n++;
+}
+
+static void print_time(int64_t ms)
+{
+    time_t s = (time_t)(ms / 1000);
+    char buf[32];
+
+    // Wall clock times as UTC, simulated ones as seconds
+    if (s >= 1000000000)
+    {
+        strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime(&s));
+        printf("%20s", buf);
+    }
+    else
+        printf("%20lld", (long long)s);
+}
+
+static int query(const char *path, const int *fields, int nf, int64_t bucket, int64_t from,
+                 int64_t to)
+{
+    static int64_t tcol[TSTORE_BLOCK_ROWS], vcol[TSTORE_FIELDS][TSTORE_BLOCK_ROWS];
+    const int64_t *cols[TSTORE_FIELDS];
+    tstore_t s;
+    tstore_block_t *blk = NULL, b;
+    bucket_t *bk;
+    char err[256];
+    int64_t lo = INT64_MAX, hi = INT64_MIN, k0, nk, k;
+    size_t nb = 0, cap = 0, i, from_headers = 0, decoded = 0;
+    uint64_t rows = 0;
+    int r, j;
+
+    if (tstore_open_read(&s, path, err, sizeof(err)))
+    {
+        fprintf(stderr, "collect: %s\n", err);
+        return 2;
+    }
+    while ((r = tstore_next(&s, &b)) > 0)
+    {
+        if (b.t1 < from || b.t0 >= to)
+            continue;
+        if (nb == cap && !(blk = realloc(blk, (cap = cap ? 2 * cap : 64) * sizeof(b))))
+        {
+            fprintf(stderr, "collect: out of memory\n");
+            return 2;
+        }
+        blk[nb++] = b;
+        lo = b.t0 > from ? (b.t0 < lo ? b.t0 : lo) : (from < lo ? from : lo);
+        hi = b.t1 < to ? (b.t1 > hi ? b.t1 : hi) : (to - 1 > hi ? to - 1 : hi);
+    }
+    if (r < 0)
+        fprintf(stderr, "collect: %s: damaged block, reading stops there\n", path);
+    if (nb == 0)
+    {
+        printf("no rows in range\n");
+        tstore_close(&s);
+        return 0;
+    }
+
+    k0 = lo / bucket;
+    nk = hi / bucket - k0 + 1;
+    if (!(bk = calloc((size_t)nk, sizeof(*bk))))
+    {
+        fprintf(stderr, "collect: out of memory\n");
+        return 2;
+    }
+    for (j = 0; j < nf; j++)
+        cols[j] = vcol[j];
+
+    for (i = 0; i < nb; i++)
+    {
+        const tstore_block_t *p = &blk[i];
+
+        k = p->t0 / bucket;
+        if (k == p->t1 / bucket && p->t0 >= from && p->t1 < to)
+        {
+            acc_block(&bk[k - k0], p, (p->t0 - k * bucket) / 1000.0, fields, nf);
+            from_headers++;
+            continue;
+        }
+        // Straddles a bucket or the range: decode the columns needed
+        if (tstore_column(&s, p, -1, tcol))
+        {
+            fprintf(stderr, "collect: %s: damaged block at %ld\n", path, p->data);
+            continue;
+        }
+        for (j = 0; j < nf; j++)
+            if (tstore_column(&s, p, fields[j], vcol[j]))
+                break;
+        if (j < nf)
+        {
+            fprintf(stderr, "collect: %s: damaged block at %ld\n", path, p->data);
+            continue;
+        }
+        for (r = 0; r < (int)p->rows; r++)
+        {
+            if (tcol[r] < from || tcol[r] >= to)
+                continue;
+            k = tcol[r] / bucket;
+            acc_row(&bk[k - k0], (tcol[r] - k * bucket) / 1000.0, cols, r, fields, nf);
+        }
+        decoded++;
+    }
+
+    printf("%20s %7s", "bucket", "rows");
+    for (j = 0; j < nf; j++)
+    {
+        const char *name = tframe_field_name(fields[j]);
+
+        printf("  %6.6s.min %6.6s.max %6.6s.mean %6.6s/h", name, name, name, name);
+    }
+    printf("\n");
+    for (k = 0; k < nk; k++)
+    {
+        bucket_t *p = &bk[k];
+        double den = p->n * p->stt - p->st * p->st;
+
+        if (p->n == 0)
+            continue;
+        rows += p->n;
+        print_time((k0 + k) * bucket);
+        printf(" %7llu", (unsigned long long)p->n);
+        for (j = 0; j < nf; j++)
+        {
+            acc_field_t *a = &p->f[fields[j]];
+
+            printf("  %10d %10d %11.2f", a->min, a->max, a->sv / p->n);
+            // Least squares slope, per hour
+            if (p->n > 1 && den > 1e-9)
+                printf(" %8.2f", (p->n * a->stv - p->st * a->sv) / den * 3600.0);
+            else
+                printf(" %8s", "-");
+        }
+        printf("\n");
+    }
+    printf("%llu rows from %zu blocks: %zu from headers, %zu decoded\n",
+           (unsigned long long)rows, nb, from_headers, decoded);
+    free(bk);
+    free(blk);
+    tstore_close(&s);
+    return 0;
+}
+
+static int parse_fields(char *list, int *fields)
+{
+    char *tok;
+    int n = 0;
+
+    for (tok = strtok(list, ","); tok; tok = strtok(NULL, ","))
+    {
+        if (n == TSTORE_FIELDS || (fields[n] = tframe_field(tok)) < 0)
+        {
+            fprintf(stderr, "collect: unknown field %s (speed, count, fuel, temp, adc, status)\n",
+                    tok);
+            exit(2);
+        }
+        n++;
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    static source_t src[MAX_SOURCES];
+    static char default_fields[] = "temp,fuel";
+    const char *dir = ".", *store = NULL;
+    char *field_list = default_fields;
+    double start = 0, period = TELEM_TICKS * TICK_MS, span = 3600, flush_s = 60;
+    double bucket = 3600, from = -1e15, to = 1e15;
+    int fields[TSTORE_FIELDS], nf, n = 0, i, follow = 0, baud = 187500;
+    struct sigaction sa;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-d") && i + 1 < argc)
+            dir = argv[++i];
+        else if (!strcmp(argv[i], "--period") && i + 1 < argc)
+            period = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--start") && i + 1 < argc)
+            start = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--follow"))
+            follow = 1;
+        else if (!strcmp(argv[i], "--baud") && i + 1 < argc)
+            baud = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--span") && i + 1 < argc)
+            span = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--flush") && i + 1 < argc)
+            flush_s = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-q") && i + 1 < argc)
+            store = argv[++i];
+        else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+            field_list = argv[++i];
+        else if (!strcmp(argv[i], "--bucket") && i + 1 < argc)
+            bucket = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--from") && i + 1 < argc)
+            from = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--to") && i + 1 < argc)
+            to = atof(argv[++i]);
+        else if (argv[i][0] == '-' && argv[i][1])
+            usage();
+        else if (n == MAX_SOURCES)
+        {
+            fprintf(stderr, "collect: at most %d sources\n", MAX_SOURCES);
+            return 2;
+        }
+        else
+            argv[n++] = argv[i];    // Sources, opened once the options are known
+    }
+
+    if (store)
+    {
+        if (n || bucket < 0.001 || from >= to)
+            usage();
+        nf = parse_fields(field_list, fields);
+        return query(store, fields, nf, (int64_t)(bucket * 1000), (int64_t)(from * 1000),
+                     (int64_t)(to * 1000));
+    }
+    if (n == 0 || period <= 0 || span < 0.001 || baud <= 0 || flush_s <= 0)
+        usage();
+    if (make_dir(dir))
+    {
+        fprintf(stderr, "collect: cannot create %s: %s\n", dir, strerror(errno));
+        return 2;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        int k;
+
+        if (open_source(&src[i], argv[i], dir, follow, baud, (int64_t)(start * 1000),
+                        (int64_t)period, (int64_t)(span * 1000)))
+            return 2;
+        for (k = 0; k < i; k++)
+            if (!strcmp(src[k].name, src[i].name))
+            {
+                fprintf(stderr, "collect: two sources for vehicle %s\n", src[i].name);
+                return 2;
+            }
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    return ingest(src, n, flush_s) ? 1 : 0;
+}
@@ -0,0 +1,506 @@
+/************************************************************
+ * fleet.c - many simulated clusters in parallel
+ *
+ * Runs N independent copies of Main.hex, each on its own
+ * simulated board with its own stimulus derived from a seed:
+ * button press time, an LM35 temperature random walk and a
+ * wheel drive cycle (built-in cycle or a constant speed, with
+ * sensor jitter). Each instance is watched every 10 ms and
+ * its outcomes are aggregated into fleet statistics:
+ *
+ *   boot      press until "TERMINAL" is on the display
+ *   lowfuel   press until "LowFuel" is shown
+ *   limp      press until the pulse counter is stopped
+ *   led_on    seconds the overheat LED was lit
+ *   alarm_lag longest stretch the LED disagreed with the
+ *             true temperature (> 40 degC); instances over
+ *             --max-lag fail the run (exit 1)
+ *
+ * Instances run on a work-stealing thread pool: every worker
+ * owns a deque pre-filled with a contiguous block of
+ * instances and pops from its tail; an idle worker steals
+ * from the head of another worker's deque. Instances are
+ * coarse (seconds of simulated time), so one lock per deque
+ * costs nothing measurable. Results depend only on the seed,
+ * never on the number of threads or the schedule.
+ *
+ *   fleet [options] [Main.hex]
+ *     -n N          instances (default 1000)
+ *     -t SEC        simulated time per instance (default 15)
+ *     -j N          worker threads (default: online cores)
+ *     -s SEED       base seed; instance i uses SEED + i (default 1)
+ *     -o FILE       per-instance outcomes as CSV
+ *     --max-lag S   allowed alarm lag in seconds (default 0.5)
+ *
+ * Throughput is reported as simulated seconds per wall
+ * second, in total and per worker.
+ ************************************************************/
+
+#include <math.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "board.h"
+
+#define SAMPLE_S        0.010   // Outcome sampling period (one firmware tick)
+#define TEMP_STEP_S     0.5     // Temperature random walk step
+#define ALARM_C         40      // Firmware overheat threshold (temp > 40)
+#define MAX_THREADS     256
+
+typedef struct
+{
+    uint64_t seed;
+    double press;               // Press time (s)
+    double temp0;               // Initial temperature (degC)
+    char wheel[16];             // Drive cycle name or constant km/h
+
+    double boot, lowfuel, limp; // Seconds after the press, -1 if never
+    double led_on;              // Seconds with the LED lit
+    double alarm_lag;           // Longest LED/temperature disagreement (s)
+    double max_temp;            // Highest input temperature (degC)
+    int lcd_violations;
+} outcome_t;
+
+// One worker's share of the instances
+typedef struct
+{
+    pthread_mutex_t lock;
+    int *jobs;
+    int head, tail;             // Pending jobs are jobs[head..tail)
+} deque_t;
+
+typedef struct fleet fleet_t;
+
+typedef struct
+{
+    fleet_t *fleet;
+    int id;
+    board_t *board;
+    uint64_t rng;               // Victim selection
+    int done, stolen;
+    double sim_s;
+} worker_t;
+
+struct fleet
+{
+    uint8_t code[65536];        // Image, loaded once and copied per instance
+    double seconds;
+    uint64_t seed;
+    int n, threads;
+    outcome_t *out;
+    deque_t *deques;
+    worker_t *workers;
+};
+
+static const char *drive_cycles[] = { "urban", "highway", "stopgo" };
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: fleet [options] [image.hex]\n"
+        "  -n N          instances (default 1000)\n"
+        "  -t SEC        simulated time per instance (default 15)\n"
+        "  -j N          worker threads (default: online cores)\n"
+        "  -s SEED       base seed; instance i uses SEED + i (default 1)\n"
+        "  -o FILE       per-instance outcomes as CSV\n"
+        "  --max-lag S   allowed alarm lag in seconds (default 0.5)\n");
+    exit(2);
+}
+
+static double now_wall(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/************************************************************
+ * Stimulus
+ ************************************************************/
+
+// splitmix64: well-mixed streams from consecutive seeds
+static uint64_t mix(uint64_t *s)
+{
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static double uniform(uint64_t *s)
+{
+    return (mix(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Fills pts with an LM35 voltage walk; returns the number of points
+static int temp_walk(uint64_t *rng, double seconds, double temp0, double (*pts)[2], int max)
+{
+    double c = temp0;
+    int n = 0;
+
+    while (n < max)
+    {
+        pts[n][0] = n * TEMP_STEP_S;
+        pts[n][1] = c * 0.010;
+        n++;
+        if ((n - 1) * TEMP_STEP_S >= seconds)
+            break;
+        c += 3.0 * uniform(rng) - 1.5;
+        if (c < 0)
+            c = 0;
+        if (c > 99)
+            c = 99;
+    }
+    return n;
+}
+
+/************************************************************
+ * Function: run_instance
+ * ----------------------
+ * Boots one cluster with the stimulus of out->seed and
+ * records its outcomes.
+ ************************************************************/
+
+static void run_instance(fleet_t *f, board_t *b, outcome_t *o)
+{
+    int npts = (int)(f->seconds / TEMP_STEP_S) + 2;
+    double (*pts)[2] = malloc(sizeof(*pts) * npts);
+    uint64_t rng = o->seed;
+    wave_t truth;
+    double t, lag = 0;
+    int tr1_seen = 0, choice;
+    char row[LCD_COLS + 1], err[128];
+
+    o->press = 0.05 + 0.45 * uniform(&rng);
+    o->temp0 = 15.0 + 30.0 * uniform(&rng);
+    choice = (int)(mix(&rng) % 4);
+    if (choice < 3)
+        snprintf(o->wheel, sizeof(o->wheel), "%s", drive_cycles[choice]);
+    else
+        snprintf(o->wheel, sizeof(o->wheel), "%d", (int)(uniform(&rng) * 140));
+    o->boot = o->lowfuel = o->limp = -1;
+    npts = temp_walk(&rng, f->seconds, o->temp0, pts, npts);
+
+    board_init(b, 12000000);
+    memcpy(b->cpu.code, f->code, sizeof(b->cpu.code));
+    mcs51_invalidate(&b->cpu, 0, sizeof(b->cpu.code));
+    wave_close(&b->adc_wave);
+    wave_table(&b->adc_wave, (const double (*)[2])pts, npts, 1.0);
+    adc0804_input(&b->adc, &b->adc_wave);
+    b->adc.seed = (uint32_t)mix(&rng) | 1;
+    board_wheel(b, o->wheel, 1, mix(&rng), err, sizeof(err));
+    b->wheel.jitter = 0.05 * uniform(&rng);
+    wave_table(&truth, (const double (*)[2])pts, npts, 1.0);
+
+    mcs51_run(&b->cpu, mcs51_cycles(&b->cpu, o->press));
+    mcs51_drive(&b->cpu, 3, 0x04, 0x00);
+    mcs51_run(&b->cpu, mcs51_cycles(&b->cpu, o->press + 0.05));
+    mcs51_drive(&b->cpu, 3, 0x04, 0x04);
+
+    for (t = o->press + 0.05 + SAMPLE_S; t <= f->seconds; t += SAMPLE_S)
+    {
+        double celsius;
+        int led, hot, tr1;
+
+        mcs51_run(&b->cpu, mcs51_cycles(&b->cpu, t));
+        celsius = wave_at(&truth, t) / 0.010;
+        led = board_led(b);
+        hot = (int)floor(celsius + 0.5) > ALARM_C;
+        tr1 = (b->cpu.sfr[SFR_TCON - 0x80] & TCON_TR1) != 0;
+
+        if (celsius > o->max_temp)
+            o->max_temp = celsius;
+        if (led)
+            o->led_on += SAMPLE_S;
+        lag = led != hot ? lag + SAMPLE_S : 0;
+        if (lag > o->alarm_lag)
+            o->alarm_lag = lag;
+
+        hd44780_row(&b->lcd, 0, row);
+        if (o->boot < 0 && !strncmp(row, "TERMINAL", 8))
+            o->boot = t - o->press;
+        if (o->lowfuel < 0 && strstr(row, "LowFuel"))
+            o->lowfuel = t - o->press;
+        if (tr1)
+            tr1_seen = 1;
+        else if (tr1_seen && o->limp < 0)
+            o->limp = t - o->press;
+    }
+    o->lcd_violations = (int)hd44780_total_violations(&b->lcd);
+
+    wave_close(&truth);
+    board_close(b);
+    free(pts);
+}
+
+/************************************************************
+ * Work-stealing pool
+ ************************************************************/
+
+static int pop_own(deque_t *d)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head)
+        job = d->jobs[--d->tail];
+    pthread_mutex_unlock(&d->lock);
+    return job;
+}
+
+static int steal(deque_t *d)
+{
+    int job = -1;
+
+    pthread_mutex_lock(&d->lock);
+    if (d->tail > d->head)
+        job = d->jobs[d->head++];
+    pthread_mutex_unlock(&d->lock);
+    return job;
+}
+
+// Tries every other worker once, starting at a random victim
+static int steal_any(worker_t *w)
+{
+    fleet_t *f = w->fleet;
+    int start = (int)(mix(&w->rng) % f->threads), i;
+
+    for (i = 0; i < f->threads; i++)
+    {
+        int v = (start + i) % f->threads, job;
+
+        if (v == w->id)
+            continue;
+        job = steal(&f->deques[v]);
+        if (job >= 0)
+        {
+            w->stolen++;
+            return job;
+        }
+    }
+    return -1;
+}
+
+static void *worker_main(void *arg)
+{
+    worker_t *w = arg;
+    fleet_t *f = w->fleet;
+    int job;
+
+    // No jobs are created while running, so one empty sweep means done
+    while ((job = pop_own(&f->deques[w->id])) >= 0 || (job = steal_any(w)) >= 0)
+    {
+        run_instance(f, w->board, &f->out[job]);
+        w->done++;
+        w->sim_s += f->seconds;
+    }
+    return NULL;
+}
+
+static int run_fleet(fleet_t *f)
+{
+    pthread_t tid[MAX_THREADS];
+    int i, j;
+
+    f->deques = calloc(f->threads, sizeof(deque_t));
+    f->workers = calloc(f->threads, sizeof(worker_t));
+    for (i = 0; i < f->threads; i++)
+    {
+        deque_t *d = &f->deques[i];
+        worker_t *w = &f->workers[i];
+        int lo = (int)((long long)f->n * i / f->threads);
+        int hi = (int)((long long)f->n * (i + 1) / f->threads);
+
+        pthread_mutex_init(&d->lock, NULL);
+        d->jobs = malloc(sizeof(int) * (hi - lo + 1));
+        for (j = lo; j < hi; j++)
+            d->jobs[d->tail++] = j;
+        w->fleet = f;
+        w->id = i;
+        w->rng = f->seed ^ (0xA5A5A5A5ull * (i + 1));
+        w->board = malloc(sizeof(board_t));
+        if (!w->board)
+            return -1;
+    }
+    for (i = 0; i < f->threads; i++)
+    {
+        if (pthread_create(&tid[i], NULL, worker_main, &f->workers[i]))
+            return -1;
+    }
+    for (i = 0; i < f->threads; i++)
+        pthread_join(tid[i], NULL);
+    for (i = 0; i < f->threads; i++)
+    {
+        pthread_mutex_destroy(&f->deques[i].lock);
+        free(f->deques[i].jobs);
+        free(f->workers[i].board);
+    }
+    return 0;
+}
+
+/************************************************************
+ * Reporting
+ ************************************************************/
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+// min / mean / p50 / p95 / max over the instances where the event happened
+static void print_stat(const char *name, const outcome_t *out, int n, size_t field, double *tmp)
+{
+    double sum = 0;
+    int i, k = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        double v = *(const double *)((const char *)&out[i] + field);
+
+        if (v >= 0)
+        {
+            tmp[k++] = v;
+            sum += v;
+        }
+    }
+    if (!k)
+    {
+        printf("%-10s %6d/%-6d           -\n", name, 0, n);
+        return;
+    }
+    qsort(tmp, k, sizeof(double), cmp_double);
+    printf("%-10s %6d/%-6d %8.3f %8.3f %8.3f %8.3f %8.3f\n", name, k, n,
+           tmp[0], sum / k, tmp[(k - 1) / 2], tmp[(int)((k - 1) * 0.95)], tmp[k - 1]);
+}
+
+static int write_csv(const char *path, const outcome_t *out, int n)
+{
+    FILE *f = fopen(path, "w");
+    int i;
+
+    if (!f)
+        return -1;
+    fprintf(f, "instance,seed,press,temp0,wheel,boot,lowfuel,limp,led_on,alarm_lag,max_temp,lcd_violations\n");
+    for (i = 0; i < n; i++)
+    {
+        const outcome_t *o = &out[i];
+
+        fprintf(f, "%d,%llu,%.3f,%.1f,%s,%.3f,%.3f,%.3f,%.2f,%.2f,%.1f,%d\n", i,
+                (unsigned long long)o->seed, o->press, o->temp0, o->wheel, o->boot,
+                o->lowfuel, o->limp, o->led_on, o->alarm_lag, o->max_temp, o->lcd_violations);
+    }
+    return fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    static fleet_t fleet;
+    fleet_t *f = &fleet;
+    const char *image = "Main.hex", *csv = NULL;
+    double max_lag = 0.5, wall, sim_total = 0, *tmp;
+    ihex_info_t info;
+    char err[256];
+    int i, late = 0, violators = 0;
+
+    f->n = 1000;
+    f->seconds = 15.0;
+    f->seed = 1;
+    f->threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            f->n = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            f->seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+            f->threads = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            f->seed = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+            csv = argv[++i];
+        else if (!strcmp(argv[i], "--max-lag") && i + 1 < argc)
+            max_lag = atof(argv[++i]);
+        else if (argv[i][0] == '-')
+            usage();
+        else
+            image = argv[i];
+    }
+    if (f->n <= 0 || f->seconds <= 0)
+        usage();
+    if (f->threads < 1)
+        f->threads = 1;
+    if (f->threads > MAX_THREADS)
+        f->threads = MAX_THREADS;
+    if (f->threads > f->n)
+        f->threads = f->n;
+    if (ihex_load(image, f->code, sizeof(f->code), NULL, &info, err, sizeof(err)))
+    {
+        fprintf(stderr, "fleet: %s\n", err);
+        return 2;
+    }
+
+    f->out = calloc(f->n, sizeof(outcome_t));
+    tmp = malloc(sizeof(double) * f->n);
+    if (!f->out || !tmp)
+    {
+        fprintf(stderr, "fleet: out of memory\n");
+        return 2;
+    }
+    for (i = 0; i < f->n; i++)
+        f->out[i].seed = f->seed + i;
+
+    wall = now_wall();
+    if (run_fleet(f))
+    {
+        fprintf(stderr, "fleet: cannot start worker threads\n");
+        return 2;
+    }
+    wall = now_wall() - wall;
+
+    for (i = 0; i < f->n; i++)
+    {
+        late += f->out[i].alarm_lag > max_lag;
+        violators += f->out[i].lcd_violations > 0;
+    }
+    printf("%d instances x %.1f s, %d threads\n\n", f->n, f->seconds, f->threads);
+    printf("%-10s %13s %8s %8s %8s %8s %8s\n", "outcome", "seen", "min", "mean", "p50", "p95", "max");
+    print_stat("boot", f->out, f->n, offsetof(outcome_t, boot), tmp);
+    print_stat("lowfuel", f->out, f->n, offsetof(outcome_t, lowfuel), tmp);
+    print_stat("limp", f->out, f->n, offsetof(outcome_t, limp), tmp);
+    print_stat("led_on", f->out, f->n, offsetof(outcome_t, led_on), tmp);
+    print_stat("alarm_lag", f->out, f->n, offsetof(outcome_t, alarm_lag), tmp);
+    print_stat("max_temp", f->out, f->n, offsetof(outcome_t, max_temp), tmp);
+    printf("\nalarm lag over %.2f s: %d instance%s\n", max_lag, late, late == 1 ? "" : "s");
+    printf("LCD timing violations: %d instance%s\n\n", violators, violators == 1 ? "" : "s");
+
+    for (i = 0; i < f->threads; i++)
+    {
+        worker_t *w = &f->workers[i];
+
+        printf("worker %-3d %6d instances (%d stolen) %10.1f sim-s/s\n", i, w->done, w->stolen,
+               wall > 0 ? w->sim_s / wall : 0.0);
+        sim_total += w->sim_s;
+    }
+    printf("total      %.1f simulated s in %.2f s wall: %.1f sim-s/s\n",
+           sim_total, wall, wall > 0 ? sim_total / wall : 0.0);
+
+    if (csv && write_csv(csv, f->out, f->n))
+    {
+        fprintf(stderr, "fleet: cannot write %s\n", csv);
+        return 2;
+    }
+    free(tmp);
+    free(f->out);
+    free(f->deques);
+    free(f->workers);
+    return late ? 1 : 0;
+}
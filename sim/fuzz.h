@@ -0,0 +1,39 @@
+/************************************************************
+ * fuzz.h - fuzz targets for the display and cluster logic
+ *
+ * Each target is one libFuzzer entry point over firmware
+ * sources built natively:
+ *
+ *   fuzz_lcd.c      lcd.c on the HD44780 model
+ *   fuzz_cluster.c  cluster.c on the host HAL
+ *
+ * Built with clang -fsanitize=fuzzer they get coverage-guided
+ * fuzzing from libFuzzer; fuzz_main.c supplies main() for
+ * gcc builds and for re-running saved inputs.
+ *
+ * An input that breaks an invariant stops the process with a
+ * message and a trap, which both drivers report as a crash
+ * and save.
+ ************************************************************/
+
+#ifndef FUZZ_H
+#define FUZZ_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FUZZ_CHECK(cond, ...)                                   \
+    do                                                          \
+    {                                                           \
+        if (!(cond))                                            \
+        {                                                       \
+            fprintf(stderr, "fuzz: " __VA_ARGS__);              \
+            fputc('\n', stderr);                                \
+            __builtin_trap();                                   \
+        }                                                       \
+    } while (0)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+#endif
@@ -0,0 +1,211 @@
+/************************************************************
+ * fuzz_cluster.c - fuzz target for the cluster logic
+ *
+ * Runs cluster.c on the host HAL with inputs taken from the
+ * fuzz data: button and page presses, ADC readings and wheel pulse
+ * rates, interleaved with runs of power_step(). After every
+ * step the state is checked against the rules of cluster.c:
+ *
+ *   - system is 1 from RUN until SHUTDOWN has run; before
+ *     BOOT the display, LED and counter are off
+ *   - fuel stays a multiple of 10 in 0-100 and never rises
+ *   - overheat is raised above TEMP_ALARM and cleared at the
+ *     table's hysteresis below it; the LED follows it and its
+ *     blink phase until it is acknowledged
+ *   - the trip distance is the pulses counted since BOOT,
+ *     across Timer1 wraps, in whole 100 m
+ *   - below FUEL_CUTOFF the cluster is in LOWFUEL_LIMP with
+ *     the speed at 0 and the counter stopped
+ *   - after a display refresh the active page shows what its
+ *     variables hold: on PAGE_MAIN row 1 reads "TERMINAL", the
+ *     blink marker and the text of the top LCD alarm (cut-off,
+ *     then overheat, then LowFuel at fuel <= FUEL_LOW), row 2 holds
+ *     the 2-digit speed, fuel and temperature fields; the
+ *     other pages as drawn in cluster.c. Since only dirty
+ *     fields are redrawn, this also checks that every change
+ *     set its dirty bit
+ *   - nothing is ever written outside the 16x2 window
+ *
+ * Input format, one op byte at a time:
+ *   op & 3 == 0   button press, page button if op & 4
+ *   op & 3 == 1   next byte is the ADC reading
+ *   op & 3 == 2   next byte is the wheel pulses per tick
+ *   op & 3 == 3   op / 4 + 1 calls to power_step()
+ *
+ * The thresholds come from tune.h, so a -DTUNE=1 build (with
+ * tune.c) is checked against the parameter table defaults.
+ *
+ * stdlib.h stays out, as in cluster_host.c.
+ ************************************************************/
+
+#include <string.h>
+
+#include "fuzz.h"
+#include "cluster.h"
+#include "tune.h"
+#include "alarm.h"
+
+#define MAX_TICKS   20000UL     // 200 s of simulated time per input
+
+static int hot;                 // Reference for ALARM_OVERHEAT and its hysteresis
+static unsigned long long trip_pulses;  // Pulses since BOOT, summed over the 16-bit wraps
+static unsigned last_count;
+
+// Whether an active alarm's indication is in its on phase
+static int lit(unsigned id)
+{
+    return (alarm_acked >> id & 1) || !(hal_tick & alarm_table[id].blink);
+}
+
+static void check_row(int n, const char *want)
+{
+    char row[HAL_LCD_COLS + 1];
+
+    hal_host_row(n, row);
+    FUZZ_CHECK(!strcmp(row, want), "page %u row %d '%s', expected '%s'", page, n, row, want);
+}
+
+static void check_step(unsigned state0, unsigned fuel0, unsigned long reads0)
+{
+    char want[HAL_LCD_COLS + 8];
+    int i, on = pwr_state == PWR_RUN || pwr_state == PWR_LOWFUEL_LIMP ||
+                pwr_state == PWR_SHUTDOWN;
+
+    FUZZ_CHECK(pwr_state <= PWR_SHUTDOWN, "pwr_state %u", pwr_state);
+    FUZZ_CHECK(system == on, "system %d in state %u", system, pwr_state);
+    if (pwr_state == PWR_OFF || pwr_state == PWR_BOOT)
+        FUZZ_CHECK(!hal_host.display_on && !hal_host.led && !hal_host.counting,
+                   "display %u, LED %u, counter %u while off", hal_host.display_on, hal_host.led,
+                   hal_host.counting);
+    FUZZ_CHECK(fuel <= 100 && fuel % 10 == 0, "fuel %u%%", fuel);
+    FUZZ_CHECK(fuel <= fuel0, "fuel rose from %u%% to %u%%", fuel0, fuel);
+    FUZZ_CHECK(pwr_state != PWR_LOWFUEL_LIMP || fuel < FUEL_CUTOFF, "limp mode at fuel %u%%", fuel);
+
+    for (i = 0; i < 128; i++)
+        FUZZ_CHECK((i & 0x3F) < HAL_LCD_COLS || hal_host.ddram[i] == ' ',
+                   "DDRAM[%02X] = '%c' is outside the 16x2 window", i, hal_host.ddram[i]);
+
+    if (state0 == PWR_BOOT)
+    {
+        trip_pulses = 0;
+        last_count = 0;
+    }
+    if (hal_host.adc_reads == reads0)
+        return;
+
+    // A sensor pass ran
+    FUZZ_CHECK(temp == adc_val, "temp %u from ADC %u", temp, adc_val);
+    trip_pulses += (count - last_count) & 0xFFFF;
+    last_count = count;
+    FUZZ_CHECK(trip_hm == (unsigned)(trip_pulses * WHEEL_MM / (100000ULL * PULSES_REV)),
+               "trip %u00 m after %llu pulses", trip_hm, trip_pulses);
+    if (temp > TEMP_ALARM)
+        hot = 1;
+    else if (temp + alarm_table[ALARM_OVERHEAT].hyst <= TEMP_ALARM)
+        hot = 0;
+    FUZZ_CHECK(overheat == hot, "overheat %u at %u C", overheat, temp);
+
+    if (pwr_state != PWR_RUN && pwr_state != PWR_LOWFUEL_LIMP)
+        return;
+
+    // and refreshed the display (a press skips the refresh and leads to SHUTDOWN)
+    FUZZ_CHECK(hal_host.led == (hot && lit(ALARM_OVERHEAT)), "LED %u at %u C, tick %u",
+               hal_host.led, temp, hal_tick);
+    if (fuel < FUEL_CUTOFF)
+        FUZZ_CHECK(pwr_state == PWR_LOWFUEL_LIMP && speed == 0 && !hal_host.counting,
+                   "fuel %u%%: state %u, speed %u, counter %u", fuel, pwr_state, speed,
+                   hal_host.counting);
+    FUZZ_CHECK(page < PAGES, "page %u", page);
+    if (page == PAGE_MAIN)
+    {
+        unsigned id = fuel < FUEL_CUTOFF ? ALARM_CUTOFF : hot ? ALARM_OVERHEAT :
+                      fuel <= FUEL_LOW ? ALARM_LOWFUEL : ALARM_NONE;
+
+        if (id == ALARM_NONE)
+            snprintf(want, sizeof(want), "TERMINAL        ");
+        else
+            snprintf(want, sizeof(want), "TERMINAL%c%s",
+                     !(alarm_acked >> id & 1) && lit(id) ? '!' : ' ', alarm_table[id].text);
+        check_row(1, want);
+        snprintf(want, sizeof(want), "s:%02u F:%02u%% T:%02uc", speed % 100, fuel % 100,
+                 temp % 100);
+        check_row(2, want);
+        return;
+    }
+    if (page == PAGE_TRIP)
+    {
+        unsigned avg = trip_sec ? (unsigned)((unsigned long)trip_hm * 360 / trip_sec) : 0;
+
+        snprintf(want, sizeof(want), "TRIP       %02u:%02u", trip_sec / 60 % 100, trip_sec % 60);
+        check_row(1, want);
+        snprintf(want, sizeof(want), "%04u.%ukm A:%02ukmh", trip_hm / 10 % 10000, trip_hm % 10,
+                 avg % 100);
+        check_row(2, want);
+        return;
+    }
+    if (page == PAGE_DIAG)
+    {
+        snprintf(want, sizeof(want), "DIAG ADC:%03u S:%u", adc_val, pwr_state);
+        check_row(1, want);
+        snprintf(want, sizeof(want), "P:%05u    OVH:%u", count, overheat);
+        check_row(2, want);
+        return;
+    }
+    snprintf(want, sizeof(want), "Tmin:%02u Tmax:%02uc", temp_min % 100, temp_max % 100);
+    check_row(1, want);
+    snprintf(want, sizeof(want), "Smax:%02ukmh      ", speed_max % 100);
+    check_row(2, want);
+    FUZZ_CHECK(temp_min <= temp && temp <= temp_max, "temp %u outside %u-%u", temp, temp_min,
+               temp_max);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    size_t i = 0;
+
+    hal_host_reset();
+    cluster_init();
+    hot = 0;
+    trip_pulses = 0;
+    last_count = 0;
+    hal_init();
+    tune_init();
+
+    while (i < size && hal_host.ticks < MAX_TICKS)
+    {
+        uint8_t op = data[i++];
+        int n;
+
+        switch (op & 3)
+        {
+            case 0:
+                if (op & 4)
+                    hal_host_page();
+                else
+                    hal_host_press();
+                break;
+
+            case 1:
+                if (i < size)
+                    hal_host.adc = data[i++];
+                break;
+
+            case 2:
+                if (i < size)
+                    hal_host.pulses_per_tick = data[i++];
+                break;
+
+            default:
+                for (n = op / 4 + 1; n > 0 && hal_host.ticks < MAX_TICKS; n--)
+                {
+                    unsigned state0 = pwr_state, fuel0 = fuel;
+                    unsigned long reads0 = hal_host.adc_reads;
+
+                    power_step();
+                    check_step(state0, fuel0, reads0);
+                }
+                break;
+        }
+    }
+    return 0;
+}
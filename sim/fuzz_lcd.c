@@ -0,0 +1,250 @@
+/************************************************************
+ * fuzz_lcd.c - fuzz target for the LCD driver
+ *
+ * Builds lcd.c natively: its pin writes go to the HD44780
+ * model through lcd_pin() and delay_ms() advances the model's
+ * clock by 1 ms per count. Each input is a list of lcd_print()
+ * and lcd_out() calls, applied to lcd.c, to the host HAL's
+ * copy in hal_host.c and to a reference written from the
+ * behaviour documented for lcd_print():
+ *
+ *   - digits 1-5 prints the low 'digits' decimal digits, so
+ *     wider values are truncated; digits > 5 prints 'E' only,
+ *     digits < 1 prints nothing
+ *   - row or column 0 prints from the home position
+ *
+ * After every call the three must agree on DDRAM and the
+ * address counter, exactly one character per field position
+ * must have been written, nothing may land outside the 16x2
+ * window except the part of a field past column 16, and
+ * the calls must keep to the bus timing.
+ *
+ * Input format, repeated until the data runs out:
+ *   odd op    lcd_print: row % 3, column % 17, value (u16 LE),
+ *             digits (signed byte)
+ *   even op   lcd_out: row 1-2, column 1-16, then op / 2 text
+ *             bytes, cut to the end of the row
+ ************************************************************/
+
+#include <string.h>
+
+#include "fuzz.h"
+#include "hd44780.h"
+#include "lcd.h"
+#include "hal.h"
+
+#define FOSC            12000000
+#define MS_CYCLES       (FOSC / 12 / 1000)
+#define PIN_CYCLES      2           // SETB/CLR plus the bit test in lcd.c
+#define BOOT_CYCLES     (100 * MS_CYCLES)   // lcd_init() runs after the first button press
+
+static mcs51_t cpu;
+static hd44780_t lcd, booted;
+static uint64_t booted_cycles;
+static uint8_t booted_p2;
+static uint64_t boot_violations;
+static int ready;
+
+// Pin write in progress: the value lands in pin_value, and is put on P2
+// when lcd.c touches the next pin or waits
+static unsigned char pin_value;
+static int pin_bit = -1;
+
+// What lcd_print()/lcd_out() should have done
+static uint8_t ref_ddram[128];
+static uint8_t ref_ac;
+
+static void pin_flush(void)
+{
+    uint8_t p2 = cpu.sfr[SFR_P2 - 0x80];
+
+    if (pin_bit < 0)
+        return;
+    p2 = pin_value ? (uint8_t)(p2 | 1 << pin_bit) : (uint8_t)(p2 & ~(1 << pin_bit));
+    pin_bit = -1;
+    cpu.cycles += PIN_CYCLES;
+    mcs51_write_direct(&cpu, SFR_P2, p2);
+}
+
+unsigned char *lcd_pin(unsigned char bit)
+{
+    pin_flush();
+    pin_bit = bit;
+    return &pin_value;
+}
+
+void delay_ms(unsigned int count)
+{
+    pin_flush();
+    cpu.cycles += (uint64_t)count * MS_CYCLES;
+}
+
+static void boot(void)
+{
+    int i;
+
+    mcs51_init(&cpu, FOSC);
+    hd44780_init(&lcd, &cpu);
+    cpu.cycles += BOOT_CYCLES;
+    lcd_init();
+    pin_flush();
+
+    FUZZ_CHECK(!lcd.bus8 && lcd.two_lines && lcd.display_on && !lcd.cursor_on,
+               "lcd_init() left the controller in the wrong mode");
+    // lcd_set_4bit() leaves 2 ms instead of 4.1 ms after the first function
+    // set; sim8051 -L reports that, and as it is the same for every input
+    // only the calls made by the input are held to the bus timing
+    boot_violations = hd44780_total_violations(&lcd);
+    for (i = 0; i < 128; i++)
+        FUZZ_CHECK(lcd.ddram[i] == ' ', "lcd_init() left DDRAM[%02X] set", i);
+
+    booted = lcd;
+    booted_cycles = cpu.cycles;
+    booted_p2 = cpu.sfr[SFR_P2 - 0x80];
+    ready = 1;
+}
+
+static void ref_cursor(int row, int column)
+{
+    if (row == 1)
+        ref_ac = (uint8_t)(column - 1);
+    else if (row == 2)
+        ref_ac = (uint8_t)(0x40 + column - 1);
+}
+
+// Writes the characters at the reference cursor; returns how many of them
+// fell outside the visible window
+static int ref_write(const uint8_t *s, int n)
+{
+    int i, off = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        off += (ref_ac & 0x3F) >= LCD_COLS;
+        ref_ddram[ref_ac] = s[i];
+        ref_ac = (uint8_t)((ref_ac + 1) & 0x7F);
+    }
+    return off;
+}
+
+static int ref_field(unsigned value, int digits, uint8_t *out)
+{
+    static const unsigned pow10[5] = { 1, 10, 100, 1000, 10000 };
+    int i;
+
+    if (digits > 5)
+    {
+        out[0] = 'E';
+        return 1;
+    }
+    for (i = 0; i < digits; i++)
+        out[i] = (uint8_t)('0' + value / pow10[digits - 1 - i] % 10);
+    return digits > 0 ? digits : 0;
+}
+
+static void check(const char *call, int written, int offscreen, uint64_t writes0, uint64_t off0)
+{
+    int i;
+
+    FUZZ_CHECK(lcd.data_writes - writes0 == (uint64_t)written,
+               "%s wrote %d characters, field is %d", call, (int)(lcd.data_writes - writes0),
+               written);
+    FUZZ_CHECK(lcd.offscreen_writes - off0 == (uint64_t)offscreen,
+               "%s wrote %d characters outside 16x2, expected %d", call,
+               (int)(lcd.offscreen_writes - off0), offscreen);
+    FUZZ_CHECK(!lcd.cg_select, "%s selected CGRAM", call);
+    FUZZ_CHECK(lcd.ac == ref_ac, "%s left the cursor at %02X, expected %02X", call, lcd.ac,
+               ref_ac);
+    FUZZ_CHECK(hd44780_total_violations(&lcd) == boot_violations, "%s breaks the bus timing",
+               call);
+    for (i = 0; i < 128; i++)
+    {
+        FUZZ_CHECK(lcd.ddram[i] == ref_ddram[i], "%s: DDRAM[%02X] is '%c', expected '%c'", call, i,
+                   lcd.ddram[i], ref_ddram[i]);
+        FUZZ_CHECK(hal_host.ddram[i] == ref_ddram[i],
+                   "%s: hal_host DDRAM[%02X] is '%c', lcd.c wrote '%c'", call, i,
+                   hal_host.ddram[i], ref_ddram[i]);
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+    size_t i = 0;
+
+    if (!ready)
+        boot();
+    lcd = booted;
+    cpu.cycles = booted_cycles;
+    cpu.sfr[SFR_P2 - 0x80] = booted_p2;
+    pin_bit = -1;
+    memset(ref_ddram, ' ', sizeof(ref_ddram));
+    ref_ac = 0;
+    hal_host_reset();
+    hal_lcd_init();
+
+    while (i < size)
+    {
+        uint8_t op = data[i++];
+        uint64_t writes0 = lcd.data_writes, off0 = lcd.offscreen_writes;
+        uint8_t field[16];
+        char call[64];
+        int n, off;
+
+        if (op & 1)
+        {
+            int row, column, digits;
+            unsigned value;
+
+            if (size - i < 5)
+                break;
+            row = data[i] % 3;
+            column = data[i + 1] % 17;
+            value = data[i + 2] | data[i + 3] << 8;
+            digits = (signed char)data[i + 4];
+            i += 5;
+
+            lcd_print((char)row, (char)column, value, digits);
+            pin_flush();
+            hal_lcd_print((char)row, (char)column, value, digits);
+
+            if (row == 0 || column == 0)
+                ref_ac = 0;
+            else
+                ref_cursor(row, column);
+            n = ref_field(value, digits, field);
+            off = ref_write(field, n);
+            snprintf(call, sizeof(call), "lcd_print(%d, %d, %u, %d)", row, column, value, digits);
+        }
+        else
+        {
+            char text[LCD_COLS + 1];
+            int row, column, k;
+
+            if (size - i < 2)
+                break;
+            row = 1 + data[i] % 2;
+            column = 1 + data[i + 1] % LCD_COLS;
+            i += 2;
+            n = (op >> 1) % (LCD_COLS + 2 - column);
+            if ((size_t)n > size - i)
+                n = (int)(size - i);
+            for (k = 0; k < n; k++)
+            {
+                field[k] = data[i + k] ? data[i + k] : '?';
+                text[k] = (char)field[k];
+            }
+            text[n] = '\0';
+            i += n;
+
+            lcd_out((char)row, (char)column, text);
+            pin_flush();
+            hal_lcd_out((char)row, (char)column, text);
+
+            ref_cursor(row, column);
+            off = ref_write(field, n);
+            snprintf(call, sizeof(call), "lcd_out(%d, %d, <%d chars>)", row, column, n);
+        }
+        check(call, n, off, writes0, off0);
+    }
+    return 0;
+}
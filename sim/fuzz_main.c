@@ -0,0 +1,344 @@
+/************************************************************
+ * fuzz_main.c - standalone driver for the fuzz targets
+ *
+ * Supplies main() for a target built without libFuzzer
+ * (gcc). Files on the command line are run once each, which
+ * is how a saved crash is reproduced or a corpus is replayed
+ * as a regression test. Otherwise random inputs are generated
+ * by mutating the corpus (directories on the command line,
+ * plus the empty input) until the time or count runs out.
+ * There is no coverage feedback; a mutated input joins the
+ * pool every POOL_EVERY runs to keep it varied.
+ *
+ *   fuzz_lcd | fuzz_cluster [options] [FILE|DIR ...]
+ *     -t SEC         fuzz for SEC seconds (default 10)
+ *     -n N           stop after N inputs
+ *     --seed N       random seed (default 1)
+ *     --max-len N    longest input generated (default 256)
+ *     --crash FILE   where a failing input is saved
+ *                    (default crash.bin)
+ *
+ * A failing input ends the run with the target's message,
+ * the input saved to the crash file and a non-zero status.
+ ************************************************************/
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fuzz.h"
+
+#define POOL_MAX    256
+#define POOL_EVERY  64
+#define FILE_MAX    (1 << 20)
+
+typedef struct
+{
+    uint8_t *data;
+    size_t len;
+} input_t;
+
+static input_t pool[POOL_MAX];
+static int npool;
+
+// Input being run, for the crash handler
+static const uint8_t *cur_data;
+static size_t cur_len;
+static const char *crash_path = "crash.bin";
+static int saving;
+
+static uint64_t rng = 1;
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: fuzz_lcd|fuzz_cluster [options] [FILE|DIR ...]\n"
+        "  -t SEC         fuzz for SEC seconds (default 10)\n"
+        "  -n N           stop after N inputs\n"
+        "  --seed N       random seed (default 1)\n"
+        "  --max-len N    longest input generated (default 256)\n"
+        "  --crash FILE   where a failing input is saved (default crash.bin)\n"
+        "FILE arguments are run once each; DIR arguments seed the corpus\n");
+    exit(2);
+}
+
+static double now_wall(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint32_t rnd(void)
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng >> 32);
+}
+
+/************************************************************
+ * Crash handling
+ ************************************************************/
+
+// Async-signal-safe message to stderr
+static void put_err(const char *s)
+{
+    if (write(2, s, strlen(s)) < 0)
+        return;
+}
+
+static void on_crash(int sig)
+{
+    int fd, ok = 0;
+
+    if (saving)
+    {
+        fd = open(crash_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0)
+        {
+            ok = write(fd, cur_data, cur_len) == (ssize_t)cur_len;
+            ok &= close(fd) == 0;
+        }
+        put_err(ok ? "fuzz: failing input saved to " : "fuzz: cannot write ");
+        put_err(crash_path);
+        put_err("\n");
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void run(const uint8_t *data, size_t len)
+{
+    cur_data = data;
+    cur_len = len;
+    LLVMFuzzerTestOneInput(data, len);
+}
+
+/************************************************************
+ * Corpus
+ ************************************************************/
+
+static int read_file(const char *path, input_t *in)
+{
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+        return -1;
+    in->data = malloc(FILE_MAX);
+    if (!in->data)
+    {
+        fclose(f);
+        return -1;
+    }
+    in->len = fread(in->data, 1, FILE_MAX, f);
+    fclose(f);
+    return 0;
+}
+
+static void add_pool(const uint8_t *data, size_t len)
+{
+    int at = npool < POOL_MAX ? npool++ : (int)(rnd() % POOL_MAX);
+
+    free(pool[at].data);
+    pool[at].data = malloc(len ? len : 1);
+    if (!pool[at].data)
+    {
+        fprintf(stderr, "fuzz: out of memory\n");
+        exit(2);
+    }
+    memcpy(pool[at].data, data, len);
+    pool[at].len = len;
+}
+
+static void load_dir(const char *path)
+{
+    DIR *d = opendir(path);
+    struct dirent *e;
+    char name[4096];
+    input_t in;
+
+    if (!d)
+    {
+        fprintf(stderr, "fuzz: cannot read %s\n", path);
+        exit(2);
+    }
+    while ((e = readdir(d)) != NULL)
+    {
+        if (e->d_name[0] == '.')
+            continue;
+        snprintf(name, sizeof(name), "%s/%s", path, e->d_name);
+        if (read_file(name, &in) == 0)
+        {
+            add_pool(in.data, in.len);
+            free(in.data);
+        }
+    }
+    closedir(d);
+}
+
+/************************************************************
+ * Mutation
+ ************************************************************/
+
+// Values that sit on the edges the targets branch on
+static const uint8_t special[] = { 0, 1, 2, 5, 6, 9, 10, 16, 17, 20, 21, 40, 41, 0x7F, 0x80, 0xFF };
+
+static size_t mutate(uint8_t *d, size_t n, size_t max)
+{
+    int k, rounds = 1 + rnd() % 4;
+
+    for (k = 0; k < rounds; k++)
+    {
+        size_t at = n ? rnd() % n : 0, len;
+
+        switch (rnd() % 6)
+        {
+            case 0:     // Flip a bit
+                if (n)
+                    d[at] ^= (uint8_t)(1 << rnd() % 8);
+                break;
+
+            case 1:     // Random byte
+                if (n)
+                    d[at] = (uint8_t)rnd();
+                break;
+
+            case 2:     // Edge value
+                if (n)
+                    d[at] = special[rnd() % sizeof(special)];
+                break;
+
+            case 3:     // Insert a byte
+                if (n < max)
+                {
+                    memmove(d + at + 1, d + at, n - at);
+                    d[at] = (uint8_t)rnd();
+                    n++;
+                }
+                break;
+
+            case 4:     // Erase a run
+                len = n - at ? 1 + rnd() % (n - at) % 8 : 0;
+                memmove(d + at, d + at + len, n - at - len);
+                n -= len;
+                break;
+
+            default:    // Repeat a run
+                len = n - at ? 1 + rnd() % (n - at) % 16 : 0;
+                if (n + len <= max)
+                {
+                    memmove(d + at + len, d + at, n - at);
+                    n += len;
+                }
+                break;
+        }
+    }
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = 10.0, t0, now;
+    unsigned long limit = 0, runs = 0, next_report = 1024;
+    size_t max_len = 256, len;
+    uint8_t *buf;
+    input_t in;
+    struct stat st;
+    int i, files = 0;
+
+    signal(SIGILL, on_crash);
+    signal(SIGABRT, on_crash);
+    signal(SIGSEGV, on_crash);
+    signal(SIGFPE, on_crash);
+    signal(SIGBUS, on_crash);
+    signal(SIGTRAP, on_crash);
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            limit = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--seed") && i + 1 < argc)
+            rng = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--max-len") && i + 1 < argc)
+            max_len = strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--crash") && i + 1 < argc)
+            crash_path = argv[++i];
+        else if (argv[i][0] == '-')
+            usage();
+        else if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+            load_dir(argv[i]);
+        else
+        {
+            if (read_file(argv[i], &in))
+            {
+                fprintf(stderr, "fuzz: cannot read %s\n", argv[i]);
+                return 2;
+            }
+            printf("run %s (%zu bytes)\n", argv[i], in.len);
+            fflush(stdout);
+            run(in.data, in.len);
+            free(in.data);
+            files++;
+        }
+    }
+    if (files)
+    {
+        printf("%d inputs, no failures\n", files);
+        return 0;
+    }
+    if (seconds <= 0 || max_len == 0 || max_len > FILE_MAX)
+        usage();
+    if (!rng)
+        rng = 1;
+
+    buf = malloc(max_len);
+    if (!buf)
+    {
+        fprintf(stderr, "fuzz: out of memory\n");
+        return 2;
+    }
+    add_pool(buf, 0);
+    saving = 1;
+    t0 = now_wall();
+    now = t0;
+    while (!limit || runs < limit)
+    {
+        const input_t *from = &pool[rnd() % npool];
+
+        len = from->len < max_len ? from->len : max_len;
+        memcpy(buf, from->data, len);
+        len = mutate(buf, len, max_len);
+        run(buf, len);
+        runs++;
+
+        if (runs % POOL_EVERY == 0)
+            add_pool(buf, len);
+        if (runs % 256 == 0)
+        {
+            now = now_wall();
+            if (now - t0 >= seconds)
+                break;
+        }
+        if (runs == next_report)
+        {
+            printf("#%lu  %.0f exec/s  pool %d\n", runs, runs / (now_wall() - t0), npool);
+            fflush(stdout);
+            next_report *= 2;
+        }
+    }
+    now = now_wall();
+    printf("%lu inputs in %.1f s (%.0f exec/s), no failures\n", runs, now - t0,
+           now > t0 ? runs / (now - t0) : 0.0);
+    free(buf);
+    return 0;
+}
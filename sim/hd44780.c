@@ -0,0 +1,366 @@
+/************************************************************
+ * hd44780.c - HD44780 16x2 LCD behavioural model
+ *
+ * Timing figures are the HD44780U datasheet values at
+ * Vcc = 4.5-5.5 V, fosc = 270 kHz.
+ ************************************************************/
+
+#include <string.h>
+
+#include "hd44780.h"
+
+#define T_POWERON_NS    15000000ULL     // Vcc rise to first instruction
+#define T_INIT1_NS      4100000ULL      // After the first 0x3 nibble
+#define T_INIT2_NS      100000ULL       // After the second 0x3 nibble
+#define T_EXEC_NS       37000ULL        // Most instructions
+#define T_DATA_NS       41000ULL        // Data write incl. address update (tADD)
+#define T_HOME_NS       1520000ULL      // Clear display / return home
+#define T_PWEH_NS       450ULL          // Enable pulse width, high
+#define T_CYCE_NS       1000ULL         // Enable cycle time
+
+static const char *const kind_name[LCD_V_KINDS] =
+{
+    "power-on", "busy", "EN pulse", "EN cycle"
+};
+
+static uint64_t ns_to_cycles(const hd44780_t *lcd, uint64_t ns)
+{
+    // Round up: a delay must cover the full datasheet time
+    return (ns * lcd->fosc + 12000000000ULL - 1) / 12000000000ULL;
+}
+
+static uint64_t cycles_to_ns(const hd44780_t *lcd, uint64_t cyc)
+{
+    return cyc * 12000000000ULL / lcd->fosc;
+}
+
+static void violation(hd44780_t *lcd, mcs51_t *cpu, int kind, uint8_t value, uint8_t rs)
+{
+    lcd->violations[kind]++;
+    if (lcd->nlog < LCD_LOG_MAX)
+    {
+        lcd_violation_t *v = &lcd->log[lcd->nlog++];
+
+        v->at = cpu->cycles;
+        v->kind = (uint8_t)kind;
+        v->rs = rs;
+        v->value = value;
+    }
+}
+
+/************************************************************
+ * Instruction execution
+ ************************************************************/
+
+// Next DDRAM address honouring the 1- or 2-line address map
+static uint8_t ddram_step(const hd44780_t *lcd, uint8_t a, int up)
+{
+    if (!lcd->two_lines)
+        return up ? (a >= 79 ? 0 : a + 1) : (a == 0 ? 79 : a - 1);
+    if (up)
+        return a == 0x27 ? 0x40 : a == 0x67 ? 0x00 : a + 1;
+    return a == 0x40 ? 0x27 : a == 0x00 ? 0x67 : a - 1;
+}
+
+static int visible(const hd44780_t *lcd, uint8_t a)
+{
+    int col;
+
+    if (!lcd->two_lines)
+        return a < LCD_COLS;    // Single-line mode shows one row
+    col = (a & 0x3F) - lcd->shift;
+    if (col < 0)
+        col += 40;
+    return (a & 0x3F) < 40 && col < LCD_COLS;
+}
+
+static void display_shift(hd44780_t *lcd, int right)
+{
+    lcd->shift = right ? (lcd->shift + 39) % 40 : (lcd->shift + 1) % 40;
+    lcd->version++;
+}
+
+static uint64_t execute_command(hd44780_t *lcd, uint8_t cmd)
+{
+    lcd->commands++;
+
+    if (cmd & 0x80)                         // Set DDRAM address
+    {
+        lcd->ac = cmd & 0x7F;
+        lcd->cg_select = 0;
+    }
+    else if (cmd & 0x40)                    // Set CGRAM address
+    {
+        lcd->ac = cmd & 0x3F;
+        lcd->cg_select = 1;
+    }
+    else if (cmd & 0x20)                    // Function set
+    {
+        lcd->bus8 = (cmd & 0x10) ? 1 : 0;
+        lcd->two_lines = (cmd & 0x08) ? 1 : 0;
+        lcd->version++;
+    }
+    else if (cmd & 0x10)                    // Cursor / display shift
+    {
+        if (cmd & 0x08)
+            display_shift(lcd, cmd & 0x04);
+        else if (lcd->cg_select)
+            lcd->ac = (lcd->ac + ((cmd & 0x04) ? 1 : 63)) & 0x3F;
+        else
+            lcd->ac = ddram_step(lcd, lcd->ac, cmd & 0x04);
+        lcd->version++;
+    }
+    else if (cmd & 0x08)                    // Display on/off control
+    {
+        lcd->display_on = (cmd & 0x04) ? 1 : 0;
+        lcd->cursor_on = (cmd & 0x02) ? 1 : 0;
+        lcd->blink_on = (cmd & 0x01) ? 1 : 0;
+        lcd->version++;
+    }
+    else if (cmd & 0x04)                    // Entry mode set
+    {
+        lcd->inc = (cmd & 0x02) ? 1 : 0;
+        lcd->shift_on_write = (cmd & 0x01) ? 1 : 0;
+    }
+    else if (cmd & 0x02)                    // Return home
+    {
+        lcd->ac = 0;
+        lcd->cg_select = 0;
+        lcd->shift = 0;
+        lcd->version++;
+        return T_HOME_NS;
+    }
+    else if (cmd & 0x01)                    // Clear display
+    {
+        memset(lcd->ddram, ' ', sizeof(lcd->ddram));
+        lcd->ac = 0;
+        lcd->cg_select = 0;
+        lcd->shift = 0;
+        lcd->inc = 1;
+        lcd->version++;
+        return T_HOME_NS;
+    }
+    return T_EXEC_NS;
+}
+
+static uint64_t execute_data(hd44780_t *lcd, uint8_t val)
+{
+    lcd->data_writes++;
+
+    if (lcd->cg_select)
+    {
+        lcd->cgram[lcd->ac & 0x3F] = val;
+        lcd->ac = (lcd->ac + (lcd->inc ? 1 : 63)) & 0x3F;
+    }
+    else
+    {
+        if (!visible(lcd, lcd->ac))
+            lcd->offscreen_writes++;
+        lcd->ddram[lcd->ac & 0x7F] = val;
+        lcd->ac = ddram_step(lcd, lcd->ac, lcd->inc);
+        if (lcd->shift_on_write)
+            display_shift(lcd, !lcd->inc);
+    }
+    lcd->version++;
+    return T_DATA_NS;
+}
+
+// One complete bus transfer (8-bit, or two nibbles in 4-bit mode)
+static void transfer(hd44780_t *lcd, mcs51_t *cpu, uint8_t rs, uint8_t val)
+{
+    uint64_t ns;
+
+    if (rs)
+    {
+        ns = execute_data(lcd, val);
+    }
+    else
+    {
+        ns = execute_command(lcd, val);
+
+        // Initialise-by-instruction: 0x3x written while still in 8-bit mode
+        if ((val & 0xF0) == 0x30 && lcd->bus8)
+        {
+            lcd->init_count++;
+            if (lcd->init_count == 1)
+                ns = T_INIT1_NS;
+            else if (lcd->init_count == 2)
+                ns = T_INIT2_NS;
+        }
+    }
+    lcd->busy_until = cpu->cycles + ns_to_cycles(lcd, ns);
+}
+
+/************************************************************
+ * Bus decoding
+ ************************************************************/
+
+static void en_falling(hd44780_t *lcd, mcs51_t *cpu, uint8_t pins)
+{
+    uint8_t rs = (pins & lcd->rs_mask) ? 1 : 0;
+    uint8_t nib = (pins >> lcd->d4_bit) & 0x0F;
+    uint64_t high = cpu->cycles - lcd->en_rise;
+
+    if (cycles_to_ns(lcd, high) < T_PWEH_NS)
+        violation(lcd, cpu, LCD_V_PULSE, nib, rs);
+
+    // The busy time applies to the first nibble of the next instruction
+    if (!lcd->have_hi || lcd->bus8)
+    {
+        if (cpu->cycles < lcd->busy_until)
+        {
+            int before_power = lcd->commands + lcd->data_writes == 0 && lcd->init_count == 0;
+
+            violation(lcd, cpu, before_power ? LCD_V_POWERON : LCD_V_BUSY, nib, rs);
+            if (lcd->strict)
+                return;     // Controller ignores the write
+        }
+        else if (lcd->commands + lcd->data_writes > 0)
+        {
+            uint64_t slack = cpu->cycles - lcd->busy_until;
+
+            if (slack < lcd->min_slack)
+                lcd->min_slack = slack;
+        }
+    }
+
+    if (lcd->bus8)
+    {
+        // D0-D3 are not wired; they read as 0
+        lcd->have_hi = 0;
+        transfer(lcd, cpu, rs, (uint8_t)(nib << 4));
+    }
+    else if (!lcd->have_hi)
+    {
+        lcd->nibble_hi = nib;
+        lcd->have_hi = 1;
+    }
+    else
+    {
+        lcd->have_hi = 0;
+        transfer(lcd, cpu, rs, (uint8_t)(lcd->nibble_hi << 4 | nib));
+    }
+}
+
+static void lcd_pins(sim_dev_t *dev, mcs51_t *cpu, int port, uint8_t old, uint8_t now)
+{
+    hd44780_t *lcd = dev->ctx;
+
+    if (port != lcd->port || !((old ^ now) & lcd->en_mask))
+        return;
+
+    if (now & lcd->en_mask)
+    {
+        if (lcd->last_en_rise &&
+            cycles_to_ns(lcd, cpu->cycles - lcd->last_en_rise) < T_CYCE_NS)
+            violation(lcd, cpu, LCD_V_CYCLE, (now >> lcd->d4_bit) & 0x0F,
+                      (now & lcd->rs_mask) ? 1 : 0);
+        lcd->en_rise = cpu->cycles;
+        lcd->last_en_rise = cpu->cycles ? cpu->cycles : 1;
+    }
+    else
+    {
+        en_falling(lcd, cpu, now);
+    }
+}
+
+void hd44780_init(hd44780_t *lcd, mcs51_t *cpu)
+{
+    memset(lcd, 0, sizeof(*lcd));
+    memset(lcd->ddram, ' ', sizeof(lcd->ddram));
+    lcd->port = 2;
+    lcd->rs_mask = 1 << 2;
+    lcd->en_mask = 1 << 3;
+    lcd->d4_bit = 4;
+    lcd->inc = 1;
+    lcd->bus8 = 1;
+    lcd->fosc = cpu->fosc;
+    lcd->min_slack = UINT64_MAX;
+    lcd->busy_until = cpu->cycles + ns_to_cycles(lcd, T_POWERON_NS);
+
+    lcd->dev.name = "hd44780";
+    lcd->dev.ctx = lcd;
+    lcd->dev.pins = lcd_pins;
+    lcd->dev.next = MCS51_NEVER;
+    mcs51_attach(cpu, &lcd->dev);
+}
+
+/************************************************************
+ * Output
+ ************************************************************/
+
+void hd44780_row(const hd44780_t *lcd, int row, char *buf)
+{
+    int col;
+
+    for (col = 0; col < LCD_COLS; col++)
+    {
+        uint8_t a, ch;
+
+        if (!lcd->display_on || (row && !lcd->two_lines))
+        {
+            buf[col] = ' ';
+            continue;
+        }
+        a = (uint8_t)((lcd->shift + col) % 40 + (row ? 0x40 : 0));
+        ch = lcd->ddram[a];
+        buf[col] = ch < 0x08 ? '#' : (ch >= 0x20 && ch < 0x7F) ? (char)ch : '?';
+    }
+    buf[LCD_COLS] = 0;
+}
+
+void hd44780_render(const hd44780_t *lcd, FILE *out)
+{
+    char row[LCD_COLS + 1];
+    int r;
+
+    fprintf(out, "+----------------+\n");
+    for (r = 0; r < LCD_ROWS; r++)
+    {
+        hd44780_row(lcd, r, row);
+        fprintf(out, "|%s|\n", row);
+    }
+    fprintf(out, "+----------------+  %s%s%s AC=%02X\n",
+            lcd->display_on ? "on" : "off",
+            lcd->cursor_on ? " cursor" : "",
+            lcd->blink_on ? " blink" : "", lcd->ac);
+}
+
+uint64_t hd44780_total_violations(const hd44780_t *lcd)
+{
+    uint64_t n = 0;
+    int k;
+
+    for (k = 0; k < LCD_V_KINDS; k++)
+        n += lcd->violations[k];
+    return n;
+}
+
+void hd44780_report(const hd44780_t *lcd, FILE *out)
+{
+    unsigned i;
+    int k;
+
+    fprintf(out, "lcd          %llu commands, %llu data writes, %llu off-screen\n",
+            (unsigned long long)lcd->commands, (unsigned long long)lcd->data_writes,
+            (unsigned long long)lcd->offscreen_writes);
+    if (lcd->min_slack != UINT64_MAX)
+        fprintf(out, "lcd slack    %llu us minimum margin over busy time\n",
+                (unsigned long long)(cycles_to_ns(lcd, lcd->min_slack) / 1000));
+    fprintf(out, "lcd timing   %llu violations", (unsigned long long)hd44780_total_violations(lcd));
+    for (k = 0; k < LCD_V_KINDS; k++)
+    {
+        if (lcd->violations[k])
+            fprintf(out, ", %s %llu", kind_name[k], (unsigned long long)lcd->violations[k]);
+    }
+    fprintf(out, "\n");
+
+    for (i = 0; i < lcd->nlog; i++)
+    {
+        const lcd_violation_t *v = &lcd->log[i];
+
+        fprintf(out, "  %12.6f s  %-8s %s %02X\n",
+                (double)cycles_to_ns(lcd, v->at) * 1e-9, kind_name[v->kind],
+                v->rs ? "data" : "cmd ", v->value);
+    }
+}
@@ -0,0 +1,102 @@
+/************************************************************
+ * hd44780.h - HD44780 16x2 LCD behavioural model
+ *
+ * Watches the 4-bit bus used by lcd.c (RS = P2.2,
+ * EN = P2.3, D4-D7 = P2.4-P2.7, R/W tied low), latches
+ * nibbles on the falling edge of EN and executes the
+ * instruction set against DDRAM/CGRAM, the address counter
+ * and the display/cursor state.
+ *
+ * Every bus write is checked against the controller timing:
+ * power-on delay, the 4.1 ms / 100 us gaps of the
+ * initialise-by-instruction sequence, the busy time of the
+ * previous instruction (37 us, 1.52 ms for clear/home) and
+ * the EN pulse width and cycle time. Violations are counted
+ * and logged; in strict mode the offending write is dropped
+ * like real silicon would.
+ ************************************************************/
+
+#ifndef HD44780_H
+#define HD44780_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mcs51.h"
+
+#define LCD_COLS        16
+#define LCD_ROWS        2
+#define LCD_LOG_MAX     32
+
+// Violation kinds
+#define LCD_V_POWERON   0   // Write before the power-on delay elapsed
+#define LCD_V_BUSY      1   // Write while the previous instruction is executing
+#define LCD_V_PULSE     2   // EN high time below PWEH
+#define LCD_V_CYCLE     3   // EN cycle time below tcycE
+#define LCD_V_KINDS     4
+
+typedef struct
+{
+    uint64_t at;            // Machine cycle of the offending EN edge
+    uint8_t kind;
+    uint8_t rs;
+    uint8_t value;          // Nibble or byte being written
+} lcd_violation_t;
+
+typedef struct
+{
+    sim_dev_t dev;
+
+    // Wiring
+    int port;
+    uint8_t rs_mask, en_mask;
+    int d4_bit;             // D4..D7 on consecutive bits starting here
+
+    // Controller state
+    uint8_t ddram[128];
+    uint8_t cgram[64];
+    uint8_t ac;             // Address counter
+    uint8_t cg_select;      // Last address set was CGRAM
+    uint8_t inc;            // Entry mode I/D
+    uint8_t shift_on_write; // Entry mode S
+    uint8_t display_on, cursor_on, blink_on;
+    uint8_t bus8;           // DL: 8-bit interface (power-on default)
+    uint8_t two_lines;      // N
+    uint8_t shift;          // Display shift (0..39)
+    uint8_t nibble_hi;      // First nibble of a 4-bit transfer
+    uint8_t have_hi;
+    uint8_t init_count;     // Function-set writes seen in 8-bit mode
+
+    // Timing (machine cycles)
+    uint64_t busy_until;
+    uint64_t en_rise;
+    uint64_t last_en_rise;
+    uint32_t fosc;
+    int strict;
+
+    // Statistics
+    uint64_t commands, data_writes;
+    uint64_t offscreen_writes;  // DDRAM writes outside the visible 16x2 window
+    uint64_t violations[LCD_V_KINDS];
+    uint64_t min_slack;         // Smallest busy-time margin seen (cycles)
+    lcd_violation_t log[LCD_LOG_MAX];
+    unsigned nlog;
+    unsigned version;           // Bumped on every visible change
+} hd44780_t;
+
+// Wires the model to cpu with the lcd.c pin assignment
+void hd44780_init(hd44780_t *lcd, mcs51_t *cpu);
+
+// Copies the visible text of row (0/1) into buf (LCD_COLS chars + NUL).
+// Blank when the display is off; CGRAM glyphs show as '#'.
+void hd44780_row(const hd44780_t *lcd, int row, char *buf);
+
+// Prints the display framed, plus cursor/state line
+void hd44780_render(const hd44780_t *lcd, FILE *out);
+
+// Prints violation counts and the first logged ones
+void hd44780_report(const hd44780_t *lcd, FILE *out);
+
+uint64_t hd44780_total_violations(const hd44780_t *lcd);
+
+#endif
@@ -0,0 +1,152 @@
+/************************************************************
+ * ihex.c - Intel HEX loader
+ *
+ * Accepts data (00), EOF (01), extended segment (02),
+ * extended linear (04) and start address (03/05) records as
+ * written by Keil OH51 and SDCC packihx. Every record's
+ * checksum is verified.
+ ************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ihex.h"
+
+static int hexval(int ch)
+{
+    if (ch >= '0' && ch <= '9') return ch - '0';
+    if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    return -1;
+}
+
+static int hexbyte(const char *s)
+{
+    int h = hexval(s[0]), l = hexval(s[1]);
+
+    return (h < 0 || l < 0) ? -1 : h << 4 | l;
+}
+
+int ihex_load(const char *path, uint8_t *mem, uint32_t size, uint8_t *used,
+              ihex_info_t *info, char *err, int errlen)
+{
+    FILE *f = fopen(path, "r");
+    char line[600];
+    uint8_t rec[256 + 5];
+    uint32_t base = 0;
+    int lineno = 0, done = 0;
+    ihex_info_t inf;
+
+    memset(&inf, 0, sizeof(inf));
+    inf.lo = UINT32_MAX;
+    if (!f)
+    {
+        snprintf(err, errlen, "%s: cannot open", path);
+        return -1;
+    }
+
+    while (!done && fgets(line, sizeof(line), f))
+    {
+        char *s = line;
+        int n, i, sum = 0;
+        uint32_t addr;
+
+        lineno++;
+        while (*s == ' ' || *s == '\t')
+            s++;
+        if (*s == '\r' || *s == '\n' || *s == 0)
+            continue;
+        if (*s++ != ':')
+        {
+            snprintf(err, errlen, "%s:%d: missing ':'", path, lineno);
+            fclose(f);
+            return -1;
+        }
+
+        n = hexbyte(s);
+        if (n < 0 || (int)strlen(s) < (n + 5) * 2)
+        {
+            snprintf(err, errlen, "%s:%d: truncated record", path, lineno);
+            fclose(f);
+            return -1;
+        }
+        for (i = 0; i < n + 5; i++)
+        {
+            int b = hexbyte(s + 2 * i);
+
+            if (b < 0)
+            {
+                snprintf(err, errlen, "%s:%d: bad hex digit", path, lineno);
+                fclose(f);
+                return -1;
+            }
+            rec[i] = (uint8_t)b;
+            sum += b;
+        }
+        if (sum & 0xFF)
+        {
+            snprintf(err, errlen, "%s:%d: checksum mismatch", path, lineno);
+            fclose(f);
+            return -1;
+        }
+
+        addr = (uint32_t)(rec[1] << 8 | rec[2]);
+        switch (rec[3])
+        {
+            case 0x00:
+                for (i = 0; i < n; i++)
+                {
+                    uint32_t a = base + addr + i;
+
+                    if (a >= size)
+                    {
+                        snprintf(err, errlen, "%s:%d: address 0x%X outside memory", path, lineno, a);
+                        fclose(f);
+                        return -1;
+                    }
+                    mem[a] = rec[4 + i];
+                    if (used)
+                        used[a] = 1;
+                }
+                if (n)
+                {
+                    if (base + addr < inf.lo)
+                        inf.lo = base + addr;
+                    if (base + addr + n > inf.hi)
+                        inf.hi = base + addr + n;
+                }
+                inf.bytes += n;
+                inf.records++;
+                break;
+            case 0x01:
+                done = 1;
+                break;
+            case 0x02:
+                base = (uint32_t)(rec[4] << 8 | rec[5]) << 4;
+                break;
+            case 0x04:
+                base = (uint32_t)(rec[4] << 8 | rec[5]) << 16;
+                break;
+            case 0x03:
+            case 0x05:
+                inf.entry = (uint32_t)rec[4] << 24 | rec[5] << 16 | rec[6] << 8 | rec[7];
+                break;
+            default:
+                snprintf(err, errlen, "%s:%d: unknown record type %02X", path, lineno, rec[3]);
+                fclose(f);
+                return -1;
+        }
+    }
+    fclose(f);
+
+    if (!done)
+    {
+        snprintf(err, errlen, "%s: no end-of-file record", path);
+        return -1;
+    }
+    if (inf.lo == UINT32_MAX)
+        inf.lo = 0;
+    if (info)
+        *info = inf;
+    return 0;
+}
@@ -0,0 +1,23 @@
+/************************************************************
+ * ihex.h - Intel HEX loader
+ ************************************************************/
+
+#ifndef IHEX_H
+#define IHEX_H
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t lo, hi;        // Lowest / one past highest address written
+    uint32_t bytes;         // Data bytes loaded
+    uint32_t records;       // Data records
+    uint32_t entry;         // Start address record, or 0
+} ihex_info_t;
+
+// Loads path into mem[0..size); 'used', if given, gets 1 for every byte written.
+// Returns 0 on success, -1 with a message in err on failure.
+int ihex_load(const char *path, uint8_t *mem, uint32_t size, uint8_t *used,
+              ihex_info_t *info, char *err, int errlen);
+
+#endif
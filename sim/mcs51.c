@@ -0,0 +1,1527 @@
+/************************************************************
+ * mcs51.c - MCS-51 instruction-set simulator core
+ *
+ * See mcs51.h for the model. Timing follows the Intel
+ * MCS-51 instruction table; peripherals are advanced by the
+ * machine cycles of each instruction, and interrupt entry
+ * costs the 2 cycles of the hardware LCALL.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mcs51.h"
+
+#define A       c->sfr[SFR_ACC - 0x80]
+#define B       c->sfr[SFR_B - 0x80]
+#define PSW     c->sfr[SFR_PSW - 0x80]
+#define SP      c->sfr[SFR_SP - 0x80]
+#define DPL     c->sfr[SFR_DPL - 0x80]
+#define DPH     c->sfr[SFR_DPH - 0x80]
+#define TCON    c->sfr[SFR_TCON - 0x80]
+#define TMOD    c->sfr[SFR_TMOD - 0x80]
+#define SCON    c->sfr[SFR_SCON - 0x80]
+#define IE      c->sfr[SFR_IE - 0x80]
+#define IP      c->sfr[SFR_IP - 0x80]
+#define PCON    c->sfr[SFR_PCON - 0x80]
+#define DPTR    ((uint16_t)(DPH << 8 | DPL))
+#define R(n)    c->iram[(PSW & PSW_RS) + (n)]
+#define CARRY   ((PSW & PSW_CY) ? 1 : 0)
+
+#define P3_INT0 0x04
+#define P3_INT1 0x08
+#define P3_T0   0x10
+#define P3_T1   0x20
+
+// Instruction lengths in bytes
+const uint8_t mcs51_oplen[256] =
+{
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    1, 2, 3, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0
+    3, 2, 3, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 1
+    3, 2, 1, 1, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 2
+    3, 2, 1, 1, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 3
+    2, 2, 2, 3, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 4
+    2, 2, 2, 3, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 5
+    2, 2, 2, 3, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 6
+    2, 2, 2, 1, 2, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // 7
+    2, 2, 2, 1, 1, 3, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // 8
+    3, 2, 2, 1, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 9
+    2, 2, 2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // A
+    2, 2, 2, 1, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,  // B
+    2, 2, 2, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // C
+    2, 2, 2, 1, 1, 3, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2,  // D
+    1, 2, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // E
+    1, 2, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1   // F
+};
+
+// Machine cycles per instruction
+const uint8_t mcs51_opcycles[256] =
+{
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    1, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 0
+    2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 1
+    2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 2
+    2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 3
+    2, 2, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 4
+    2, 2, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 5
+    2, 2, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 6
+    2, 2, 2, 2, 1, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 7
+    2, 2, 2, 2, 4, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // 8
+    2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // 9
+    2, 2, 1, 2, 4, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // A
+    2, 2, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,  // B
+    2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // C
+    2, 2, 1, 1, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2,  // D
+    2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,  // E
+    2, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1   // F
+};
+
+static uint8_t parity(uint8_t v)
+{
+    v ^= v >> 4;
+    v ^= v >> 2;
+    v ^= v >> 1;
+    return v & 1;
+}
+
+/************************************************************
+ * Pins, edges and device notification
+ ************************************************************/
+
+uint8_t mcs51_pins(const mcs51_t *c, int port)
+{
+    return c->sfr[(SFR_P0 + (port << 4)) - 0x80] & c->pin_ext[port];
+}
+
+static int timer_runs(mcs51_t *c, int t)
+{
+    uint8_t mode = TMOD >> (t * 4);
+    uint8_t gate_pin = t ? P3_INT1 : P3_INT0;
+
+    if (!(TCON & (t ? TCON_TR1 : TCON_TR0)))
+        return 0;
+    return !(mode & 0x08) || (mcs51_pins(c, 3) & gate_pin);
+}
+
+static uint64_t timer_inc(mcs51_t *c, int t, uint64_t n);
+
+#define TCON_FLAGS  (TCON_TF1 | TCON_TF0 | TCON_IE1 | TCON_IE0)
+
+// Reports interrupt flags that changed since the last call to the devices
+static void tcon_changed(mcs51_t *c)
+{
+    uint8_t now = TCON & TCON_FLAGS, old = c->tcon_flags;
+    sim_dev_t *d;
+
+    if (now == old)
+        return;
+    c->tcon_flags = now;
+    for (d = c->devs; d; d = d->link)
+    {
+        if (d->tcon)
+            d->tcon(d, c, old, now);
+    }
+}
+
+static void pins_changed(mcs51_t *c, int port, uint8_t old)
+{
+    uint8_t now = mcs51_pins(c, port);
+    uint8_t fell = old & ~now;
+    sim_dev_t *d;
+
+    if (now == old)
+        return;
+
+    if (port == 3)
+    {
+        if ((fell & P3_INT0) && (TCON & TCON_IT0))
+            TCON |= TCON_IE0;
+        if ((fell & P3_INT1) && (TCON & TCON_IT1))
+            TCON |= TCON_IE1;
+        if ((fell & P3_T0) && (TMOD & 0x04) && timer_runs(c, 0))
+            timer_inc(c, 0, 1);
+        if ((fell & P3_T1) && (TMOD & 0x40) && timer_runs(c, 1))
+            timer_inc(c, 1, 1);
+    }
+
+    for (d = c->devs; d; d = d->link)
+    {
+        if (d->pins)
+            d->pins(d, c, port, old, now);
+    }
+    if (port == 3)
+        tcon_changed(c);
+}
+
+void mcs51_drive(mcs51_t *c, int port, uint8_t mask, uint8_t value)
+{
+    uint8_t old = mcs51_pins(c, port);
+
+    if (c->on_drive)
+        c->on_drive(c, port, mask, value, c->on_drive_ctx);
+    c->pin_ext[port] = (c->pin_ext[port] & ~mask) | (value & mask);
+    pins_changed(c, port, old);
+}
+
+/************************************************************
+ * Timers and serial port
+ ************************************************************/
+
+static void serial_t1_overflows(mcs51_t *c, uint64_t n)
+{
+    c->t1_ovf += (uint32_t)n;
+    if (c->tx_busy && c->tx_t1_left)
+    {
+        c->tx_t1_left = n >= c->tx_t1_left ? 0 : c->tx_t1_left - (uint32_t)n;
+    }
+}
+
+// Applies n count pulses to timer t; returns the overflow count
+static uint64_t timer_inc(mcs51_t *c, int t, uint64_t n)
+{
+    uint8_t *tl = &c->sfr[(t ? SFR_TL1 : SFR_TL0) - 0x80];
+    uint8_t *th = &c->sfr[(t ? SFR_TH1 : SFR_TH0) - 0x80];
+    uint8_t tf = t ? TCON_TF1 : TCON_TF0;
+    uint8_t mode = (TMOD >> (t * 4)) & 0x03;
+    uint64_t v, ovf = 0;
+
+    if (t == 1 && mode == 3)
+        return 0;   // Timer1 halts in mode 3
+
+    // Timer0 mode 3: TL0 is an 8-bit timer/counter here; TH0 runs from advance_timers()
+    if (t == 0 && mode == 3)
+    {
+        v = *tl + n;
+        ovf = v >> 8;
+        *tl = (uint8_t)v;
+    }
+    else if (mode == 0)
+    {
+        v = ((uint64_t)*th << 5 | (*tl & 0x1F)) + n;
+        ovf = v >> 13;
+        v &= 0x1FFF;
+        *th = (uint8_t)(v >> 5);
+        *tl = (*tl & 0xE0) | (v & 0x1F);
+    }
+    else if (mode == 1)
+    {
+        v = ((uint64_t)*th << 8 | *tl) + n;
+        ovf = v >> 16;
+        *th = (uint8_t)(v >> 8);
+        *tl = (uint8_t)v;
+    }
+    else
+    {
+        uint64_t period = 256 - *th;
+
+        v = *tl + n;
+        if (v > 0xFF)
+        {
+            v -= 256;
+            ovf = 1 + v / period;
+            *tl = (uint8_t)(*th + v % period);
+        }
+        else
+        {
+            *tl = (uint8_t)v;
+        }
+    }
+
+    if (ovf)
+    {
+        // With Timer0 in mode 3, TH0 owns TF1 and Timer1 only clocks the UART
+        if (!(t == 1 && (TMOD & 0x03) == 3))
+            TCON |= tf;
+        if (t == 1)
+            serial_t1_overflows(c, ovf);
+    }
+    return ovf;
+}
+
+static void advance_timers(mcs51_t *c, uint64_t n)
+{
+    if (!(TMOD & 0x04) && timer_runs(c, 0))
+        timer_inc(c, 0, n);
+
+    if ((TMOD & 0x03) == 3)
+    {
+        // TH0 as 8-bit timer gated by TR1 only
+        if (TCON & TCON_TR1)
+        {
+            uint64_t v = c->sfr[SFR_TH0 - 0x80] + n;
+
+            c->sfr[SFR_TH0 - 0x80] = (uint8_t)v;
+            if (v >> 8)
+                TCON |= TCON_TF1;
+        }
+        // Timer1 keeps running (mode 0-2) without TF1 as long as it is not in mode 3
+        if (!(TMOD & 0x40) && (TMOD & 0x30) != 0x30)
+            timer_inc(c, 1, n);
+    }
+    else if (!(TMOD & 0x40) && timer_runs(c, 1))
+    {
+        timer_inc(c, 1, n);
+    }
+    tcon_changed(c);
+}
+
+// Cycles until timer t overflows when clocked by the oscillator
+static uint64_t timer_horizon(mcs51_t *c, int t)
+{
+    uint8_t tl = c->sfr[(t ? SFR_TL1 : SFR_TL0) - 0x80];
+    uint8_t th = c->sfr[(t ? SFR_TH1 : SFR_TH0) - 0x80];
+
+    switch ((TMOD >> (t * 4)) & 0x03)
+    {
+        case 0:  return 0x2000 - ((unsigned)th << 5 | (tl & 0x1F));
+        case 1:  return 0x10000 - ((unsigned)th << 8 | tl);
+        case 2:  return 0x100 - tl;
+        default: return t ? MCS51_NEVER : (uint64_t)(0x100 - tl);
+    }
+}
+
+static unsigned serial_bits(mcs51_t *c)
+{
+    return (SCON & 0xC0) == 0x40 ? 10 : 11;     // Mode 1: 8N1, modes 2/3: 9 data bits
+}
+
+static int serial_uses_t1(mcs51_t *c)
+{
+    return (SCON & 0x40) != 0;      // Modes 1 and 3
+}
+
+// Machine cycles for one frame in modes 0/2, or an estimate for 1/3
+static uint64_t serial_frame_cycles(mcs51_t *c)
+{
+    unsigned smod = (PCON & 0x80) ? 1 : 0;
+
+    switch (SCON >> 6)
+    {
+        case 0:  return 8;
+        case 2:  return (11 * (smod ? 32 : 64) + 11) / 12;
+        default:
+        {
+            unsigned period = ((TMOD & 0x30) == 0x20) ? 256 - c->sfr[SFR_TH1 - 0x80] : 256;
+
+            return (uint64_t)serial_bits(c) * (smod ? 16 : 32) * period;
+        }
+    }
+}
+
+static void serial_start_tx(mcs51_t *c, uint8_t byte)
+{
+    unsigned smod = (PCON & 0x80) ? 1 : 0;
+
+    c->tx_byte = byte;
+    c->tx_tb8 = (SCON & SCON_TB8) ? 1 : 0;
+    c->tx_busy = 1;
+    if (serial_uses_t1(c))
+    {
+        c->tx_t1_left = serial_bits(c) * (smod ? 16 : 32);
+        c->tx_done = MCS51_NEVER;
+    }
+    else
+    {
+        c->tx_t1_left = 0;
+        c->tx_done = c->cycles + serial_frame_cycles(c);
+    }
+}
+
+static void serial_poll(mcs51_t *c)
+{
+    sim_dev_t *d;
+
+    if (c->tx_busy &&
+        (serial_uses_t1(c) ? c->tx_t1_left == 0 : c->cycles >= c->tx_done))
+    {
+        c->tx_busy = 0;
+        SCON |= SCON_TI;
+        for (d = c->devs; d; d = d->link)
+        {
+            if (d->uart_tx)
+                d->uart_tx(d, c, c->tx_byte, c->tx_tb8);
+        }
+    }
+
+    if (c->rx_head != c->rx_tail && (SCON & SCON_REN) && !(SCON & SCON_RI) &&
+        c->cycles >= c->rx_ready)
+    {
+        c->sbuf_rx = c->rx_queue[c->rx_tail++];
+        SCON = (SCON & ~SCON_RB8) | SCON_RI | SCON_RB8;   // Stop bit / 9th bit = 1
+        c->rx_ready = c->cycles + serial_frame_cycles(c);
+    }
+}
+
+void mcs51_uart_rx(mcs51_t *c, uint8_t byte)
+{
+    if ((uint8_t)(c->rx_head + 1) == c->rx_tail)
+        return;     // Queue full, byte lost like a real overrun
+    if (c->rx_head == c->rx_tail && c->rx_ready < c->cycles)
+        c->rx_ready = c->cycles + serial_frame_cycles(c);
+    c->rx_queue[c->rx_head++] = byte;
+}
+
+/************************************************************
+ * Data memory access
+ ************************************************************/
+
+static uint8_t sfr_read(mcs51_t *c, uint8_t a)
+{
+    switch (a)
+    {
+        case SFR_P0: return mcs51_pins(c, 0);
+        case SFR_P1: return mcs51_pins(c, 1);
+        case SFR_P2: return mcs51_pins(c, 2);
+        case SFR_P3: return mcs51_pins(c, 3);
+        case SFR_SBUF: return c->sbuf_rx;
+        case SFR_PSW: return (PSW & ~PSW_P) | parity(A);
+        default: return c->sfr[a - 0x80];
+    }
+}
+
+static void sfr_write(mcs51_t *c, uint8_t a, uint8_t v)
+{
+    uint8_t old;
+
+    switch (a)
+    {
+        case SFR_P0: case SFR_P1: case SFR_P2: case SFR_P3:
+            old = mcs51_pins(c, (a >> 4) & 3);
+            c->sfr[a - 0x80] = v;
+            pins_changed(c, (a >> 4) & 3, old);
+            return;
+        case SFR_SBUF:
+            serial_start_tx(c, v);
+            return;
+        case SFR_PCON:
+            PCON = v & 0x8F;
+            if (v & 0x02)
+                c->powerdown = 1;
+            else if (v & 0x01)
+                c->idle = 1;
+            return;
+        case SFR_IE:
+        case SFR_IP:
+            c->irq_hold = 1;
+            break;
+        case SFR_SP:
+            if (v > c->sp_max)
+                c->sp_max = v;
+            break;
+        case SFR_TCON:
+            TCON = v;
+            tcon_changed(c);
+            return;
+    }
+    c->sfr[a - 0x80] = v;
+}
+
+static uint8_t rd_dir(mcs51_t *c, uint8_t a)
+{
+    return a < 0x80 ? c->iram[a] : sfr_read(c, a);
+}
+
+// Read-modify-write instructions see port latches, not pins
+static uint8_t rd_latch(mcs51_t *c, uint8_t a)
+{
+    if (a < 0x80)
+        return c->iram[a];
+    return a == SFR_PSW ? sfr_read(c, a) : c->sfr[a - 0x80];
+}
+
+static void wr_dir(mcs51_t *c, uint8_t a, uint8_t v)
+{
+    if (a < 0x80)
+        c->iram[a] = v;
+    else
+        sfr_write(c, a, v);
+}
+
+uint8_t mcs51_read_direct(mcs51_t *c, uint8_t a)
+{
+    return a == SFR_SBUF ? c->sbuf_rx : rd_dir(c, a);
+}
+
+void mcs51_write_direct(mcs51_t *c, uint8_t a, uint8_t v)
+{
+    wr_dir(c, a, v);
+}
+
+static uint8_t bit_byte(uint8_t b)
+{
+    return b < 0x80 ? 0x20 + (b >> 3) : b & 0xF8;
+}
+
+static int rd_bit(mcs51_t *c, uint8_t b)
+{
+    return (rd_dir(c, bit_byte(b)) >> (b & 7)) & 1;
+}
+
+static int rd_bit_latch(mcs51_t *c, uint8_t b)
+{
+    return (rd_latch(c, bit_byte(b)) >> (b & 7)) & 1;
+}
+
+static void wr_bit(mcs51_t *c, uint8_t b, int v)
+{
+    uint8_t a = bit_byte(b);
+    uint8_t m = 1 << (b & 7);
+    uint8_t x = rd_latch(c, a);
+
+    wr_dir(c, a, v ? (x | m) : (x & ~m));
+}
+
+static void push(mcs51_t *c, uint8_t v)
+{
+    SP++;
+    if (SP > c->sp_max)
+        c->sp_max = SP;
+    c->iram[SP] = v;
+}
+
+static uint8_t pop(mcs51_t *c)
+{
+    return c->iram[SP--];
+}
+
+/************************************************************
+ * ALU helpers
+ ************************************************************/
+
+static void add(mcs51_t *c, uint8_t v, int cy)
+{
+    unsigned a = A;
+    unsigned r = a + v + cy;
+
+    PSW &= ~(PSW_CY | PSW_AC | PSW_OV);
+    if (r > 0xFF)
+        PSW |= PSW_CY;
+    if ((a & 0x0F) + (v & 0x0F) + cy > 0x0F)
+        PSW |= PSW_AC;
+    if (~(a ^ v) & (a ^ r) & 0x80)
+        PSW |= PSW_OV;
+    A = (uint8_t)r;
+}
+
+static void subb(mcs51_t *c, uint8_t v)
+{
+    int cy = CARRY;
+    unsigned a = A;
+    unsigned r = (a - v - cy) & 0xFF;
+
+    PSW &= ~(PSW_CY | PSW_AC | PSW_OV);
+    if ((int)a - (int)v - cy < 0)
+        PSW |= PSW_CY;
+    if ((int)(a & 0x0F) - (int)(v & 0x0F) - cy < 0)
+        PSW |= PSW_AC;
+    if ((a ^ v) & (a ^ r) & 0x80)
+        PSW |= PSW_OV;
+    A = (uint8_t)r;
+}
+
+static uint8_t src_operand(mcs51_t *c, uint8_t op, uint8_t o1)
+{
+    switch (op & 0x0F)
+    {
+        case 0x4: return o1;
+        case 0x5: return rd_dir(c, o1);
+        case 0x6: case 0x7: return c->iram[R(op & 1)];
+        default: return R(op & 7);
+    }
+}
+
+/************************************************************
+ * Interrupts
+ ************************************************************/
+
+// Source number of the interrupt the CPU would accept now (level in *lvl), or -1.
+// Level-triggered request flags are refreshed from the pins on the way.
+static int irq_pick(mcs51_t *c, int *lvl)
+{
+    uint8_t req = 0;
+    int i, hi;
+
+    if (!(IE & 0x80))
+        return -1;
+
+    // Level-triggered external interrupts follow the pin
+    if (!(TCON & TCON_IT0))
+        TCON = (mcs51_pins(c, 3) & P3_INT0) ? TCON & ~TCON_IE0 : TCON | TCON_IE0;
+    if (!(TCON & TCON_IT1))
+        TCON = (mcs51_pins(c, 3) & P3_INT1) ? TCON & ~TCON_IE1 : TCON | TCON_IE1;
+
+    if (TCON & TCON_IE0) req |= 0x01;
+    if (TCON & TCON_TF0) req |= 0x02;
+    if (TCON & TCON_IE1) req |= 0x04;
+    if (TCON & TCON_TF1) req |= 0x08;
+    if (SCON & (SCON_RI | SCON_TI)) req |= 0x10;
+    req &= IE & 0x1F;
+    if (!req)
+        return -1;
+
+    // High-priority requests first, each level in polling order
+    for (hi = 1; hi >= 0; hi--)
+    {
+        uint8_t lv = hi ? (req & IP) : (req & ~IP);
+
+        if (!lv)
+            continue;
+        if (c->isr_active & 2)
+            return -1;
+        if (!hi && c->isr_active)
+            return -1;
+        for (i = 0; i < IRQ_COUNT; i++)
+        {
+            if (lv & (1 << i))
+                break;
+        }
+        *lvl = hi ? 2 : 1;
+        return i;
+    }
+    return -1;
+}
+
+// Returns 1 and vectors if an interrupt is accepted
+static int irq_dispatch(mcs51_t *c)
+{
+    int i, lvl;
+
+    if (c->irq_hold)
+    {
+        c->irq_hold = 0;
+        return 0;
+    }
+    i = irq_pick(c, &lvl);
+    if (i < 0)
+        return 0;
+
+    switch (i)
+    {
+        case IRQ_INT0:   if (TCON & TCON_IT0) TCON &= ~TCON_IE0; break;
+        case IRQ_TIMER0: TCON &= ~TCON_TF0; break;
+        case IRQ_INT1:   if (TCON & TCON_IT1) TCON &= ~TCON_IE1; break;
+        case IRQ_TIMER1: TCON &= ~TCON_TF1; break;
+        default: break; // RI/TI are cleared by software
+    }
+    tcon_changed(c);
+
+    push(c, (uint8_t)c->pc);
+    push(c, (uint8_t)(c->pc >> 8));
+    c->pc = (uint16_t)(0x03 + 8 * i);
+    c->isr_active |= lvl;
+    if (c->idle)
+    {
+        c->idle = 0;
+        PCON &= ~0x01;
+    }
+    return 1;
+}
+
+/************************************************************
+ * Devices
+ ************************************************************/
+
+void mcs51_attach(mcs51_t *c, sim_dev_t *dev)
+{
+    sim_dev_t **p = &c->devs;
+
+    while (*p)
+        p = &(*p)->link;
+    dev->link = NULL;
+    *p = dev;
+    if (dev->next < c->next_event)
+        c->next_event = dev->next;
+}
+
+void mcs51_schedule(mcs51_t *c, sim_dev_t *dev, uint64_t at)
+{
+    dev->next = at;
+    if (at < c->next_event)
+        c->next_event = at;
+}
+
+static void dispatch_events(mcs51_t *c)
+{
+    sim_dev_t *d;
+    uint64_t next = MCS51_NEVER;
+
+    for (d = c->devs; d; d = d->link)
+    {
+        if (d->next <= c->cycles)
+        {
+            d->next = MCS51_NEVER;
+            if (d->event)
+                d->event(d, c);
+        }
+    }
+    for (d = c->devs; d; d = d->link)
+    {
+        if (d->next < next)
+            next = d->next;
+    }
+    c->next_event = next;
+}
+
+/************************************************************
+ * Reset
+ ************************************************************/
+
+void mcs51_init(mcs51_t *c, uint32_t fosc)
+{
+    memset(c, 0, sizeof(*c));
+    memset(c->code, 0xFF, sizeof(c->code));
+    c->fosc = fosc;
+    c->iram_size = 128;
+    c->next_event = MCS51_NEVER;
+    c->translate = 1;
+    mcs51_reset(c);
+}
+
+void mcs51_reset(mcs51_t *c)
+{
+    sim_dev_t *d;
+
+    memset(c->sfr, 0, sizeof(c->sfr));
+    c->sfr[SFR_P0 - 0x80] = 0xFF;
+    c->sfr[SFR_P1 - 0x80] = 0xFF;
+    c->sfr[SFR_P2 - 0x80] = 0xFF;
+    c->sfr[SFR_P3 - 0x80] = 0xFF;
+    c->sfr[SFR_SP - 0x80] = 0x07;
+    memset(c->pin_ext, 0xFF, sizeof(c->pin_ext));
+    c->pc = 0;
+    c->sp_max = 0x07;
+    c->isr_active = 0;
+    c->irq_hold = 0;
+    c->idle = 0;
+    c->powerdown = 0;
+    c->tx_busy = 0;
+    c->rx_head = c->rx_tail = 0;
+    c->rx_ready = 0;
+    c->tcon_flags = 0;
+
+    c->next_event = MCS51_NEVER;
+    for (d = c->devs; d; d = d->link)
+    {
+        if (d->next < c->next_event)
+            c->next_event = d->next;
+    }
+}
+
+/************************************************************
+ * Execution
+ ************************************************************/
+
+// Length of an idle stretch: up to the next event that can wake the CPU
+static uint64_t idle_horizon(mcs51_t *c, uint64_t limit)
+{
+    uint64_t h = limit;
+    uint64_t t;
+
+    if (c->next_event < h)
+        h = c->next_event;
+    if (c->powerdown)
+        return h;   // Only reset ends power-down
+
+    if ((IE & 0x80) && (IE & 0x02) && !(TMOD & 0x04) && timer_runs(c, 0))
+    {
+        t = c->cycles + timer_horizon(c, 0);
+        if (t < h)
+            h = t;
+    }
+    if ((IE & 0x80) && (IE & 0x08) && !(TMOD & 0x40) && timer_runs(c, 1))
+    {
+        t = c->cycles + timer_horizon(c, 1);
+        if (t < h)
+            h = t;
+    }
+    if (c->tx_busy)
+    {
+        if (!serial_uses_t1(c))
+            t = c->tx_done;
+        else if (!(TMOD & 0x40) && timer_runs(c, 1))
+            t = c->cycles + timer_horizon(c, 1);    // Frame ends on a Timer1 overflow
+        else
+            t = MCS51_NEVER;
+        if (t < h)
+            h = t;
+    }
+    if (c->rx_head != c->rx_tail && c->rx_ready < h)
+        h = c->rx_ready > c->cycles ? c->rx_ready : c->cycles + 1;
+    return h > c->cycles ? h - c->cycles : 1;
+}
+
+static void end_cycles(mcs51_t *c, unsigned n)
+{
+    c->cycles += n;
+    advance_timers(c, n);
+    serial_poll(c);
+    if (c->cycles >= c->next_event)
+        dispatch_events(c);
+}
+
+// Idle / power-down: skip straight to the next wake-up candidate
+static unsigned idle_step(mcs51_t *c, uint64_t until)
+{
+    uint64_t n;
+
+    if (!c->powerdown && irq_dispatch(c))
+    {
+        end_cycles(c, 2);
+        return 2;
+    }
+    n = idle_horizon(c, until);
+    c->cycles += n;
+    if (!c->powerdown)
+        advance_timers(c, n);
+    serial_poll(c);
+    if (c->cycles >= c->next_event)
+        dispatch_events(c);
+    return (unsigned)n;
+}
+
+// Executes one decoded instruction; c->pc already points past it (npc)
+static void exec(mcs51_t *c, uint8_t op, uint8_t o1, uint8_t o2, uint16_t npc)
+{
+    uint8_t v, *p;
+    unsigned r;
+
+    switch (op)
+    {
+        // Control flow
+        case 0x00: break;                                           // NOP
+        case 0x01: case 0x21: case 0x41: case 0x61:
+        case 0x81: case 0xA1: case 0xC1: case 0xE1:                 // AJMP
+            c->pc = (npc & 0xF800) | ((op & 0xE0) << 3) | o1;
+            break;
+        case 0x11: case 0x31: case 0x51: case 0x71:
+        case 0x91: case 0xB1: case 0xD1: case 0xF1:                 // ACALL
+            push(c, (uint8_t)npc);
+            push(c, (uint8_t)(npc >> 8));
+            c->pc = (npc & 0xF800) | ((op & 0xE0) << 3) | o1;
+            break;
+        case 0x02: c->pc = (uint16_t)(o1 << 8 | o2); break;         // LJMP
+        case 0x12:                                                  // LCALL
+            push(c, (uint8_t)npc);
+            push(c, (uint8_t)(npc >> 8));
+            c->pc = (uint16_t)(o1 << 8 | o2);
+            break;
+        case 0x22:                                                  // RET
+            c->pc = (uint16_t)(pop(c) << 8);
+            c->pc |= pop(c);
+            break;
+        case 0x32:                                                  // RETI
+            c->pc = (uint16_t)(pop(c) << 8);
+            c->pc |= pop(c);
+            if (c->isr_active & 2)
+                c->isr_active &= ~2;
+            else
+                c->isr_active &= ~1;
+            c->irq_hold = 1;
+            break;
+        case 0x73: c->pc = (uint16_t)(DPTR + A); break;             // JMP @A+DPTR
+        case 0x80: c->pc = (uint16_t)(npc + (int8_t)o1); break;     // SJMP
+        case 0x40: if (CARRY) c->pc = (uint16_t)(npc + (int8_t)o1); break;      // JC
+        case 0x50: if (!CARRY) c->pc = (uint16_t)(npc + (int8_t)o1); break;     // JNC
+        case 0x60: if (!A) c->pc = (uint16_t)(npc + (int8_t)o1); break;         // JZ
+        case 0x70: if (A) c->pc = (uint16_t)(npc + (int8_t)o1); break;          // JNZ
+        case 0x20: if (rd_bit(c, o1)) c->pc = (uint16_t)(npc + (int8_t)o2); break;   // JB
+        case 0x30: if (!rd_bit(c, o1)) c->pc = (uint16_t)(npc + (int8_t)o2); break;  // JNB
+        case 0x10:                                                  // JBC
+            if (rd_bit_latch(c, o1))
+            {
+                wr_bit(c, o1, 0);
+                c->pc = (uint16_t)(npc + (int8_t)o2);
+            }
+            break;
+        case 0xB4: case 0xB5: case 0xB6: case 0xB7:                 // CJNE
+        case 0xB8: case 0xB9: case 0xBA: case 0xBB:
+        case 0xBC: case 0xBD: case 0xBE: case 0xBF:
+        {
+            uint8_t x, y;
+
+            if (op == 0xB4)      { x = A; y = o1; }
+            else if (op == 0xB5) { x = A; y = rd_dir(c, o1); }
+            else if (op < 0xB8)  { x = c->iram[R(op & 1)]; y = o1; }
+            else                 { x = R(op & 7); y = o1; }
+            PSW = x < y ? PSW | PSW_CY : PSW & ~PSW_CY;
+            if (x != y)
+                c->pc = (uint16_t)(npc + (int8_t)o2);
+            break;
+        }
+        case 0xD5:                                                  // DJNZ dir
+            v = (uint8_t)(rd_latch(c, o1) - 1);
+            wr_dir(c, o1, v);
+            if (v)
+                c->pc = (uint16_t)(npc + (int8_t)o2);
+            break;
+        case 0xD8: case 0xD9: case 0xDA: case 0xDB:
+        case 0xDC: case 0xDD: case 0xDE: case 0xDF:                 // DJNZ Rn
+            if (--R(op & 7))
+                c->pc = (uint16_t)(npc + (int8_t)o1);
+            break;
+
+        // Accumulator-only operations
+        case 0x03: A = (uint8_t)(A >> 1 | A << 7); break;           // RR A
+        case 0x13:                                                  // RRC A
+            r = CARRY;
+            PSW = (A & 1) ? PSW | PSW_CY : PSW & ~PSW_CY;
+            A = (uint8_t)(A >> 1 | r << 7);
+            break;
+        case 0x23: A = (uint8_t)(A << 1 | A >> 7); break;           // RL A
+        case 0x33:                                                  // RLC A
+            r = CARRY;
+            PSW = (A & 0x80) ? PSW | PSW_CY : PSW & ~PSW_CY;
+            A = (uint8_t)(A << 1 | r);
+            break;
+        case 0x04: A++; break;                                      // INC A
+        case 0x14: A--; break;                                      // DEC A
+        case 0xC4: A = (uint8_t)(A << 4 | A >> 4); break;           // SWAP A
+        case 0xE4: A = 0; break;                                    // CLR A
+        case 0xF4: A = (uint8_t)~A; break;                          // CPL A
+        case 0xD4:                                                  // DA A
+            r = A;
+            if ((r & 0x0F) > 9 || (PSW & PSW_AC))
+                r += 0x06;
+            if (r > 0xFF)
+                PSW |= PSW_CY;
+            if ((r & 0x1F0) > 0x90 || (PSW & PSW_CY))
+                r += 0x60;
+            if (r > 0xFF)
+                PSW |= PSW_CY;
+            A = (uint8_t)r;
+            break;
+        case 0xA4:                                                  // MUL AB
+            r = (unsigned)A * B;
+            A = (uint8_t)r;
+            B = (uint8_t)(r >> 8);
+            PSW &= ~(PSW_CY | PSW_OV);
+            if (r > 0xFF)
+                PSW |= PSW_OV;
+            break;
+        case 0x84:                                                  // DIV AB
+            PSW &= ~(PSW_CY | PSW_OV);
+            if (B == 0)
+            {
+                PSW |= PSW_OV;
+            }
+            else
+            {
+                v = A;
+                A = v / B;
+                B = v % B;
+            }
+            break;
+
+        // INC / DEC
+        case 0x05: wr_dir(c, o1, (uint8_t)(rd_latch(c, o1) + 1)); break;
+        case 0x06: case 0x07: c->iram[R(op & 1)]++; break;
+        case 0x08: case 0x09: case 0x0A: case 0x0B:
+        case 0x0C: case 0x0D: case 0x0E: case 0x0F: R(op & 7)++; break;
+        case 0x15: wr_dir(c, o1, (uint8_t)(rd_latch(c, o1) - 1)); break;
+        case 0x16: case 0x17: c->iram[R(op & 1)]--; break;
+        case 0x18: case 0x19: case 0x1A: case 0x1B:
+        case 0x1C: case 0x1D: case 0x1E: case 0x1F: R(op & 7)--; break;
+        case 0xA3:                                                  // INC DPTR
+            if (++DPL == 0)
+                DPH++;
+            break;
+
+        // Arithmetic and logic on A
+        case 0x24: case 0x25: case 0x26: case 0x27:
+        case 0x28: case 0x29: case 0x2A: case 0x2B:
+        case 0x2C: case 0x2D: case 0x2E: case 0x2F:
+            add(c, src_operand(c, op, o1), 0);
+            break;
+        case 0x34: case 0x35: case 0x36: case 0x37:
+        case 0x38: case 0x39: case 0x3A: case 0x3B:
+        case 0x3C: case 0x3D: case 0x3E: case 0x3F:
+            add(c, src_operand(c, op, o1), CARRY);
+            break;
+        case 0x94: case 0x95: case 0x96: case 0x97:
+        case 0x98: case 0x99: case 0x9A: case 0x9B:
+        case 0x9C: case 0x9D: case 0x9E: case 0x9F:
+            subb(c, src_operand(c, op, o1));
+            break;
+        case 0x44: case 0x45: case 0x46: case 0x47:
+        case 0x48: case 0x49: case 0x4A: case 0x4B:
+        case 0x4C: case 0x4D: case 0x4E: case 0x4F:
+            A |= src_operand(c, op, o1);
+            break;
+        case 0x54: case 0x55: case 0x56: case 0x57:
+        case 0x58: case 0x59: case 0x5A: case 0x5B:
+        case 0x5C: case 0x5D: case 0x5E: case 0x5F:
+            A &= src_operand(c, op, o1);
+            break;
+        case 0x64: case 0x65: case 0x66: case 0x67:
+        case 0x68: case 0x69: case 0x6A: case 0x6B:
+        case 0x6C: case 0x6D: case 0x6E: case 0x6F:
+            A ^= src_operand(c, op, o1);
+            break;
+
+        // Logic on direct bytes (read-modify-write)
+        case 0x42: wr_dir(c, o1, rd_latch(c, o1) | A); break;
+        case 0x43: wr_dir(c, o1, rd_latch(c, o1) | o2); break;
+        case 0x52: wr_dir(c, o1, rd_latch(c, o1) & A); break;
+        case 0x53: wr_dir(c, o1, rd_latch(c, o1) & o2); break;
+        case 0x62: wr_dir(c, o1, rd_latch(c, o1) ^ A); break;
+        case 0x63: wr_dir(c, o1, rd_latch(c, o1) ^ o2); break;
+
+        // Boolean operations
+        case 0x72: if (rd_bit(c, o1)) PSW |= PSW_CY; break;          // ORL C,bit
+        case 0xA0: if (!rd_bit(c, o1)) PSW |= PSW_CY; break;         // ORL C,/bit
+        case 0x82: if (!rd_bit(c, o1)) PSW &= ~PSW_CY; break;        // ANL C,bit
+        case 0xB0: if (rd_bit(c, o1)) PSW &= ~PSW_CY; break;         // ANL C,/bit
+        case 0xA2: PSW = rd_bit(c, o1) ? PSW | PSW_CY : PSW & ~PSW_CY; break;   // MOV C,bit
+        case 0x92: wr_bit(c, o1, CARRY); break;                      // MOV bit,C
+        case 0xB2: wr_bit(c, o1, !rd_bit_latch(c, o1)); break;       // CPL bit
+        case 0xB3: PSW ^= PSW_CY; break;                             // CPL C
+        case 0xC2: wr_bit(c, o1, 0); break;                          // CLR bit
+        case 0xC3: PSW &= ~PSW_CY; break;                            // CLR C
+        case 0xD2: wr_bit(c, o1, 1); break;                          // SETB bit
+        case 0xD3: PSW |= PSW_CY; break;                             // SETB C
+
+        // Data transfer
+        case 0x74: A = o1; break;                                   // MOV A,#imm
+        case 0x75: wr_dir(c, o1, o2); break;                        // MOV dir,#imm
+        case 0x76: case 0x77: c->iram[R(op & 1)] = o1; break;       // MOV @Ri,#imm
+        case 0x78: case 0x79: case 0x7A: case 0x7B:
+        case 0x7C: case 0x7D: case 0x7E: case 0x7F: R(op & 7) = o1; break;
+        case 0x85: wr_dir(c, o2, rd_dir(c, o1)); break;             // MOV dir,dir
+        case 0x86: case 0x87: wr_dir(c, o1, c->iram[R(op & 1)]); break;
+        case 0x88: case 0x89: case 0x8A: case 0x8B:
+        case 0x8C: case 0x8D: case 0x8E: case 0x8F: wr_dir(c, o1, R(op & 7)); break;
+        case 0x90: DPH = o1; DPL = o2; break;                       // MOV DPTR,#imm16
+        case 0xA6: case 0xA7: c->iram[R(op & 1)] = rd_dir(c, o1); break;
+        case 0xA8: case 0xA9: case 0xAA: case 0xAB:
+        case 0xAC: case 0xAD: case 0xAE: case 0xAF: R(op & 7) = rd_dir(c, o1); break;
+        case 0xE5: A = rd_dir(c, o1); break;
+        case 0xE6: case 0xE7: A = c->iram[R(op & 1)]; break;
+        case 0xE8: case 0xE9: case 0xEA: case 0xEB:
+        case 0xEC: case 0xED: case 0xEE: case 0xEF: A = R(op & 7); break;
+        case 0xF5: wr_dir(c, o1, A); break;
+        case 0xF6: case 0xF7: c->iram[R(op & 1)] = A; break;
+        case 0xF8: case 0xF9: case 0xFA: case 0xFB:
+        case 0xFC: case 0xFD: case 0xFE: case 0xFF: R(op & 7) = A; break;
+        case 0x83: A = c->code[(uint16_t)(npc + A)]; break;         // MOVC A,@A+PC
+        case 0x93: A = c->code[(uint16_t)(DPTR + A)]; break;        // MOVC A,@A+DPTR
+        case 0xE0: A = c->xram[DPTR]; break;                        // MOVX A,@DPTR
+        case 0xE2: case 0xE3:
+            A = c->xram[c->sfr[SFR_P2 - 0x80] << 8 | R(op & 1)];
+            break;
+        case 0xF0: c->xram[DPTR] = A; break;                        // MOVX @DPTR,A
+        case 0xF2: case 0xF3:
+            c->xram[c->sfr[SFR_P2 - 0x80] << 8 | R(op & 1)] = A;
+            break;
+        case 0xC0: push(c, rd_dir(c, o1)); break;                   // PUSH
+        case 0xD0: wr_dir(c, o1, pop(c)); break;                    // POP
+        case 0xC5:                                                  // XCH A,dir
+            v = rd_dir(c, o1);
+            wr_dir(c, o1, A);
+            A = v;
+            break;
+        case 0xC6: case 0xC7:
+            p = &c->iram[R(op & 1)];
+            v = *p; *p = A; A = v;
+            break;
+        case 0xC8: case 0xC9: case 0xCA: case 0xCB:
+        case 0xCC: case 0xCD: case 0xCE: case 0xCF:
+            p = &R(op & 7);
+            v = *p; *p = A; A = v;
+            break;
+        case 0xD6: case 0xD7:                                       // XCHD A,@Ri
+            p = &c->iram[R(op & 1)];
+            v = *p;
+            *p = (uint8_t)((v & 0xF0) | (A & 0x0F));
+            A = (uint8_t)((A & 0xF0) | (v & 0x0F));
+            break;
+
+        default:                                                    // 0xA5 reserved
+            break;
+    }
+}
+
+unsigned mcs51_step(mcs51_t *c)
+{
+    uint16_t pc0, npc;
+    uint8_t op;
+    unsigned cyc;
+
+    if (c->idle || c->powerdown)
+        return idle_step(c, c->cycles + 0x10000);
+
+    pc0 = c->pc;
+    if (c->on_insn)
+        c->on_insn(c, pc0, c->on_insn_ctx);
+
+    op = c->code[pc0];
+    npc = (uint16_t)(pc0 + mcs51_oplen[op]);
+    c->pc = npc;
+    cyc = mcs51_opcycles[op];
+    c->insns++;
+    exec(c, op, c->code[(uint16_t)(pc0 + 1)], c->code[(uint16_t)(pc0 + 2)], npc);
+
+    if (irq_dispatch(c))
+        cyc += 2;
+    end_cycles(c, cyc);
+    return cyc;
+}
+
+/************************************************************
+ * Block translation
+ *
+ * mcs51_run() goes through a cache of pre-decoded blocks
+ * instead of fetching and decoding every instruction. A
+ * block is a run of "pure" instructions - ones that only
+ * touch A, B, PSW, DPTR, the register banks, IRAM, XRAM and
+ * code memory - ended by the first control transfer. Pure
+ * code cannot start a timer, move a pin or raise an
+ * interrupt, so while a chain of blocks ends before the next
+ * asynchronous event (device callback, timer overflow,
+ * serial frame) the per-instruction timer, serial and
+ * interrupt bookkeeping can be done once for the chain with
+ * the same result. Everything else (SFR and port access,
+ * RETI, blocks that would cross an event) goes through
+ * mcs51_step().
+ *
+ * Three delay-loop shapes are fast-forwarded in closed form,
+ * in whole iterations and never past the next event:
+ *
+ *   DJNZ Rn,$ / DJNZ dir,$       8-bit countdown
+ *   MOV A,Rl; DEC Rl; JNZ +1;    Keil C51's 16-bit
+ *   DEC Rh; MOV A,Rl; ORL A,Rh;  "while (i > 0) i--;"
+ *   JNZ back                     (delay_ms in lcd.c)
+ *   JB/JNB bit,$ / SJMP $        spin until an event
+ *
+ * Code memory is only written by the host; callers that do
+ * so after running must call mcs51_invalidate().
+ ************************************************************/
+
+#define XLAT_MAX_UOPS   32
+
+// Block kinds
+#define BLK_STEP    0   // First instruction is not pure: interpret it
+#define BLK_PURE    1   // Pre-decoded pure instructions
+#define BLK_DJNZ    2   // DJNZ counter,$
+#define BLK_CNT16   3   // Keil 16-bit countdown loop
+#define BLK_SPIN    4   // JB/JNB bit,$ or SJMP $
+
+typedef struct
+{
+    uint8_t op, o1, o2, cyc;
+    uint16_t npc;
+} uop_t;
+
+typedef struct
+{
+    uint8_t kind;
+    uint8_t n;              // Pure: number of uops
+    uint8_t a, b;           // Loops: counter / bit, high counter byte
+    uint16_t pc, len;       // Code bytes covered
+    uint32_t cycles;        // Pure: machine cycles of all uops
+    uint32_t first;         // Pure: index of the first uop
+} block_t;
+
+struct mcs51_xlat
+{
+    int32_t map[65536];     // pc -> block index + 1, 0 = not translated
+    block_t *blocks;
+    uint32_t nblocks, bcap;
+    uop_t *uops;
+    uint32_t nuops, ucap;
+};
+
+// Direct addresses whose access has no side effects
+static int dir_pure(uint8_t a)
+{
+    return a < 0x80 || a == SFR_ACC || a == SFR_B || a == SFR_PSW || a == SFR_DPL || a == SFR_DPH;
+}
+
+static int insn_pure(uint8_t op, uint8_t o1, uint8_t o2)
+{
+    switch (op)
+    {
+        case 0x32:                                                  // RETI
+            return 0;
+        case 0x05: case 0x15: case 0x25: case 0x35: case 0x45:
+        case 0x55: case 0x65: case 0x95: case 0x42: case 0x43:
+        case 0x52: case 0x53: case 0x62: case 0x63: case 0x75:
+        case 0x86: case 0x87: case 0x88: case 0x89: case 0x8A:
+        case 0x8B: case 0x8C: case 0x8D: case 0x8E: case 0x8F:
+        case 0xA6: case 0xA7: case 0xA8: case 0xA9: case 0xAA:
+        case 0xAB: case 0xAC: case 0xAD: case 0xAE: case 0xAF:
+        case 0xB5: case 0xC0: case 0xC5: case 0xD0: case 0xD5:
+        case 0xE5: case 0xF5:                                       // Direct operand in o1
+            return dir_pure(o1);
+        case 0x85:                                                  // MOV dir,dir
+            return dir_pure(o1) && dir_pure(o2);
+        case 0x10: case 0x20: case 0x30: case 0x72: case 0x82:
+        case 0x92: case 0xA0: case 0xA2: case 0xB0: case 0xB2:
+        case 0xC2: case 0xD2:                                       // Bit operand in o1
+            return dir_pure(bit_byte(o1));
+        default:
+            return 1;
+    }
+}
+
+static int insn_jumps(uint8_t op)
+{
+    if ((op & 0x0F) == 0x01)                                        // AJMP / ACALL
+        return 1;
+    if (op >= 0xB4 && op <= 0xBF)                                   // CJNE
+        return 1;
+    if ((op & 0xF8) == 0xD8)                                       // DJNZ Rn
+        return 1;
+    switch (op)
+    {
+        case 0x02: case 0x12: case 0x22: case 0x32: case 0x73: case 0x80:
+        case 0x40: case 0x50: case 0x60: case 0x70: case 0x10: case 0x20:
+        case 0x30: case 0xD5:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+// Recognises the fast-forwarded loop shapes at pc
+static int match_loop(const mcs51_t *c, uint16_t pc, block_t *b)
+{
+    const uint8_t *k = c->code;
+    uint8_t op = k[pc], o1 = k[(uint16_t)(pc + 1)], o2 = k[(uint16_t)(pc + 2)];
+    uint8_t l = op & 7, h = k[(uint16_t)(pc + 4)] & 7;
+
+    if (op == 0x80 && o1 == 0xFE)
+    {
+        b->kind = BLK_SPIN;
+        b->len = 2;
+    }
+    else if ((op == 0x20 || op == 0x30) && o2 == 0xFD)
+    {
+        b->kind = BLK_SPIN;
+        b->a = o1;
+        b->len = 3;
+    }
+    else if ((op & 0xF8) == 0xD8 && o1 == 0xFE)
+    {
+        b->kind = BLK_DJNZ;
+        b->a = l;
+        b->len = 2;
+    }
+    else if (op == 0xD5 && o1 < 0x80 && o2 == 0xFD)
+    {
+        b->kind = BLK_DJNZ;
+        b->a = o1;
+        b->len = 3;
+    }
+    else if ((op & 0xF8) == 0xE8 && o1 == (0x18 | l) && o2 == 0x70 &&
+             k[(uint16_t)(pc + 3)] == 0x01 && (k[(uint16_t)(pc + 4)] & 0xF8) == 0x18 && h != l &&
+             k[(uint16_t)(pc + 5)] == op && k[(uint16_t)(pc + 6)] == (0x48 | h) &&
+             k[(uint16_t)(pc + 7)] == 0x70 && k[(uint16_t)(pc + 8)] == 0xF7)
+    {
+        b->kind = BLK_CNT16;
+        b->a = l;
+        b->b = h;
+        b->len = 9;
+    }
+    else
+    {
+        return 0;
+    }
+    return 1;
+}
+
+static const block_t *translate(mcs51_t *c, uint16_t pc)
+{
+    mcs51_xlat_t *x = c->xlat;
+    block_t b;
+    uint16_t p = pc;
+
+    memset(&b, 0, sizeof(b));
+    b.pc = pc;
+    if (!match_loop(c, pc, &b))
+    {
+        b.first = x->nuops;
+        while (b.n < XLAT_MAX_UOPS)
+        {
+            uint8_t op = c->code[p];
+            uop_t *u;
+
+            if (!insn_pure(op, c->code[(uint16_t)(p + 1)], c->code[(uint16_t)(p + 2)]))
+                break;
+            if (x->nuops == x->ucap)
+            {
+                uint32_t cap = x->ucap ? 2 * x->ucap : 4096;
+                uop_t *n = realloc(x->uops, cap * sizeof(uop_t));
+
+                if (!n)
+                    break;
+                x->uops = n;
+                x->ucap = cap;
+            }
+            u = &x->uops[x->nuops++];
+            u->op = op;
+            u->o1 = c->code[(uint16_t)(p + 1)];
+            u->o2 = c->code[(uint16_t)(p + 2)];
+            u->cyc = mcs51_opcycles[op];
+            u->npc = (uint16_t)(p + mcs51_oplen[op]);
+            b.cycles += u->cyc;
+            b.len += mcs51_oplen[op];
+            b.n++;
+            if (insn_jumps(op) || u->npc < p)
+                break;      // Control transfer, or wrapped past 0xFFFF
+            p = u->npc;
+        }
+        b.kind = b.n ? BLK_PURE : BLK_STEP;
+        if (!b.n)
+            b.len = mcs51_oplen[c->code[pc]];
+    }
+
+    if (x->nblocks == x->bcap)
+    {
+        uint32_t cap = x->bcap ? 2 * x->bcap : 1024;
+        block_t *n = realloc(x->blocks, cap * sizeof(block_t));
+
+        if (!n)
+            return NULL;
+        x->blocks = n;
+        x->bcap = cap;
+    }
+    x->blocks[x->nblocks++] = b;
+    x->map[pc] = (int32_t)x->nblocks;
+    c->xlat_blocks++;
+    return &x->blocks[x->nblocks - 1];
+}
+
+void mcs51_invalidate(mcs51_t *c, uint32_t addr, uint32_t len)
+{
+    mcs51_xlat_t *x = c->xlat;
+    uint32_t i;
+
+    if (!x)
+        return;
+    for (i = 0; i < x->nblocks; i++)
+    {
+        const block_t *b = &x->blocks[i];
+
+        if (b->pc < addr + len && (uint32_t)b->pc + b->len > addr)
+            break;
+    }
+    if (i == x->nblocks)
+        return;
+
+    // Code writes are rare (image loads), so drop everything
+    memset(x->map, 0, sizeof(x->map));
+    x->nblocks = 0;
+    x->nuops = 0;
+}
+
+void mcs51_free(mcs51_t *c)
+{
+    if (!c->xlat)
+        return;
+    free(c->xlat->blocks);
+    free(c->xlat->uops);
+    free(c->xlat);
+    c->xlat = NULL;
+}
+
+// First cycle at which something outside the instruction stream can change state
+static uint64_t event_horizon(mcs51_t *c)
+{
+    uint64_t h = c->next_event, t;
+
+    if (!(TMOD & 0x04) && timer_runs(c, 0))
+    {
+        t = c->cycles + timer_horizon(c, 0);
+        if (t < h)
+            h = t;
+    }
+    if ((TMOD & 0x03) == 3)
+    {
+        if (TCON & TCON_TR1)
+        {
+            t = c->cycles + 0x100 - c->sfr[SFR_TH0 - 0x80];
+            if (t < h)
+                h = t;
+        }
+        if (!(TMOD & 0x40) && (TMOD & 0x30) != 0x30)
+        {
+            t = c->cycles + timer_horizon(c, 1);
+            if (t < h)
+                h = t;
+        }
+    }
+    else if (!(TMOD & 0x40) && timer_runs(c, 1))
+    {
+        t = c->cycles + timer_horizon(c, 1);
+        if (t < h)
+            h = t;
+    }
+    if (c->tx_busy && !serial_uses_t1(c) && c->tx_done < h)
+        h = c->tx_done;
+    if (c->rx_head != c->rx_tail && (SCON & SCON_REN) && !(SCON & SCON_RI) && c->rx_ready < h)
+        h = c->rx_ready;
+    return h;
+}
+
+// Whole iterations of a recognised loop that fit in budget cycles; 0 to interpret
+static uint64_t fast_forward(mcs51_t *c, const block_t *b, uint64_t budget)
+{
+    uint64_t k;
+
+    if (b->kind == BLK_SPIN)
+    {
+        uint8_t op = c->code[b->pc];
+
+        // The spun-on bit can only change at an event
+        if (op != 0x80 && rd_bit(c, b->a) != (op == 0x20))
+            return 0;
+        k = budget / 2;
+        c->cycles += 2 * k;
+        c->insns += k;
+    }
+    else if (b->kind == BLK_DJNZ)
+    {
+        uint8_t *cnt = b->len == 2 ? &R(b->a) : &c->iram[b->a];
+        unsigned iters = *cnt ? *cnt : 256;
+
+        k = budget / 2 < iters ? budget / 2 : iters;
+        *cnt = (uint8_t)(*cnt - k);
+        if (k == iters)
+            c->pc = (uint16_t)(b->pc + b->len);
+        c->cycles += 2 * k;
+        c->insns += k;
+    }
+    else
+    {
+        // 8 cycles / 6 insns per pass, +1 / +1 when the low byte borrows
+        uint8_t *lo = &R(b->a), *hi = &R(b->b);
+        uint64_t v = (uint64_t)*hi << 8 | *lo, lo_k, hi_k, borrows;
+
+        if (!v)
+            v = 0x10000;
+        lo_k = 0;
+        hi_k = budget / 8 < v ? budget / 8 : v;
+        while (lo_k < hi_k)
+        {
+            uint64_t m = (lo_k + hi_k + 1) / 2;
+
+            if (8 * m + (v >> 8) - ((v - m) >> 8) <= budget)
+                lo_k = m;
+            else
+                hi_k = m - 1;
+        }
+        k = lo_k;
+        if (!k)
+            return 0;
+        borrows = (v >> 8) - ((v - k) >> 8);
+        v = (v - k) & 0xFFFF;
+        *lo = (uint8_t)v;
+        *hi = (uint8_t)(v >> 8);
+        A = *lo | *hi;
+        if (!v)
+            c->pc = (uint16_t)(b->pc + b->len);
+        c->cycles += 8 * k + borrows;
+        c->insns += 6 * k + borrows;
+        k = 6 * k + borrows;
+    }
+    c->ff_insns += k;
+    return k;
+}
+
+// Runs translated code up to until; falls back to one interpreted step
+static void xlat_run(mcs51_t *c, uint64_t until)
+{
+    uint64_t start = c->cycles, h, stop;
+    uint8_t tcon;
+    int lvl;
+
+    if (!c->xlat)
+    {
+        c->xlat = calloc(1, sizeof(*c->xlat));
+        if (!c->xlat)
+        {
+            c->translate = 0;
+            mcs51_step(c);
+            return;
+        }
+    }
+
+    // Blocks must end by until and before the next event, with no interrupt
+    // waiting. The level-trigger refresh in irq_pick() belongs after the next
+    // instruction, not here, so TCON is put back.
+    h = event_horizon(c);
+    stop = h - 1 < until ? h - 1 : until;
+    tcon = TCON;
+    if (h <= c->cycles || irq_pick(c, &lvl) >= 0)
+    {
+        TCON = tcon;
+        mcs51_step(c);
+        return;
+    }
+    TCON = tcon;
+
+    while (1)
+    {
+        int32_t i = c->xlat->map[c->pc];
+        const block_t *b = i ? &c->xlat->blocks[i - 1] : translate(c, c->pc);
+        const uop_t *u, *e;
+
+        if (!b)
+            break;
+        if (b->kind == BLK_PURE)
+        {
+            if (c->cycles + b->cycles > stop)
+                break;
+            for (u = &c->xlat->uops[b->first], e = u + b->n; u < e; u++)
+            {
+                c->pc = u->npc;
+                exec(c, u->op, u->o1, u->o2, u->npc);
+            }
+            c->cycles += b->cycles;
+            c->insns += b->n;
+            c->xlat_insns += b->n;
+        }
+        else if (b->kind == BLK_STEP || !fast_forward(c, b, stop - c->cycles))
+        {
+            break;
+        }
+    }
+
+    if (c->cycles == start)
+    {
+        mcs51_step(c);
+        return;
+    }
+    irq_pick(c, &lvl);      // Refresh as after every instruction; nothing can be accepted
+    advance_timers(c, c->cycles - start);
+    serial_poll(c);
+    if (c->cycles >= c->next_event)
+        dispatch_events(c);
+}
+
+uint64_t mcs51_run(mcs51_t *c, uint64_t until)
+{
+    uint64_t n0 = c->insns;
+
+    while (c->cycles < until)
+    {
+        if (c->idle || c->powerdown)
+            idle_step(c, until);
+        else if (c->translate && !c->on_insn)
+            xlat_run(c, until);
+        else
+            mcs51_step(c);
+    }
+    return c->insns - n0;
+}
+
+double mcs51_seconds(const mcs51_t *c, uint64_t cycles)
+{
+    return (double)cycles * 12.0 / (double)c->fosc;
+}
+
+uint64_t mcs51_cycles(const mcs51_t *c, double seconds)
+{
+    return (uint64_t)(seconds * (double)c->fosc / 12.0 + 0.5);
+}
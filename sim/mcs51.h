@@ -0,0 +1,203 @@
+/************************************************************
+ * mcs51.h - MCS-51 instruction-set simulator core
+ *
+ * Executes the full 8051 instruction set with machine-cycle
+ * accounting (1 machine cycle = 12 oscillator periods) and
+ * models the AT89C51 on-chip peripherals used by the cluster
+ * firmware: SFRs, Timer0/Timer1 (modes 0-3, timer/counter,
+ * GATE), INT0/INT1 (edge/level), the serial port, the two
+ * priority levels and PCON idle/power-down.
+ *
+ * Port pins follow the quasi-bidirectional model: the level
+ * on a pin is the SFR latch ANDed with whatever an external
+ * device drives (1 = released). Read-modify-write
+ * instructions see the latch, all other reads see the pins.
+ *
+ * External models (LCD, ADC, pulse generators, ...) attach
+ * as sim_dev_t. They are told about pin changes, TCON
+ * interrupt flag changes and UART output and can schedule a
+ * callback at a future cycle.
+ ************************************************************/
+
+#ifndef MCS51_H
+#define MCS51_H
+
+#include <stdint.h>
+
+// SFR addresses
+#define SFR_P0    0x80
+#define SFR_SP    0x81
+#define SFR_DPL   0x82
+#define SFR_DPH   0x83
+#define SFR_PCON  0x87
+#define SFR_TCON  0x88
+#define SFR_TMOD  0x89
+#define SFR_TL0   0x8A
+#define SFR_TL1   0x8B
+#define SFR_TH0   0x8C
+#define SFR_TH1   0x8D
+#define SFR_P1    0x90
+#define SFR_SCON  0x98
+#define SFR_SBUF  0x99
+#define SFR_P2    0xA0
+#define SFR_IE    0xA8
+#define SFR_P3    0xB0
+#define SFR_IP    0xB8
+#define SFR_PSW   0xD0
+#define SFR_ACC   0xE0
+#define SFR_B     0xF0
+
+// TCON bits
+#define TCON_IT0  0x01
+#define TCON_IE0  0x02
+#define TCON_IT1  0x04
+#define TCON_IE1  0x08
+#define TCON_TR0  0x10
+#define TCON_TF0  0x20
+#define TCON_TR1  0x40
+#define TCON_TF1  0x80
+
+// SCON bits
+#define SCON_RI   0x01
+#define SCON_TI   0x02
+#define SCON_RB8  0x04
+#define SCON_TB8  0x08
+#define SCON_REN  0x10
+
+// PSW bits
+#define PSW_P     0x01
+#define PSW_OV    0x04
+#define PSW_RS    0x18
+#define PSW_F0    0x20
+#define PSW_AC    0x40
+#define PSW_CY    0x80
+
+// Interrupt sources, in hardware polling order
+#define IRQ_INT0    0
+#define IRQ_TIMER0  1
+#define IRQ_INT1    2
+#define IRQ_TIMER1  3
+#define IRQ_SERIAL  4
+#define IRQ_COUNT   5
+
+#define MCS51_NEVER  UINT64_MAX
+
+typedef struct mcs51 mcs51_t;
+typedef struct sim_dev sim_dev_t;
+typedef struct mcs51_xlat mcs51_xlat_t;
+
+// External device hooked to the pins / UART of one CPU
+struct sim_dev
+{
+    const char *name;
+    void *ctx;
+
+    // Pin levels of a port changed (latch write or external drive)
+    void (*pins)(sim_dev_t *dev, mcs51_t *cpu, int port, uint8_t old, uint8_t now);
+
+    // Byte shifted out of the serial port (tb8 = 9th bit in modes 2/3)
+    void (*uart_tx)(sim_dev_t *dev, mcs51_t *cpu, uint8_t byte, int tb8);
+
+    // Called once cpu->cycles reaches dev->next
+    void (*event)(sim_dev_t *dev, mcs51_t *cpu);
+
+    // Interrupt flags in TCON (TF1, TF0, IE1, IE0) changed
+    void (*tcon)(sim_dev_t *dev, mcs51_t *cpu, uint8_t old, uint8_t now);
+
+    uint64_t next;          // Cycle of the next event, MCS51_NEVER for none
+    sim_dev_t *link;        // Next device on this CPU
+};
+
+struct mcs51
+{
+    uint8_t code[65536];    // Program memory (MOVC / fetch)
+    uint8_t xram[65536];    // External data memory (MOVX)
+    uint8_t iram[256];      // Internal RAM (0x80-0xFF only via @Ri)
+    uint8_t sfr[128];       // SFR space 0x80-0xFF
+    uint8_t pin_ext[4];     // External drive per port, 1 = released
+
+    uint16_t pc;
+    uint64_t cycles;        // Machine cycles since reset
+    uint64_t insns;         // Instructions executed
+    uint32_t fosc;          // Crystal frequency (Hz)
+    unsigned iram_size;     // 128 for 8051, 256 for 8052 parts
+
+    uint8_t isr_active;     // Bit 0: low-priority ISR running, bit 1: high
+    uint8_t irq_hold;       // Last insn was RETI or wrote IE/IP
+    uint8_t idle;           // PCON.IDL in effect
+    uint8_t powerdown;      // PCON.PD in effect
+    uint8_t sp_max;         // Highest SP seen (stack depth tracking)
+
+    // Serial port
+    uint8_t sbuf_rx;        // Receive buffer (read side of SBUF)
+    uint64_t tx_done;       // Cycle when the current TX frame completes
+    uint8_t tx_byte;
+    uint8_t tx_tb8;
+    uint8_t tx_busy;
+    uint32_t t1_ovf;        // Timer1 overflows (serial clock in modes 1/3)
+    uint32_t tx_t1_left;    // Timer1 overflows left in a mode 1/3 frame
+    uint8_t rx_queue[256];  // Bytes waiting to be received
+    uint8_t rx_head, rx_tail;
+    uint64_t rx_ready;      // Earliest cycle the next RX byte can land
+
+    sim_dev_t *devs;
+    uint64_t next_event;    // Min of devs->next
+    uint8_t tcon_flags;     // TCON flags as last reported to devices
+
+    // Optional per-instruction hook (trace, profiler); NULL when unused
+    void (*on_insn)(mcs51_t *cpu, uint16_t pc, void *ctx);
+    void *on_insn_ctx;
+
+    // Optional hook on every mcs51_drive() call (input recording); NULL when unused
+    void (*on_drive)(mcs51_t *cpu, int port, uint8_t mask, uint8_t value, void *ctx);
+    void *on_drive_ctx;
+
+    // Block translation in mcs51_run() (on after init; off, or an
+    // on_insn hook, selects the plain interpreter)
+    uint8_t translate;
+    mcs51_xlat_t *xlat;     // Block cache, allocated on first use
+    uint32_t xlat_blocks;   // Blocks translated
+    uint64_t xlat_insns;    // Instructions run from translated blocks
+    uint64_t ff_insns;      // Instructions covered by delay-loop fast-forward
+};
+
+extern const uint8_t mcs51_oplen[256];
+extern const uint8_t mcs51_opcycles[256];
+
+void mcs51_init(mcs51_t *cpu, uint32_t fosc);
+void mcs51_reset(mcs51_t *cpu);
+
+// Releases the block cache; call before discarding or re-initialising cpu
+void mcs51_free(mcs51_t *cpu);
+
+// Drops translated code after code[addr .. addr+len) was written
+void mcs51_invalidate(mcs51_t *cpu, uint32_t addr, uint32_t len);
+
+// Executes one instruction (or one idle stretch); returns machine cycles used
+unsigned mcs51_step(mcs51_t *cpu);
+
+// Runs until cpu->cycles >= until; returns instructions executed.
+// Results are identical with and without translation.
+uint64_t mcs51_run(mcs51_t *cpu, uint64_t until);
+
+// External pin drive: bits in mask take value (1 = released, 0 = pulled low)
+void mcs51_drive(mcs51_t *cpu, int port, uint8_t mask, uint8_t value);
+
+// Current pin levels of a port (latch AND external drive)
+uint8_t mcs51_pins(const mcs51_t *cpu, int port);
+
+// Queue a byte for the serial receiver
+void mcs51_uart_rx(mcs51_t *cpu, uint8_t byte);
+
+void mcs51_attach(mcs51_t *cpu, sim_dev_t *dev);
+void mcs51_schedule(mcs51_t *cpu, sim_dev_t *dev, uint64_t at);
+
+// Direct/SFR access without side effects on the running program
+uint8_t mcs51_read_direct(mcs51_t *cpu, uint8_t addr);
+void mcs51_write_direct(mcs51_t *cpu, uint8_t addr, uint8_t val);
+
+// Converts between machine cycles and seconds
+double mcs51_seconds(const mcs51_t *cpu, uint64_t cycles);
+uint64_t mcs51_cycles(const mcs51_t *cpu, double seconds);
+
+#endif
@@ -0,0 +1,578 @@
+/************************************************************
+ * profile.c - sampling profiler for the firmware
+ *
+ * Runs Main.hex on the simulated board and samples the PC
+ * every N machine cycles. Samples are charged to the
+ * function the PC is in (from the linker map) and to the
+ * call chain that led there, which is rebuilt from the
+ * LCALL/ACALL instructions, interrupt entries and the stack
+ * pointer: a frame is dropped as soon as SP falls below the
+ * level it had right after the call, which also covers RETI
+ * and the Keil helpers that pop their return address.
+ *
+ *   profile [options] [Main.hex]
+ *     --map FILE        Keil .m51 or SDCC .map of the image
+ *     -t SEC            simulated time (default 10)
+ *     --interval N      cycles between samples (default 101)
+ *     --collapsed FILE  write the call stacks in the collapsed
+ *                       format of flamegraph.pl / speedscope
+ *     -n N              list only the N hottest functions
+ *     -w PROFILE        wheel input (default 36 km/h)
+ *     --adc-volts V     ADC input (default 0.25 V)
+ *     --replay FILE     inputs from a sim8051 --record log
+ *
+ * The flat profile lists main-loop and interrupt time as
+ * separate rows, so a delay called from both shows up twice.
+ * Self is the share of samples in the function itself, total
+ * includes the functions it called. A prime interval keeps
+ * the samples from locking onto the period of a loop.
+ *
+ * Without --replay the cluster is switched on with a press
+ * of P3.2 at 0.10 s, as in bench.
+ ************************************************************/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "board.h"
+#include "replay.h"
+#include "symmap.h"
+
+#define MAX_DEPTH       32
+#define MAX_NAMES       1024
+#define MAX_STARTS      2048
+#define STACK_SLOTS     8192        // Distinct call stacks, power of two
+
+#define OP_ACALL_MASK   0x1F
+#define OP_ACALL        0x11
+#define OP_LCALL        0x12
+
+typedef struct
+{
+    uint16_t addr;
+    uint8_t sym;            // From a symbol, else from a function segment
+    int name;
+} start_t;
+
+typedef struct
+{
+    int name;               // Function entered
+    int caller;             // Function the call was made from
+    uint8_t sp;             // SP right after the return address was pushed
+    uint8_t isr;            // Entered by an interrupt
+} frame_t;
+
+typedef struct
+{
+    uint64_t self, total;
+} count_t;
+
+typedef struct
+{
+    uint32_t hash;
+    int len;                // 0: slot free
+    int name[MAX_DEPTH + 2];
+    uint64_t samples;
+} callstack_t;
+
+typedef struct
+{
+    // Code address -> function
+    start_t start[MAX_STARTS];
+    int nstart;
+    char *names[MAX_NAMES];
+    int nnames;
+    int have_map;
+
+    // Shadow call stack
+    frame_t frame[MAX_DEPTH];
+    int depth;
+    uint64_t lost;          // Calls deeper than MAX_DEPTH
+
+    // The instruction that ran before the one now starting
+    uint16_t last_pc;
+    uint8_t last_sp, last_isr;
+
+    uint64_t interval, next_sample;
+    uint64_t samples, isr_samples;
+    count_t count[2][MAX_NAMES];    // [0] main loop, [1] interrupts
+    uint64_t isr_root[MAX_NAMES];   // Samples per interrupt handler
+    callstack_t *stacks;
+    int nstacks;
+    uint64_t stacks_dropped;
+} profile_t;
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: profile [options] [image.hex]\n"
+        "  --map FILE        Keil .m51 or SDCC .map of the image\n"
+        "  -t SEC            simulated time (default 10)\n"
+        "  --interval N      cycles between samples (default 101)\n"
+        "  --collapsed FILE  write collapsed call stacks for flame graphs\n"
+        "  -n N              list only the N hottest functions\n"
+        "  -w PROFILE        wheel input (default 36 km/h)\n"
+        "  --adc-volts V     ADC input (default 0.25 V)\n"
+        "  --replay FILE     inputs from a sim8051 --record log\n");
+    exit(2);
+}
+
+/************************************************************
+ * Names
+ ************************************************************/
+
+static int intern(profile_t *p, const char *name)
+{
+    int i;
+
+    for (i = 0; i < p->nnames; i++)
+    {
+        if (!strcmp(p->names[i], name))
+            return i;
+    }
+    if (p->nnames == MAX_NAMES)
+        return MAX_NAMES - 1;
+    p->names[p->nnames] = malloc(strlen(name) + 1);
+    if (!p->names[p->nnames])
+    {
+        fprintf(stderr, "profile: out of memory\n");
+        exit(2);
+    }
+    strcpy(p->names[p->nnames], name);
+    return p->nnames++;
+}
+
+static void add_start(profile_t *p, uint16_t addr, const char *name, int sym)
+{
+    char c_name[SYM_NAME_MAX];
+    int i;
+
+    if (p->nstart == MAX_STARTS)
+        return;
+
+    // C spelling: Keil upper-cases segment names, both tools prefix
+    // register-parameter functions with '_'
+    snprintf(c_name, sizeof(c_name), "%s", name[0] == '_' && name[1] != '_' ? name + 1 : name);
+    if (!sym)
+    {
+        for (i = 0; c_name[i]; i++)
+            c_name[i] = (char)tolower((unsigned char)c_name[i]);
+    }
+    p->start[p->nstart].addr = addr;
+    p->start[p->nstart].sym = (uint8_t)sym;
+    p->start[p->nstart].name = intern(p, c_name);
+    p->nstart++;
+}
+
+static int cmp_start(const void *a, const void *b)
+{
+    const start_t *x = a, *y = b;
+
+    if (x->addr != y->addr)
+        return (int)x->addr - (int)y->addr;
+    return x->sym - y->sym;
+}
+
+// Function starts from the Keil function segments and the global code symbols
+static void load_names(profile_t *p, const symmap_t *m)
+{
+    int i, n = 0;
+
+    p->have_map = 1;
+    for (i = 0; i < m->nseg; i++)
+    {
+        if (m->seg[i].space == SYM_CODE && m->seg[i].kind == SEG_FUNC)
+            add_start(p, m->seg[i].base, m->seg[i].name, 0);
+    }
+    for (i = 0; i < m->n; i++)
+    {
+        if (m->sym[i].space == SYM_CODE && m->sym[i].global)
+            add_start(p, m->sym[i].addr, m->sym[i].name, 1);
+    }
+    qsort(p->start, p->nstart, sizeof(p->start[0]), cmp_start);
+
+    // One entry per address; the symbol (sorted after the segment) wins
+    for (i = 0; i < p->nstart; i++)
+    {
+        if (n && p->start[n - 1].addr == p->start[i].addr)
+            p->start[n - 1] = p->start[i];
+        else
+            p->start[n++] = p->start[i];
+    }
+    p->nstart = n;
+}
+
+// Function containing addr: last start at or below it
+static int name_of(profile_t *p, uint16_t addr)
+{
+    char buf[16];
+    int lo = 0, hi = p->nstart - 1, at = -1;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+
+        if (p->start[mid].addr <= addr)
+        {
+            at = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+    if (at >= 0)
+        return p->start[at].name;
+    snprintf(buf, sizeof(buf), "sub_%04X", addr);
+    return intern(p, buf);
+}
+
+// Function the CPU is in: from the map, else the last call tracked
+static int current(profile_t *p, uint16_t pc)
+{
+    if (p->have_map)
+        return name_of(p, pc);
+    return p->depth ? p->frame[p->depth - 1].name : intern(p, "reset");
+}
+
+/************************************************************
+ * Sampling
+ ************************************************************/
+
+static void push(profile_t *p, int name, int caller, uint8_t sp, int isr)
+{
+    frame_t *f;
+
+    if (p->depth == MAX_DEPTH)
+    {
+        p->lost++;
+        return;
+    }
+    f = &p->frame[p->depth++];
+    f->name = name;
+    f->caller = caller;
+    f->sp = sp;
+    f->isr = (uint8_t)isr;
+}
+
+// Interrupt handler behind a vector (LJMP/AJMP there) for the frame name
+static uint16_t vector_target(const mcs51_t *cpu, uint16_t vec)
+{
+    uint8_t op = cpu->code[vec];
+
+    if (op == 0x02)
+        return (uint16_t)(cpu->code[(uint16_t)(vec + 1)] << 8 | cpu->code[(uint16_t)(vec + 2)]);
+    if ((op & 0x1F) == 0x01)
+        return (uint16_t)(((vec + 2) & 0xF800) | (op >> 5) << 8 | cpu->code[(uint16_t)(vec + 1)]);
+    return vec;
+}
+
+static uint32_t hash_stack(const int *name, int len)
+{
+    uint32_t h = 2166136261u;
+    int i;
+
+    for (i = 0; i < len; i++)
+    {
+        h ^= (uint32_t)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void add_stack(profile_t *p, const int *name, int len, uint64_t n)
+{
+    uint32_t h = hash_stack(name, len);
+    uint32_t i = h & (STACK_SLOTS - 1);
+
+    for (;;)
+    {
+        callstack_t *s = &p->stacks[i];
+
+        if (!s->len)
+        {
+            if (p->nstacks >= STACK_SLOTS / 2)
+            {
+                p->stacks_dropped += n;
+                return;
+            }
+            s->hash = h;
+            s->len = len;
+            memcpy(s->name, name, len * sizeof(name[0]));
+            p->nstacks++;
+        }
+        if (s->hash == h && s->len == len && !memcmp(s->name, name, len * sizeof(name[0])))
+        {
+            s->samples += n;
+            return;
+        }
+        i = (i + 1) & (STACK_SLOTS - 1);
+    }
+}
+
+// n samples of the instruction at pc with the current call stack
+static void sample(profile_t *p, uint16_t pc, uint64_t n)
+{
+    int chain[MAX_DEPTH + 2], len = 0, base = 0, isr, i, j, seen;
+    int leaf;
+
+    for (i = p->depth - 1; i >= 0; i--)
+    {
+        if (p->frame[i].isr)
+        {
+            base = i;
+            break;
+        }
+    }
+    isr = p->depth && p->frame[base].isr;
+    if (!isr && p->depth)
+        chain[len++] = p->frame[0].caller;
+    for (i = base; i < p->depth; i++)
+    {
+        // A call to a helper the map has no name for stays in the caller
+        if (!len || chain[len - 1] != p->frame[i].name)
+            chain[len++] = p->frame[i].name;
+    }
+    leaf = current(p, pc);
+    if (!len || chain[len - 1] != leaf)
+        chain[len++] = leaf;
+
+    p->samples += n;
+    if (isr)
+    {
+        p->isr_samples += n;
+        p->isr_root[p->frame[base].name] += n;
+    }
+    p->count[isr][leaf].self += n;
+    for (i = 0; i < len; i++)
+    {
+        // Recursion or a name repeated by a tail jump counts once
+        for (seen = 0, j = 0; j < i; j++)
+            seen |= chain[j] == chain[i];
+        if (!seen)
+            p->count[isr][chain[i]].total += n;
+    }
+    add_stack(p, chain, len, n);
+}
+
+static void profile_insn(mcs51_t *cpu, uint16_t pc, void *ctx)
+{
+    profile_t *p = ctx;
+    uint8_t sp = cpu->sfr[SFR_SP - 0x80];
+    uint8_t op = cpu->code[p->last_pc];
+
+    // Sample times passed while the previous instruction ran
+    if (cpu->cycles > p->next_sample)
+    {
+        uint64_t n = (cpu->cycles - 1 - p->next_sample) / p->interval + 1;
+
+        sample(p, p->last_pc, n);
+        p->next_sample += n * p->interval;
+    }
+
+    while (p->depth && sp < p->frame[p->depth - 1].sp)
+        p->depth--;
+
+    if ((op == OP_LCALL || (op & OP_ACALL_MASK) == OP_ACALL) && sp >= (uint8_t)(p->last_sp + 2))
+    {
+        uint16_t target = op == OP_LCALL ?
+            (uint16_t)(cpu->code[(uint16_t)(p->last_pc + 1)] << 8 | cpu->code[(uint16_t)(p->last_pc + 2)]) :
+            (uint16_t)(((p->last_pc + 2) & 0xF800) | (op >> 5) << 8 | cpu->code[(uint16_t)(p->last_pc + 1)]);
+
+        push(p, name_of(p, target), current(p, p->last_pc), (uint8_t)(p->last_sp + 2), 0);
+    }
+    if (cpu->isr_active & ~p->last_isr)
+        push(p, name_of(p, vector_target(cpu, pc)), -1, sp, 1);
+
+    p->last_pc = pc;
+    p->last_sp = sp;
+    p->last_isr = cpu->isr_active;
+}
+
+/************************************************************
+ * Report
+ ************************************************************/
+
+typedef struct
+{
+    int name, isr;
+    uint64_t self, total;
+} row_t;
+
+static int cmp_row(const void *a, const void *b)
+{
+    const row_t *x = a, *y = b;
+
+    if (x->self != y->self)
+        return x->self < y->self ? 1 : -1;
+    if (x->total != y->total)
+        return x->total < y->total ? 1 : -1;
+    return x->isr - y->isr;
+}
+
+static void report(profile_t *p, const mcs51_t *cpu, int top)
+{
+    static row_t rows[2 * MAX_NAMES];
+    double all = p->samples ? (double)p->samples : 1.0;
+    int n = 0, i, k;
+
+    printf("samples      %llu, one every %llu cycles (%.1f us) over %.3f s\n",
+           (unsigned long long)p->samples, (unsigned long long)p->interval,
+           mcs51_seconds(cpu, p->interval) * 1e6, mcs51_seconds(cpu, cpu->cycles));
+    printf("main loop    %5.1f%%\n", 100.0 * (p->samples - p->isr_samples) / all);
+    printf("interrupts   %5.1f%%", 100.0 * p->isr_samples / all);
+    for (i = 0; i < p->nnames; i++)
+    {
+        if (p->isr_root[i])
+            printf("  %s %.1f%%", p->names[i], 100.0 * p->isr_root[i] / all);
+    }
+    printf("\n");
+    if (p->lost)
+        printf("call depth   %llu calls beyond %d levels not tracked\n", (unsigned long long)p->lost,
+               MAX_DEPTH);
+    printf("\n");
+
+    for (k = 0; k < 2; k++)
+    {
+        for (i = 0; i < p->nnames; i++)
+        {
+            if (!p->count[k][i].total)
+                continue;
+            rows[n].name = i;
+            rows[n].isr = k;
+            rows[n].self = p->count[k][i].self;
+            rows[n].total = p->count[k][i].total;
+            n++;
+        }
+    }
+    qsort(rows, n, sizeof(rows[0]), cmp_row);
+    printf("%7s %7s %10s  %-5s %s\n", "self%", "total%", "samples", "ctx", "function");
+    for (i = 0; i < n && (top < 0 || i < top); i++)
+        printf("%6.1f%% %6.1f%% %10llu  %-5s %s\n", 100.0 * rows[i].self / all,
+               100.0 * rows[i].total / all, (unsigned long long)rows[i].self,
+               rows[i].isr ? "isr" : "main", p->names[rows[i].name]);
+}
+
+static int write_collapsed(const profile_t *p, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    int i, j;
+
+    if (!f)
+        return -1;
+    for (i = 0; i < STACK_SLOTS; i++)
+    {
+        const callstack_t *s = &p->stacks[i];
+
+        if (!s->len)
+            continue;
+        for (j = 0; j < s->len; j++)
+            fprintf(f, "%s%s", j ? ";" : "", p->names[s->name[j]]);
+        fprintf(f, " %llu\n", (unsigned long long)s->samples);
+    }
+    if (p->stacks_dropped)
+        fprintf(f, "(other stacks) %llu\n", (unsigned long long)p->stacks_dropped);
+    return fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    static board_t board;
+    static profile_t prof;
+    static replay_t rep;
+    symmap_t map;
+    mcs51_t *cpu = &board.cpu;
+    const char *image = "Main.hex", *map_path = NULL, *collapsed = NULL;
+    const char *wheel = "36", *rep_path = NULL;
+    double seconds = 10.0, adc_volts = 0.25;
+    uint32_t fosc = 12000000;
+    char err[256];
+    int i, top = -1;
+
+    prof.interval = 101;
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--map") && i + 1 < argc)
+            map_path = argv[++i];
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--interval") && i + 1 < argc)
+            prof.interval = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--collapsed") && i + 1 < argc)
+            collapsed = argv[++i];
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)
+            top = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+            wheel = argv[++i];
+        else if (!strcmp(argv[i], "--adc-volts") && i + 1 < argc)
+            adc_volts = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+            rep_path = argv[++i];
+        else if (argv[i][0] == '-')
+            usage();
+        else
+            image = argv[i];
+    }
+    if (seconds <= 0 || prof.interval == 0)
+        usage();
+
+    if (map_path)
+    {
+        if (symmap_load(&map, map_path, err, sizeof(err)))
+        {
+            fprintf(stderr, "profile: %s\n", err);
+            return 2;
+        }
+        load_names(&prof, &map);
+        symmap_free(&map);
+    }
+    prof.stacks = calloc(STACK_SLOTS, sizeof(prof.stacks[0]));
+    if (!prof.stacks)
+    {
+        fprintf(stderr, "profile: out of memory\n");
+        return 2;
+    }
+
+    if (rep_path && !(fosc = replay_fosc(rep_path)))
+    {
+        fprintf(stderr, "profile: %s is not an input log\n", rep_path);
+        return 2;
+    }
+    board_init(&board, fosc);
+    if (board_load(&board, image, err, sizeof(err)) ||
+        (rep_path ? replay_open(&rep, &board, rep_path, err, sizeof(err)) :
+                    board_wheel(&board, wheel, 1, 1, err, sizeof(err))))
+    {
+        fprintf(stderr, "profile: %s\n", err);
+        return 2;
+    }
+    if (!rep_path)
+        board_adc_volts(&board, adc_volts);
+
+    prof.next_sample = prof.interval;
+    prof.last_sp = cpu->sfr[SFR_SP - 0x80];
+    cpu->on_insn = profile_insn;
+    cpu->on_insn_ctx = &prof;
+    if (rep_path)
+        mcs51_run(cpu, mcs51_cycles(cpu, seconds));
+    else
+    {
+        mcs51_run(cpu, mcs51_cycles(cpu, 0.10));
+        mcs51_drive(cpu, 3, 0x04, 0x00);
+        mcs51_run(cpu, mcs51_cycles(cpu, 0.15));
+        mcs51_drive(cpu, 3, 0x04, 0x04);
+        mcs51_run(cpu, mcs51_cycles(cpu, seconds));
+    }
+
+    report(&prof, cpu, top);
+    if (collapsed && write_collapsed(&prof, collapsed))
+    {
+        fprintf(stderr, "profile: cannot write %s\n", collapsed);
+        return 2;
+    }
+    if (rep_path)
+        replay_close(&rep);
+    board_close(&board);
+    return 0;
+}
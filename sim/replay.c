@@ -0,0 +1,532 @@
+/************************************************************
+ * replay.c - record and replay of the board inputs
+ *
+ * Keyframes are taken from a device event, so the state is
+ * always one between two instructions. The event waits a
+ * cycle while another device is still due at the same
+ * cycle; after a restore every device then continues
+ * exactly where the recording run left off.
+ *
+ * Replay reads the whole log into memory and walks it with
+ * two cursors: one drives the pins from a device event at
+ * each recorded cycle, the other follows the ADC samples as
+ * the converter asks for them.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "replay.h"
+
+#define LOG_MAGIC       "S51R"
+#define INDEX_MAGIC     "S51I"
+#define LOG_VERSION     1
+#define HEADER_SIZE     23
+#define TRAILER_SIZE    12
+
+// Record tags; PIN carries the port in the low two bits
+#define T_PIN           0x10
+#define T_ADC           0x20
+#define T_KEY           0x30
+#define T_END           0x40
+
+/************************************************************
+ * Encoding
+ ************************************************************/
+
+static void put_bytes(recorder_t *r, const void *p, size_t n)
+{
+    fwrite(p, 1, n, r->f);
+    r->offset += n;
+}
+
+static void put_le(recorder_t *r, uint64_t v, int n)
+{
+    uint8_t b[8];
+    int i;
+
+    for (i = 0; i < n; i++)
+        b[i] = (uint8_t)(v >> (8 * i));
+    put_bytes(r, b, n);
+}
+
+static void put_varint(recorder_t *r, uint64_t v)
+{
+    uint8_t b[10];
+    int n = 0;
+
+    while (v >= 0x80)
+    {
+        b[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    b[n++] = (uint8_t)v;
+    put_bytes(r, b, n);
+}
+
+// Tag and cycle delta common to all records
+static void put_record(recorder_t *r, int tag, uint64_t cycle)
+{
+    uint8_t t = (uint8_t)tag;
+
+    put_bytes(r, &t, 1);
+    put_varint(r, cycle - r->last);
+    r->last = cycle;
+}
+
+static uint64_t get_le(const uint8_t *p, int n)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = n - 1; i >= 0; i--)
+        v = v << 8 | p[i];
+    return v;
+}
+
+// Returns 0, or -1 when the varint runs past end
+static int get_varint(const uint8_t *log, size_t end, size_t *pos, uint64_t *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    while (*pos < end && shift < 64)
+    {
+        uint8_t b = log[(*pos)++];
+
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return 0;
+        shift += 7;
+    }
+    return -1;
+}
+
+/************************************************************
+ * Recorder
+ ************************************************************/
+
+static void rec_drive(mcs51_t *cpu, int port, uint8_t mask, uint8_t value, void *ctx)
+{
+    recorder_t *r = ctx;
+    uint8_t m = mask & REPLAY_PINS;
+    uint8_t b[2];
+
+    if (port != 3 || !m)
+        return;
+    put_record(r, T_PIN | port, cpu->cycles);
+    b[0] = m;
+    b[1] = value & m;
+    put_bytes(r, b, 2);
+    r->pins++;
+}
+
+static double rec_sample(void *ctx, mcs51_t *cpu, double vin)
+{
+    recorder_t *r = ctx;
+    double x = vin * 1e6;
+    int32_t uv;
+
+    x = x > 2e9 ? 2e9 : x < -2e9 ? -2e9 : x;
+    uv = (int32_t)(x < 0 ? x - 0.5 : x + 0.5);
+    if (uv != r->uv)
+    {
+        int64_t d = (int64_t)uv - r->uv;
+
+        put_record(r, T_ADC, cpu->cycles);
+        put_varint(r, d < 0 ? ((uint64_t)-d << 1) - 1 : (uint64_t)d << 1);
+        r->uv = uv;
+        r->samples++;
+    }
+    return uv / 1e6;
+}
+
+static int put_key(recorder_t *r)
+{
+    mcs51_t *cpu = &r->board->cpu;
+    size_t n = board_save(r->board, r->state, r->state_cap);
+
+    if (n > r->state_cap)
+    {
+        free(r->state);
+        r->state = malloc(n);
+        r->state_cap = r->state ? n : 0;
+        if (!r->state)
+            return -1;
+        board_save(r->board, r->state, r->state_cap);
+    }
+    if (r->nkeys == r->keys_cap)
+    {
+        int cap = r->keys_cap ? 2 * r->keys_cap : 64;
+        uint64_t *k = realloc(r->keys, 2 * cap * sizeof(*k));
+
+        if (!k)
+            return -1;
+        r->keys = k;
+        r->keys_cap = cap;
+    }
+    r->keys[2 * r->nkeys] = cpu->cycles;
+    r->keys[2 * r->nkeys + 1] = r->offset;
+    r->nkeys++;
+
+    put_record(r, T_KEY, cpu->cycles);
+    put_le(r, (uint32_t)r->uv, 4);
+    put_le(r, n, 4);
+    put_bytes(r, r->state, n);
+    return 0;
+}
+
+static void key_event(sim_dev_t *dev, mcs51_t *cpu)
+{
+    recorder_t *r = dev->ctx;
+    sim_dev_t *d;
+
+    // Not while another device still has work at this cycle
+    for (d = cpu->devs; d; d = d->link)
+    {
+        if (d != dev && d->next <= cpu->cycles)
+        {
+            mcs51_schedule(cpu, dev, cpu->cycles + 1);
+            return;
+        }
+    }
+    if (put_key(r))
+    {
+        fprintf(stderr, "replay: out of memory, no more keyframes\n");
+        return;
+    }
+    mcs51_schedule(cpu, dev, cpu->cycles + r->interval);
+}
+
+int recorder_open(recorder_t *r, board_t *b, const char *path, double keyframe,
+                  char *err, int errlen)
+{
+    mcs51_t *cpu = &b->cpu;
+
+    memset(r, 0, sizeof(*r));
+    r->f = fopen(path, "wb");
+    if (!r->f)
+    {
+        snprintf(err, errlen, "cannot create %s", path);
+        return -1;
+    }
+    setvbuf(r->f, NULL, _IOFBF, 1 << 16);
+    r->board = b;
+    r->last = cpu->cycles;
+    r->interval = keyframe > 0 ? mcs51_cycles(cpu, keyframe) : 0;
+    if (keyframe > 0 && !r->interval)
+        r->interval = 1;
+
+    put_bytes(r, LOG_MAGIC, 4);
+    put_le(r, LOG_VERSION, 2);
+    put_le(r, cpu->fosc, 4);
+    put_le(r, (uint32_t)(b->adc.vref * 1e6 + 0.5), 4);
+    put_le(r, b->adc.lm35, 1);
+    put_le(r, board_hash(cpu->code, sizeof(cpu->code)), 8);
+
+    cpu->on_drive = rec_drive;
+    cpu->on_drive_ctx = r;
+    b->adc.on_sample = rec_sample;
+    b->adc.on_sample_ctx = r;
+
+    r->dev.name = "recorder";
+    r->dev.ctx = r;
+    r->dev.event = key_event;
+    r->dev.next = r->interval ? cpu->cycles : MCS51_NEVER;
+    mcs51_attach(cpu, &r->dev);
+    return 0;
+}
+
+int recorder_close(recorder_t *r, char *err, int errlen)
+{
+    mcs51_t *cpu = &r->board->cpu;
+    uint64_t index;
+    int i, rc = 0;
+
+    if (!r->f)
+        return 0;
+    put_record(r, T_END, cpu->cycles);
+    index = r->offset;
+    put_le(r, (uint32_t)r->nkeys, 4);
+    for (i = 0; i < 2 * r->nkeys; i++)
+        put_le(r, r->keys[i], 8);
+    put_le(r, index, 8);
+    put_bytes(r, INDEX_MAGIC, 4);
+
+    if (ferror(r->f))
+        rc = -1;
+    if (fclose(r->f))
+        rc = -1;
+    if (rc)
+        snprintf(err, errlen, "error writing the input log");
+    r->f = NULL;
+    cpu->on_drive = NULL;
+    r->board->adc.on_sample = NULL;
+    r->dev.next = MCS51_NEVER;
+    free(r->state);
+    free(r->keys);
+    r->state = NULL;
+    r->keys = NULL;
+    return rc;
+}
+
+/************************************************************
+ * Replay
+ ************************************************************/
+
+// Decodes the record at c->pos; returns 0, or -1 at END (tag T_END,
+// cycle of the end) or at a damaged record (tag -1)
+static int next_record(const replay_t *p, replay_cursor_t *c)
+{
+    size_t end = p->index - 4;      // The index count follows the records
+    size_t pos = c->pos;
+    uint64_t delta, v, len;
+    int tag;
+
+    if (c->tag == T_END || pos >= end)
+        return -1;
+    tag = p->log[pos++];
+    c->tag = -1;
+    if (get_varint(p->log, end, &pos, &delta))
+        return -1;
+
+    switch (tag & 0xF0)
+    {
+        case T_PIN:
+            if (pos + 2 > end)
+                return -1;
+            c->port = (uint8_t)(tag & 3);
+            c->mask = p->log[pos] & REPLAY_PINS;
+            c->value = p->log[pos + 1] & c->mask;
+            pos += 2;
+            tag = T_PIN;
+            break;
+        case T_ADC:
+            if (get_varint(p->log, end, &pos, &v))
+                return -1;
+            c->uv = (int32_t)(c->uv + (v & 1 ? -(int64_t)(v >> 1) - 1 : (int64_t)(v >> 1)));
+            break;
+        case T_KEY:
+            if (pos + 8 > end || pos + 8 + (len = get_le(p->log + pos + 4, 4)) > end)
+                return -1;
+            c->uv = (int32_t)get_le(p->log + pos, 4);
+            c->state = pos + 8;
+            c->state_len = (size_t)len;
+            pos += 8 + len;
+            break;
+        case T_END:
+            break;
+        default:
+            return -1;
+    }
+    c->tag = tag;
+    c->pos = pos;
+    c->cycle += delta;
+    return tag == T_END ? -1 : 0;
+}
+
+// Loads the next pin record into the cursor and schedules it
+static void pin_next(replay_t *p, mcs51_t *cpu)
+{
+    while (!next_record(p, &p->pin))
+    {
+        if (p->pin.tag == T_PIN)
+        {
+            mcs51_schedule(cpu, &p->dev, p->pin.cycle);
+            return;
+        }
+    }
+    p->dev.next = MCS51_NEVER;
+}
+
+static void pin_event(sim_dev_t *dev, mcs51_t *cpu)
+{
+    replay_t *p = dev->ctx;
+
+    while (p->pin.tag == T_PIN && p->pin.cycle <= cpu->cycles)
+    {
+        mcs51_drive(cpu, p->pin.port, p->pin.mask, p->pin.value);
+        p->pins++;
+        pin_next(p, cpu);
+    }
+}
+
+static double adc_sample(void *ctx, mcs51_t *cpu, double vin)
+{
+    replay_t *p = ctx;
+    replay_cursor_t c = p->adc;
+
+    (void)vin;
+    while (!next_record(p, &c) && c.cycle <= cpu->cycles)
+    {
+        if (c.tag == T_ADC)
+            p->samples++;
+        p->adc = c;
+    }
+    return p->adc.uv / 1e6;
+}
+
+// Both cursors to just after a KEY record (or to the first record)
+static void start_at(replay_t *p, size_t pos, uint64_t cycle, int32_t uv)
+{
+    mcs51_t *cpu = &p->board->cpu;
+
+    memset(&p->pin, 0, sizeof(p->pin));
+    p->pin.pos = pos;
+    p->pin.cycle = cycle;
+    p->pin.uv = uv;
+    p->adc = p->pin;
+    p->dev.next = MCS51_NEVER;
+    pin_next(p, cpu);
+}
+
+uint32_t replay_fosc(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t h[HEADER_SIZE];
+    uint32_t fosc = 0;
+
+    if (!f)
+        return 0;
+    if (fread(h, 1, sizeof(h), f) == sizeof(h) && !memcmp(h, LOG_MAGIC, 4))
+        fosc = (uint32_t)get_le(h + 6, 4);
+    fclose(f);
+    return fosc;
+}
+
+int replay_open(replay_t *p, board_t *b, const char *path, char *err, int errlen)
+{
+    mcs51_t *cpu = &b->cpu;
+    FILE *f = fopen(path, "rb");
+    uint64_t index;
+    replay_cursor_t c;
+    long n;
+
+    memset(p, 0, sizeof(*p));
+    if (!f)
+    {
+        snprintf(err, errlen, "cannot open %s", path);
+        return -1;
+    }
+    if (fseek(f, 0, SEEK_END) || (n = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) ||
+        !(p->log = malloc(n ? n : 1)) || fread(p->log, 1, n, f) != (size_t)n)
+    {
+        fclose(f);
+        replay_close(p);
+        snprintf(err, errlen, "cannot read %s", path);
+        return -1;
+    }
+    fclose(f);
+    p->len = n;
+
+    if (p->len < HEADER_SIZE + 4 + TRAILER_SIZE || memcmp(p->log, LOG_MAGIC, 4) ||
+        memcmp(p->log + p->len - 4, INDEX_MAGIC, 4))
+    {
+        snprintf(err, errlen, "%s is not a complete input log", path);
+        replay_close(p);
+        return -1;
+    }
+    if (get_le(p->log + 4, 2) != LOG_VERSION)
+    {
+        snprintf(err, errlen, "%s: log version %u not supported", path,
+                 (unsigned)get_le(p->log + 4, 2));
+        replay_close(p);
+        return -1;
+    }
+    p->fosc = (uint32_t)get_le(p->log + 6, 4);
+    p->vref_uv = (uint32_t)get_le(p->log + 10, 4);
+    p->lm35 = p->log[14] & 1;
+    p->image_hash = get_le(p->log + 15, 8);
+    index = get_le(p->log + p->len - TRAILER_SIZE, 8);
+    if (index < HEADER_SIZE || index + 4 > p->len - TRAILER_SIZE)
+    {
+        snprintf(err, errlen, "%s: damaged index", path);
+        replay_close(p);
+        return -1;
+    }
+    p->nkeys = (int)get_le(p->log + index, 4);
+    p->index = index + 4;
+    if (p->index + 16 * (uint64_t)p->nkeys != p->len - TRAILER_SIZE)
+    {
+        snprintf(err, errlen, "%s: damaged index", path);
+        replay_close(p);
+        return -1;
+    }
+    if (p->fosc != cpu->fosc)
+    {
+        snprintf(err, errlen, "%s was recorded at %u Hz", path, p->fosc);
+        replay_close(p);
+        return -1;
+    }
+    p->data = HEADER_SIZE;
+    p->same_image = p->image_hash == board_hash(cpu->code, sizeof(cpu->code));
+
+    // Walk once: every record must decode and the last one is END
+    memset(&c, 0, sizeof(c));
+    c.pos = p->data;
+    while (!next_record(p, &c))
+        ;
+    if (c.tag != T_END || c.pos != p->index - 4)
+    {
+        snprintf(err, errlen, "%s: damaged record at offset %lu", path, (unsigned long)c.pos);
+        replay_close(p);
+        return -1;
+    }
+    p->end = c.cycle;
+
+    p->board = b;
+    b->adc.vref = p->vref_uv / 1e6;
+    b->adc.lm35 = p->lm35;
+    b->adc.on_sample = adc_sample;
+    b->adc.on_sample_ctx = p;
+    p->dev.name = "replay";
+    p->dev.ctx = p;
+    p->dev.event = pin_event;
+    mcs51_attach(cpu, &p->dev);
+    start_at(p, p->data, 0, 0);
+    return 0;
+}
+
+int replay_seek(replay_t *p, double seconds, char *err, int errlen)
+{
+    mcs51_t *cpu = &p->board->cpu;
+    uint64_t target = mcs51_cycles(cpu, seconds);
+    int i, best = -1;
+
+    for (i = 0; p->same_image && i < p->nkeys; i++)
+    {
+        uint64_t at = get_le(p->log + p->index + 16 * i, 8);
+
+        if (at <= target && at > cpu->cycles)
+            best = i;
+    }
+    if (best >= 0)
+    {
+        replay_cursor_t c;
+
+        memset(&c, 0, sizeof(c));
+        c.pos = (size_t)get_le(p->log + p->index + 16 * best + 8, 8);
+        if (c.pos < p->data || next_record(p, &c) || c.tag != T_KEY)
+        {
+            snprintf(err, errlen, "damaged keyframe %d", best);
+            return -1;
+        }
+        if (board_restore(p->board, p->log + c.state, c.state_len, err, errlen))
+            return -1;
+        start_at(p, c.pos, cpu->cycles, c.uv);
+        p->key_cycle = cpu->cycles;
+    }
+    mcs51_run(cpu, target);
+    return 0;
+}
+
+void replay_close(replay_t *p)
+{
+    if (p->board)
+    {
+        p->board->adc.on_sample = NULL;
+        p->dev.next = MCS51_NEVER;
+    }
+    free(p->log);
+    p->log = NULL;
+}
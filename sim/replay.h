@@ -0,0 +1,113 @@
+/************************************************************
+ * replay.h - record and replay of the board inputs
+ *
+ * The recorder logs every external input of a run with its
+ * machine cycle: edges on INT0, INT1, T0 and T1 (P3.2-P3.5,
+ * push button, wheel sensor) and the voltage each ADC
+ * conversion sampled. The replayer feeds the log back into a
+ * board without the stimulus, wave and wheel models, so the
+ * firmware sees the same inputs at the same cycles and the
+ * run is reproduced bit for bit.
+ *
+ * Every 'keyframe' seconds the recorder also stores the
+ * machine state (board_save()). Replay can seek to any time:
+ * it restores the last keyframe before it and runs from
+ * there. When the log was made with another image the
+ * keyframes are of no use; the inputs are then replayed
+ * from reset, which is how a field trace is run against an
+ * older or newer firmware.
+ *
+ * Log format, little-endian:
+ *   header   "S51R", u16 version, u32 fosc, u32 vref (uV),
+ *            u8 LM35 input, u64 FNV-1a hash of the program memory
+ *   records  tag, varint cycles since the previous record,
+ *            then by tag:
+ *              PIN+port  mask, value
+ *              ADC       zigzag varint change in uV
+ *              KEY       u32 uV, u32 length, board_save() state
+ *              END       -
+ *   index    u32 count, count x (u64 cycle, u64 offset of KEY)
+ *   trailer  u64 offset of the index, "S51I"
+ *
+ * ADC voltages are rounded to 1 uV when recorded, well below
+ * the 10 mV step of the converter.
+ ************************************************************/
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "board.h"
+
+#define REPLAY_PINS     0x3C    // P3 lines that are recorded (INT0, INT1, T0, T1)
+
+typedef struct
+{
+    FILE *f;
+    board_t *board;
+    sim_dev_t dev;              // Keyframe timer
+    uint64_t interval;          // Cycles between keyframes, 0 for none
+    uint64_t last;              // Cycle of the previous record
+    int32_t uv;                 // Last ADC input logged
+    uint64_t offset;            // Bytes written
+    uint8_t *state;             // board_save() buffer
+    size_t state_cap;
+    uint64_t *keys;             // Index: cycle, offset pairs
+    int nkeys, keys_cap;
+    uint64_t pins, samples;     // Records written
+} recorder_t;
+
+// Position in the record stream (deltas need every record)
+typedef struct
+{
+    size_t pos;
+    uint64_t cycle;
+    int32_t uv;
+    int tag;                    // Last record decoded, -1 if damaged
+    uint8_t port, mask, value;  // PIN record
+    size_t state, state_len;    // KEY record: saved state in the log
+} replay_cursor_t;
+
+typedef struct
+{
+    board_t *board;
+    sim_dev_t dev;              // Drives the recorded pins
+    uint8_t *log;
+    size_t len;
+    size_t data;                // Offset of the first record
+    uint32_t fosc, vref_uv;     // Board settings of the recording
+    int lm35;
+    uint64_t image_hash;
+    int same_image;             // Keyframes usable
+    int nkeys;
+    size_t index;               // Offset of the index entries
+    uint64_t end;               // Cycle of the END record
+    replay_cursor_t pin, adc;
+    uint64_t pins, samples;     // Records applied
+    uint64_t key_cycle;         // Keyframe the run started from (0: reset)
+} replay_t;
+
+// Starts logging the inputs of b to path; call after board_load(), before
+// running. keyframe is in seconds, <= 0 for none. Returns 0 or -1.
+int recorder_open(recorder_t *r, board_t *b, const char *path, double keyframe,
+                  char *err, int errlen);
+
+// Writes the end record and the keyframe index; returns -1 on a write error
+int recorder_close(recorder_t *r, char *err, int errlen);
+
+// Loads a log and attaches to b (after board_init() with the log's
+// fosc, see replay_fosc(), and board_load()). Returns 0 or -1.
+int replay_open(replay_t *p, board_t *b, const char *path, char *err, int errlen);
+
+// Crystal frequency of a log, 0 if the file is not a log
+uint32_t replay_fosc(const char *path);
+
+// Brings the board forward to 'seconds': restores the last keyframe at or before
+// it (if any and the image matches) and runs the rest. Returns 0 or -1.
+int replay_seek(replay_t *p, double seconds, char *err, int errlen);
+
+void replay_close(replay_t *p);
+
+#endif
@@ -0,0 +1,1411 @@
+/************************************************************
+ * scenario.c - headless scenario regression runner
+ *
+ * Runs declarative scenario files (sim/scenarios) against
+ * Main.hex on the simulated board and checks the display,
+ * LED, pins and firmware variables at given simulated times.
+ *
+ *   scenario [options] file.scn...
+ *     --image HEX     firmware image (overrides 'image' lines)
+ *     --map FILE      Keil .m51 / SDCC .map for 'var' checks
+ *     --junit FILE    write JUnit XML results
+ *     --stamp         record the sources of each image and exit
+ *     -f HZ           crystal frequency (default 12000000)
+ *     -v              print every check, not just failures
+ *
+ * Scenario syntax, one statement per line, '#' comments:
+ *
+ *   name     readme-step1-power
+ *   image    ../../Main.hex          (relative to the .scn)
+ *   duration 4                       (seconds, default last event)
+ *   adc      0.25                    (constant input, volts)
+ *   adc-file PATH [speed K]          (series, see sim8051 -a)
+ *   wheel    PROFILE|KMH [loop] [seed N] [jitter F] [drop P]
+ *   symbol   NAME D:0x10             (when there is no map)
+ *   start    FILE                    (continue from a snapshot)
+ *   xfail    REASON                  (why the xfail checks fail)
+ *
+ *   at T     press Pp.b [HOLD] [bounce N]
+ *   at T     pin Pp.b 0|1
+ *   at T     adc V
+ *   at T     save FILE               (snapshot for 'start')
+ *   at T     expect CHECK
+ *   within T1 T2 expect CHECK        (must hold at some point)
+ *   at T     xfail CHECK             (as expect, see below)
+ *
+ * Checks:
+ *   lcd ROW "text"          row equals text (trailing blanks ignored)
+ *   lcd ROW:COL "text"      text appears at ROW, COL (1-based)
+ *   lcd blank               display off or empty
+ *   lcd clean               no HD44780 timing violations so far
+ *   led on|off
+ *   pin Pp.b 0|1
+ *   counter OP N            Timer1 count (TH1:TL1)
+ *   var NAME[:TYPE] OP N    TYPE u8 s8 u16 s16 u32 s32 bit
+ *
+ * OP is one of == != < <= > >=. Variables are looked up in
+ * the map, then the 'symbol' lines, then the SFR names; a
+ * variable that cannot be resolved is reported as skipped.
+ *
+ * Snapshots let one slow lead-in (engine warmed up, tank
+ * nearly empty) feed several short branches: the lead-in
+ * saves the machine state, each branch starts from it with
+ * its own inputs and keeps the times of the lead-in, so all
+ * its events must come at or after the snapshot. A scenario
+ * that saves a file runs before the ones that start from it.
+ *
+ * The expectations follow the firmware sources, so a Main.hex
+ * left over from an older tree fails some of them for no
+ * fault of the code. Each image therefore carries a stamp,
+ * Main.hex.src next to it: a hash of the image and of every
+ * firmware source (the .c and .h files beside it, less
+ * hal_host) as they were when it was built; --stamp records
+ * it after a rebuild. Checks written with xfail instead of
+ * expect need an image built from the current sources. While
+ * the stamp is missing or no longer matches, their failures
+ * are expected (reported as xfail, with the scenario's
+ * REASON) and a pass is an error (XPASS), since the mark is
+ * then out of date. Against a current image they are plain
+ * checks. expect checks must hold on any image.
+ *
+ * Exit status: 0 all passed, 1 a check failed or an xfail
+ * check passed, 2 bad input.
+ ************************************************************/
+
+#include <ctype.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "board.h"
+#include "symmap.h"
+
+#define SCN_LINE_MAX    256
+#define SCN_PATH_MAX    512
+#define POLL_S          0.001   // 'within' checks are sampled every 1 ms
+#define BOUNCE_S        0.0005  // Contact chatter edge spacing
+#define STAMP_EXT       ".src"  // Main.hex -> Main.hex.src
+#define STAMP_FILES     64      // Most sources in a stamp
+#define STAMP_NAME_MAX  64
+
+// Statement kinds
+#define EV_PIN      0
+#define EV_ADC      1
+#define EV_EXPECT   2
+#define EV_SAVE     3
+
+// Check kinds
+#define CK_LCD_ROW      0
+#define CK_LCD_AT       1
+#define CK_LCD_BLANK    2
+#define CK_LCD_CLEAN    3
+#define CK_LED          4
+#define CK_PIN          5
+#define CK_COUNTER      6
+#define CK_VAR          7
+
+// Results
+#define R_PENDING   0
+#define R_PASS      1
+#define R_FAIL      2
+#define R_SKIP      3
+#define R_XFAIL     4       // Failed as expected on a stale image
+#define R_XPASS     5       // Passed although marked xfail
+
+typedef struct
+{
+    double t, t_end;        // t_end > t for 'within'
+    int kind;
+    int line;
+    int seq;                // File order, keeps the sort stable
+
+    // EV_PIN
+    uint8_t port, mask, value;
+
+    // EV_ADC
+    double volts;
+
+    // EV_SAVE
+    char file[SCN_PATH_MAX];
+
+    // EV_EXPECT
+    int check;
+    int row, col;
+    char text[LCD_COLS + 1];
+    char var[SYM_NAME_MAX];
+    char type[4];
+    char op[3];
+    long long ref;
+    char src[SCN_LINE_MAX];
+    int xfail;              // Written as xfail
+    int result;
+    char detail[128];
+    double at;              // When the check passed or failed
+} event_t;
+
+typedef struct
+{
+    char path[SCN_PATH_MAX];
+    char name[64];
+    char image[SCN_PATH_MAX];
+    double duration;
+    double adc_volts;
+    char adc_file[SCN_PATH_MAX];
+    double adc_speed;
+    char wheel[SCN_PATH_MAX];
+    int wheel_loop;
+    uint64_t wheel_seed;
+    double wheel_jitter, wheel_drop;
+    symmap_t syms;          // 'symbol' lines
+    char start[SCN_PATH_MAX];   // Snapshot to continue from
+    char xfail[SCN_LINE_MAX];   // Reason for the xfail checks
+    int stale;              // Image is not stamped from the current sources
+
+    event_t *ev;
+    int n, cap;
+
+    int passed, failed, skipped, xfailed, errors;
+    char error[SCN_PATH_MAX + 64];
+    double wall;
+} scenario_t;
+
+typedef struct
+{
+    const char *image;
+    symmap_t map;
+    int have_map;
+    uint32_t fosc;
+    int verbose;
+} options_t;
+
+// SFRs and SFR bits, so checks work without a map
+static const struct { const char *name; char space; uint8_t addr; } sfr_names[] =
+{
+    { "P0", 'D', 0x80 }, { "SP", 'D', 0x81 }, { "DPL", 'D', 0x82 }, { "DPH", 'D', 0x83 },
+    { "PCON", 'D', 0x87 }, { "TCON", 'D', 0x88 }, { "TMOD", 'D', 0x89 }, { "TL0", 'D', 0x8A },
+    { "TL1", 'D', 0x8B }, { "TH0", 'D', 0x8C }, { "TH1", 'D', 0x8D }, { "P1", 'D', 0x90 },
+    { "SCON", 'D', 0x98 }, { "SBUF", 'D', 0x99 }, { "P2", 'D', 0xA0 }, { "IE", 'D', 0xA8 },
+    { "P3", 'D', 0xB0 }, { "IP", 'D', 0xB8 }, { "PSW", 'D', 0xD0 }, { "ACC", 'D', 0xE0 },
+    { "B", 'D', 0xF0 },
+    { "IT0", 'B', 0x88 }, { "IE0", 'B', 0x89 }, { "IT1", 'B', 0x8A }, { "IE1", 'B', 0x8B },
+    { "TR0", 'B', 0x8C }, { "TF0", 'B', 0x8D }, { "TR1", 'B', 0x8E }, { "TF1", 'B', 0x8F },
+    { "EX0", 'B', 0xA8 }, { "ET0", 'B', 0xA9 }, { "EX1", 'B', 0xAA }, { "ET1", 'B', 0xAB },
+    { "ES", 'B', 0xAC }, { "EA", 'B', 0xAF }
+};
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: scenario [options] file.scn...\n"
+        "  --image HEX     firmware image (overrides 'image' lines)\n"
+        "  --map FILE      Keil .m51 / SDCC .map for 'var' checks\n"
+        "  --junit FILE    write JUnit XML results\n"
+        "  --stamp         record the sources of each image and exit\n"
+        "  -f HZ           crystal frequency (default 12000000)\n"
+        "  -v              print every check, not just failures\n");
+    exit(2);
+}
+
+static double now_wall(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/************************************************************
+ * Parsing
+ ************************************************************/
+
+static event_t *add_event(scenario_t *s, int kind, double t, int line)
+{
+    event_t *e;
+
+    if (s->n == s->cap)
+    {
+        int cap = s->cap ? s->cap * 2 : 32;
+        event_t *p = realloc(s->ev, cap * sizeof(*p));
+
+        if (!p)
+        {
+            fprintf(stderr, "scenario: out of memory\n");
+            exit(2);
+        }
+        s->ev = p;
+        s->cap = cap;
+    }
+    e = &s->ev[s->n];
+    memset(e, 0, sizeof(*e));
+    e->kind = kind;
+    e->t = e->t_end = t;
+    e->line = line;
+    e->seq = s->n++;
+    return e;
+}
+
+// "P3.2" -> port, mask
+static int parse_pin(const char *tok, uint8_t *port, uint8_t *mask)
+{
+    int p, b;
+    char c;
+
+    if (sscanf(tok, "P%d.%d%c", &p, &b, &c) != 2 || p < 0 || p > 3 || b < 0 || b > 7)
+        return -1;
+    *port = (uint8_t)p;
+    *mask = (uint8_t)(1 << b);
+    return 0;
+}
+
+// Copies the "quoted" text starting at p into out
+static int parse_text(const char *p, char *out, int max)
+{
+    const char *q;
+    int n;
+
+    while (isspace((unsigned char)*p))
+        p++;
+    if (*p != '"' || !(q = strchr(p + 1, '"')))
+        return -1;
+    n = (int)(q - p - 1);
+    if (n > max)
+        return -1;
+    memcpy(out, p + 1, n);
+    out[n] = '\0';
+    return 0;
+}
+
+static int valid_op(const char *op)
+{
+    static const char *ops[] = { "==", "!=", "<", "<=", ">", ">=" };
+    unsigned i;
+
+    for (i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+        if (!strcmp(op, ops[i]))
+            return 1;
+    return 0;
+}
+
+static int valid_type(const char *type)
+{
+    return !strcmp(type, "u8") || !strcmp(type, "s8") || !strcmp(type, "u16") ||
+           !strcmp(type, "s16") || !strcmp(type, "u32") || !strcmp(type, "s32") ||
+           !strcmp(type, "bit");
+}
+
+// Parses the text after "expect"
+static int parse_check(event_t *e, const char *p)
+{
+    char what[16], a[64], b[64], c[64];
+    int n;
+
+    if (sscanf(p, "%15s%n", what, &n) != 1)
+        return -1;
+    p += n;
+
+    if (!strcmp(what, "lcd"))
+    {
+        if (sscanf(p, "%63s", a) != 1)
+            return -1;
+        if (!strcmp(a, "blank"))
+        {
+            e->check = CK_LCD_BLANK;
+            return 0;
+        }
+        if (!strcmp(a, "clean"))
+        {
+            e->check = CK_LCD_CLEAN;
+            return 0;
+        }
+        e->col = 0;
+        if (sscanf(a, "%d:%d", &e->row, &e->col) < 1 || e->row < 1 || e->row > LCD_ROWS ||
+            e->col < 0 || e->col > LCD_COLS)
+            return -1;
+        e->check = e->col ? CK_LCD_AT : CK_LCD_ROW;
+        p = strstr(p, a) + strlen(a);
+        return parse_text(p, e->text, e->col ? LCD_COLS - e->col + 1 : LCD_COLS);
+    }
+    if (!strcmp(what, "led"))
+    {
+        if (sscanf(p, "%63s", a) != 1 || (strcmp(a, "on") && strcmp(a, "off")))
+            return -1;
+        e->check = CK_LED;
+        e->ref = !strcmp(a, "on");
+        return 0;
+    }
+    if (!strcmp(what, "pin"))
+    {
+        if (sscanf(p, "%63s %63s", a, b) != 2 || parse_pin(a, &e->port, &e->mask) ||
+            (strcmp(b, "0") && strcmp(b, "1")))
+            return -1;
+        e->check = CK_PIN;
+        e->ref = b[0] - '0';
+        return 0;
+    }
+    if (!strcmp(what, "counter"))
+    {
+        if (sscanf(p, "%2s %63s", e->op, b) != 2 || !valid_op(e->op))
+            return -1;
+        e->check = CK_COUNTER;
+        e->ref = strtoll(b, NULL, 0);
+        return 0;
+    }
+    if (!strcmp(what, "var"))
+    {
+        char *colon;
+
+        if (sscanf(p, "%63s %63s %63s", a, b, c) != 3 || strlen(b) > 2 || !valid_op(b))
+            return -1;
+        strcpy(e->op, b);
+        e->ref = strtoll(c, NULL, 0);
+        e->check = CK_VAR;
+        colon = strchr(a, ':');
+        if (colon)
+        {
+            *colon = '\0';
+            if (strlen(colon + 1) >= sizeof(e->type) || !valid_type(colon + 1))
+                return -1;
+            strcpy(e->type, colon + 1);
+        }
+        snprintf(e->var, sizeof(e->var), "%.*s", SYM_NAME_MAX - 1, a);
+        return 0;
+    }
+    return -1;
+}
+
+// Resolves path relative to the directory of the scenario file
+static void relative_path(char *out, const char *scn, const char *path)
+{
+    const char *slash = strrchr(scn, '/');
+
+    if (path[0] == '/' || !slash)
+        snprintf(out, SCN_PATH_MAX, "%s", path);
+    else
+        snprintf(out, SCN_PATH_MAX, "%.*s/%s", (int)(slash - scn), scn, path);
+}
+
+static int cmp_event(const void *a, const void *b)
+{
+    const event_t *x = a, *y = b;
+
+    if (x->t != y->t)
+        return x->t < y->t ? -1 : 1;
+    return x->seq - y->seq;
+}
+
+static int fail_parse(scenario_t *s, int line, const char *why)
+{
+    snprintf(s->error, sizeof(s->error), "%s:%d: %s", s->path, line, why);
+    return -1;
+}
+
+static int parse_statement(scenario_t *s, char *buf, int line)
+{
+    char kw[16], a[SCN_PATH_MAX], b[64];
+    double t, t2;
+    int n, npts;
+    char *p = buf;
+    event_t *e;
+
+    if (sscanf(p, "%15s%n", kw, &n) != 1)
+        return 0;
+    p += n;
+
+    if (!strcmp(kw, "name"))
+    {
+        if (sscanf(p, "%63s", s->name) != 1)
+            return fail_parse(s, line, "name needs a value");
+        return 0;
+    }
+    if (!strcmp(kw, "xfail"))
+    {
+        while (isspace((unsigned char)*p))
+            p++;
+        if (!*p)
+            return fail_parse(s, line, "xfail needs a reason");
+        snprintf(s->xfail, sizeof(s->xfail), "%s", p);
+        return 0;
+    }
+    if (!strcmp(kw, "image"))
+    {
+        if (sscanf(p, "%511s", a) != 1)
+            return fail_parse(s, line, "image needs a path");
+        relative_path(s->image, s->path, a);
+        return 0;
+    }
+    if (!strcmp(kw, "duration"))
+    {
+        if (sscanf(p, "%lf", &s->duration) != 1 || s->duration <= 0)
+            return fail_parse(s, line, "bad duration");
+        return 0;
+    }
+    if (!strcmp(kw, "adc"))
+    {
+        if (sscanf(p, "%lf", &s->adc_volts) != 1)
+            return fail_parse(s, line, "adc needs a voltage");
+        return 0;
+    }
+    if (!strcmp(kw, "adc-file"))
+    {
+        if (sscanf(p, "%511s%n", a, &n) != 1)
+            return fail_parse(s, line, "adc-file needs a path");
+        relative_path(s->adc_file, s->path, a);
+        if (sscanf(p + n, " speed %lf", &s->adc_speed) != 1)
+            s->adc_speed = 1.0;
+        return 0;
+    }
+    if (!strcmp(kw, "wheel"))
+    {
+        if (sscanf(p, "%511s%n", a, &n) != 1)
+            return fail_parse(s, line, "wheel needs a profile");
+        if (isdigit((unsigned char)a[0]) || wheel_profile(a, &npts))
+            snprintf(s->wheel, sizeof(s->wheel), "%s", a);
+        else
+            relative_path(s->wheel, s->path, a);
+        p = strstr(p, a) + strlen(a);
+        while (sscanf(p, "%63s%n", b, &n) == 1)
+        {
+            p += n;
+            if (!strcmp(b, "loop"))
+                s->wheel_loop = 1;
+            else if (!strcmp(b, "seed") && sscanf(p, "%63s%n", b, &n) == 1)
+                s->wheel_seed = strtoull(b, NULL, 0), p += n;
+            else if (!strcmp(b, "jitter") && sscanf(p, "%lf%n", &s->wheel_jitter, &n) == 1)
+                p += n;
+            else if (!strcmp(b, "drop") && sscanf(p, "%lf%n", &s->wheel_drop, &n) == 1)
+                p += n;
+            else
+                return fail_parse(s, line, "bad wheel option");
+        }
+        return 0;
+    }
+    if (!strcmp(kw, "symbol"))
+    {
+        char name[SYM_NAME_MAX];
+        char space;
+        unsigned addr;
+
+        if (sscanf(p, "%39s %c:%x", name, &space, &addr) != 3 || !strchr("DIXBC", space) ||
+            addr > 0xFFFF)
+            return fail_parse(s, line, "want: symbol NAME D:0xADDR");
+        symmap_add(&s->syms, name, space, (uint16_t)addr, 1);
+        return 0;
+    }
+    if (!strcmp(kw, "start"))
+    {
+        if (sscanf(p, "%511s", a) != 1)
+            return fail_parse(s, line, "start needs a snapshot file");
+        relative_path(s->start, s->path, a);
+        return 0;
+    }
+
+    if (!strcmp(kw, "at"))
+    {
+        if (sscanf(p, "%lf%n", &t, &n) != 1 || t < 0)
+            return fail_parse(s, line, "at needs a time");
+        t2 = t;
+    }
+    else if (!strcmp(kw, "within"))
+    {
+        if (sscanf(p, "%lf %lf%n", &t, &t2, &n) != 2 || t < 0 || t2 < t)
+            return fail_parse(s, line, "within needs T1 T2");
+    }
+    else
+    {
+        return fail_parse(s, line, "unknown statement");
+    }
+    p += n;
+    if (sscanf(p, "%15s%n", kw, &n) != 1)
+        return fail_parse(s, line, "missing action");
+    p += n;
+
+    if (strcmp(kw, "expect") && strcmp(kw, "xfail") && t2 != t)
+        return fail_parse(s, line, "within only applies to expect and xfail");
+
+    if (!strcmp(kw, "press"))
+    {
+        uint8_t port, mask;
+        double hold = 0.05;
+        int bounce = 0, i;
+
+        if (sscanf(p, "%63s%n", a, &n) != 1 || parse_pin(a, &port, &mask))
+            return fail_parse(s, line, "press needs a pin");
+        p += n;
+        if (sscanf(p, "%lf%n", &hold, &n) == 1)
+            p += n;
+        if (sscanf(p, " bounce %d", &bounce) == 1 && (bounce < 0 || bounce > 50))
+            return fail_parse(s, line, "bounce out of range");
+
+        // Contact chatter: bounce short open/close pairs after the first edge
+        for (i = 0; i <= bounce; i++)
+        {
+            e = add_event(s, EV_PIN, t + 2 * i * BOUNCE_S, line);
+            e->port = port, e->mask = mask, e->value = 0;
+            if (i < bounce)
+            {
+                e = add_event(s, EV_PIN, t + (2 * i + 1) * BOUNCE_S, line);
+                e->port = port, e->mask = mask, e->value = mask;
+            }
+        }
+        e = add_event(s, EV_PIN, t + hold, line);
+        e->port = port, e->mask = mask, e->value = mask;
+        return 0;
+    }
+    if (!strcmp(kw, "pin"))
+    {
+        uint8_t port, mask;
+
+        if (sscanf(p, "%63s %63s", a, b) != 2 || parse_pin(a, &port, &mask) ||
+            (strcmp(b, "0") && strcmp(b, "1")))
+            return fail_parse(s, line, "want: pin Pp.b 0|1");
+        e = add_event(s, EV_PIN, t, line);
+        e->port = port, e->mask = mask, e->value = b[0] == '1' ? mask : 0;
+        return 0;
+    }
+    if (!strcmp(kw, "adc"))
+    {
+        double v;
+
+        if (sscanf(p, "%lf", &v) != 1)
+            return fail_parse(s, line, "adc needs a voltage");
+        e = add_event(s, EV_ADC, t, line);
+        e->volts = v;
+        return 0;
+    }
+    if (!strcmp(kw, "save"))
+    {
+        if (sscanf(p, "%511s", a) != 1)
+            return fail_parse(s, line, "save needs a file");
+        e = add_event(s, EV_SAVE, t, line);
+        relative_path(e->file, s->path, a);
+        return 0;
+    }
+    if (!strcmp(kw, "expect") || !strcmp(kw, "xfail"))
+    {
+        e = add_event(s, EV_EXPECT, t, line);
+        e->t_end = t2;
+        e->xfail = kw[0] == 'x';
+        while (isspace((unsigned char)*p))
+            p++;
+        snprintf(e->src, sizeof(e->src), "%s", buf + strspn(buf, " \t"));
+        for (n = (int)strlen(e->src); n > 0 && isspace((unsigned char)e->src[n - 1]); n--)
+            e->src[n - 1] = '\0';
+        if (parse_check(e, p))
+        {
+            s->n--;
+            return fail_parse(s, line, "bad expect");
+        }
+        return 0;
+    }
+    return fail_parse(s, line, "unknown action");
+}
+
+static int load_scenario(scenario_t *s, const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char buf[SCN_LINE_MAX];
+    const char *base;
+    int line = 0, i;
+
+    memset(s, 0, sizeof(*s));
+    snprintf(s->path, sizeof(s->path), "%s", path);
+    base = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    snprintf(s->name, sizeof(s->name), "%.*s", (int)strcspn(base, "."), base);
+    s->adc_volts = 0.25;
+    s->wheel_seed = 1;
+    if (!f)
+    {
+        snprintf(s->error, sizeof(s->error), "cannot open %s", path);
+        return -1;
+    }
+    while (fgets(buf, sizeof(buf), f))
+    {
+        char *hash = NULL, *q;
+
+        line++;
+        // Strip comments outside quotes and the line end
+        for (q = buf; *q && !hash; q++)
+        {
+            if (*q == '"')
+            {
+                q = strchr(q + 1, '"');
+                if (!q)
+                    break;
+            }
+            else if (*q == '#')
+            {
+                hash = q;
+            }
+        }
+        if (hash)
+            *hash = '\0';
+        buf[strcspn(buf, "\r\n")] = '\0';
+        if (parse_statement(s, buf, line))
+        {
+            fclose(f);
+            return -1;
+        }
+    }
+    fclose(f);
+
+    qsort(s->ev, s->n, sizeof(s->ev[0]), cmp_event);
+    for (i = 0; i < s->n; i++)
+    {
+        if (s->ev[i].t_end > s->duration)
+            s->duration = s->ev[i].t_end;
+        if (s->ev[i].xfail && !s->xfail[0])
+            return fail_parse(s, s->ev[i].line, "xfail checks need an xfail REASON line");
+    }
+    if (s->duration == 0)
+        return fail_parse(s, line, "nothing to run");
+    return 0;
+}
+
+/************************************************************
+ * Checks
+ ************************************************************/
+
+static const sym_t *resolve(const scenario_t *s, const options_t *o, const char *name, sym_t *tmp)
+{
+    const sym_t *sym = NULL;
+    unsigned i;
+
+    if (o->have_map)
+        sym = symmap_find(&o->map, name);
+    if (!sym)
+        sym = symmap_find(&s->syms, name);
+    if (sym)
+        return sym;
+    for (i = 0; i < sizeof(sfr_names) / sizeof(sfr_names[0]); i++)
+    {
+        if (!strcmp(sfr_names[i].name, name))
+        {
+            snprintf(tmp->name, sizeof(tmp->name), "%s", name);
+            tmp->space = sfr_names[i].space;
+            tmp->addr = sfr_names[i].addr;
+            return tmp;
+        }
+    }
+    return NULL;
+}
+
+static uint8_t read_byte(mcs51_t *cpu, char space, uint16_t addr)
+{
+    switch (space)
+    {
+        case SYM_DATA:  return addr < 0x80 ? cpu->iram[addr] : mcs51_read_direct(cpu, (uint8_t)addr);
+        case SYM_IDATA: return cpu->iram[addr & 0xFF];
+        case SYM_XDATA: return cpu->xram[addr];
+        default:        return cpu->code[addr];
+    }
+}
+
+// Reads a variable; multi-byte values in the map's byte order
+static long long read_var(mcs51_t *cpu, const sym_t *sym, const char *type, int big_endian)
+{
+    int size, i;
+    unsigned long long v = 0;
+
+    if (sym->space == SYM_BIT || !strcmp(type, "bit"))
+    {
+        uint8_t a = (uint8_t)sym->addr;
+        uint8_t byte = a < 0x80 ? cpu->iram[0x20 + (a >> 3)] : mcs51_read_direct(cpu, a & 0xF8);
+
+        return (byte >> (a & 7)) & 1;
+    }
+    size = type[1] == '8' ? 1 : type[1] == '1' ? 2 : 4;
+    for (i = 0; i < size; i++)
+    {
+        uint8_t byte = read_byte(cpu, sym->space, (uint16_t)(sym->addr + i));
+
+        v |= (unsigned long long)byte << (8 * (big_endian ? size - 1 - i : i));
+    }
+    if (type[0] == 's' && (v >> (8 * size - 1)) & 1)
+        return (long long)v - (1LL << (8 * size));
+    return (long long)v;
+}
+
+static int compare(long long a, const char *op, long long b)
+{
+    if (!strcmp(op, "=="))
+        return a == b;
+    if (!strcmp(op, "!="))
+        return a != b;
+    if (!strcmp(op, "<"))
+        return a < b;
+    if (!strcmp(op, "<="))
+        return a <= b;
+    if (!strcmp(op, ">"))
+        return a > b;
+    return a >= b;
+}
+
+// Evaluates e now; fills e->detail with the observed value
+static int evaluate(board_t *b, const scenario_t *s, const options_t *o, event_t *e)
+{
+    char row[LCD_COLS + 1], rows[LCD_ROWS][LCD_COLS + 1];
+    int r, len;
+
+    switch (e->check)
+    {
+        case CK_LCD_ROW:
+            hd44780_row(&b->lcd, e->row - 1, row);
+            len = LCD_COLS;
+            while (len > 0 && row[len - 1] == ' ')
+                row[--len] = '\0';
+            snprintf(e->detail, sizeof(e->detail), "row %d is \"%s\"", e->row, row);
+            return !strcmp(row, e->text) ? R_PASS : R_FAIL;
+
+        case CK_LCD_AT:
+            hd44780_row(&b->lcd, e->row - 1, row);
+            snprintf(e->detail, sizeof(e->detail), "row %d is \"%s\"", e->row, row);
+            return !strncmp(row + e->col - 1, e->text, strlen(e->text)) ? R_PASS : R_FAIL;
+
+        case CK_LCD_BLANK:
+            for (r = 0; r < LCD_ROWS; r++)
+                hd44780_row(&b->lcd, r, rows[r]);
+            snprintf(e->detail, sizeof(e->detail), "display %s \"%s\" \"%s\"",
+                     b->lcd.display_on ? "on" : "off", rows[0], rows[1]);
+            for (r = 0; r < LCD_ROWS; r++)
+                if (strspn(rows[r], " ") != LCD_COLS)
+                    return R_FAIL;
+            return R_PASS;
+
+        case CK_LCD_CLEAN:
+            snprintf(e->detail, sizeof(e->detail), "%llu timing violations",
+                     (unsigned long long)hd44780_total_violations(&b->lcd));
+            return hd44780_total_violations(&b->lcd) == 0 ? R_PASS : R_FAIL;
+
+        case CK_LED:
+            snprintf(e->detail, sizeof(e->detail), "led is %s", board_led(b) ? "on" : "off");
+            return board_led(b) == e->ref ? R_PASS : R_FAIL;
+
+        case CK_PIN:
+            r = (mcs51_pins(&b->cpu, e->port) & e->mask) != 0;
+            snprintf(e->detail, sizeof(e->detail), "pin reads %d", r);
+            return r == e->ref ? R_PASS : R_FAIL;
+
+        case CK_COUNTER:
+        {
+            long long v = (mcs51_read_direct(&b->cpu, SFR_TH1) << 8) | mcs51_read_direct(&b->cpu, SFR_TL1);
+
+            snprintf(e->detail, sizeof(e->detail), "counter is %lld", v);
+            return compare(v, e->op, e->ref) ? R_PASS : R_FAIL;
+        }
+
+        default:
+        {
+            sym_t tmp;
+            const sym_t *sym = resolve(s, o, e->var, &tmp);
+            const char *type = e->type[0] ? e->type : "u16";
+            long long v;
+
+            if (!sym)
+            {
+                snprintf(e->detail, sizeof(e->detail), "symbol %s not found (pass --map)", e->var);
+                return R_SKIP;
+            }
+            if (!e->type[0] && (sym == &tmp || sym->space == SYM_BIT))
+                type = sym->space == SYM_BIT ? "bit" : "u8";
+            v = read_var(&b->cpu, sym, type, o->have_map ? o->map.big_endian : 1);
+            snprintf(e->detail, sizeof(e->detail), "%s (%c:%04X %s) is %lld",
+                     e->var, sym->space, sym->addr, type, v);
+            return compare(v, e->op, e->ref) ? R_PASS : R_FAIL;
+        }
+    }
+}
+
+static void record(scenario_t *s, const options_t *o, event_t *e, int result, double t)
+{
+    static const char *tags[] = { "", "ok  ", "FAIL", "skip", "xfail", "XPASS" };
+
+    if (e->xfail && s->stale && result == R_FAIL)
+        result = R_XFAIL;
+    else if (e->xfail && s->stale && result == R_PASS)
+    {
+        result = R_XPASS;
+        snprintf(e->detail, sizeof(e->detail), "passes on a stale image; drop the xfail");
+    }
+    e->result = result;
+    e->at = t;
+    if (result == R_PASS)
+        s->passed++;
+    else if (result == R_FAIL || result == R_XPASS)
+        s->failed++;
+    else if (result == R_XFAIL)
+        s->xfailed++;
+    else
+        s->skipped++;
+    if (result != R_PASS || o->verbose)
+        printf("  %s %s:%d t=%.3f  %s  [%s]\n", tags[result], s->path, e->line, t, e->src,
+               e->detail);
+}
+
+/************************************************************
+ * Runner
+ ************************************************************/
+
+static const char *image_of(const scenario_t *s, const options_t *o)
+{
+    return o->image ? o->image : s->image[0] ? s->image : "Main.hex";
+}
+
+static int setup(board_t *b, scenario_t *s, const options_t *o)
+{
+    const char *image = image_of(s, o);
+    char err[256];
+
+    board_init(b, o->fosc);
+    if (board_load(b, image, err, sizeof(err)))
+        goto fail;
+    if (s->adc_file[0])
+    {
+        if (board_adc_file(b, s->adc_file, s->adc_speed, err, sizeof(err)))
+            goto fail;
+    }
+    else
+    {
+        board_adc_volts(b, s->adc_volts);
+    }
+    if (s->wheel[0])
+    {
+        if (board_wheel(b, s->wheel, s->wheel_loop, s->wheel_seed, err, sizeof(err)))
+            goto fail;
+        b->wheel.jitter = s->wheel_jitter;
+        b->wheel.dropout = s->wheel_drop;
+    }
+    if (s->start[0])
+    {
+        double t;
+        int i;
+
+        if (board_snapshot_load(b, s->start, err, sizeof(err)))
+            goto fail;
+        t = mcs51_seconds(&b->cpu, b->cpu.cycles);
+        for (i = 0; i < s->n; i++)
+        {
+            // The save lands on the first instruction boundary after its time
+            if (s->ev[i].t < t - POLL_S)
+            {
+                snprintf(s->error, sizeof(s->error), "line %d: before the snapshot at %.3f s",
+                         s->ev[i].line, t);
+                return -1;
+            }
+        }
+    }
+    return 0;
+
+fail:
+    snprintf(s->error, sizeof(s->error), "%s", err);
+    return -1;
+}
+
+static void run_scenario(scenario_t *s, const options_t *o)
+{
+    static board_t board;
+    mcs51_t *cpu = &board.cpu;
+    uint64_t end, poll;
+    int next = 0, i, pending = 0;
+    double t0 = now_wall();
+
+    printf("%s\n", s->name);
+    if (s->stale && s->xfail[0])
+        printf("  xfail: %s\n", s->xfail);
+    if (setup(&board, s, o))
+    {
+        s->errors++;
+        printf("  ERROR %s\n", s->error);
+        board_close(&board);
+        return;
+    }
+    poll = mcs51_cycles(cpu, POLL_S);
+    end = mcs51_cycles(cpu, s->duration);
+
+    while (1)
+    {
+        uint64_t stop = end;
+
+        // Fire everything that is due
+        while (next < s->n && mcs51_cycles(cpu, s->ev[next].t) <= cpu->cycles)
+        {
+            event_t *e = &s->ev[next++];
+
+            if (e->kind == EV_PIN)
+                mcs51_drive(cpu, e->port, e->mask, e->value);
+            else if (e->kind == EV_ADC)
+                board_adc_volts(&board, e->volts);
+            else if (e->kind == EV_SAVE)
+            {
+                char err[256];
+
+                if (board_snapshot_save(&board, e->file, err, sizeof(err)))
+                {
+                    s->errors++;
+                    snprintf(s->error, sizeof(s->error), "line %d: %s", e->line, err);
+                    printf("  ERROR %s\n", s->error);
+                }
+                else if (o->verbose)
+                    printf("  save %s:%d t=%.3f  %s\n", s->path, e->line,
+                           mcs51_seconds(cpu, cpu->cycles), e->file);
+            }
+            else
+                pending++;
+        }
+
+        // Checks whose window is open
+        for (i = 0; i < next; i++)
+        {
+            event_t *e = &s->ev[i];
+            double t = mcs51_seconds(cpu, cpu->cycles);
+            int r;
+
+            if (e->kind != EV_EXPECT || e->result != R_PENDING)
+                continue;
+            r = evaluate(&board, s, o, e);
+            if (r == R_FAIL && cpu->cycles < mcs51_cycles(cpu, e->t_end))
+                continue;
+            record(s, o, e, r, t);
+            pending--;
+        }
+
+        if (next >= s->n && !pending)
+            break;
+        if (next < s->n && mcs51_cycles(cpu, s->ev[next].t) < stop)
+            stop = mcs51_cycles(cpu, s->ev[next].t);
+        if (pending && cpu->cycles + poll < stop)
+            stop = cpu->cycles + poll;
+        if (stop <= cpu->cycles && cpu->cycles >= end)
+            break;
+        mcs51_run(cpu, stop);
+    }
+    if (cpu->cycles < end)
+        mcs51_run(cpu, end);
+
+    s->wall = now_wall() - t0;
+    board_close(&board);
+}
+
+// Whether s writes the snapshot file path
+static int saves(const scenario_t *s, const char *path)
+{
+    int i;
+
+    for (i = 0; i < s->n; i++)
+    {
+        if (s->ev[i].kind == EV_SAVE && !strcmp(s->ev[i].file, path))
+            return 1;
+    }
+    return 0;
+}
+
+// Next scenario to run: the first one whose snapshot no waiting scenario
+// still has to save (on a cycle, the first one waiting)
+static int next_to_run(const scenario_t *list, const int *done, int n)
+{
+    int i, j, first = -1;
+
+    for (i = 0; i < n; i++)
+    {
+        int blocked = 0;
+
+        if (done[i])
+            continue;
+        if (first < 0)
+            first = i;
+        for (j = 0; j < n && list[i].start[0]; j++)
+            blocked |= j != i && !done[j] && saves(&list[j], list[i].start);
+        if (!blocked)
+            return i;
+    }
+    return first;
+}
+
+/************************************************************
+ * Image stamps
+ ************************************************************/
+
+// Directory part of a path, "." when there is none
+static void dir_of(char *out, const char *path)
+{
+    const char *slash = strrchr(path, '/');
+
+    if (slash)
+        snprintf(out, SCN_PATH_MAX, "%.*s", (int)(slash - path), path);
+    else
+        snprintf(out, SCN_PATH_MAX, ".");
+}
+
+static int is_source(const char *name)
+{
+    size_t n = strlen(name);
+
+    return n > 2 && name[n - 2] == '.' && (name[n - 1] == 'c' || name[n - 1] == 'h') &&
+           strncmp(name, "hal_host.", 9);
+}
+
+// Hash of a file with the CRs left out, so a CRLF checkout stamps the same
+static int hash_file(const char *path, uint64_t *h)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *buf = NULL;
+    size_t n = 0, cap = 0;
+    int c;
+
+    if (!f)
+        return -1;
+    while ((c = getc(f)) != EOF)
+    {
+        if (c == '\r')
+            continue;
+        if (n == cap)
+        {
+            uint8_t *p = realloc(buf, cap = cap ? cap * 2 : 4096);
+
+            if (!p)
+            {
+                free(buf);
+                fclose(f);
+                return -1;
+            }
+            buf = p;
+        }
+        buf[n++] = (uint8_t)c;
+    }
+    fclose(f);
+    *h = board_hash(buf, n);
+    free(buf);
+    return 0;
+}
+
+static int cmp_name(const void *a, const void *b)
+{
+    return strcmp(a, b);
+}
+
+// Firmware sources beside the image, sorted; returns the count or -1
+static int list_sources(const char *dir, char names[][STAMP_NAME_MAX])
+{
+    DIR *d = opendir(dir);
+    struct dirent *de;
+    int n = 0;
+
+    if (!d)
+        return -1;
+    while ((de = readdir(d)) && n < STAMP_FILES)
+        if (is_source(de->d_name) && strlen(de->d_name) < STAMP_NAME_MAX)
+            strcpy(names[n++], de->d_name);
+    closedir(d);
+    qsort(names, n, STAMP_NAME_MAX, cmp_name);
+    return n;
+}
+
+static int write_stamp(const char *image, char *err, size_t len)
+{
+    char dir[SCN_PATH_MAX], path[SCN_PATH_MAX + STAMP_NAME_MAX];
+    char names[STAMP_FILES][STAMP_NAME_MAX];
+    const char *base = strrchr(image, '/') ? strrchr(image, '/') + 1 : image;
+    uint64_t h;
+    FILE *f;
+    int n, i;
+
+    dir_of(dir, image);
+    if ((n = list_sources(dir, names)) < 0 || hash_file(image, &h))
+    {
+        snprintf(err, len, "cannot read %s", image);
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s%s", image, STAMP_EXT);
+    if (!(f = fopen(path, "w")))
+    {
+        snprintf(err, len, "cannot write %s%s", image, STAMP_EXT);
+        return -1;
+    }
+    fprintf(f, "# Sources %s was built from (scenario --stamp)\n", base);
+    fprintf(f, "%016llx %s\n", (unsigned long long)h, base);
+    for (i = 0; i < n; i++)
+    {
+        snprintf(path, sizeof(path), "%s/%.*s", dir, STAMP_NAME_MAX - 1, names[i]);
+        if (hash_file(path, &h))
+            continue;
+        fprintf(f, "%016llx %s\n", (unsigned long long)h, names[i]);
+    }
+    if (fclose(f))
+    {
+        snprintf(err, len, "cannot write %s%s", image, STAMP_EXT);
+        return -1;
+    }
+    return 0;
+}
+
+// 0 when the image has a stamp and neither it nor a source has changed since
+static int check_stamp(const char *image, char *err, size_t len)
+{
+    char dir[SCN_PATH_MAX], path[SCN_PATH_MAX + STAMP_NAME_MAX], line[SCN_LINE_MAX];
+    char names[STAMP_FILES][STAMP_NAME_MAX], name[STAMP_NAME_MAX];
+    int seen[STAMP_FILES] = { 0 };
+    unsigned long long want;
+    uint64_t h;
+    FILE *f;
+    int n, i, first = 1;
+
+    snprintf(path, sizeof(path), "%s%s", image, STAMP_EXT);
+    if (!(f = fopen(path, "r")))
+    {
+        snprintf(err, len, "%s has no stamp (%s%s); rebuild it from this tree, then run "
+                 "scenario --stamp", image, image, STAMP_EXT);
+        return -1;
+    }
+    dir_of(dir, image);
+    if ((n = list_sources(dir, names)) < 0)
+        n = 0;
+    while (fgets(line, sizeof(line), f))
+    {
+        if (line[0] == '#' || sscanf(line, "%llx %63s", &want, name) != 2)
+            continue;
+        if (first)
+            snprintf(path, sizeof(path), "%s", image);      // The image itself comes first
+        else
+            snprintf(path, sizeof(path), "%s/%s", dir, name);
+        if (hash_file(path, &h) || h != want)
+        {
+            snprintf(err, len, "%s is stale: %s changed since it was stamped", image, name);
+            fclose(f);
+            return -1;
+        }
+        for (i = 0; i < n && !first; i++)
+            seen[i] |= !strcmp(names[i], name);
+        first = 0;
+    }
+    fclose(f);
+    for (i = 0; i < n; i++)
+    {
+        if (!seen[i])
+        {
+            snprintf(err, len, "%s is stale: %s is not in its stamp", image, names[i]);
+            return -1;
+        }
+    }
+    return first ? (snprintf(err, len, "%s%s is empty", image, STAMP_EXT), -1) : 0;
+}
+
+/************************************************************
+ * JUnit XML
+ ************************************************************/
+
+static void xml_text(FILE *f, const char *p)
+{
+    for (; *p; p++)
+    {
+        switch (*p)
+        {
+            case '&':  fputs("&amp;", f); break;
+            case '<':  fputs("&lt;", f); break;
+            case '>':  fputs("&gt;", f); break;
+            case '"':  fputs("&quot;", f); break;
+            case '\'': fputs("&apos;", f); break;
+            default:   fputc(*p, f); break;
+        }
+    }
+}
+
+static int write_junit(const char *path, scenario_t *list, int n)
+{
+    FILE *f = fopen(path, "w");
+    int tests = 0, failures = 0, errors = 0, skipped = 0, i, j;
+    double wall = 0;
+
+    if (!f)
+        return -1;
+    for (i = 0; i < n; i++)
+    {
+        tests += list[i].passed + list[i].failed + list[i].skipped + list[i].xfailed +
+                 list[i].errors;
+        failures += list[i].failed;
+        errors += list[i].errors;
+        skipped += list[i].skipped + list[i].xfailed;
+        wall += list[i].wall;
+    }
+    fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
+    fprintf(f, "<testsuites name=\"scenario\" tests=\"%d\" failures=\"%d\" errors=\"%d\" "
+               "skipped=\"%d\" time=\"%.3f\">\n", tests, failures, errors, skipped, wall);
+    for (i = 0; i < n; i++)
+    {
+        scenario_t *s = &list[i];
+
+        fprintf(f, "  <testsuite name=\"");
+        xml_text(f, s->name);
+        fprintf(f, "\" tests=\"%d\" failures=\"%d\" errors=\"%d\" skipped=\"%d\" time=\"%.3f\">\n",
+                s->passed + s->failed + s->skipped + s->xfailed + s->errors, s->failed, s->errors,
+                s->skipped + s->xfailed, s->wall);
+        if (s->errors)
+        {
+            fprintf(f, "    <testcase classname=\"");
+            xml_text(f, s->name);
+            fprintf(f, "\" name=\"setup\" time=\"0\">\n      <error message=\"");
+            xml_text(f, s->error);
+            fprintf(f, "\"/>\n    </testcase>\n");
+        }
+        for (j = 0; j < s->n; j++)
+        {
+            event_t *e = &s->ev[j];
+            char name[SCN_LINE_MAX + 32];
+            int fail;
+
+            if (e->kind != EV_EXPECT || e->result == R_PENDING)
+                continue;
+            snprintf(name, sizeof(name), "line %d: %s", e->line, e->src);
+            fprintf(f, "    <testcase classname=\"");
+            xml_text(f, s->name);
+            fprintf(f, "\" name=\"");
+            xml_text(f, name);
+            fprintf(f, "\" time=\"0\"");
+            if (e->result == R_PASS)
+            {
+                fprintf(f, "/>\n");
+                continue;
+            }
+            fail = e->result == R_FAIL || e->result == R_XPASS;
+            fprintf(f, ">\n      <%s message=\"", fail ? "failure" : "skipped");
+            if (e->result == R_XFAIL)
+            {
+                fprintf(f, "expected failure (");
+                xml_text(f, s->xfail);
+                fprintf(f, "): ");
+            }
+            xml_text(f, e->detail);
+            fprintf(f, "\"");
+            if (fail)
+            {
+                fprintf(f, ">t=%.3f s: ", e->at);
+                xml_text(f, e->detail);
+                fprintf(f, "</failure>\n");
+            }
+            else
+            {
+                fprintf(f, "/>\n");
+            }
+            fprintf(f, "    </testcase>\n");
+        }
+        fprintf(f, "  </testsuite>\n");
+    }
+    fprintf(f, "</testsuites>\n");
+    return fclose(f);
+}
+
+int main(int argc, char **argv)
+{
+    options_t o;
+    int *done;
+    const char *junit = NULL;
+    const char *map = NULL;
+    scenario_t *list;
+    int n = 0, i, j, bad = 0, failed = 0, passed = 0, skipped = 0, xfailed = 0, stamp = 0;
+    double t0 = now_wall();
+    char err[256];
+
+    memset(&o, 0, sizeof(o));
+    o.fosc = 12000000;
+    list = calloc(argc, sizeof(*list));
+    done = calloc(argc, sizeof(*done));
+    if (!list || !done)
+        return 2;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--image") && i + 1 < argc)
+            o.image = argv[++i];
+        else if (!strcmp(argv[i], "--map") && i + 1 < argc)
+            map = argv[++i];
+        else if (!strcmp(argv[i], "--junit") && i + 1 < argc)
+            junit = argv[++i];
+        else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+            o.fosc = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-v"))
+            o.verbose = 1;
+        else if (!strcmp(argv[i], "--stamp"))
+            stamp = 1;
+        else if (argv[i][0] == '-')
+            usage();
+        else if (load_scenario(&list[n++], argv[i]))
+        {
+            fprintf(stderr, "scenario: %s\n", list[n - 1].error);
+            bad = 1;
+        }
+    }
+    if (n == 0 || o.fosc == 0)
+        usage();
+    if (bad)
+        return 2;
+
+    // Each image once, in the order the scenarios name them
+    for (i = 0; i < n; i++)
+    {
+        const char *image = image_of(&list[i], &o);
+
+        for (j = 0; j < i && strcmp(image_of(&list[j], &o), image); j++)
+            ;
+        if (j < i)
+        {
+            list[i].stale = list[j].stale;
+            continue;
+        }
+        if (stamp)
+        {
+            if (write_stamp(image, err, sizeof(err)))
+            {
+                fprintf(stderr, "scenario: %s\n", err);
+                return 2;
+            }
+            printf("stamped %s\n", image);
+        }
+        else if (check_stamp(image, err, sizeof(err)))
+        {
+            printf("note: %s; xfail checks are expected to fail\n", err);
+            list[i].stale = 1;
+        }
+    }
+    if (stamp)
+        return 0;
+
+    if (map)
+    {
+        if (symmap_load(&o.map, map, err, sizeof(err)))
+        {
+            fprintf(stderr, "scenario: %s\n", err);
+            return 2;
+        }
+        o.have_map = 1;
+    }
+
+    for (i = 0; i < n; i++)
+    {
+        int k = next_to_run(list, done, n);
+
+        run_scenario(&list[k], &o);
+        done[k] = 1;
+        passed += list[k].passed;
+        failed += list[k].failed + list[k].errors;
+        skipped += list[k].skipped;
+        xfailed += list[k].xfailed;
+    }
+    printf("%d scenarios, %d checks passed, %d failed, %d expected failures, %d skipped "
+           "(%.2f s wall)\n", n, passed, failed, xfailed, skipped, now_wall() - t0);
+
+    if (junit && write_junit(junit, list, n))
+    {
+        fprintf(stderr, "scenario: cannot write %s\n", junit);
+        return 2;
+    }
+    for (i = 0; i < n; i++)
+    {
+        symmap_free(&list[i].syms);
+        free(list[i].ev);
+    }
+    free(list);
+    free(done);
+    if (o.have_map)
+        symmap_free(&o.map);
+    return failed ? 1 : 0;
+}
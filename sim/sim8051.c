@@ -0,0 +1,622 @@
+/************************************************************
+ * sim8051.c - command-line 8051 simulator
+ *
+ * Loads an Intel HEX image (Main.hex) and runs it headless
+ * for a given simulated time, with optional pin stimulus and
+ * an instruction trace.
+ *
+ *   sim8051 [options] Main.hex
+ *     -t SEC          simulated time to run (default 10)
+ *     -f HZ           crystal frequency (default 12000000)
+ *     -e T:Pp.b=V     drive pin p.b to V (0/1) at T seconds
+ *     -i N            trace the first N instructions to stderr
+ *     -d              dump IRAM and SFRs at the end
+ *     -q              no summary
+ *     -L              attach the HD44780 model, print the display
+ *                     and its timing report at the end
+ *     --lcd-live      print the display whenever it changes
+ *     --lcd-snap FILE write the final display text to FILE
+ *     --lcd-strict    drop LCD writes that violate busy timing
+ *     -a FILE         ADC input series ("seconds,volts", or a
+ *                     "seconds,celsius" header for LM35 degC)
+ *     --adc-volts V   constant ADC input (default 0.25 V)
+ *     --adc-speed K   replay the ADC series K times faster
+ *     --adc-vref V    ADC full-scale voltage (default 2.56)
+ *     --adc-log       print every conversion with LED/display state
+ *     -w PROFILE      wheel pulses on T1 (P3.5) from a drive cycle:
+ *                     urban, highway, stopgo, a "seconds,kmh" CSV
+ *                     or a constant speed in km/h
+ *     --wheel-loop    repeat the drive cycle for the whole run
+ *     --wheel-jitter F  pulse period jitter, +/- fraction
+ *     --wheel-drop P  probability that a pulse is missing
+ *     --wheel-seed N  seed for jitter/dropouts
+ *     --interp        plain interpreter, no block translation
+ *     --vcd FILE      write a GTKWave value change dump of the pins
+ *     --vcd-signals G groups: lcd,adc,io,flags,ports or all
+ *                     (default lcd,adc,io,flags)
+ *     --vcd-from SEC  start of the dumped window (default 0)
+ *     --vcd-to SEC    end of the dumped window (default: end of run)
+ *     --record FILE   log the inputs (P3.2-P3.5 edges, ADC samples)
+ *     --keyframe SEC  machine state in the log every SEC (default 10)
+ *     --replay FILE   take the inputs from a log instead of -e/-a/-w;
+ *                     -t defaults to the length of the recording
+ *     --seek SEC      with --replay: start from the last keyframe
+ *                     before SEC and report from there
+ *     --snapshot FILE save the machine state at the end of the run
+ *     --resume FILE   continue from a snapshot (same image); times
+ *                     stay absolute, -t defaults to 10 s more
+ *     --uart FILE     write every byte sent on TXD to FILE
+ *
+ * The board wiring (LCD, ADC0804) lives in board.c; the ADC
+ * is always attached since the firmware waits on its INTR
+ * line.
+ ************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "board.h"
+#include "replay.h"
+#include "vcd.h"
+
+#define MAX_PIN_EVENTS 256
+
+typedef struct
+{
+    uint64_t at;            // Machine cycle
+    uint8_t port, mask, value;
+} pin_event_t;
+
+typedef struct
+{
+    pin_event_t ev[MAX_PIN_EVENTS];
+    int n, pos;
+} pin_stim_t;
+
+typedef struct
+{
+    uint64_t left;
+} trace_t;
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: sim8051 [options] image.hex\n"
+        "  -t SEC          simulated time to run (default 10)\n"
+        "  -f HZ           crystal frequency (default 12000000)\n"
+        "  -e T:Pp.b=V     drive pin p.b to V (0/1) at T seconds\n"
+        "  -i N            trace the first N instructions to stderr\n"
+        "  -d              dump IRAM and SFRs at the end\n"
+        "  -q              no summary\n"
+        "  -L              attach the HD44780 model and report it at the end\n"
+        "  --lcd-live      print the display whenever it changes\n"
+        "  --lcd-snap FILE write the final display text to FILE\n"
+        "  --lcd-strict    drop LCD writes that violate busy timing\n"
+        "  -a FILE         ADC input series (seconds,volts or seconds,celsius)\n"
+        "  --adc-volts V   constant ADC input (default 0.25 V)\n"
+        "  --adc-speed K   replay the ADC series K times faster\n"
+        "  --adc-vref V    ADC full-scale voltage (default 2.56)\n"
+        "  --adc-log       print every conversion with LED/display state\n"
+        "  -w PROFILE      wheel pulses from urban, highway, stopgo, a seconds,kmh CSV or km/h\n"
+        "  --wheel-loop    repeat the drive cycle for the whole run\n"
+        "  --wheel-jitter F  pulse period jitter, +/- fraction\n"
+        "  --wheel-drop P  probability that a pulse is missing\n"
+        "  --wheel-seed N  seed for jitter/dropouts\n"
+        "  --interp        plain interpreter, no block translation\n"
+        "  --vcd FILE      write a value change dump of the pins\n"
+        "  --vcd-signals G lcd,adc,io,flags,ports or all (default lcd,adc,io,flags)\n"
+        "  --vcd-from SEC  start of the dumped window (default 0)\n"
+        "  --vcd-to SEC    end of the dumped window (default: end of run)\n"
+        "  --record FILE   log the inputs for --replay\n"
+        "  --keyframe SEC  machine state in the log every SEC (default 10)\n"
+        "  --replay FILE   take the inputs from a log instead of -e/-a/-w\n"
+        "  --seek SEC      with --replay: start from the last keyframe before SEC\n"
+        "  --snapshot FILE save the machine state at the end of the run\n"
+        "  --resume FILE   continue from a snapshot; -t defaults to 10 s more\n"
+        "  --uart FILE     write every byte sent on TXD to FILE\n");
+    exit(2);
+}
+
+static double now_wall(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/************************************************************
+ * Pin stimulus
+ ************************************************************/
+
+static int cmp_event(const void *a, const void *b)
+{
+    const pin_event_t *x = a, *y = b;
+
+    return x->at < y->at ? -1 : x->at > y->at;
+}
+
+static void stim_event(sim_dev_t *dev, mcs51_t *cpu)
+{
+    pin_stim_t *s = dev->ctx;
+
+    while (s->pos < s->n && s->ev[s->pos].at <= cpu->cycles)
+    {
+        pin_event_t *e = &s->ev[s->pos++];
+
+        mcs51_drive(cpu, e->port, e->mask, e->value);
+    }
+    if (s->pos < s->n)
+        mcs51_schedule(cpu, dev, s->ev[s->pos].at);
+}
+
+// Parses "T:Pp.b=V"
+static int parse_pin_event(const char *arg, mcs51_t *cpu, pin_event_t *e)
+{
+    double t;
+    int port, bit, val;
+
+    if (sscanf(arg, "%lf:P%d.%d=%d", &t, &port, &bit, &val) != 4 ||
+        port < 0 || port > 3 || bit < 0 || bit > 7 || t < 0)
+        return -1;
+    e->at = mcs51_cycles(cpu, t);
+    e->port = (uint8_t)port;
+    e->mask = (uint8_t)(1 << bit);
+    e->value = val ? e->mask : 0;
+    return 0;
+}
+
+/************************************************************
+ * Trace
+ ************************************************************/
+
+static void trace_insn(mcs51_t *cpu, uint16_t pc, void *ctx)
+{
+    trace_t *t = ctx;
+    uint8_t op = cpu->code[pc];
+    int i;
+
+    fprintf(stderr, "%10llu  %04X ", (unsigned long long)cpu->cycles, pc);
+    for (i = 0; i < 3; i++)
+    {
+        if (i < mcs51_oplen[op])
+            fprintf(stderr, " %02X", cpu->code[(uint16_t)(pc + i)]);
+        else
+            fprintf(stderr, "   ");
+    }
+    fprintf(stderr, "  A=%02X PSW=%02X SP=%02X DPTR=%02X%02X\n",
+            cpu->sfr[SFR_ACC - 0x80], cpu->sfr[SFR_PSW - 0x80], cpu->sfr[SFR_SP - 0x80],
+            cpu->sfr[SFR_DPH - 0x80], cpu->sfr[SFR_DPL - 0x80]);
+
+    if (--t->left == 0)
+        cpu->on_insn = NULL;
+}
+
+static void dump_state(mcs51_t *cpu)
+{
+    int i;
+
+    printf("IRAM:\n");
+    for (i = 0; i < (int)cpu->iram_size; i++)
+        printf("%s%02X%s", i % 16 ? " " : "  ", cpu->iram[i], i % 16 == 15 ? "\n" : "");
+    printf("SFR:\n");
+    for (i = 0x80; i < 0x100; i++)
+        printf("%s%02X%s", i % 16 ? " " : "  ", mcs51_read_direct(cpu, (uint8_t)i), i % 16 == 15 ? "\n" : "");
+}
+
+typedef struct
+{
+    hd44780_t *lcd;         // NULL when the LCD model is not attached
+} adc_log_t;
+
+static void log_conversion(void *ctx, mcs51_t *cpu, double vin, uint8_t code)
+{
+    adc_log_t *log = ctx;
+    char r0[LCD_COLS + 1], r1[LCD_COLS + 1];
+
+    printf("t=%10.3f s  vin=%.3f V  code=%3u  led=%d",
+           mcs51_seconds(cpu, cpu->cycles), vin, code, mcs51_pins(cpu, 3) & 0x01);
+    if (log->lcd)
+    {
+        hd44780_row(log->lcd, 0, r0);
+        hd44780_row(log->lcd, 1, r1);
+        printf("  |%s|%s|", r0, r1);
+    }
+    printf("\n");
+}
+
+static void uart_tx(sim_dev_t *dev, mcs51_t *cpu, uint8_t byte, int tb8)
+{
+    (void)cpu;
+    (void)tb8;
+    fputc(byte, (FILE *)dev->ctx);
+}
+
+static int write_snapshot(const hd44780_t *lcd, const char *path)
+{
+    FILE *f = fopen(path, "w");
+    char row[LCD_COLS + 1];
+    int r;
+
+    if (!f)
+        return -1;
+    for (r = 0; r < LCD_ROWS; r++)
+    {
+        hd44780_row(lcd, r, row);
+        fprintf(f, "%s\n", row);
+    }
+    return fclose(f);
+}
+
+// Runs to 'until', printing the display each time its contents change
+static void run_lcd_live(mcs51_t *cpu, hd44780_t *lcd, uint64_t until)
+{
+    uint64_t slice = mcs51_cycles(cpu, 0.001);
+    unsigned seen = lcd->version;
+
+    while (cpu->cycles < until)
+    {
+        uint64_t stop = cpu->cycles + slice;
+
+        mcs51_run(cpu, stop < until ? stop : until);
+        if (lcd->version != seen)
+        {
+            seen = lcd->version;
+            printf("t=%.3f s\n", mcs51_seconds(cpu, cpu->cycles));
+            hd44780_render(lcd, stdout);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static board_t board;
+    static pin_stim_t stim;
+    mcs51_t *cpu = &board.cpu;
+    adc_log_t adc_log = { NULL };
+    const char *adc_file = NULL;
+    double adc_volts = 0.25, adc_speed = 1.0, adc_vref = 2.56;
+    int adc_logging = 0;
+    const char *wheel_src = NULL;
+    double wheel_jitter = 0, wheel_drop = 0;
+    uint64_t wheel_seed = 1;
+    int wheel_loop = 0;
+    static vcd_t vcd;
+    const char *vcd_path = NULL;
+    unsigned vcd_sel = VCD_DEFAULT;
+    double vcd_from = 0, vcd_to = 0;
+    static recorder_t rec;
+    static replay_t rep;
+    const char *rec_path = NULL, *rep_path = NULL, *snap_path = NULL, *resume_path = NULL;
+    double keyframe = 10.0, seek = 0;
+    uint8_t *state;
+    size_t state_len;
+    sim_dev_t stim_dev, uart_dev;
+    const char *uart_path = NULL;
+    FILE *uart = NULL;
+    trace_t trace = { 0 };
+    const char *image = NULL;
+    double seconds = 0, t0, wall;
+    uint32_t fosc = 12000000;
+    int quiet = 0, dump = 0, use_lcd = 0, lcd_live = 0, lcd_strict = 0, interp = 0, i;
+    const char *lcd_snap = NULL;
+    const char *events[MAX_PIN_EVENTS];
+    int nevents = 0;
+    char err[256];
+    uint64_t insns;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-t") && i + 1 < argc)
+            seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-f") && i + 1 < argc)
+            fosc = (uint32_t)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-e") && i + 1 < argc && nevents < MAX_PIN_EVENTS)
+            events[nevents++] = argv[++i];
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc)
+            trace.left = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-d"))
+            dump = 1;
+        else if (!strcmp(argv[i], "-q"))
+            quiet = 1;
+        else if (!strcmp(argv[i], "-L"))
+            use_lcd = 1;
+        else if (!strcmp(argv[i], "--lcd-live"))
+            use_lcd = lcd_live = 1;
+        else if (!strcmp(argv[i], "--lcd-strict"))
+            use_lcd = lcd_strict = 1;
+        else if (!strcmp(argv[i], "-a") && i + 1 < argc)
+            adc_file = argv[++i];
+        else if (!strcmp(argv[i], "--adc-volts") && i + 1 < argc)
+            adc_volts = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--adc-speed") && i + 1 < argc)
+            adc_speed = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--adc-vref") && i + 1 < argc)
+            adc_vref = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--adc-log"))
+            adc_logging = 1;
+        else if (!strcmp(argv[i], "-w") && i + 1 < argc)
+            wheel_src = argv[++i];
+        else if (!strcmp(argv[i], "--wheel-loop"))
+            wheel_loop = 1;
+        else if (!strcmp(argv[i], "--wheel-jitter") && i + 1 < argc)
+            wheel_jitter = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--wheel-drop") && i + 1 < argc)
+            wheel_drop = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--interp"))
+            interp = 1;
+        else if (!strcmp(argv[i], "--wheel-seed") && i + 1 < argc)
+            wheel_seed = strtoull(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--vcd") && i + 1 < argc)
+            vcd_path = argv[++i];
+        else if (!strcmp(argv[i], "--vcd-signals") && i + 1 < argc)
+        {
+            if (!(vcd_sel = vcd_groups(argv[++i])))
+                usage();
+        }
+        else if (!strcmp(argv[i], "--vcd-from") && i + 1 < argc)
+            vcd_from = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--vcd-to") && i + 1 < argc)
+            vcd_to = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc)
+            rec_path = argv[++i];
+        else if (!strcmp(argv[i], "--keyframe") && i + 1 < argc)
+            keyframe = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+            rep_path = argv[++i];
+        else if (!strcmp(argv[i], "--seek") && i + 1 < argc)
+            seek = atof(argv[++i]);
+        else if (!strcmp(argv[i], "--snapshot") && i + 1 < argc)
+            snap_path = argv[++i];
+        else if (!strcmp(argv[i], "--resume") && i + 1 < argc)
+            resume_path = argv[++i];
+        else if (!strcmp(argv[i], "--uart") && i + 1 < argc)
+            uart_path = argv[++i];
+        else if (!strcmp(argv[i], "--lcd-snap") && i + 1 < argc)
+        {
+            use_lcd = 1;
+            lcd_snap = argv[++i];
+        }
+        else if (argv[i][0] == '-' || image)
+            usage();
+        else
+            image = argv[i];
+    }
+    if (!image || fosc == 0 || (rec_path && rep_path) || (seek && !rep_path) ||
+        (resume_path && (rec_path || rep_path)))
+        usage();
+    if (rep_path)
+    {
+        if (nevents || adc_file || wheel_src)
+        {
+            fprintf(stderr, "sim8051: --replay takes the inputs from the log, not from -e, -a or -w\n");
+            return 2;
+        }
+        if (!(fosc = replay_fosc(rep_path)))
+        {
+            fprintf(stderr, "sim8051: %s is not an input log\n", rep_path);
+            return 1;
+        }
+    }
+
+    board_init(&board, fosc);
+    if (board_load(&board, image, err, sizeof(err)))
+    {
+        fprintf(stderr, "sim8051: %s\n", err);
+        return 1;
+    }
+
+    for (i = 0; i < nevents; i++)
+    {
+        if (parse_pin_event(events[i], cpu, &stim.ev[stim.n++]))
+        {
+            fprintf(stderr, "sim8051: bad pin event '%s' (want T:Pp.b=V)\n", events[i]);
+            return 2;
+        }
+    }
+    qsort(stim.ev, stim.n, sizeof(stim.ev[0]), cmp_event);
+    memset(&stim_dev, 0, sizeof(stim_dev));
+    stim_dev.name = "pins";
+    stim_dev.ctx = &stim;
+    stim_dev.event = stim_event;
+    stim_dev.next = stim.n ? stim.ev[0].at : MCS51_NEVER;
+    mcs51_attach(cpu, &stim_dev);
+
+    if (uart_path)
+    {
+        if (!(uart = fopen(uart_path, "wb")))
+        {
+            fprintf(stderr, "sim8051: cannot create %s\n", uart_path);
+            return 1;
+        }
+        memset(&uart_dev, 0, sizeof(uart_dev));
+        uart_dev.name = "uart";
+        uart_dev.ctx = uart;
+        uart_dev.uart_tx = uart_tx;
+        uart_dev.next = MCS51_NEVER;
+        mcs51_attach(cpu, &uart_dev);
+    }
+
+    board.lcd.strict = lcd_strict;
+
+    if (adc_file)
+    {
+        if (board_adc_file(&board, adc_file, adc_speed, err, sizeof(err)))
+        {
+            fprintf(stderr, "sim8051: %s\n", err);
+            return 1;
+        }
+    }
+    else
+    {
+        board_adc_volts(&board, adc_volts);
+    }
+    board.adc.vref = adc_vref;
+    if (adc_logging)
+    {
+        adc_log.lcd = use_lcd ? &board.lcd : NULL;
+        board.adc.on_convert = log_conversion;
+        board.adc.on_convert_ctx = &adc_log;
+    }
+
+    if (wheel_src)
+    {
+        if (board_wheel(&board, wheel_src, wheel_loop, wheel_seed, err, sizeof(err)))
+        {
+            fprintf(stderr, "sim8051: %s\n", err);
+            return 1;
+        }
+        board.wheel.jitter = wheel_jitter;
+        board.wheel.dropout = wheel_drop;
+    }
+
+    if (rec_path && recorder_open(&rec, &board, rec_path, keyframe, err, sizeof(err)))
+    {
+        fprintf(stderr, "sim8051: %s\n", err);
+        return 1;
+    }
+    if (rep_path)
+    {
+        if (replay_open(&rep, &board, rep_path, err, sizeof(err)))
+        {
+            fprintf(stderr, "sim8051: %s\n", err);
+            return 1;
+        }
+        if (!seconds)
+            seconds = mcs51_seconds(cpu, rep.end);
+    }
+    if (resume_path)
+    {
+        if (board_snapshot_load(&board, resume_path, err, sizeof(err)))
+        {
+            fprintf(stderr, "sim8051: %s\n", err);
+            return 1;
+        }
+        if (!seconds)
+            seconds = mcs51_seconds(cpu, cpu->cycles) + 10.0;
+    }
+    if (!seconds)
+        seconds = 10.0;
+
+    cpu->translate = !interp;
+    t0 = now_wall();
+    if (seek && replay_seek(&rep, seek, err, sizeof(err)))
+    {
+        fprintf(stderr, "sim8051: %s\n", err);
+        return 1;
+    }
+
+    if (vcd_path && vcd_open(&vcd, cpu, vcd_path, vcd_sel, vcd_from, vcd_to, err, sizeof(err)))
+    {
+        fprintf(stderr, "sim8051: %s\n", err);
+        return 1;
+    }
+
+    if (trace.left)
+    {
+        cpu->on_insn = trace_insn;
+        cpu->on_insn_ctx = &trace;
+    }
+
+    if (lcd_live)
+        run_lcd_live(cpu, &board.lcd, mcs51_cycles(cpu, seconds));
+    else
+        mcs51_run(cpu, mcs51_cycles(cpu, seconds));
+    insns = cpu->insns;
+    wall = now_wall() - t0;
+    if (snap_path && board_snapshot_save(&board, snap_path, err, sizeof(err)))
+    {
+        fprintf(stderr, "sim8051: %s\n", err);
+        return 1;
+    }
+    if (rec_path && recorder_close(&rec, err, sizeof(err)))
+    {
+        fprintf(stderr, "sim8051: %s\n", err);
+        return 1;
+    }
+    if (uart && fclose(uart))
+    {
+        fprintf(stderr, "sim8051: error writing %s\n", uart_path);
+        return 1;
+    }
+    if (vcd_path && vcd_close(&vcd, cpu))
+    {
+        fprintf(stderr, "sim8051: error writing %s\n", vcd_path);
+        return 1;
+    }
+
+    if (!quiet)
+    {
+        double sim = mcs51_seconds(cpu, cpu->cycles);
+
+        printf("image        %s (%u bytes, 0x%04X-0x%04X)\n", image, board.image.bytes,
+               board.image.lo, board.image.hi ? board.image.hi - 1 : 0);
+        printf("cycles       %llu\n", (unsigned long long)cpu->cycles);
+        printf("instructions %llu\n", (unsigned long long)insns);
+        printf("simulated    %.6f s\n", sim);
+        printf("wall         %.6f s (%.1fx real time)\n", wall, wall > 0 ? sim / wall : 0.0);
+        if (cpu->translate && insns)
+            printf("translated   %u blocks, %.1f%% of insns in blocks, %.1f%% fast-forwarded\n",
+                   cpu->xlat_blocks, 100.0 * cpu->xlat_insns / insns, 100.0 * cpu->ff_insns / insns);
+        printf("pc           %04X%s\n", cpu->pc, cpu->idle ? " (idle)" : cpu->powerdown ? " (power-down)" : "");
+        printf("ports        P0=%02X P1=%02X P2=%02X P3=%02X\n",
+               mcs51_pins(cpu, 0), mcs51_pins(cpu, 1), mcs51_pins(cpu, 2), mcs51_pins(cpu, 3));
+        printf("sp max       %02X%s\n", cpu->sp_max,
+               cpu->sp_max >= cpu->iram_size ? " (stack overflowed IRAM)" : "");
+    }
+    if (use_lcd)
+    {
+        if (!quiet)
+        {
+            hd44780_render(&board.lcd, stdout);
+            hd44780_report(&board.lcd, stdout);
+        }
+        if (lcd_snap && write_snapshot(&board.lcd, lcd_snap))
+        {
+            fprintf(stderr, "sim8051: cannot write %s\n", lcd_snap);
+            return 1;
+        }
+    }
+    if (!quiet)
+        printf("adc          %llu conversions, %llu early reads, last %.3f V -> %u\n",
+               (unsigned long long)board.adc.conversions, (unsigned long long)board.adc.early_reads,
+               board.adc.vin, board.adc.result);
+    if (!quiet && vcd_path)
+        printf("vcd          %s, %llu value changes\n", vcd_path, (unsigned long long)vcd.changes);
+    if (!quiet && wheel_src)
+        printf("wheel        %llu pulses, %llu dropped, %.3f km, %.1f km/h now\n",
+               (unsigned long long)board.wheel.pulses, (unsigned long long)board.wheel.dropped,
+               board.wheel.distance / 1000.0, board.wheel.kmh);
+    if (!quiet && (rec_path || rep_path || snap_path || resume_path))
+    {
+        state_len = board_save(&board, NULL, 0);
+        state = malloc(state_len);
+        if (state)
+        {
+            board_save(&board, state, state_len);
+            printf("state        %016llx\n", (unsigned long long)board_hash(state, state_len));
+            free(state);
+        }
+    }
+    if (!quiet && rec_path)
+        printf("record       %s, %llu pin edges, %llu ADC changes, %d keyframes, %llu bytes\n",
+               rec_path, (unsigned long long)rec.pins, (unsigned long long)rec.samples, rec.nkeys,
+               (unsigned long long)rec.offset);
+    if (!quiet && rep_path)
+    {
+        printf("replay       %s, %llu pin edges, %llu ADC changes, ", rep_path,
+               (unsigned long long)rep.pins, (unsigned long long)rep.samples);
+        if (rep.key_cycle)
+            printf("from keyframe at %.3f s\n", mcs51_seconds(cpu, rep.key_cycle));
+        else
+            printf("from reset%s\n", rep.same_image ? "" : " (log made with another image)");
+    }
+    if (dump)
+        dump_state(cpu);
+    if (rep_path)
+        replay_close(&rep);
+    board_close(&board);
+    return 0;
+}
@@ -0,0 +1,766 @@
+/************************************************************
+ * stackcheck.c - static stack depth and IRAM budget
+ *
+ * The AT89C51 has 128 bytes of internal RAM for register
+ * banks, bit variables, globals, overlaid locals and the
+ * stack, which grows up from SP+1 after the startup code.
+ * This tool walks the code of Main.hex from the reset vector
+ * and from every interrupt vector in use, following jumps and
+ * calls, to build the call graph and the worst-case stack
+ * depth: 2 bytes per LCALL/ACALL, 1 per PUSH, and for each
+ * interrupt 2 bytes for the return address plus whatever its
+ * handler pushes. The linker map, if given, names the
+ * functions and supplies the data segments (register banks,
+ * ?DT? variables, _DATA_GROUP_ overlay, ?STACK) so the free
+ * IRAM above the stack can be reported.
+ *
+ *   stackcheck [options] [Main.hex]
+ *     --map FILE    Keil .m51 or SDCC .map of the image
+ *     --iram N      internal RAM size (default 128, IRAM(0-0x7F))
+ *     --reserve N   fail when fewer than N bytes stay free (default 0)
+ *     --ip MASK     interrupt priorities (IP register); by default
+ *                   taken from the code's writes to IP
+ *     -v            list every function
+ *
+ * Interrupts nest at most one level deep: a high priority
+ * handler can interrupt a low priority one, never the same
+ * level. The worst case is therefore main + the deepest low
+ * priority handler + the deepest high priority handler.
+ *
+ * Keil switch statements call ?C?CCASE / ?C?ICASE / ?C?LCASE
+ * with the case table inline after the call; those tables are
+ * decoded when the map names the helpers. Other indirect jumps
+ * and calls are reported, and the depth is then a lower bound.
+ *
+ * Exit status is 1 when the headroom is below --reserve, the
+ * stack starts below the end of the data segments, or the
+ * depth is unbounded (recursion, SP arithmetic, push loops).
+ ************************************************************/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "ihex.h"
+#include "mcs51.h"
+#include "symmap.h"
+
+#define MAX_FUNCS       512
+#define MAX_EDGES       4096
+#define DEPTH_LIMIT     256         // Deeper than any IRAM: a push loop
+#define UNSEEN          (-32768)
+
+#define SFR_SP          0x81
+#define SFR_IP          0xB8
+
+// Function flags
+#define F_RECURSIVE     0x01
+#define F_UNBOUNDED     0x02        // SP arithmetic or a loop that keeps pushing
+#define F_INDIRECT      0x04        // Indirect jump or call with unknown targets
+#define F_INLINE        0x08        // Call to a helper that eats its return address
+#define F_BAD           0x10        // Invalid opcode or code outside the image
+#define F_CASE          0x20        // Keil switch helper, table decoded at the call
+
+typedef struct
+{
+    uint16_t addr;
+    char name[SYM_NAME_MAX];
+    int state;                      // 0 new, 1 being walked, 2 done
+    int own;                        // Deepest own pushes, bytes above the entry SP
+    int depth;                      // Worst case including callees
+    int min;                        // Lowest SP delta; < 0 pops the return address
+    int flags;
+    int worst;                      // Callee on the worst path, -1 for none
+    int via;                        // Depth through that callee
+    uint16_t bad_at;                // First problem address, for the report
+} func_t;
+
+typedef struct
+{
+    const uint8_t *code, *used;
+    const symmap_t *map;
+    uint8_t entry[65536];           // Known function entries from the map
+    func_t f[MAX_FUNCS];
+    int n;
+    int from[MAX_EDGES], to[MAX_EDGES];
+    int nedge;
+    int sp_init;                    // MOV SP,#imm in the startup code, -1 if none
+    unsigned ip_mask;               // IP bits the code may set
+    int ip_unknown;                 // IP written other than by immediate/SETB
+} graph_t;
+
+typedef struct
+{
+    const char *name;
+    uint16_t vector;
+    int irq;                        // Bit in IP, -1 for reset
+    int root;
+    int depth;                      // Including the 2 byte return address for interrupts
+    char prio;                      // 'L'ow, 'H'igh or '?' when IP cannot be traced
+} root_t;
+
+static const char *irq_names[] = { "INT0", "Timer0", "INT1", "Timer1", "Serial", "Timer2" };
+
+static uint8_t code[65536], used[65536];
+
+static void usage(void)
+{
+    fprintf(stderr,
+        "usage: stackcheck [options] [image.hex]\n"
+        "  --map FILE    Keil .m51 or SDCC .map of the image\n"
+        "  --iram N      internal RAM size (default 128)\n"
+        "  --reserve N   fail when fewer than N bytes stay free (default 0)\n"
+        "  --ip MASK     interrupt priority bits (default: from the code)\n"
+        "  -v            list every function\n");
+    exit(2);
+}
+
+static uint16_t word_at(uint16_t a)
+{
+    return (uint16_t)(code[a] << 8 | code[(uint16_t)(a + 1)]);
+}
+
+// Name for a code address: global symbol, Keil function segment, or a placeholder
+static void name_of(const graph_t *g, uint16_t addr, char *out, int len)
+{
+    int i;
+
+    if (g->map)
+    {
+        for (i = 0; i < g->map->n; i++)
+        {
+            const sym_t *s = &g->map->sym[i];
+
+            if (s->space == SYM_CODE && s->global && s->addr == addr)
+            {
+                snprintf(out, len, "%s", s->name);
+                return;
+            }
+        }
+        for (i = 0; i < g->map->nseg; i++)
+        {
+            const symseg_t *s = &g->map->seg[i];
+
+            if (s->space == SYM_CODE && s->kind == SEG_FUNC && s->base == addr)
+            {
+                snprintf(out, len, "%s", s->name);
+                return;
+            }
+        }
+    }
+    snprintf(out, len, "sub_%04X", addr);
+}
+
+static int func_at(graph_t *g, uint16_t addr)
+{
+    func_t *f;
+    int i;
+
+    for (i = 0; i < g->n; i++)
+    {
+        if (g->f[i].addr == addr)
+            return i;
+    }
+    if (g->n == MAX_FUNCS)
+    {
+        fprintf(stderr, "stackcheck: more than %d functions\n", MAX_FUNCS);
+        exit(2);
+    }
+    f = &g->f[g->n];
+    memset(f, 0, sizeof(*f));
+    f->addr = addr;
+    f->worst = -1;
+    f->via = -1;
+    name_of(g, addr, f->name, sizeof(f->name));
+    return g->n++;
+}
+
+static void add_edge(graph_t *g, int from, int to)
+{
+    int i;
+
+    for (i = 0; i < g->nedge; i++)
+    {
+        if (g->from[i] == from && g->to[i] == to)
+            return;
+    }
+    if (g->nedge < MAX_EDGES)
+    {
+        g->from[g->nedge] = from;
+        g->to[g->nedge++] = to;
+    }
+}
+
+// Entry size of a Keil switch helper's inline table, 0 if name is not one
+static int case_entry(const char *name)
+{
+    if (!strcasecmp(name, "?C?CCASE"))
+        return 3;       // DW label, DB value
+    if (!strcasecmp(name, "?C?ICASE"))
+        return 4;       // DW label, DW value
+    if (!strcasecmp(name, "?C?LCASE"))
+        return 6;       // DW label, DD value
+    return 0;
+}
+
+// Direct address an instruction writes, -1 for none; bit writes give the SFR byte
+static int direct_dest(uint16_t pc)
+{
+    uint8_t op = code[pc], a1 = code[(uint16_t)(pc + 1)];
+
+    switch (op)
+    {
+        case 0x05: case 0x15: case 0x42: case 0x43: case 0x52: case 0x53:
+        case 0x62: case 0x63: case 0x75: case 0x86: case 0x87: case 0xC5:
+        case 0xD0: case 0xD5: case 0xF5:
+            return a1;
+        case 0x85:
+            return code[(uint16_t)(pc + 2)];    // MOV dst,src is encoded src, dst
+        case 0x10: case 0x92: case 0xB2: case 0xC2: case 0xD2:
+            return a1 >= 0x80 ? (a1 & 0xF8) : -1;
+    }
+    if ((op & 0xF8) == 0x88)
+        return a1;
+    return -1;
+}
+
+// Tracks writes to IP; bit clears only lower priorities and are ignored
+static void note_ip(graph_t *g, uint16_t pc)
+{
+    uint8_t op = code[pc], a1 = code[(uint16_t)(pc + 1)];
+
+    if (direct_dest(pc) != SFR_IP)
+        return;
+    if (op == 0x75 || op == 0x43)
+        g->ip_mask |= code[(uint16_t)(pc + 2)];
+    else if (op == 0xD2)
+        g->ip_mask |= 1u << (a1 & 7);
+    else if (op != 0xC2 && op != 0x53)
+        g->ip_unknown = 1;
+}
+
+typedef struct
+{
+    int16_t *at;                    // SP delta on entry to each address
+    uint16_t *queue;
+    uint8_t *queued;
+    unsigned head, tail;
+} walk_t;
+
+static void visit(walk_t *w, func_t *f, uint16_t pc, int d)
+{
+    if (d > DEPTH_LIMIT)
+    {
+        if (!(f->flags & F_UNBOUNDED))
+            f->bad_at = pc;
+        f->flags |= F_UNBOUNDED;
+        return;
+    }
+    if (w->at[pc] != UNSEEN && w->at[pc] >= d)
+        return;
+    w->at[pc] = (int16_t)d;
+    if (!w->queued[pc])
+    {
+        w->queued[pc] = 1;
+        w->queue[w->tail++ & 0xFFFF] = pc;
+    }
+}
+
+static void problem(func_t *f, int flag, uint16_t pc)
+{
+    if (!(f->flags & (F_INDIRECT | F_INLINE | F_BAD | F_UNBOUNDED)))
+        f->bad_at = pc;
+    f->flags |= flag;
+}
+
+static int analyse(graph_t *g, int idx);
+
+// Call or tail jump to target at SP delta d; returns the callee or -1
+static int call(graph_t *g, int idx, uint16_t target, int d, int ret)
+{
+    int c = func_at(g, target), cd;
+    func_t *f = &g->f[idx];
+
+    if (g->f[c].state == 1)
+    {
+        g->f[c].flags |= F_RECURSIVE;
+        f->flags |= F_RECURSIVE;
+    }
+    cd = analyse(g, c);
+    add_edge(g, idx, c);
+    if (d + ret + cd > f->via)
+    {
+        f->via = d + ret + cd;
+        f->worst = c;
+    }
+    if (f->via > f->depth)
+        f->depth = f->via;
+    return c;
+}
+
+// Walks one function from its entry; returns its worst-case depth
+static int analyse(graph_t *g, int idx)
+{
+    func_t *f = &g->f[idx];
+    walk_t w;
+    unsigned i;
+
+    if (f->state)
+        return f->depth;
+    f->state = 1;
+
+    w.at = malloc(65536 * sizeof(*w.at));
+    w.queue = malloc(65536 * sizeof(*w.queue));
+    w.queued = calloc(65536, 1);
+    if (!w.at || !w.queue || !w.queued)
+    {
+        fprintf(stderr, "stackcheck: out of memory\n");
+        exit(2);
+    }
+    for (i = 0; i < 65536; i++)
+        w.at[i] = UNSEEN;
+    w.head = w.tail = 0;
+    visit(&w, f, f->addr, 0);
+
+    while (w.head != w.tail)
+    {
+        uint16_t pc = w.queue[w.head++ & 0xFFFF], next, t;
+        int d = w.at[pc], c, n;
+        uint8_t op;
+
+        w.queued[pc] = 0;
+        f = &g->f[idx];
+        if (!used[pc] || code[pc] == 0xA5)
+        {
+            problem(f, F_BAD, pc);
+            continue;
+        }
+        op = code[pc];
+        next = (uint16_t)(pc + mcs51_oplen[op]);
+        if (d > f->own)
+            f->own = d;
+        if (d < f->min)
+            f->min = d;
+        if (d > f->depth)
+            f->depth = d;
+
+        note_ip(g, pc);
+        if (direct_dest(pc) == SFR_SP)
+        {
+            if (op == 0x75)
+            {
+                // MOV SP,#imm: the startup code setting up a fresh stack
+                if (g->sp_init < 0)
+                    g->sp_init = code[(uint16_t)(pc + 2)];
+                visit(&w, f, next, 0);
+            }
+            else
+                problem(f, F_UNBOUNDED, pc);
+            continue;
+        }
+
+        switch (op)
+        {
+            case 0x22:  // RET
+            case 0x32:  // RETI
+                continue;
+            case 0xC0:  // PUSH
+                visit(&w, f, next, d + 1);
+                continue;
+            case 0xD0:  // POP
+                visit(&w, f, next, d - 1);
+                continue;
+            case 0x02:  // LJMP
+            case 0x80:  // SJMP
+                t = op == 0x02 ? word_at((uint16_t)(pc + 1)) :
+                    (uint16_t)(next + (int8_t)code[(uint16_t)(pc + 1)]);
+                if (t != f->addr && g->entry[t])
+                    call(g, idx, t, d, 0);      // Tail call into another function
+                else
+                    visit(&w, f, t, d);
+                continue;
+            case 0x73:  // JMP @A+DPTR: a jump table right after it, or at MOV DPTR,#table
+                t = pc >= 3 && code[pc - 3] == 0x90 ? word_at((uint16_t)(pc - 2)) : next;
+                for (n = 0; n < 128 && used[t] && (code[t] == 0x02 || code[t] == 0x80 ||
+                     (code[t] & 0x1F) == 0x01); n++)
+                {
+                    visit(&w, f, t, d);
+                    t = (uint16_t)(t + mcs51_oplen[code[t]]);
+                }
+                if (!n)
+                    problem(f, F_INDIRECT, pc);
+                continue;
+            case 0x12:  // LCALL
+            case 0x11: case 0x31: case 0x51: case 0x71:
+            case 0x91: case 0xB1: case 0xD1: case 0xF1:     // ACALL
+                t = op == 0x12 ? word_at((uint16_t)(pc + 1)) :
+                    (uint16_t)((next & 0xF800) | (op >> 5) << 8 | code[(uint16_t)(pc + 1)]);
+                c = call(g, idx, t, d, 2);
+                f = &g->f[idx];
+                if (g->f[c].min >= 0 || g->f[c].state == 1)
+                {
+                    visit(&w, f, next, d);
+                    continue;
+                }
+
+                // The helper pops its return address to read inline data
+                if (!(n = case_entry(g->f[c].name)))
+                {
+                    problem(f, F_INLINE, pc);
+                    continue;
+                }
+                g->f[c].flags = (g->f[c].flags & ~F_INDIRECT) | F_CASE;
+                for (t = next, i = 0; i < 256 && used[t]; i++, t = (uint16_t)(t + n))
+                {
+                    if (!word_at(t))
+                    {
+                        visit(&w, f, (uint16_t)(t + 2), d);   // Default: code after the table
+                        break;
+                    }
+                    visit(&w, f, word_at(t), d);
+                }
+                continue;
+        }
+        if ((op & 0x1F) == 0x01)   // AJMP
+        {
+            t = (uint16_t)((next & 0xF800) | (op >> 5) << 8 | code[(uint16_t)(pc + 1)]);
+            if (t != f->addr && g->entry[t])
+                call(g, idx, t, d, 0);
+            else
+                visit(&w, f, t, d);
+            continue;
+        }
+
+        // Conditional branches: relative offset in the last byte
+        switch (op)
+        {
+            case 0x10: case 0x20: case 0x30: case 0x40: case 0x50: case 0x60: case 0x70:
+            case 0xB4: case 0xB5: case 0xB6: case 0xB7: case 0xB8: case 0xB9: case 0xBA:
+            case 0xBB: case 0xBC: case 0xBD: case 0xBE: case 0xBF: case 0xD5:
+                visit(&w, f, (uint16_t)(next + (int8_t)code[(uint16_t)(next - 1)]), d);
+                break;
+            default:
+                if ((op & 0xF8) == 0xD8)    // DJNZ Rn
+                    visit(&w, f, (uint16_t)(next + (int8_t)code[(uint16_t)(pc + 1)]), d);
+                break;
+        }
+        visit(&w, f, next, d);
+    }
+
+    free(w.at);
+    free(w.queue);
+    free(w.queued);
+    f = &g->f[idx];
+    f->state = 2;
+    return f->depth;
+}
+
+// Flags of every function reachable from root
+static int reach_flags(const graph_t *g, int root, uint8_t *seen)
+{
+    int flags = g->f[root].flags & ~F_CASE, i;
+
+    if (seen[root])
+        return 0;
+    seen[root] = 1;
+    if (g->f[root].flags & F_CASE)
+        flags &= ~F_INDIRECT;
+    for (i = 0; i < g->nedge; i++)
+    {
+        if (g->from[i] == root)
+            flags |= reach_flags(g, g->to[i], seen);
+    }
+    return flags;
+}
+
+static void print_path(const graph_t *g, int root)
+{
+    uint8_t seen[MAX_FUNCS] = { 0 };
+    int i, n;
+
+    for (i = root, n = 0; i >= 0 && !seen[i]; i = g->f[i].worst, n++)
+    {
+        seen[i] = 1;
+        printf("%s%s", n ? " > " : "", g->f[i].name);
+    }
+    printf(i >= 0 ? " > %s ...\n" : "\n", i >= 0 ? g->f[i].name : "");
+}
+
+static void print_problems(const graph_t *g)
+{
+    int i;
+
+    for (i = 0; i < g->n; i++)
+    {
+        const func_t *f = &g->f[i];
+
+        if (f->flags & F_RECURSIVE)
+            printf("  %s: recursive, depth unbounded\n", f->name);
+        if (f->flags & F_UNBOUNDED)
+            printf("  %s: SP changed or pushes in a loop at %04XH, depth unbounded\n", f->name,
+                   f->bad_at);
+        if ((f->flags & F_INDIRECT) && !(f->flags & F_CASE))
+            printf("  %s: indirect jump or call at %04XH, targets not followed\n", f->name,
+                   f->bad_at);
+        if (f->flags & F_INLINE)
+            printf("  %s: call at %04XH to a helper with inline data, rest not followed\n",
+                   f->name, f->bad_at);
+        if (f->flags & F_BAD)
+            printf("  %s: invalid or missing code at %04XH\n", f->name, f->bad_at);
+    }
+}
+
+static const char *seg_kind_name(char kind)
+{
+    switch (kind)
+    {
+        case SEG_REG:       return "registers";
+        case SEG_VAR:       return "variables";
+        case SEG_OVERLAY:   return "overlay";
+        case SEG_STACK:     return "stack";
+    }
+    return "other";
+}
+
+// Prints the data segments; returns the end of the highest one below the stack
+static unsigned print_iram(const symmap_t *map, unsigned iram, int *stack_base)
+{
+    char owner[256] = { 0 };
+    unsigned regs = 0, vars = 0, over = 0, end = 0, a;
+    int i;
+
+    printf("  addr  bytes  %-10s segment\n", "kind");
+    for (i = 0; i < map->nseg; i++)
+    {
+        const symseg_t *s = &map->seg[i];
+        unsigned lo = s->base, hi = s->base + s->length;
+
+        if (s->space == SYM_BIT)
+        {
+            lo = 0x20 + s->base / 8;
+            hi = 0x20 + (s->base + s->length + 7) / 8;
+        }
+        else if (s->space != SYM_DATA && s->space != SYM_IDATA)
+            continue;
+        if (s->kind == SEG_STACK)
+        {
+            *stack_base = s->base;
+            continue;
+        }
+        if (s->space == SYM_BIT)
+            printf("  %04XH %3u.%u  %-10s %s\n", lo, s->length / 8, s->length % 8,
+                   seg_kind_name(s->kind), s->name);
+        else
+            printf("  %04XH %5u  %-10s %s\n", lo, s->length, seg_kind_name(s->kind), s->name);
+
+        // Bit segments share bytes; the first segment in a byte owns it
+        for (a = lo; a < hi && a < sizeof(owner); a++)
+        {
+            if (!owner[a])
+                owner[a] = s->kind;
+        }
+        if (hi > end)
+            end = hi;
+    }
+    for (a = 0; a < sizeof(owner); a++)
+    {
+        regs += owner[a] == SEG_REG;
+        vars += owner[a] == SEG_VAR;
+        over += owner[a] == SEG_OVERLAY;
+    }
+    printf("  %u register, %u variable, %u overlay bytes; data ends at %02XH of %u\n", regs, vars,
+           over, end, iram);
+    return end;
+}
+
+int main(int argc, char **argv)
+{
+    static graph_t g;
+    symmap_t map;
+    ihex_info_t info;
+    root_t roots[1 + 6];
+    const char *image = "Main.hex", *map_path = NULL;
+    unsigned iram = 128, reserve = 0, ip = 0, data_end = 0;
+    int ip_given = 0, verbose = 0, nroot = 0, stack_base = -1, start, avail, headroom;
+    int main_depth, low_i = -1, high_i = -1, total, flags = 0, ip_traced, overlap, i;
+    uint8_t seen[MAX_FUNCS];
+    char err[256];
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--map") && i + 1 < argc)
+            map_path = argv[++i];
+        else if (!strcmp(argv[i], "--iram") && i + 1 < argc)
+            iram = (unsigned)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--reserve") && i + 1 < argc)
+            reserve = (unsigned)strtoul(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "--ip") && i + 1 < argc)
+        {
+            ip = (unsigned)strtoul(argv[++i], NULL, 0);
+            ip_given = 1;
+        }
+        else if (!strcmp(argv[i], "-v"))
+            verbose = 1;
+        else if (argv[i][0] == '-')
+            usage();
+        else
+            image = argv[i];
+    }
+    if (iram != 128 && iram != 256)
+        usage();
+
+    if (ihex_load(image, code, sizeof(code), used, &info, err, sizeof(err)))
+    {
+        fprintf(stderr, "stackcheck: %s\n", err);
+        return 2;
+    }
+    if (map_path)
+    {
+        if (symmap_load(&map, map_path, err, sizeof(err)))
+        {
+            fprintf(stderr, "stackcheck: %s\n", err);
+            return 2;
+        }
+        g.map = &map;
+        for (i = 0; i < map.n; i++)
+        {
+            if (map.sym[i].space == SYM_CODE && map.sym[i].global)
+                g.entry[map.sym[i].addr] = 1;
+        }
+        for (i = 0; i < map.nseg; i++)
+        {
+            if (map.seg[i].space == SYM_CODE && map.seg[i].kind == SEG_FUNC)
+                g.entry[map.seg[i].base] = 1;
+        }
+    }
+    g.code = code;
+    g.used = used;
+    g.sp_init = -1;
+
+    // Reset, then every interrupt vector that holds code
+    roots[nroot].name = "reset";
+    roots[nroot].vector = 0;
+    roots[nroot].irq = -1;
+    roots[nroot++].root = func_at(&g, 0);
+    snprintf(g.f[0].name, sizeof(g.f[0].name), "vector 0000H");
+    for (i = 0; i < (iram > 128 ? 6 : 5); i++)
+    {
+        uint16_t v = (uint16_t)(3 + 8 * i);
+
+        if (!used[v])
+            continue;
+        roots[nroot].name = irq_names[i];
+        roots[nroot].vector = v;
+        roots[nroot].irq = i;
+        roots[nroot].root = func_at(&g, v);
+        snprintf(g.f[roots[nroot].root].name, sizeof(g.f[0].name), "vector %04XH", v);
+        nroot++;
+    }
+    for (i = 0; i < nroot; i++)
+    {
+        roots[i].depth = analyse(&g, roots[i].root) + (i ? 2 : 0);
+        memset(seen, 0, sizeof(seen));
+        flags |= reach_flags(&g, roots[i].root, seen);
+    }
+    if (!ip_given)
+        ip = g.ip_mask;
+    ip_traced = ip_given || !g.ip_unknown;
+
+    if (verbose)
+    {
+        printf("  addr  own  worst  name\n");
+        for (i = 0; i < g.n; i++)
+            printf("  %04XH %4d %6d  %s\n", g.f[i].addr, g.f[i].own, g.f[i].depth, g.f[i].name);
+        printf("\n");
+    }
+
+    // Deepest handler per priority level; untraceable IP lets the two deepest nest
+    main_depth = roots[0].depth;
+    for (i = 1; i < nroot; i++)
+    {
+        root_t *r = &roots[i];
+
+        r->prio = !ip_traced ? '?' : (ip >> r->irq) & 1 ? 'H' : 'L';
+        if (r->prio == 'H')
+        {
+            if (high_i < 0 || r->depth > roots[high_i].depth)
+                high_i = i;
+        }
+        else if (r->prio == 'L')
+        {
+            if (low_i < 0 || r->depth > roots[low_i].depth)
+                low_i = i;
+        }
+        else if (low_i < 0 || r->depth > roots[low_i].depth)
+        {
+            high_i = low_i;
+            low_i = i;
+        }
+        else if (high_i < 0 || r->depth > roots[high_i].depth)
+            high_i = i;
+    }
+    total = main_depth + (low_i >= 0 ? roots[low_i].depth : 0) +
+            (high_i >= 0 ? roots[high_i].depth : 0);
+
+    printf("Stack depth in bytes, worst path:\n");
+    for (i = 0; i < nroot; i++)
+    {
+        const root_t *r = &roots[i];
+
+        printf("  %-7s %04XH %-4s %4d  ", r->name, r->vector,
+               !i ? "" : r->prio == 'H' ? "high" : r->prio == 'L' ? "low" : "?", r->depth);
+        print_path(&g, r->root);
+    }
+    printf("\nInterrupt priority: IP %s 0x%02X%s\n", ip_given ? "given as" : "written with", ip,
+           ip_traced ? "" : " and in ways the analysis cannot follow; assuming the deepest two nest");
+    printf("Worst case: main %d", main_depth);
+    if (low_i >= 0)
+        printf(" + %s %d", roots[low_i].name, roots[low_i].depth);
+    if (high_i >= 0)
+        printf(" + %s %d", roots[high_i].name, roots[high_i].depth);
+    printf(" = %d bytes\n", total);
+
+    if (flags & ~F_CASE)
+    {
+        printf("\nProblems:\n");
+        print_problems(&g);
+    }
+
+    printf("\nIRAM (%u bytes):\n", iram);
+    if (map_path)
+        data_end = print_iram(&map, iram, &stack_base);
+    else
+        printf("  no map: data segments unknown\n");
+
+    // Without MOV SP,#imm the stack starts above the reset value SP = 07H
+    start = g.sp_init >= 0 ? g.sp_init + 1 : stack_base >= 0 ? stack_base : 8;
+    if ((int)data_end > start)
+        printf("  data segments end at %02XH, above the stack start %02XH\n", data_end, start);
+    overlap = (int)data_end > start;
+    avail = (int)iram - start;
+    headroom = avail - total;
+    printf("  stack from %02XH: %d bytes, worst case %d, headroom %d bytes%s\n", start, avail,
+           total, headroom, flags & (F_INDIRECT | F_INLINE | F_BAD) ? " (depth is a lower bound)" : "");
+
+    if (map_path)
+        symmap_free(&map);
+    if (flags & (F_RECURSIVE | F_UNBOUNDED))
+    {
+        printf("FAIL: stack depth is unbounded\n");
+        return 1;
+    }
+    if (overlap)
+    {
+        printf("FAIL: the stack overwrites data\n");
+        return 1;
+    }
+    if (headroom < (int)reserve)
+    {
+        printf("FAIL: headroom %d below the %u bytes reserve\n", headroom, reserve);
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,346 @@
+/************************************************************
+ * symmap.c - linker map symbols
+ *
+ * Keil BL51 symbol lines look like
+ *
+ *   D:0010H         PUBLIC        fuel
+ *   B:0020H.1       PUBLIC        btn_event
+ *   C:0800H         PUBLIC        main
+ *
+ * SDCC (sdld -m) lists globals per area:
+ *
+ *   Area  ...  DSEG   00000008  00000016 = ...
+ *        00000010  _fuel     Main
+ *
+ * and BSEG symbols are already bit addresses.
+ *
+ * Code segments come from the Keil memory map
+ *
+ *   CODE    0800H     0193H     UNIT         ?PR?MAIN?MAIN
+ *   CODE    0993H     0041H     UNIT         ?CO?MAIN
+ *   CODE    0003H     0003H     ABSOLUTE
+ *
+ * or from the SDCC code area headers (CSEG, CONST, HOME,
+ * GSINIT, ...). SDCC function sizes are the gap to the next
+ * code symbol. DATA, IDATA, REG and BIT lines of the Keil
+ * memory map and the SDCC data areas (DSEG, OSEG, SSEG, ...)
+ * are kept as data segments for the IRAM budget.
+ ************************************************************/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "symmap.h"
+
+void symmap_add(symmap_t *m, const char *name, char space, uint16_t addr, int global)
+{
+    sym_t *s;
+
+    if (m->n == m->cap)
+    {
+        int cap = m->cap ? m->cap * 2 : 64;
+        sym_t *p = realloc(m->sym, cap * sizeof(*p));
+
+        if (!p)
+            return;
+        m->sym = p;
+        m->cap = cap;
+    }
+    s = &m->sym[m->n++];
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->space = space;
+    s->global = (uint8_t)(global != 0);
+    s->addr = addr;
+}
+
+static void add_segment(symmap_t *m, const char *name, const char *module, char space,
+                        char kind, unsigned base, unsigned length)
+{
+    symseg_t *g;
+
+    if (m->nseg == m->segcap)
+    {
+        int cap = m->segcap ? m->segcap * 2 : 32;
+        symseg_t *p = realloc(m->seg, cap * sizeof(*p));
+
+        if (!p)
+            return;
+        m->seg = p;
+        m->segcap = cap;
+    }
+    g = &m->seg[m->nseg++];
+    snprintf(g->name, sizeof(g->name), "%.*s", SYM_NAME_MAX - 1, name);
+    snprintf(g->module, sizeof(g->module), "%.*s", SYM_NAME_MAX - 1, module);
+    g->space = space;
+    g->kind = kind;
+    g->base = (uint16_t)base;
+    g->length = (uint16_t)length;
+}
+
+// Keil data memory map, bit segments as "BIT 0020H.0 0000H.3 UNIT ?BI?MAIN"
+static int keil_data_segment(symmap_t *m, const char *line)
+{
+    char type[16], reloc[16], seg[64];
+    unsigned base, length, b0 = 0, b1 = 0;
+    char space, kind;
+
+    if (sscanf(line, "%15s", type) != 1)
+        return 0;
+    if (!strcmp(type, "BIT"))
+    {
+        if (sscanf(line, "%15s %xH.%u %xH.%u %15s %63s", type, &base, &b0, &length, &b1, reloc,
+                   seg) != 7)
+            return 0;
+        base = (base - 0x20) * 8 + b0;
+        length = length * 8 + b1;
+        space = SYM_BIT;
+    }
+    else if (!strcmp(type, "DATA") || !strcmp(type, "IDATA") || !strcmp(type, "REG"))
+    {
+        if (sscanf(line, "%15s %xH %xH %15s %63s", type, &base, &length, reloc, seg) != 5)
+            return 0;
+        space = type[0] == 'I' ? SYM_IDATA : SYM_DATA;
+    }
+    else
+        return 0;
+
+    if (!strcmp(type, "REG"))
+        kind = SEG_REG;
+    else if (!strcmp(seg, "_DATA_GROUP_") || !strcmp(seg, "_BIT_GROUP_"))
+        kind = SEG_OVERLAY;
+    else if (!strcmp(seg, "?STACK"))
+        kind = SEG_STACK;
+    else
+        kind = SEG_VAR;
+    add_segment(m, kind == SEG_REG ? "register bank" : seg, "", space, kind, base, length);
+    return 1;
+}
+
+// Keil memory map "CODE 0800H 0193H UNIT ?PR?MAIN?MAIN"; returns 1 on a match
+static int keil_segment(symmap_t *m, const char *line)
+{
+    char type[16], reloc[16], seg[64], *name, *module;
+    unsigned base, length;
+    int n = sscanf(line, "%15s %xH %xH %15s %63s", type, &base, &length, reloc, seg);
+
+    if (n < 4 || strcmp(type, "CODE"))
+        return keil_data_segment(m, line);
+    if (n == 4)
+    {
+        if (strcmp(reloc, "ABSOLUTE"))
+            return 0;
+        snprintf(seg, sizeof(seg), "vector %04XH", base);
+        add_segment(m, seg, "", SYM_CODE, SEG_ABS, base, length);
+        return 1;
+    }
+
+    // ?PR?FUNC?MODULE and ?CO?MODULE
+    name = seg + 4;
+    module = strchr(name, '?');
+    if (!strncmp(seg, "?PR?", 4) && module)
+    {
+        *module++ = '\0';
+        add_segment(m, name, module, SYM_CODE, SEG_FUNC, base, length);
+    }
+    else if (!strncmp(seg, "?CO?", 4))
+        add_segment(m, seg, name, SYM_CODE, SEG_CONST, base, length);
+    else if (!strcmp(seg, "?C?LIB_CODE"))
+        add_segment(m, seg, "", SYM_CODE, SEG_LIB, base, length);
+    else if (!strncmp(seg, "?C_", 3))
+        add_segment(m, seg, "", SYM_CODE, SEG_START, base, length);
+    else
+        add_segment(m, seg, "", SYM_CODE, SEG_OTHER, base, length);
+    return 1;
+}
+
+// Kind of an SDCC area
+static char sdcc_seg_kind(const char *area)
+{
+    if (!strcmp(area, "CSEG"))
+        return SEG_AREA;
+    if (!strcmp(area, "CONST"))
+        return SEG_CONST;
+    if (!strcmp(area, "CABS"))
+        return SEG_ABS;
+    if (!strcmp(area, "HOME") || !strncmp(area, "GS", 2) || !strcmp(area, "XINIT"))
+        return SEG_START;
+    if (!strncmp(area, "REG_BANK_", 9))
+        return SEG_REG;
+    if (!strcmp(area, "OSEG"))
+        return SEG_OVERLAY;
+    if (!strcmp(area, "SSEG"))
+        return SEG_STACK;
+    if (!strcmp(area, "DSEG") || !strcmp(area, "ISEG") || !strcmp(area, "BSEG"))
+        return SEG_VAR;
+    return SEG_OTHER;
+}
+
+// Keil "D:0010H" / "B:0020H.1"; returns 1 on a match
+static int keil_line(symmap_t *m, const char *line)
+{
+    char space, kind[16], name[64];
+    unsigned addr, bit = 0;
+    const char *p = line;
+
+    while (*p == ' ' || *p == '\t')
+        p++;
+    if (!strchr("DIXBC", p[0]) || p[1] != ':')
+        return 0;
+    space = p[0];
+    if (sscanf(p + 2, "%xH", &addr) != 1)
+        return 0;
+    p += 2;
+    while (isxdigit((unsigned char)*p))
+        p++;
+    if (*p++ != 'H')
+        return 0;
+    if (*p == '.')
+    {
+        bit = (unsigned)atoi(p + 1);
+        p += 2;
+    }
+    if (sscanf(p, "%15s %63s", kind, name) != 2)
+        return 0;
+    if (strcmp(kind, "PUBLIC") && strcmp(kind, "SYMBOL"))
+        return 0;
+
+    // Bit symbols are given as byte.bit; convert to a bit address
+    if (space == SYM_BIT)
+        addr = addr < 0x80 ? (addr - 0x20) * 8 + bit : addr + bit;
+    symmap_add(m, name, space, (uint16_t)addr, !strcmp(kind, "PUBLIC"));
+    return 1;
+}
+
+static char sdcc_space(const char *area)
+{
+    if (!strcmp(area, "DSEG") || !strcmp(area, "OSEG") || !strncmp(area, "REG_BANK_", 9))
+        return SYM_DATA;
+    if (!strcmp(area, "ISEG") || !strcmp(area, "SSEG"))
+        return SYM_IDATA;
+    if (!strcmp(area, "XSEG") || !strcmp(area, "PSEG") || !strcmp(area, "XISEG"))
+        return SYM_XDATA;
+    if (!strcmp(area, "BSEG") || !strcmp(area, "BIT_BANK"))
+        return SYM_BIT;
+    return SYM_CODE;
+}
+
+int symmap_load(symmap_t *m, const char *path, char *err, int errlen)
+{
+    FILE *f = fopen(path, "r");
+    char line[256], area[32] = "";
+    int keil = 0, sdcc = 0;
+
+    memset(m, 0, sizeof(*m));
+    if (!f)
+    {
+        snprintf(err, errlen, "cannot open %s", path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f))
+    {
+        char a[64], b[64];
+        unsigned addr;
+
+        if (strstr(line, "BL51 BANKED LINKER") || strstr(line, "LX51 LINKER"))
+            keil = 1;
+        if (keil || !sdcc)
+        {
+            if (keil_line(m, line) || keil_segment(m, line))
+            {
+                keil = 1;
+                continue;
+            }
+        }
+        if (keil)
+            continue;
+
+        // SDCC: area header "NAME  addr  size = ..." then "addr  _name  module"
+        if (sscanf(line, "%63s %x %63s", a, &addr, b) == 3 && strchr(line, '=') &&
+            strstr(line, "bytes"))
+        {
+            unsigned size = (unsigned)strtoul(b, NULL, 16);
+
+            snprintf(area, sizeof(area), "%.31s", a);
+            if (sdcc_space(area) != SYM_XDATA && size)
+                add_segment(m, area, "", sdcc_space(area), sdcc_seg_kind(area), addr, size);
+            sdcc = 1;
+        }
+        else if (area[0] && sscanf(line, "%x %63s", &addr, a) == 2 && a[0] == '_')
+        {
+            symmap_add(m, a + 1, sdcc_space(area), (uint16_t)addr, 1);
+        }
+    }
+    fclose(f);
+
+    m->big_endian = !sdcc;
+    if (m->n == 0)
+    {
+        snprintf(err, errlen, "%s: no symbols found (not a Keil or SDCC map?)", path);
+        return -1;
+    }
+    return 0;
+}
+
+const sym_t *symmap_find(const symmap_t *m, const char *name)
+{
+    int pass, i;
+
+    for (pass = 0; pass < 4; pass++)
+    {
+        for (i = 0; i < m->n; i++)
+        {
+            const sym_t *s = &m->sym[i];
+
+            if (s->global != !(pass & 1))
+                continue;
+            if (pass < 2 ? !strcmp(s->name, name) : !strcasecmp(s->name, name))
+                return s;
+        }
+    }
+    return NULL;
+}
+
+const sym_t *symmap_func(const symmap_t *m, const char *name)
+{
+    char reg[SYM_NAME_MAX + 1];
+    const sym_t *s = symmap_find(m, name);
+
+    if (s && s->space == SYM_CODE)
+        return s;
+    snprintf(reg, sizeof(reg), "_%s", name);
+    s = symmap_find(m, reg);
+    return s && s->space == SYM_CODE ? s : NULL;
+}
+
+int symmap_code_size(const symmap_t *m, const char *name)
+{
+    const sym_t *s = symmap_func(m, name);
+    unsigned next = 0x10000;
+    int i;
+
+    for (i = 0; i < m->nseg; i++)
+    {
+        const char *g = m->seg[i].name;
+
+        if (m->seg[i].kind != SEG_FUNC)
+            continue;
+        if (!strcasecmp(g, name) || (g[0] == '_' && !strcasecmp(g + 1, name)))
+            return m->seg[i].length;
+    }
+    if (!s)
+        return -1;
+    for (i = 0; i < m->n; i++)
+        if (m->sym[i].space == SYM_CODE && m->sym[i].addr > s->addr && m->sym[i].addr < next)
+            next = m->sym[i].addr;
+    return next == 0x10000 ? -1 : (int)(next - s->addr);
+}
+
+void symmap_free(symmap_t *m)
+{
+    free(m->sym);
+    free(m->seg);
+    memset(m, 0, sizeof(*m));
+}
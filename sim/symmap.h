@@ -0,0 +1,85 @@
+/************************************************************
+ * symmap.h - linker map symbols
+ *
+ * Reads the symbol table of a Keil BL51 map (Listings/
+ * Main.m51) or an SDCC .map so host tools can refer to
+ * firmware variables by name. Addresses are tagged with the
+ * memory space they live in.
+ ************************************************************/
+
+#ifndef SYMMAP_H
+#define SYMMAP_H
+
+#include <stdint.h>
+
+#define SYM_NAME_MAX  40
+
+// Memory spaces
+#define SYM_DATA    'D'     // Direct: IRAM 0x00-0x7F, SFRs 0x80-0xFF
+#define SYM_IDATA   'I'     // Indirect IRAM
+#define SYM_XDATA   'X'
+#define SYM_BIT     'B'     // Bit address 0x00-0xFF
+#define SYM_CODE    'C'
+
+typedef struct
+{
+    char name[SYM_NAME_MAX];
+    char space;
+    uint8_t global;         // PUBLIC, as opposed to a function-local SYMBOL
+    uint16_t addr;
+} sym_t;
+
+// Segment kinds, code
+#define SEG_FUNC    'F'     // One function: Keil ?PR?FUNC?MODULE
+#define SEG_CONST   'K'     // Constants and strings: Keil ?CO?MODULE, SDCC CONST
+#define SEG_LIB     'L'     // Keil run-time library (?C?LIB_CODE)
+#define SEG_START   'S'     // Startup code and initialisers
+#define SEG_ABS     'A'     // Absolute code (interrupt vectors)
+#define SEG_AREA    'R'     // SDCC code area, split up by its symbols
+#define SEG_OTHER   'O'
+
+// Segment kinds, data
+#define SEG_REG     'G'     // Register bank
+#define SEG_VAR     'V'     // Globals and statics: Keil ?DT? ?ID? ?BI?, SDCC DSEG ISEG BSEG
+#define SEG_OVERLAY 'Y'     // Overlaid locals: Keil _DATA_GROUP_ _BIT_GROUP_, SDCC OSEG
+#define SEG_STACK   'T'     // Keil ?STACK, SDCC SSEG
+
+// Memory segment; bit segments count base and length in bits
+typedef struct
+{
+    char name[SYM_NAME_MAX];        // Function for SEG_FUNC, else segment/area name
+    char module[SYM_NAME_MAX];      // Keil module, if any
+    char space;                     // SYM_CODE, SYM_DATA, SYM_IDATA or SYM_BIT
+    char kind;
+    uint16_t base, length;
+} symseg_t;
+
+typedef struct
+{
+    sym_t *sym;
+    int n, cap;
+    symseg_t *seg;
+    int nseg, segcap;
+    int big_endian;         // Keil C51 stores int/long MSB first, SDCC LSB first
+} symmap_t;
+
+// Loads path; returns 0 or -1 with a message in err
+int symmap_load(symmap_t *m, const char *path, char *err, int errlen);
+
+// Adds one symbol
+void symmap_add(symmap_t *m, const char *name, char space, uint16_t addr, int global);
+
+// Globals before locals, exact match before case-insensitive; NULL if absent
+const sym_t *symmap_find(const symmap_t *m, const char *name);
+
+// Code symbol of a C function: NAME, or _NAME for Keil/SDCC functions
+// with register parameters
+const sym_t *symmap_func(const symmap_t *m, const char *name);
+
+// Code bytes of a function: its segment length when the map has one,
+// otherwise the distance to the next code symbol; -1 if unknown
+int symmap_code_size(const symmap_t *m, const char *name);
+
+void symmap_free(symmap_t *m);
+
+#endif
@@ -0,0 +1,173 @@
+/************************************************************
+ * tframe.c - decoder for the telemetry stream of telem.c
+ *
+ * A candidate frame is collected from a sync byte until its
+ * header says how long it is. The CRC is checked over the
+ * whole candidate at the end; when it fails, or the header
+ * cannot occur, the bytes after the sync byte are fed back
+ * through the decoder so a real frame inside is not lost.
+ ************************************************************/
+
+#include <string.h>
+
+#include "tframe.h"
+
+static const char *const names[TELEM_FIELDS] =
+{
+    "speed", "count", "fuel", "temp", "adc", "status"
+};
+
+const char *tframe_field_name(int field)
+{
+    return field >= 0 && field < TELEM_FIELDS ? names[field] : "?";
+}
+
+int tframe_field(const char *name)
+{
+    int i;
+
+    for (i = 0; i < TELEM_FIELDS; i++)
+        if (!strcmp(name, names[i]))
+            return i;
+    return -1;
+}
+
+void tframe_init(tframe_t *d, tframe_row_fn on_row, void *ctx)
+{
+    memset(d, 0, sizeof(*d));
+    d->on_row = on_row;
+    d->ctx = ctx;
+}
+
+// CRC-8, poly 0x07, init 0, as telem_put()
+static uint8_t crc8(const uint8_t *p, int n)
+{
+    uint8_t c = 0;
+    int i, k;
+
+    for (i = 0; i < n; i++)
+    {
+        c ^= p[i];
+        for (k = 0; k < 8; k++)
+            c = (uint8_t)(c & 0x80 ? c << 1 ^ 0x07 : c << 1);
+    }
+    return c;
+}
+
+// Frame length from the header; 0 for a header telem.c never sends
+static int frame_len(uint8_t hdr)
+{
+    int n = 4, i;
+
+    if (hdr & TELEM_KEY)
+        return hdr == (TELEM_KEY | TELEM_ALL) ? TELEM_FRAME_MAX : 0;
+    if (hdr & ~TELEM_ALL)
+        return 0;
+    for (i = 0; i < TELEM_FIELDS; i++)
+        n += hdr >> i & 1;
+    return n;
+}
+
+// Applies a frame with a good CRC
+static void frame(tframe_t *d, const uint8_t *f)
+{
+    uint8_t seq = f[1], hdr = f[2], step = (uint8_t)(seq - d->seq);
+    const uint8_t *p = f + 3;
+    int i;
+
+    d->frames++;
+    if (d->have_seq && step == 0)
+    {
+        d->dups++;
+        return;
+    }
+    if (!d->have_seq)
+        d->index = 0;
+    else if ((hdr & TELEM_KEY) && seq == 0 && step > TELEM_KEY_FRAMES)
+    {
+        d->restarts++;
+        d->index++;
+        step = 1;
+    }
+    else
+    {
+        d->lost += step - 1u;
+        d->index += step;
+    }
+    d->have_seq = 1;
+    d->seq = seq;
+
+    if (hdr & TELEM_KEY)
+    {
+        d->val[TF_SPEED] = p[0] << 8 | p[1];
+        d->val[TF_COUNT] = p[2] << 8 | p[3];
+        for (i = TF_FUEL; i < TELEM_FIELDS; i++)
+            d->val[i] = p[i + 2];
+        d->have_val = 1;
+    }
+    else if (!d->have_val || step != 1)
+    {
+        d->have_val = 0;
+        d->unsynced++;
+        return;
+    }
+    else
+    {
+        for (i = 0; i < TELEM_FIELDS; i++)
+        {
+            if (!(hdr >> i & 1))
+                continue;
+            if (i == TF_STATUS)
+                d->val[i] = *p++;
+            else if (i <= TF_COUNT)
+                d->val[i] = (d->val[i] + (int8_t)*p++) & 0xFFFF;
+            else
+                d->val[i] = (d->val[i] + (int8_t)*p++) & 0xFF;
+        }
+    }
+    d->rows++;
+    if (d->on_row)
+        d->on_row(d->ctx, d->index, d->val);
+}
+
+void tframe_feed(tframe_t *d, const uint8_t *p, size_t n)
+{
+    size_t i;
+
+    d->bytes += n;
+    for (i = 0; i < n; i++)
+    {
+        int want;
+
+        if (d->len == 0 && p[i] != TELEM_SYNC)
+        {
+            d->skipped++;
+            continue;
+        }
+        d->buf[d->len++] = p[i];
+        if (d->len < 3)
+            continue;
+        want = frame_len(d->buf[2]);
+        if (want && d->len < want)
+            continue;
+        if (want && crc8(d->buf + 1, want - 2) == d->buf[want - 1])
+        {
+            d->len = 0;
+            frame(d, d->buf);
+            continue;
+        }
+
+        // Not a frame: drop the sync byte and rescan the rest
+        {
+            uint8_t rest[TELEM_FRAME_MAX];
+            int k = d->len - 1;
+
+            memcpy(rest, d->buf + 1, k);
+            d->bad++;
+            d->skipped++;
+            d->len = 0;
+            d->bytes -= k;
+            tframe_feed(d, rest, k);
+        }
+    }
+}
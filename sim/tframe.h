@@ -0,0 +1,69 @@
+/************************************************************
+ * tframe.h - decoder for the telemetry stream of telem.c
+ *
+ * Takes the raw UART bytes in any chunking and hands out
+ * one row of field values per good frame. Bytes are matched
+ * against the frame layout in telem.h: a candidate starting
+ * at a sync byte is dropped when its header is impossible or
+ * its CRC-8 fails, and the search restarts at the next sync
+ * byte inside it, so a corrupted frame costs only itself.
+ *
+ * Delta frames build on the frame before, so after a lost
+ * frame (a jump in the sequence number) the fields are
+ * unknown until the next key frame; the delta frames in
+ * between are counted but produce no row. Rows are numbered
+ * on a frame index that counts the lost frames too, which
+ * keeps the time axis right across gaps. A key frame with
+ * sequence number 0 that skips more than TELEM_KEY_FRAMES
+ * frames is taken as a restart of the cluster rather than a
+ * gap: seq 0 is also a scheduled key frame, so a short loss
+ * before it is still counted as lost.
+ ************************************************************/
+
+#ifndef TFRAME_H
+#define TFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "telem.h"
+
+// Field order in a frame and in a row
+#define TF_SPEED    0
+#define TF_COUNT    1
+#define TF_FUEL     2
+#define TF_TEMP     3
+#define TF_ADC      4
+#define TF_STATUS   5
+
+typedef void (*tframe_row_fn)(void *ctx, uint64_t index, const int32_t *val);
+
+typedef struct
+{
+    uint8_t buf[TELEM_FRAME_MAX];   // Frame being assembled
+    int len;
+    int have_seq, have_val;
+    uint8_t seq;                    // Last good frame
+    int32_t val[TELEM_FIELDS];
+    uint64_t index;                 // Frame index of the last good frame
+
+    tframe_row_fn on_row;
+    void *ctx;
+
+    // Statistics
+    uint64_t bytes, frames, rows;
+    uint64_t bad;                   // Candidates rejected (header or CRC)
+    uint64_t skipped;               // Bytes outside any good frame
+    uint64_t lost;                  // Frames missing from the sequence
+    uint64_t unsynced;              // Delta frames dropped waiting for a key frame
+    uint64_t dups, restarts;
+} tframe_t;
+
+void tframe_init(tframe_t *d, tframe_row_fn on_row, void *ctx);
+void tframe_feed(tframe_t *d, const uint8_t *p, size_t n);
+
+// Column names for TF_* ("speed", "count", ...); -1 for an unknown name
+const char *tframe_field_name(int field);
+int tframe_field(const char *name);
+
+#endif
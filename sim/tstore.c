@@ -0,0 +1,439 @@
+/************************************************************
+ * tstore.c - columnar time-series file for telemetry rows
+ *
+ * See tstore.h for the layout. A block is encoded whole in
+ * memory and written with one fwrite at the end of the last
+ * whole block, so a crash leaves at most one torn block for
+ * the next open to cut off.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tstore.h"
+
+#define FILE_MAGIC      "S51T"
+#define BLOCK_MAGIC     "S51B"
+#define FILE_VERSION    1
+#define FILE_HEADER     12
+#define COL_HEADER      40
+#define BLOCK_HEADER    (56 + TSTORE_FIELDS * COL_HEADER)
+
+// Block header:
+//   0 "S51B"       4 length       8 rows        12 lost frames
+//  16 t0 (ms)     24 t1 (ms)     32 sum_t      40 sum_tt
+//  48 time column offset         52 time column length
+//  56 per field: min, max, first, last (i32), sum (i64), sum_tv (f64),
+//     column offset, column length (u32)
+
+/************************************************************
+ * Encoding
+ ************************************************************/
+
+static void put_le(uint8_t *p, uint64_t v, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *p, int n)
+{
+    uint64_t v = 0;
+    int i;
+
+    for (i = n - 1; i >= 0; i--)
+        v = v << 8 | p[i];
+    return v;
+}
+
+static void put_double(uint8_t *p, double d)
+{
+    uint64_t v;
+
+    memcpy(&v, &d, 8);
+    put_le(p, v, 8);
+}
+
+static double get_double(const uint8_t *p)
+{
+    uint64_t v = get_le(p, 8);
+    double d;
+
+    memcpy(&d, &v, 8);
+    return d;
+}
+
+static size_t put_varint(uint8_t *p, uint64_t v)
+{
+    size_t n = 0;
+
+    while (v >= 0x80)
+    {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+// Returns 0, or -1 when the varint runs past end
+static int get_varint(const uint8_t *p, size_t end, size_t *pos, uint64_t *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    while (*pos < end && shift < 64)
+    {
+        uint8_t b = p[(*pos)++];
+
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return 0;
+        shift += 7;
+    }
+    return -1;
+}
+
+// Differences of the given order, zigzag coded; a zero is followed by the
+// number of zeros after it. out needs n * 10 bytes.
+static size_t encode(const int64_t *v, int n, int order, uint8_t *out)
+{
+    int64_t prev = 0, step = 0;
+    size_t len = 0;
+    uint64_t run = 0;
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        int64_t d = v[i] - prev;
+        uint64_t z;
+
+        if (order == 2)
+        {
+            int64_t dd = d - step;
+
+            step = d;
+            d = dd;
+        }
+        prev = v[i];
+        z = (uint64_t)d << 1 ^ (uint64_t)(d >> 63);
+        if (z == 0)
+        {
+            if (run++ == 0)
+                out[len++] = 0;
+            continue;
+        }
+        if (run)
+            len += put_varint(out + len, run - 1);
+        run = 0;
+        len += put_varint(out + len, z);
+    }
+    if (run)
+        len += put_varint(out + len, run - 1);
+    return len;
+}
+
+static int decode(const uint8_t *p, size_t len, int n, int order, int64_t *out)
+{
+    int64_t prev = 0, step = 0;
+    size_t pos = 0;
+    uint64_t run = 0, z;
+    int i;
+
+    for (i = 0; i < n; i++)
+    {
+        int64_t d;
+
+        if (run)
+        {
+            run--;
+            z = 0;
+        }
+        else
+        {
+            if (get_varint(p, len, &pos, &z))
+                return -1;
+            if (z == 0 && get_varint(p, len, &pos, &run))
+                return -1;
+        }
+        d = (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+        if (order == 2)
+        {
+            step += d;
+            d = step;
+        }
+        prev += d;
+        out[i] = prev;
+    }
+    return run || pos != len ? -1 : 0;
+}
+
+/************************************************************
+ * Writing
+ ************************************************************/
+
+int tstore_open(tstore_t *s, const char *path, int64_t span, char *err, size_t errlen)
+{
+    uint8_t head[FILE_HEADER];
+    long size;
+
+    memset(s, 0, sizeof(*s));
+    s->span = span > 0 ? span : TSTORE_SPAN_MS;
+    s->write = 1;
+    if (!(s->f = fopen(path, "r+b")) && !(s->f = fopen(path, "w+b")))
+    {
+        snprintf(err, errlen, "cannot open %s", path);
+        return -1;
+    }
+    fseek(s->f, 0, SEEK_END);
+    size = ftell(s->f);
+    if (size == 0)
+    {
+        memcpy(head, FILE_MAGIC, 4);
+        put_le(head + 4, FILE_VERSION, 2);
+        put_le(head + 6, TSTORE_FIELDS, 2);
+        put_le(head + 8, TSTORE_BLOCK_ROWS, 4);
+        if (fwrite(head, 1, FILE_HEADER, s->f) != FILE_HEADER || fflush(s->f))
+        {
+            snprintf(err, errlen, "cannot write %s", path);
+            fclose(s->f);
+            return -1;
+        }
+        s->end = FILE_HEADER;
+        return 0;
+    }
+
+    // Find the end of the last whole block
+    fseek(s->f, 0, SEEK_SET);
+    if (fread(head, 1, FILE_HEADER, s->f) != FILE_HEADER || memcmp(head, FILE_MAGIC, 4) ||
+        get_le(head + 4, 2) != FILE_VERSION || get_le(head + 6, 2) != TSTORE_FIELDS)
+    {
+        snprintf(err, errlen, "%s is not a telemetry store", path);
+        fclose(s->f);
+        return -1;
+    }
+    s->end = FILE_HEADER;
+    for (;;)
+    {
+        uint8_t b[8];
+        uint32_t len;
+
+        if (fread(b, 1, 8, s->f) != 8 || memcmp(b, BLOCK_MAGIC, 4) ||
+            (len = (uint32_t)get_le(b + 4, 4)) < BLOCK_HEADER || s->end + (long)len > size)
+            break;
+        s->end += len;
+        fseek(s->f, s->end, SEEK_SET);
+    }
+    if (s->end < size)
+    {
+        fprintf(stderr, "tstore: %s: dropping %ld bytes after the last whole block\n", path,
+                size - s->end);
+        fflush(s->f);
+        if (ftruncate(fileno(s->f), s->end))
+        {
+            snprintf(err, errlen, "cannot truncate %s", path);
+            fclose(s->f);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void tstore_lost(tstore_t *s, uint32_t frames)
+{
+    s->lost += frames;
+}
+
+int tstore_add(tstore_t *s, const tstore_row_t *r)
+{
+    if (s->n > 0 && (s->n == TSTORE_BLOCK_ROWS || r->t / s->span != s->rows[0].t / s->span))
+        if (tstore_flush(s))
+            return -1;
+    s->rows[s->n++] = *r;
+    return 0;
+}
+
+int tstore_flush(tstore_t *s)
+{
+    static int64_t v[TSTORE_BLOCK_ROWS];
+    uint8_t *blk, *h, *data;
+    size_t len;
+    int n = s->n, i, c;
+    int64_t t0;
+    double sum_t = 0, sum_tt = 0;
+
+    if (n == 0)
+        return 0;
+    if (!(blk = malloc(BLOCK_HEADER + (size_t)(TSTORE_FIELDS + 1) * n * 10)))
+        return -1;
+    h = blk;
+    data = blk + BLOCK_HEADER;
+    t0 = s->rows[0].t;
+
+    for (i = 0; i < n; i++)
+    {
+        double t = (s->rows[i].t - t0) / 1000.0;
+
+        v[i] = s->rows[i].t;
+        sum_t += t;
+        sum_tt += t * t;
+    }
+    len = encode(v, n, 2, data);
+    put_le(h + 48, 0, 4);
+    put_le(h + 52, len, 4);
+
+    for (c = 0; c < TSTORE_FIELDS; c++)
+    {
+        uint8_t *ch = h + 56 + c * COL_HEADER;
+        int32_t lo = s->rows[0].v[c], hi = lo;
+        int64_t sum = 0;
+        double sum_tv = 0;
+        size_t clen;
+
+        for (i = 0; i < n; i++)
+        {
+            int32_t x = s->rows[i].v[c];
+
+            v[i] = x;
+            lo = x < lo ? x : lo;
+            hi = x > hi ? x : hi;
+            sum += x;
+            sum_tv += (s->rows[i].t - t0) / 1000.0 * x;
+        }
+        clen = encode(v, n, 1, data + len);
+        put_le(ch, (uint32_t)lo, 4);
+        put_le(ch + 4, (uint32_t)hi, 4);
+        put_le(ch + 8, (uint32_t)s->rows[0].v[c], 4);
+        put_le(ch + 12, (uint32_t)s->rows[n - 1].v[c], 4);
+        put_le(ch + 16, (uint64_t)sum, 8);
+        put_double(ch + 24, sum_tv);
+        put_le(ch + 32, len, 4);
+        put_le(ch + 36, clen, 4);
+        len += clen;
+    }
+
+    memcpy(h, BLOCK_MAGIC, 4);
+    put_le(h + 4, BLOCK_HEADER + len, 4);
+    put_le(h + 8, n, 4);
+    put_le(h + 12, s->lost, 4);
+    put_le(h + 16, (uint64_t)t0, 8);
+    put_le(h + 24, (uint64_t)s->rows[n - 1].t, 8);
+    put_double(h + 32, sum_t);
+    put_double(h + 40, sum_tt);
+
+    len += BLOCK_HEADER;
+    fseek(s->f, s->end, SEEK_SET);
+    if (fwrite(blk, 1, len, s->f) != len || fflush(s->f))
+    {
+        free(blk);
+        return -1;
+    }
+    free(blk);
+    s->end += (long)len;
+    s->blocks++;
+    s->bytes += len;
+    s->n = 0;
+    s->lost = 0;
+    return 0;
+}
+
+int tstore_close(tstore_t *s)
+{
+    int r = 0;
+
+    if (s->write)
+        r = tstore_flush(s);
+    if (fclose(s->f))
+        r = -1;
+    return r;
+}
+
+/************************************************************
+ * Reading
+ ************************************************************/
+
+int tstore_open_read(tstore_t *s, const char *path, char *err, size_t errlen)
+{
+    uint8_t head[FILE_HEADER];
+
+    memset(s, 0, sizeof(*s));
+    if (!(s->f = fopen(path, "rb")))
+    {
+        snprintf(err, errlen, "cannot open %s", path);
+        return -1;
+    }
+    if (fread(head, 1, FILE_HEADER, s->f) != FILE_HEADER || memcmp(head, FILE_MAGIC, 4) ||
+        get_le(head + 4, 2) != FILE_VERSION || get_le(head + 6, 2) != TSTORE_FIELDS)
+    {
+        snprintf(err, errlen, "%s is not a telemetry store", path);
+        fclose(s->f);
+        return -1;
+    }
+    s->end = FILE_HEADER;
+    return 0;
+}
+
+int tstore_next(tstore_t *s, tstore_block_t *b)
+{
+    uint8_t h[BLOCK_HEADER];
+    size_t got;
+    uint32_t len;
+    int c;
+
+    fseek(s->f, s->end, SEEK_SET);
+    got = fread(h, 1, BLOCK_HEADER, s->f);
+    if (got == 0)
+        return 0;
+    if (got != BLOCK_HEADER || memcmp(h, BLOCK_MAGIC, 4) ||
+        (len = (uint32_t)get_le(h + 4, 4)) < BLOCK_HEADER)
+        return -1;
+
+    b->rows = (uint32_t)get_le(h + 8, 4);
+    b->lost = (uint32_t)get_le(h + 12, 4);
+    b->t0 = (int64_t)get_le(h + 16, 8);
+    b->t1 = (int64_t)get_le(h + 24, 8);
+    b->sum_t = get_double(h + 32);
+    b->sum_tt = get_double(h + 40);
+    b->t_off = (uint32_t)get_le(h + 48, 4);
+    b->t_len = (uint32_t)get_le(h + 52, 4);
+    b->data = s->end + BLOCK_HEADER;
+    b->data_len = len - BLOCK_HEADER;
+    if (b->rows == 0 || b->rows > TSTORE_BLOCK_ROWS || b->t_off + b->t_len > b->data_len)
+        return -1;
+    for (c = 0; c < TSTORE_FIELDS; c++)
+    {
+        const uint8_t *ch = h + 56 + c * COL_HEADER;
+        tstore_col_t *col = &b->col[c];
+
+        col->min = (int32_t)get_le(ch, 4);
+        col->max = (int32_t)get_le(ch + 4, 4);
+        col->first = (int32_t)get_le(ch + 8, 4);
+        col->last = (int32_t)get_le(ch + 12, 4);
+        col->sum = (int64_t)get_le(ch + 16, 8);
+        col->sum_tv = get_double(ch + 24);
+        col->off = (uint32_t)get_le(ch + 32, 4);
+        col->len = (uint32_t)get_le(ch + 36, 4);
+        if (col->off + col->len > b->data_len)
+            return -1;
+    }
+    s->end += len;
+    return 1;
+}
+
+int tstore_column(tstore_t *s, const tstore_block_t *b, int field, int64_t *out)
+{
+    uint32_t off = field < 0 ? b->t_off : b->col[field].off;
+    uint32_t len = field < 0 ? b->t_len : b->col[field].len;
+    uint8_t *p;
+    int r;
+
+    if (!(p = malloc(len ? len : 1)))
+        return -1;
+    fseek(s->f, b->data + off, SEEK_SET);
+    r = fread(p, 1, len, s->f) == len ? decode(p, len, b->rows, field < 0 ? 2 : 1, out) : -1;
+    free(p);
+    return r;
+}
@@ -0,0 +1,98 @@
+/************************************************************
+ * tstore.h - columnar time-series file for telemetry rows
+ *
+ * One file per vehicle, appended to in blocks of up to
+ * TSTORE_BLOCK_ROWS rows. A block never crosses a multiple
+ * of its span (one hour by default) in row time, so hourly
+ * questions line up with whole blocks.
+ *
+ * Every column of a block is stored on its own: the time as
+ * a delta of deltas, the fields as deltas, each zigzag and
+ * varint coded with runs of zeros folded into a count. A
+ * steady column costs a few bytes per block.
+ *
+ * The block header carries the time range and, per field,
+ * min, max, first, last, sum and the sums needed for a least
+ * squares slope, plus where each column starts. A query reads
+ * headers only and decodes a column just for blocks that
+ * straddle the edge of the range it asks about.
+ *
+ * File:
+ *   "S51T", u16 version, u16 fields, u32 block rows
+ *   blocks, each "S51B", u32 length, header, column data
+ *
+ * Numbers are little-endian. A block cut short by a crash is
+ * dropped when the file is next opened for appending.
+ ************************************************************/
+
+#ifndef TSTORE_H
+#define TSTORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "tframe.h"
+
+#define TSTORE_FIELDS       TELEM_FIELDS
+#define TSTORE_BLOCK_ROWS   1024
+#define TSTORE_SPAN_MS      3600000     // Blocks do not cross an hour
+
+typedef struct
+{
+    int64_t t;                      // ms
+    int32_t v[TSTORE_FIELDS];
+} tstore_row_t;
+
+typedef struct
+{
+    int32_t min, max, first, last;
+    int64_t sum;
+    double sum_tv;                  // Sum of (t - t0) * v, t in s
+    uint32_t off, len;              // Column data, from the start of the data
+} tstore_col_t;
+
+typedef struct
+{
+    uint32_t rows;
+    uint32_t lost;                  // Frames missing between the rows
+    int64_t t0, t1;                 // First and last row, ms
+    double sum_t, sum_tt;           // Sums of (t - t0) and its square, t in s
+    uint32_t t_off, t_len;          // Time column
+    tstore_col_t col[TSTORE_FIELDS];
+
+    long data;                      // File offset of the column data
+    uint32_t data_len;
+} tstore_block_t;
+
+typedef struct
+{
+    FILE *f;
+    int write;
+    long end;                       // End of the last whole block
+    int64_t span;
+
+    // Block being filled
+    tstore_row_t rows[TSTORE_BLOCK_ROWS];
+    int n;
+    uint32_t lost;
+
+    uint64_t blocks, bytes;         // Written since open
+} tstore_t;
+
+// Opens a file for appending, creating it if needed; span 0 for TSTORE_SPAN_MS
+int tstore_open(tstore_t *s, const char *path, int64_t span, char *err, size_t errlen);
+
+// Adds a row; the block is written when full or when the row leaves its span
+int tstore_add(tstore_t *s, const tstore_row_t *r);
+void tstore_lost(tstore_t *s, uint32_t frames);
+int tstore_flush(tstore_t *s);
+int tstore_close(tstore_t *s);
+
+// Reading: opens for reading, then walks the block headers in order
+int tstore_open_read(tstore_t *s, const char *path, char *err, size_t errlen);
+int tstore_next(tstore_t *s, tstore_block_t *b);   // 1 block, 0 end, -1 damaged
+
+// Decodes one column of a block into rows values; field -1 is the time in ms
+int tstore_column(tstore_t *s, const tstore_block_t *b, int field, int64_t *out);
+
+#endif
@@ -0,0 +1,278 @@
+/************************************************************
+ * vcd.c - Value Change Dump of the board signals
+ *
+ * Timestamps are in nanoseconds from reset. Pin signals are
+ * sampled in the pins() callback, the TCON flags in tcon(),
+ * so only the signals of the port or register that changed
+ * are compared against the values last written.
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vcd.h"
+
+#define SRC_TCON    4       // Signal source: TCON flags instead of a port
+
+typedef struct
+{
+    unsigned group;
+    const char *scope, *name;
+    int src;                // Port 0-3 or SRC_TCON
+    int shift, width;
+} signal_t;
+
+// Wiring as in board.h; _n marks active-low lines
+static const signal_t signals[] =
+{
+    { VCD_LCD,   "lcd",   "rs",     2,        2, 1 },
+    { VCD_LCD,   "lcd",   "en",     2,        3, 1 },
+    { VCD_LCD,   "lcd",   "d",      2,        4, 4 },
+    { VCD_ADC,   "adc",   "db",     1,        0, 8 },
+    { VCD_ADC,   "adc",   "rd_n",   2,        1, 1 },
+    { VCD_ADC,   "adc",   "wr_n",   3,        6, 1 },
+    { VCD_ADC,   "adc",   "intr_n", 3,        7, 1 },
+    { VCD_IO,    "io",    "led",    3,        0, 1 },
+    { VCD_IO,    "io",    "int0_n", 3,        2, 1 },
+    { VCD_IO,    "io",    "t1",     3,        5, 1 },
+    { VCD_FLAGS, "tcon",  "tf0",    SRC_TCON, 5, 1 },
+    { VCD_FLAGS, "tcon",  "tf1",    SRC_TCON, 7, 1 },
+    { VCD_FLAGS, "tcon",  "ie0",    SRC_TCON, 1, 1 },
+    { VCD_FLAGS, "tcon",  "ie1",    SRC_TCON, 3, 1 },
+    { VCD_PORTS, "ports", "p0",     0,        0, 8 },
+    { VCD_PORTS, "ports", "p1",     1,        0, 8 },
+    { VCD_PORTS, "ports", "p2",     2,        0, 8 },
+    { VCD_PORTS, "ports", "p3",     3,        0, 8 },
+};
+
+#define NSIGNALS    ((int)(sizeof(signals) / sizeof(signals[0])))
+
+static const struct
+{
+    const char *name;
+    unsigned mask;
+} group_names[] =
+{
+    { "lcd", VCD_LCD }, { "adc", VCD_ADC }, { "io", VCD_IO }, { "flags", VCD_FLAGS },
+    { "ports", VCD_PORTS }, { "all", VCD_ALL },
+};
+
+unsigned vcd_groups(const char *list)
+{
+    unsigned mask = 0;
+    const char *p = list;
+
+    while (*p)
+    {
+        size_t n = strcspn(p, ",");
+        unsigned i, found = 0;
+
+        for (i = 0; i < sizeof(group_names) / sizeof(group_names[0]); i++)
+        {
+            if (strlen(group_names[i].name) == n && !strncmp(p, group_names[i].name, n))
+                found = group_names[i].mask;
+        }
+        if (!found)
+            return 0;
+        mask |= found;
+        p += n;
+        if (*p == ',')
+            p++;
+    }
+    return mask;
+}
+
+static uint32_t sample(const signal_t *s, mcs51_t *cpu)
+{
+    uint8_t src = s->src == SRC_TCON ? cpu->tcon_flags : mcs51_pins(cpu, s->src);
+
+    return (src >> s->shift) & ((1u << s->width) - 1);
+}
+
+static void put_time(vcd_t *v, mcs51_t *cpu, int force)
+{
+    uint64_t t = (uint64_t)(mcs51_seconds(cpu, cpu->cycles) * 1e9 + 0.5);
+
+    if (t != v->last_time || force)
+        fprintf(v->f, "#%llu\n", (unsigned long long)t);
+    v->last_time = t;
+}
+
+static void put_value(vcd_t *v, int i, uint32_t value)
+{
+    const signal_t *s = &signals[v->sig[i]];
+    int b;
+
+    if (s->width == 1)
+    {
+        fprintf(v->f, "%u%c\n", value, '!' + i);
+        return;
+    }
+    fputc('b', v->f);
+    for (b = s->width - 1; b >= 0; b--)
+        fputc('0' + ((value >> b) & 1), v->f);
+    fprintf(v->f, " %c\n", '!' + i);
+}
+
+static void changes(vcd_t *v, mcs51_t *cpu, int src)
+{
+    int i, stamped = 0;
+
+    if (!v->active)
+        return;
+    for (i = 0; i < v->nsig; i++)
+    {
+        uint32_t value;
+
+        if (signals[v->sig[i]].src != src)
+            continue;
+        value = sample(&signals[v->sig[i]], cpu);
+        if (value == v->value[i])
+            continue;
+        if (!stamped)
+            put_time(v, cpu, 0);
+        stamped = 1;
+        put_value(v, i, value);
+        v->value[i] = value;
+        v->changes++;
+    }
+}
+
+static void vcd_pins(sim_dev_t *dev, mcs51_t *cpu, int port, uint8_t old, uint8_t now)
+{
+    (void)old;
+    (void)now;
+    changes(dev->ctx, cpu, port);
+}
+
+static void vcd_tcon(sim_dev_t *dev, mcs51_t *cpu, uint8_t old, uint8_t now)
+{
+    (void)old;
+    (void)now;
+    changes(dev->ctx, cpu, SRC_TCON);
+}
+
+// Window start: every value once, then changes only
+static void start(vcd_t *v, mcs51_t *cpu)
+{
+    int i;
+
+    put_time(v, cpu, 1);
+    fprintf(v->f, "$dumpvars\n");
+    for (i = 0; i < v->nsig; i++)
+    {
+        v->value[i] = sample(&signals[v->sig[i]], cpu);
+        put_value(v, i, v->value[i]);
+    }
+    fprintf(v->f, "$end\n");
+    v->active = 1;
+}
+
+static void finish(vcd_t *v, mcs51_t *cpu)
+{
+    if (v->active)
+        put_time(v, cpu, 0);
+    v->active = 0;
+    v->done = 1;
+    fflush(v->f);
+}
+
+static void vcd_event(sim_dev_t *dev, mcs51_t *cpu)
+{
+    vcd_t *v = dev->ctx;
+
+    if (!v->active && !v->done)
+    {
+        start(v, cpu);
+        mcs51_schedule(cpu, dev, v->to);
+    }
+    else if (v->active)
+        finish(v, cpu);
+}
+
+int vcd_open(vcd_t *v, mcs51_t *cpu, const char *path, unsigned groups,
+             double from, double to, char *err, int errlen)
+{
+    const char *scope = NULL;
+    int i;
+
+    memset(v, 0, sizeof(*v));
+    v->groups = groups;
+    v->from = mcs51_cycles(cpu, from > 0 ? from : 0);
+    v->to = to > 0 ? mcs51_cycles(cpu, to) : MCS51_NEVER;
+    if (v->to <= v->from)
+    {
+        snprintf(err, errlen, "VCD window ends before it starts");
+        return -1;
+    }
+    v->f = fopen(path, "w");
+    if (!v->f)
+    {
+        snprintf(err, errlen, "cannot create %s", path);
+        return -1;
+    }
+    setvbuf(v->f, NULL, _IOFBF, 1 << 16);
+
+    for (i = 0; i < NSIGNALS && v->nsig < VCD_MAX_SIGNALS; i++)
+    {
+        if (signals[i].group & groups)
+            v->sig[v->nsig++] = i;
+    }
+
+    fprintf(v->f, "$version sim8051 $end\n");
+    fprintf(v->f, "$comment %u Hz crystal, one machine cycle is %.1f ns $end\n", cpu->fosc,
+            12e9 / cpu->fosc);
+    fprintf(v->f, "$timescale 1ns $end\n");
+    fprintf(v->f, "$scope module board $end\n");
+    for (i = 0; i < v->nsig; i++)
+    {
+        const signal_t *s = &signals[v->sig[i]];
+
+        if (!scope || strcmp(scope, s->scope))
+        {
+            if (scope)
+                fprintf(v->f, "$upscope $end\n");
+            fprintf(v->f, "$scope module %s $end\n", s->scope);
+            scope = s->scope;
+        }
+        if (s->width == 1)
+            fprintf(v->f, "$var wire 1 %c %s $end\n", '!' + i, s->name);
+        else
+            fprintf(v->f, "$var wire %d %c %s [%d:%d] $end\n", s->width, '!' + i, s->name,
+                    s->shift + s->width - 1, s->shift);
+    }
+    if (scope)
+        fprintf(v->f, "$upscope $end\n");
+    fprintf(v->f, "$upscope $end\n$enddefinitions $end\n");
+
+    v->dev.name = "vcd";
+    v->dev.ctx = v;
+    v->dev.pins = vcd_pins;
+    v->dev.tcon = vcd_tcon;
+    v->dev.event = vcd_event;
+    v->dev.next = MCS51_NEVER;
+    if (v->from <= cpu->cycles)
+    {
+        start(v, cpu);
+        v->dev.next = v->to;
+    }
+    else
+        v->dev.next = v->from;
+    mcs51_attach(cpu, &v->dev);
+    return 0;
+}
+
+int vcd_close(vcd_t *v, mcs51_t *cpu)
+{
+    int rc;
+
+    if (!v->f)
+        return 0;
+    if (v->active)
+        finish(v, cpu);
+    rc = ferror(v->f) ? -1 : 0;
+    if (fclose(v->f))
+        rc = -1;
+    v->f = NULL;
+    return rc;
+}
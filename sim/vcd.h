@@ -0,0 +1,66 @@
+/************************************************************
+ * vcd.h - Value Change Dump of the board signals
+ *
+ * Attaches to a CPU as a device and writes every change of
+ * the selected signals to a VCD file (IEEE 1364) that
+ * GTKWave can open. Changes are written as they happen, so
+ * the memory use does not grow with the length of the run.
+ *
+ * Signal groups (names for vcd_groups()):
+ *   lcd     RS, EN, D4-D7 on P2 (HD44780)
+ *   adc     DB0-DB7 on P1, RD on P2.1, WR, INTR on P3.6/P3.7
+ *   io      LED on P3.0, INT0 on P3.2, wheel pulses on T1 P3.5
+ *   flags   TF0, TF1, IE0, IE1 in TCON
+ *   ports   P0-P3 as 8-bit buses
+ *   all     every group
+ *
+ * Only the time window [from, to) is dumped: at 'from' the
+ * current values are written as $dumpvars, and at 'to' the
+ * file is finished and no further changes are recorded.
+ ************************************************************/
+
+#ifndef VCD_H
+#define VCD_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "mcs51.h"
+
+#define VCD_LCD     0x01
+#define VCD_ADC     0x02
+#define VCD_IO      0x04
+#define VCD_FLAGS   0x08
+#define VCD_PORTS   0x10
+#define VCD_ALL     0x1F
+#define VCD_DEFAULT (VCD_LCD | VCD_ADC | VCD_IO | VCD_FLAGS)
+
+#define VCD_MAX_SIGNALS  32
+
+typedef struct
+{
+    FILE *f;
+    sim_dev_t dev;
+    unsigned groups;
+    uint64_t from, to;          // Window in machine cycles; to = MCS51_NEVER for open end
+    int active;                 // Inside the window
+    int done;                   // Window closed
+    int nsig;
+    int sig[VCD_MAX_SIGNALS];   // Index into the signal table
+    uint32_t value[VCD_MAX_SIGNALS];    // Last value written
+    uint64_t last_time;         // Last timestamp written (ns)
+    uint64_t changes;           // Value changes written
+} vcd_t;
+
+// Parses a comma-separated group list ("lcd,adc"); returns 0 for an unknown name
+unsigned vcd_groups(const char *list);
+
+// Creates path and attaches to cpu; from/to in seconds, to <= 0 for no end.
+// Returns 0 or -1 with a message in err.
+int vcd_open(vcd_t *v, mcs51_t *cpu, const char *path, unsigned groups,
+             double from, double to, char *err, int errlen);
+
+// Writes the final timestamp and closes the file; returns -1 on a write error
+int vcd_close(vcd_t *v, mcs51_t *cpu);
+
+#endif
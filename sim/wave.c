@@ -0,0 +1,144 @@
+/************************************************************
+ * wave.c - streamed piecewise-linear time series
+ ************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "wave.h"
+
+// Reads the next raw (unscaled) point; returns 0, or -1 at end of data
+static int read_point(wave_t *w, double *t, double *v)
+{
+    char buf[256];
+
+    if (w->table)
+    {
+        if (w->tpos >= w->ntable)
+            return -1;
+        *t = w->table[w->tpos][0];
+        *v = w->table[w->tpos][1];
+        w->tpos++;
+        return 0;
+    }
+
+    while (w->f && fgets(buf, sizeof(buf), w->f))
+    {
+        char *s = buf, *end;
+
+        w->line++;
+        while (*s == ' ' || *s == '\t')
+            s++;
+        if (*s == '#' || *s == '\n' || *s == '\r' || *s == 0)
+            continue;
+        *t = strtod(s, &end);
+        if (end == s)
+        {
+            if (w->line == 1)
+            {
+                snprintf(w->header, sizeof(w->header), "%.*s", (int)strcspn(s, "\r\n"), s);
+            }
+            continue;
+        }
+        s = end;
+        while (*s == ' ' || *s == '\t' || *s == ',' || *s == ';')
+            s++;
+        *v = strtod(s, &end);
+        if (end == s)
+            continue;
+        return 0;
+    }
+    return -1;
+}
+
+// Next point on the simulated time axis, wrapping around when looping
+static int next_point(wave_t *w, double *t, double *v)
+{
+    if (read_point(w, t, v))
+    {
+        if (!w->loop || w->last_t <= w->offset)
+            return -1;
+        w->offset = w->last_t;
+        w->tpos = 0;
+        w->line = 0;
+        if (w->f)
+            rewind(w->f);
+        if (read_point(w, t, v))
+            return -1;
+    }
+    *t = *t / w->scale + w->offset;
+    w->last_t = *t;
+    return 0;
+}
+
+static void prime(wave_t *w)
+{
+    w->t1 = w->t0;
+    w->v1 = w->v0;
+    w->ended = next_point(w, &w->t1, &w->v1) != 0;
+}
+
+int wave_open(wave_t *w, const char *path, double scale, char *err, int errlen)
+{
+    memset(w, 0, sizeof(*w));
+    w->scale = scale > 0 ? scale : 1.0;
+    w->f = fopen(path, "r");
+    if (!w->f)
+    {
+        snprintf(err, errlen, "%s: cannot open", path);
+        return -1;
+    }
+    if (next_point(w, &w->t0, &w->v0))
+    {
+        snprintf(err, errlen, "%s: no data points", path);
+        fclose(w->f);
+        w->f = NULL;
+        return -1;
+    }
+    prime(w);
+    return 0;
+}
+
+void wave_table(wave_t *w, const double (*pts)[2], int n, double scale)
+{
+    memset(w, 0, sizeof(*w));
+    w->scale = scale > 0 ? scale : 1.0;
+    w->table = pts;
+    w->ntable = n;
+    if (next_point(w, &w->t0, &w->v0))
+    {
+        wave_const(w, 0.0);
+        return;
+    }
+    prime(w);
+}
+
+void wave_const(wave_t *w, double value)
+{
+    memset(w, 0, sizeof(*w));
+    w->scale = 1.0;
+    w->v0 = w->v1 = value;
+    w->ended = 1;
+}
+
+double wave_at(wave_t *w, double t)
+{
+    while (!w->ended && t >= w->t1)
+    {
+        w->t0 = w->t1;
+        w->v0 = w->v1;
+        w->ended = next_point(w, &w->t1, &w->v1) != 0;
+    }
+    if (t >= w->t1)
+        return w->v1;           // Past the last point
+    if (t <= w->t0 || w->t1 <= w->t0)
+        return w->v0;
+    return w->v0 + (w->v1 - w->v0) * (t - w->t0) / (w->t1 - w->t0);
+}
+
+void wave_close(wave_t *w)
+{
+    if (w->f)
+        fclose(w->f);
+    w->f = NULL;
+}
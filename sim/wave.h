@@ -0,0 +1,54 @@
+/************************************************************
+ * wave.h - streamed piecewise-linear time series
+ *
+ * Reads "seconds,value" CSV lines on demand, so traces of
+ * any length replay in constant memory. Blank lines and
+ * lines starting with '#' are skipped; a first line that is
+ * not numeric is kept as the column header (e.g.
+ * "seconds,celsius"). Values are interpolated linearly
+ * between points and held after the last one.
+ *
+ * 'scale' compresses the trace in time: with scale = 60 one
+ * simulated second replays one minute of the file. With
+ * 'loop' set the series restarts after its last point, so a
+ * short profile can drive an arbitrarily long run.
+ *
+ * Built-in profiles use the same cursor over a const table.
+ ************************************************************/
+
+#ifndef WAVE_H
+#define WAVE_H
+
+#include <stdio.h>
+
+typedef struct
+{
+    FILE *f;
+    const double (*table)[2];   // Built-in points instead of a file
+    int ntable, tpos;
+    char header[64];
+    double scale;
+    int loop;               // Restart after the last point
+    double offset;          // Time added to the current pass
+    double last_t;          // Time of the newest point read
+    double t0, v0;          // Point at or before the cursor
+    double t1, v1;          // Next point
+    int ended;              // No points after (t1, v1)
+    long line;
+} wave_t;
+
+// Opens path; returns 0 or -1 with a message in err
+int wave_open(wave_t *w, const char *path, double scale, char *err, int errlen);
+
+// Value at simulated time t (seconds); t must not decrease between calls
+double wave_at(wave_t *w, double t);
+
+// Opens a const table of (seconds, value) points
+void wave_table(wave_t *w, const double (*pts)[2], int n, double scale);
+
+// Constant waveform (no file)
+void wave_const(wave_t *w, double value);
+
+void wave_close(wave_t *w);
+
+#endif
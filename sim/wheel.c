@@ -0,0 +1,151 @@
+/************************************************************
+ * wheel.c - wheel-speed pulse generator on T1 (P3.5)
+ ************************************************************/
+
+#include <string.h>
+
+#include "wheel.h"
+
+#define P3_T1        0x20
+#define STOP_POLL_S  0.010      // Profile re-check interval while stopped
+#define PULSE_LOW_S  0.0001     // Sensor low time, capped at half the period
+
+// ECE-15 style urban cycle (195 s)
+static const double urban[][2] =
+{
+    {   0,  0 }, {  11,  0 }, {  15, 15 }, {  23, 15 }, {  25, 10 }, {  28,  0 },
+    {  49,  0 }, {  61, 32 }, {  85, 32 }, {  93, 10 }, {  96,  0 }, { 117,  0 },
+    { 143, 50 }, { 155, 50 }, { 163, 35 }, { 176, 35 }, { 178, 32 }, { 185, 10 },
+    { 188,  0 }, { 195,  0 }
+};
+
+// EUDC style extra-urban / highway cycle (400 s)
+static const double highway[][2] =
+{
+    {   0,   0 }, {  20,   0 }, {  41,  70 }, {  91,  70 }, {  99,  50 }, { 168,  50 },
+    { 181,  70 }, { 231,  70 }, { 266, 100 }, { 296, 100 }, { 316, 120 }, { 326, 120 },
+    { 360,   0 }, { 400,   0 }
+};
+
+// Congested traffic: short creeps between stops (90 s)
+static const double stopgo[][2] =
+{
+    {  0,  0 }, {  5,  0 }, { 10, 12 }, { 14, 12 }, { 18,  0 }, { 30,  0 },
+    { 36, 15 }, { 40,  8 }, { 44,  0 }, { 60,  0 }, { 64, 10 }, { 70, 10 },
+    { 74,  0 }, { 90,  0 }
+};
+
+const double (*wheel_profile(const char *name, int *n))[2]
+{
+    if (!strcmp(name, "urban"))
+    {
+        *n = (int)(sizeof(urban) / sizeof(urban[0]));
+        return urban;
+    }
+    if (!strcmp(name, "highway"))
+    {
+        *n = (int)(sizeof(highway) / sizeof(highway[0]));
+        return highway;
+    }
+    if (!strcmp(name, "stopgo"))
+    {
+        *n = (int)(sizeof(stopgo) / sizeof(stopgo[0]));
+        return stopgo;
+    }
+    return NULL;
+}
+
+// Uniform random in [0, 1)
+static double rnd(wheel_t *w)
+{
+    w->rng ^= w->rng << 13;
+    w->rng ^= w->rng >> 7;
+    w->rng ^= w->rng << 17;
+    return (double)(w->rng >> 11) / 9007199254740992.0;
+}
+
+static void wheel_event(sim_dev_t *dev, mcs51_t *cpu)
+{
+    wheel_t *w = dev->ctx;
+    double now = mcs51_seconds(cpu, cpu->cycles);
+    double step = w->circumference / w->pulses_per_rev;
+    double kmh, mps, dt;
+    uint64_t pulse_end = 0;
+
+    if (w->low)
+    {
+        // End of the current pulse; resume the pending evaluation
+        mcs51_drive(cpu, 3, P3_T1, P3_T1);
+        w->low = 0;
+        if (cpu->cycles < w->low_until)
+        {
+            mcs51_schedule(cpu, dev, w->low_until);
+            return;
+        }
+    }
+
+    // Trapezoidal distance since the last evaluation
+    kmh = wave_at(w->profile, now);
+    dt = now - w->last_t;
+    w->phase += (w->kmh + kmh) / 2.0 / 3.6 * dt;
+    w->last_t = now;
+    w->kmh = kmh;
+    mps = kmh / 3.6;
+
+    if (w->phase >= step)
+    {
+        w->phase -= step;
+        if (w->phase > step)
+            w->phase = step;    // Never owe more than one pulse
+        w->distance += step;
+
+        if (w->dropout > 0 && rnd(w) < w->dropout)
+        {
+            w->dropped++;
+        }
+        else
+        {
+            double period = mps > 0 ? step / mps : STOP_POLL_S;
+            double low = period / 2 < PULSE_LOW_S ? period / 2 : PULSE_LOW_S;
+
+            mcs51_drive(cpu, 3, P3_T1, 0);
+            w->low = 1;
+            w->pulses++;
+            pulse_end = cpu->cycles + mcs51_cycles(cpu, low);
+        }
+    }
+
+    // Next evaluation: when the next pulse is due at the current speed, at most STOP_POLL_S away
+    dt = STOP_POLL_S;
+    if (mps > 0 && (step - w->phase) / mps < dt)
+    {
+        dt = (step - w->phase) / mps;
+        if (w->jitter > 0)
+            dt *= 1.0 + w->jitter * (2.0 * rnd(w) - 1.0);
+    }
+    if (pulse_end)
+    {
+        // Release the pin first, evaluate again afterwards
+        w->low_until = cpu->cycles + mcs51_cycles(cpu, dt);
+        if (w->low_until <= pulse_end)
+            w->low_until = pulse_end + 1;
+        mcs51_schedule(cpu, dev, pulse_end);
+        return;
+    }
+    mcs51_schedule(cpu, dev, cpu->cycles + (dt > 0 ? mcs51_cycles(cpu, dt) : 1));
+}
+
+void wheel_init(wheel_t *w, mcs51_t *cpu, wave_t *profile, uint64_t seed)
+{
+    memset(w, 0, sizeof(*w));
+    w->profile = profile;
+    w->circumference = 1.884;
+    w->pulses_per_rev = 20;
+    w->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+
+    w->dev.name = "wheel";
+    w->dev.ctx = w;
+    w->dev.event = wheel_event;
+    w->dev.next = cpu->cycles;
+    mcs51_attach(cpu, &w->dev);
+}
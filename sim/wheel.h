@@ -0,0 +1,53 @@
+/************************************************************
+ * wheel.h - wheel-speed pulse generator on T1 (P3.5)
+ *
+ * Turns a speed-versus-time drive cycle (km/h) into the
+ * pulse train of the wheel sensor: one pulse per
+ * circumference / pulses_per_rev metres travelled, i.e.
+ * 20 pulses per 1.884 m revolution as in Main.c.
+ *
+ * Pulses are generated lazily: distance is integrated from
+ * the profile between evaluations, each scheduled when the
+ * next pulse is due at the current speed (at most 10 ms
+ * ahead), so memory use is constant whatever the cycle
+ * length and speed changes are tracked closely. Optional
+ * uniform jitter (fraction of the period) and random
+ * dropouts (pulse missing, distance still travelled) model
+ * a worn sensor.
+ ************************************************************/
+
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stdint.h>
+
+#include "mcs51.h"
+#include "wave.h"
+
+typedef struct
+{
+    sim_dev_t dev;
+    wave_t *profile;        // km/h over time
+
+    double circumference;   // Metres per revolution
+    int pulses_per_rev;
+    double jitter;          // Max period deviation, fraction (0..0.5)
+    double dropout;         // Probability a pulse is missing
+    uint64_t rng;           // xorshift state (seed)
+
+    int low;                // Pin currently held low
+    uint64_t low_until;     // While low: cycle of the next evaluation
+    double phase;           // Metres travelled towards the next pulse
+    double last_t;          // Time of the last evaluation (s)
+
+    uint64_t pulses, dropped;
+    double distance;        // Metres
+    double kmh;             // Speed at the last pulse
+} wheel_t;
+
+// Built-in drive cycles: "urban", "highway", "stopgo"; NULL if unknown
+const double (*wheel_profile(const char *name, int *n))[2];
+
+void wheel_init(wheel_t *w, mcs51_t *cpu, wave_t *profile, uint64_t seed);
+
+#endif
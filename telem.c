@@ -0,0 +1,149 @@
+/************************************************************
+ * telem.c - binary telemetry frames on the UART
+ *
+ * See telem.h for the frame format. Frames are built in the
+ * main loop, where speed and count cannot change under the
+ * encoder, and go straight into the HAL transmit ring with
+ * the CRC computed on the way.
+ ************************************************************/
+
+#include "hal.h"
+#include "cluster.h"
+#include "telem.h"
+
+#if TELEM
+
+unsigned char telem_seq;            // Sequence number of the next frame
+unsigned char telem_mark;           // Tick of the last frame
+unsigned char telem_key_left;       // Delta frames before the next key frame
+unsigned char telem_crc;            // CRC of the frame being queued
+
+// Values in the last frame sent
+unsigned int telem_speed, telem_count;
+unsigned char telem_fuel, telem_temp, telem_adc, telem_status;
+
+// CRC-8, poly 0x07: what a high nibble feeds back into the register
+HAL_CODE unsigned char telem_crc_nibble[16] =
+{
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+    0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
+// A 16-bit difference fits in a signed byte
+#define FITS(d)  ((d) <= 0x7F || (d) >= 0xFF80)
+
+/************************************************************
+ * Function: telem_init
+ * --------------------
+ * Sets up the UART and makes the next frame a key frame.
+ ************************************************************/
+
+void telem_init()
+{
+    hal_uart_init();
+    telem_seq = 0;
+    telem_key_left = 0;
+    telem_mark = hal_tick;
+}
+
+/************************************************************
+ * Function: telem_put
+ * -------------------
+ * Queues one frame byte and folds it into the CRC, a nibble
+ * at a time from a 16-byte table.
+ ************************************************************/
+
+void telem_put(unsigned char b)
+{
+    unsigned char c = telem_crc ^ b;
+
+    c = (c << 4) ^ telem_crc_nibble[c >> 4];
+    telem_crc = (c << 4) ^ telem_crc_nibble[c >> 4];
+    hal_uart_put(b);
+}
+
+/************************************************************
+ * Function: telem_poll
+ * --------------------
+ * Called from the idle loops. Once TELEM_TICKS have passed
+ * since the last frame, queues a key frame or a delta frame
+ * against the last one sent. When the ring has no room for
+ * it the frame is skipped.
+ ************************************************************/
+
+void telem_poll()
+{
+    unsigned int sp, cn, ds, dc;
+    unsigned char status, hdr, n;
+
+    if ((unsigned char)(hal_tick - telem_mark) < TELEM_TICKS)
+    {
+        return;
+    }
+    telem_mark = hal_tick;
+
+    sp = speed;
+    cn = count;
+    ds = (sp - telem_speed) & 0xFFFF;
+    dc = (cn - telem_count) & 0xFFFF;
+    status = (system ? 0x80 : 0x00) | pwr_state;
+
+    if (telem_key_left == 0 || !FITS(ds) || !FITS(dc))
+    {
+        hdr = TELEM_KEY | TELEM_ALL;
+        n = TELEM_FRAME_MAX;
+    }
+    else
+    {
+        hdr = 0;
+        n = 4;
+        if (ds)                     { hdr |= 0x01; n++; }
+        if (dc)                     { hdr |= 0x02; n++; }
+        if (fuel != telem_fuel)     { hdr |= 0x04; n++; }
+        if (temp != telem_temp)     { hdr |= 0x08; n++; }
+        if (adc_val != telem_adc)   { hdr |= 0x10; n++; }
+        if (status != telem_status) { hdr |= 0x20; n++; }
+    }
+    if (hal_uart_room() < n)
+    {
+        return;     // Skipped; the next frame is taken against the last one sent
+    }
+
+    hal_uart_put(TELEM_SYNC);
+    telem_crc = 0;
+    telem_put(telem_seq);
+    telem_put(hdr);
+    if (hdr & TELEM_KEY)
+    {
+        telem_put(sp >> 8);
+        telem_put(sp);
+        telem_put(cn >> 8);
+        telem_put(cn);
+        telem_put(fuel);
+        telem_put(temp);
+        telem_put(adc_val);
+        telem_put(status);
+        telem_key_left = TELEM_KEY_FRAMES - 1;
+    }
+    else
+    {
+        if (hdr & 0x01) telem_put(ds);
+        if (hdr & 0x02) telem_put(dc);
+        if (hdr & 0x04) telem_put(fuel - telem_fuel);
+        if (hdr & 0x08) telem_put(temp - telem_temp);
+        if (hdr & 0x10) telem_put(adc_val - telem_adc);
+        if (hdr & 0x20) telem_put(status);
+        telem_key_left--;
+    }
+    hal_uart_put(telem_crc);
+
+    telem_seq++;
+    telem_speed = sp;
+    telem_count = cn;
+    telem_fuel = fuel;
+    telem_temp = temp;
+    telem_adc = adc_val;
+    telem_status = status;
+}
+
+#endif
@@ -0,0 +1,79 @@
+/************************************************************
+ * telem.h - binary telemetry frames on the UART
+ *
+ * Every TELEM_TICKS system ticks telem_poll() queues one
+ * frame with the cluster state on the HAL transmit ring,
+ * which the serial interrupt drains. The UART runs in mode 2
+ * (fosc/64, 187.5 kbaud at 12 MHz) so no timer is needed and
+ * Timer1 keeps counting wheel pulses. A receiver set to
+ * 187500 baud 8N1 reads the frames; TB8 = 1 acts as a second
+ * stop bit.
+ *
+ * Frame:
+ *   0x5A         sync
+ *   seq          +1 per frame sent
+ *   hdr          bit 7: key frame, bits 0-5: fields present
+ *   fields       in this order, those present only:
+ *                  0 speed   low 16 bits of speed (km/h)
+ *                  1 count   Timer1 pulse count
+ *                  2 fuel    %
+ *                  3 temp    deg C
+ *                  4 adc     adc_val
+ *                  5 status  system << 7 | pwr_state
+ *   crc          CRC-8 (poly 0x07, init 0) of seq .. last field
+ *
+ * A key frame carries every field as its value: speed and
+ * count as 16 bits, big-endian, the rest as one byte. A delta
+ * frame carries only the fields that changed since the last
+ * frame sent, as a signed byte difference that wraps like the
+ * field, except status which is sent as its new value. A key
+ * frame goes out every TELEM_KEY_FRAMES frames, first after
+ * telem_init(), and whenever a difference does not fit in a
+ * signed byte. A delta frame with no fields is a 4-byte
+ * heartbeat.
+ *
+ * A frame that does not fit in the ring is skipped rather
+ * than waited for; the next one is taken against the last
+ * frame actually sent, so a receiver never loses sync.
+ *
+ * Disabled by default; build with TELEM defined to 1 for the
+ * whole target (C51 Define), as for INSTR. The two cannot be
+ * used together since both need the UART. Costs
+ * HAL_UART_RING + 14 bytes and one bit of IRAM.
+ ************************************************************/
+
+#ifndef TELEM_H
+#define TELEM_H
+
+#ifndef TELEM
+#define TELEM 0
+#endif
+
+#ifndef TELEM_TICKS
+#define TELEM_TICKS       50    // Ticks between frames (0.5 s)
+#endif
+#define TELEM_KEY_FRAMES  16    // Frames between key frames
+
+#define TELEM_SYNC        0x5A
+#define TELEM_KEY         0x80  // hdr: key frame
+#define TELEM_FIELDS      6
+#define TELEM_ALL         0x3F  // hdr: every field present
+#define TELEM_FRAME_MAX   12    // Key frame: sync, seq, hdr, 8 field bytes, crc
+
+#if TELEM
+
+#if defined(INSTR) && INSTR
+#error "TELEM and INSTR both use the UART"
+#endif
+
+void telem_init();
+void telem_poll();
+
+#else
+
+#define telem_init()
+#define telem_poll()
+
+#endif
+
+#endif
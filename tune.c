@@ -0,0 +1,271 @@
+/************************************************************
+ * tune.c - runtime-tunable thresholds over the UART
+ *
+ * See tune.h for the commands. The serial interrupt only
+ * fills the line buffer; the table is read and written from
+ * the main loop alone, so the cluster logic never sees a
+ * half-written parameter.
+ ************************************************************/
+
+#include "hal.h"
+#include "cluster.h"
+#include "tune.h"
+
+#if TUNE
+
+tune_t tune;                        // Parameter table
+
+// Line buffer, filled by tune_rx()
+unsigned char tune_name;            // First character, 0 while the line is empty
+unsigned char tune_op;              // '?', '=', 'N' once a digit came, '!' when malformed
+unsigned int tune_val;              // Value of X=value
+volatile HAL_BIT tune_ready = 0;    // Line complete, waiting for tune_poll()
+HAL_BIT tune_skip = 0;              // Dropping a line that came too early
+
+HAL_CODE unsigned char tune_names[5] = { 'T', 'L', 'C', 'P', 'W' };
+HAL_CODE unsigned int tune_min[5] = { 0, 0, 0, 1, 100 };
+HAL_CODE unsigned int tune_max[5] = { 255, 100, 100, 255, 9999 };
+HAL_CODE char tune_hex[16] = "0123456789ABCDEF";
+
+#define TUNE_SEED  0xA5     // So a table of zeros does not check out
+
+/************************************************************
+ * Function: tune_sum
+ * ------------------
+ * Checksum of the parameters: a byte sum from TUNE_SEED.
+ ************************************************************/
+
+unsigned char tune_sum()
+{
+    return TUNE_SEED + tune.temp_alarm + tune.fuel_low + tune.fuel_cutoff + tune.pulses_rev +
+           (unsigned char)(tune.wheel_mm >> 8) + (unsigned char)tune.wheel_mm;
+}
+
+void tune_defaults()
+{
+    tune.temp_alarm = TUNE_TEMP_ALARM;
+    tune.fuel_low = TUNE_FUEL_LOW;
+    tune.fuel_cutoff = TUNE_FUEL_CUTOFF;
+    tune.pulses_rev = TUNE_PULSES_REV;
+    tune.wheel_mm = TUNE_WHEEL_MM;
+    tune.sum = tune_sum();
+}
+
+unsigned int tune_get(unsigned char id)
+{
+    switch (id)
+    {
+        case 0:  return tune.temp_alarm;
+        case 1:  return tune.fuel_low;
+        case 2:  return tune.fuel_cutoff;
+        case 3:  return tune.pulses_rev;
+        default: return tune.wheel_mm;
+    }
+}
+
+void tune_set(unsigned char id, unsigned int v)
+{
+    switch (id)
+    {
+        case 0:  tune.temp_alarm = v;  break;
+        case 1:  tune.fuel_low = v;    break;
+        case 2:  tune.fuel_cutoff = v; break;
+        case 3:  tune.pulses_rev = v;  break;
+        default: tune.wheel_mm = v;    break;
+    }
+    tune.sum = tune_sum();
+}
+
+#if TUNE_EEPROM
+/************************************************************
+ * Function: tune_load
+ * -------------------
+ * Takes the table from the EEPROM when its checksum and
+ * every value check out.
+ ************************************************************/
+
+void tune_load()
+{
+    tune_t saved;
+    unsigned char id;
+
+    if (hal_eeprom_read(0, (unsigned char *)&saved, sizeof(saved)))
+    {
+        return;
+    }
+    tune = saved;
+    if (tune_sum() == saved.sum)
+    {
+        for (id = 0; id < 5; id++)
+        {
+            if (tune_get(id) < tune_min[id] || tune_get(id) > tune_max[id])
+            {
+                break;
+            }
+        }
+        if (id == 5)
+        {
+            return;
+        }
+    }
+    tune_defaults();
+}
+#endif
+
+/************************************************************
+ * Function: tune_init
+ * -------------------
+ * Sets up the UART for commands and loads the table: the
+ * defaults, then the saved copy if there is a good one.
+ ************************************************************/
+
+void tune_init()
+{
+    hal_uart_init();
+    tune_defaults();
+#if TUNE_EEPROM
+    tune_load();
+#endif
+}
+
+/************************************************************
+ * Function: tune_rx
+ * -----------------
+ * Called from the serial interrupt with each received byte.
+ * Builds up the line and hands it to tune_poll() at CR or
+ * LF; keeps no more than the name, the operator and the
+ * value, so a line of any length fits.
+ ************************************************************/
+
+void tune_rx(unsigned char c)
+{
+    if (c == '\r' || c == '\n')
+    {
+        if (tune_skip)
+        {
+            tune_skip = 0;
+        }
+        else if (tune_name && !tune_ready)
+        {
+            tune_ready = 1;
+        }
+        return;
+    }
+    if (tune_ready || tune_skip)
+    {
+        tune_skip = 1;      // Last line not carried out yet
+    }
+    else if (!tune_name)
+    {
+        tune_name = c;
+    }
+    else if (!tune_op && (c == '?' || c == '='))
+    {
+        tune_op = c;
+    }
+    else if ((tune_op == '=' || tune_op == 'N') && c >= '0' && c <= '9' && tune_val < 1000)
+    {
+        tune_val = tune_val * 10 + (c - '0');
+        tune_op = 'N';
+    }
+    else
+    {
+        tune_op = '!';
+    }
+}
+
+/************************************************************
+ * Function: tune_reply
+ * --------------------
+ * Queues "X=value" CR LF, or just X when there is no value.
+ ************************************************************/
+
+void tune_reply(unsigned char name, unsigned int v, HAL_BIT with_value)
+{
+    unsigned char d[4], n = 0;
+
+    hal_uart_put(name);
+    if (with_value)
+    {
+        hal_uart_put('=');
+        do
+        {
+            d[n++] = v % 10;
+            v /= 10;
+        } while (v);
+        while (n)
+        {
+            hal_uart_put('0' + d[--n]);
+        }
+    }
+    hal_uart_put('\r');
+    hal_uart_put('\n');
+}
+
+/************************************************************
+ * Function: tune_poll
+ * -------------------
+ * Called from the idle loops. Puts the defaults back when
+ * the table fails its checksum, then carries out a complete
+ * command line once the transmit ring has room for the
+ * longest reply; until then the line waits.
+ ************************************************************/
+
+void tune_poll()
+{
+    unsigned char id, name, op;
+
+    if (tune.sum != tune_sum())
+    {
+        tune_defaults();
+    }
+    if (!tune_ready || hal_uart_room() < TUNE_REPLY_MAX)
+    {
+        return;
+    }
+    name = tune_name;   // Only now: tune_rx() leaves the line alone once it is ready
+    op = tune_op;
+
+    for (id = 0; id < 5 && tune_names[id] != name; id++)
+        ;
+    if (id < 5 && op == '?')
+    {
+        tune_reply(name, tune_get(id), 1);
+    }
+    else if (id < 5 && op == 'N' && tune_val >= tune_min[id] && tune_val <= tune_max[id])
+    {
+        tune_set(id, tune_val);
+        tune_reply(name, tune_get(id), 1);
+    }
+    else if (name == '#' && op == '?')
+    {
+        hal_uart_put('#');
+        hal_uart_put('=');
+        hal_uart_put(tune_hex[tune.sum >> 4]);
+        hal_uart_put(tune_hex[tune.sum & 0x0F]);
+        hal_uart_put('\r');
+        hal_uart_put('\n');
+    }
+    else if (name == 'D' && !op)
+    {
+        tune_defaults();
+        tune_reply('D', 0, 0);
+    }
+#if TUNE_EEPROM
+    else if (name == 'S' && !op && !hal_eeprom_write(0, (unsigned char *)&tune, sizeof(tune)))
+    {
+        tune_reply('S', 0, 0);
+    }
+#endif
+    else
+    {
+        tune_reply('!', 0, 0);
+    }
+
+    tune_name = 0;
+    tune_op = 0;
+    tune_val = 0;
+    tune_ready = 0;     // Last, so tune_rx() leaves the line alone until here
+}
+
+#endif
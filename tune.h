@@ -0,0 +1,112 @@
+/************************************************************
+ * tune.h - runtime-tunable thresholds over the UART
+ *
+ * The overheat and fuel thresholds and the wheel geometry
+ * come from a parameter table in IRAM instead of constants,
+ * so a vehicle can be tuned in the field without reflashing.
+ * The table carries a checksum: tune_poll() checks it on
+ * every call and falls back to the defaults if anything
+ * (a stack overrun, say) has written over it.
+ *
+ * Commands arrive on RXD at the telemetry line settings
+ * (mode 2, 187500 baud 8N1) and end with CR or LF; RXD is
+ * P3.0, so TUNE builds move the LED to P2.0. The serial
+ * interrupt parses one byte per interrupt into a line
+ * buffer of four bytes; the main loop carries the line out
+ * in tune_poll() and queues the reply on the transmit ring,
+ * so neither side ever waits. Send the next command after
+ * the reply; a line that arrives before the last one was
+ * carried out is dropped.
+ *
+ *   X?         read parameter X        reply  X=value
+ *   X=value    set parameter X         reply  X=value
+ *   #?         table checksum          reply  #=hh (hex)
+ *   S          save to EEPROM          reply  S
+ *   D          back to the defaults    reply  D
+ *
+ * Anything else, a value out of range, or S without a
+ * working EEPROM, is answered with !. Replies end with CR LF
+ * and never contain the telemetry sync byte, so a collector
+ * on the same line skips them.
+ *
+ *   X  parameter                             range     default
+ *   T  overheat LED above, deg C             0-255     40
+ *   L  LowFuel shown at or below, %          0-100     20
+ *   C  fuel cut-off (LOWFUEL_LIMP) below, %  0-100     10
+ *   P  wheel pulses per revolution           1-255     20
+ *   W  wheel circumference, mm               100-9999  1884
+ *
+ * With TUNE_EEPROM the table is kept in a 24C02 on P0 (see
+ * hal_8051.h) and read back by tune_init(); a blank or
+ * damaged copy leaves the defaults in place.
+ *
+ * Disabled by default; build with TUNE defined to 1 for the
+ * whole target (C51 Define), as for TELEM, which it can be
+ * combined with. Without it the thresholds are the constants
+ * below and nothing is compiled in. Costs 7 bytes of IRAM for
+ * the table and 4 bytes and 2 bits for the parser.
+ ************************************************************/
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include "cluster.h"
+
+#ifndef TUNE
+#define TUNE 0
+#endif
+#ifndef TUNE_EEPROM
+#define TUNE_EEPROM 0
+#endif
+
+// Defaults
+#define TUNE_TEMP_ALARM   40    // deg C
+#define TUNE_FUEL_LOW     20    // %
+#define TUNE_FUEL_CUTOFF  10    // %
+#define TUNE_PULSES_REV   PULSES_PER_REVOLUTION
+#define TUNE_WHEEL_MM     ((unsigned int)(WHEEL_CIRCUMFERENCE * 1000 + 0.5))
+
+#define TUNE_REPLY_MAX    8     // Longest reply: W=9999 CR LF
+
+#if TUNE
+
+#if defined(INSTR) && INSTR
+#error "TUNE and INSTR both use the UART"
+#endif
+
+typedef struct
+{
+    unsigned char temp_alarm;
+    unsigned char fuel_low;
+    unsigned char fuel_cutoff;
+    unsigned char pulses_rev;
+    unsigned int wheel_mm;
+    unsigned char sum;          // tune_sum() of the fields above
+} tune_t;
+
+extern tune_t tune;
+
+#define TEMP_ALARM   tune.temp_alarm
+#define FUEL_LOW     tune.fuel_low
+#define FUEL_CUTOFF  tune.fuel_cutoff
+#define PULSES_REV   tune.pulses_rev
+#define WHEEL_MM     tune.wheel_mm
+
+void tune_init();
+void tune_rx(unsigned char c);  // Serial interrupt, one received byte
+void tune_poll();
+
+#else
+
+#define TEMP_ALARM   TUNE_TEMP_ALARM
+#define FUEL_LOW     TUNE_FUEL_LOW
+#define FUEL_CUTOFF  TUNE_FUEL_CUTOFF
+#define PULSES_REV   TUNE_PULSES_REV
+#define WHEEL_MM     TUNE_WHEEL_MM
+
+#define tune_init()
+#define tune_poll()
+
+#endif
+
+#endif